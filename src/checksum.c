@@ -0,0 +1,737 @@
+/* ---------------------------------------------------------------------
+ *
+ * checksum.c
+ *
+ * \checksum: compare a table's contents between two databases using
+ * per-chunk checksums computed by the server
+ *
+ * The table is divided into ranges of its (integer) primary key; for
+ * each range, both databases return the row count and the sum of the
+ * HASH() of each row's column values, so only these need to be
+ * transferred. Ranges whose checksums differ are divided further, and
+ * small enough ranges compared row by row, to locate the differing
+ * rows.
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "checksum.h"
+#include "common.h"
+#include "parallel.h"
+#include "query.h"
+#include "settings.h"
+
+/* RDB$FIELDS.RDB$FIELD_TYPE values */
+#define FIELD_TYPE_SMALLINT	7
+#define FIELD_TYPE_INTEGER	8
+#define FIELD_TYPE_BIGINT	16
+#define FIELD_TYPE_BLOB		261
+
+typedef struct checksumRange
+{
+	long long	lo;				/* inclusive key range */
+	long long	hi;
+	long		rows[2];		/* per database */
+	char	   *hash[2];
+	FBresult   *row_hashes[2];	/* row-level comparison */
+	char	   *error;
+} checksumRange;
+
+typedef struct checksumRun
+{
+	const char *dbpath[2];
+	int			ndatabases;
+	char	   *key_name;		/* primary key column */
+	char	   *key_ident;		/* quoted for use in queries */
+	char	   *table_ident;
+	char	   *chunk_query;
+	char	   *row_query;
+	bool		row_level;
+	checksumRange *ranges;
+	int			nranges;
+	FBconn	   *conns[PARALLEL_MAX_WORKERS][2];
+	pthread_mutex_t error_lock;
+} checksumRun;
+
+static bool _buildQueries(checksumRun *run, const char *table);
+static bool _getKeyRange(checksumRun *run, long long *lo, long long *hi, long *rows);
+static bool _checksumJob(FBconn *conn, int worker, int job, void *arg);
+static void _addRange(checksumRange **ranges, int *nranges, int *alloc_ranges, long long lo, long long hi);
+static void _splitRange(checksumRange **ranges, int *nranges, int *alloc_ranges,
+						long long lo, long long hi, long parts);
+static long _compareRows(const checksumRange *range, fbsqlTable *table);
+static void _freeRanges(checksumRange *ranges, int nranges);
+static void _freeRun(checksumRun *run);
+
+
+/**
+ * checksumTable()
+ *
+ * \checksum TABLE [DSN] [chunk N] [workers N]
+ *
+ * Compare the contents of "table" in the current database with the
+ * table of the same name in "other_dsn", reporting the rows which differ.
+ * Without "other_dsn", display the checksum of each chunk of the table.
+ *
+ * Returns false if the comparison could not be started, if any chunks
+ * or rows differ, or if any range could not be compared; differences
+ * and errors are reported.
+ */
+bool
+checksumTable(const char *table, const char *other_dsn, long chunk_rows, int nworkers)
+{
+	checksumRun run;
+	checksumRange *pending = NULL;
+	int			npending = 0, alloc_pending = 0;
+	checksumRange *row_level = NULL;
+	int			nrow_level = 0, alloc_row_level = 0;
+	query_time	before, after;
+	long long	lo, hi;
+	long		rows;
+	long		differing_rows = 0;
+	int			nchunks, differing_chunks = 0;
+	int			round, errors = 0;
+	int			i;
+
+	memset(&run, 0, sizeof(run));
+	run.dbpath[0] = fset.dbpath;
+	run.dbpath[1] = other_dsn;
+	run.ndatabases = other_dsn != NULL ? 2 : 1;
+	pthread_mutex_init(&run.error_lock, NULL);
+
+	gettimeofday(&before, NULL);
+
+	if (_buildQueries(&run, table) == false
+	 || _getKeyRange(&run, &lo, &hi, &rows) == false)
+	{
+		_freeRun(&run);
+		return false;
+	}
+
+	if (rows == 0)
+	{
+		puts("Table is empty");
+		nchunks = 0;
+	}
+	else
+	{
+		nchunks = (int)((rows + chunk_rows - 1) / chunk_rows);
+		_splitRange(&pending, &npending, &alloc_pending, lo, hi, nchunks);
+		nchunks = npending;
+	}
+
+	/* compare chunk checksums, dividing mismatching chunks until they are small enough */
+	for (round = 0; npending > 0; round++)
+	{
+		checksumRange *next = NULL;
+		int			nnext = 0, alloc_next = 0;
+
+		run.ranges = pending;
+		run.nranges = npending;
+		run.row_level = false;
+
+		runParallelTasks(nworkers, npending * run.ndatabases, _checksumJob, &run);
+
+		if (run.ndatabases == 1)
+		{
+			fbsqlTable	result;
+			const char *headers[] = {"from", "to", "rows", "checksum"};
+
+			initTable(&result, 4, headers);
+			result.right_align[0] = result.right_align[1] = result.right_align[2] = result.right_align[3] = true;
+
+			for (i = 0; i < npending; i++)
+			{
+				checksumRange *range = &pending[i];
+				char		from[32], to[32], count[32];
+				const char *values[4];
+
+				if (range->error != NULL)
+				{
+					errors++;
+					continue;
+				}
+
+				snprintf(from, sizeof(from), "%lld", range->lo);
+				snprintf(to, sizeof(to), "%lld", range->hi);
+				snprintf(count, sizeof(count), "%li", range->rows[0]);
+
+				values[0] = from;
+				values[1] = to;
+				values[2] = count;
+				values[3] = range->hash[0];
+
+				addTableRow(&result, values);
+			}
+
+			printTable(&result, &fset.popt);
+			printf("(%i rows)\n", result.ntuples);
+			termTable(&result);
+		}
+		else
+		{
+			for (i = 0; i < npending; i++)
+			{
+				checksumRange *range = &pending[i];
+				long		max_rows;
+
+				if (range->error != NULL)
+				{
+					errors++;
+					continue;
+				}
+
+				if (range->rows[0] == range->rows[1]
+				 && ((range->hash[0] == NULL && range->hash[1] == NULL)
+					 || (range->hash[0] != NULL && range->hash[1] != NULL
+						 && strcmp(range->hash[0], range->hash[1]) == 0)))
+					continue;
+
+				if (round == 0)
+					differing_chunks++;
+
+				max_rows = range->rows[0] > range->rows[1] ? range->rows[0] : range->rows[1];
+
+				if (max_rows <= CHECKSUM_ROW_LEVEL_ROWS || range->lo == range->hi)
+					_addRange(&row_level, &nrow_level, &alloc_row_level, range->lo, range->hi);
+				else
+					_splitRange(&next, &nnext, &alloc_next, range->lo, range->hi, CHECKSUM_SPLIT_FACTOR);
+			}
+		}
+
+		_freeRanges(pending, npending);
+
+		pending = next;
+		npending = nnext;
+		alloc_pending = alloc_next;
+	}
+
+	/* compare the rows of the remaining mismatching ranges */
+	if (nrow_level > 0)
+	{
+		fbsqlTable	result;
+		const char *headers[] = {run.key_name, "difference"};
+
+		run.ranges = row_level;
+		run.nranges = nrow_level;
+		run.row_level = true;
+
+		runParallelTasks(nworkers, nrow_level * run.ndatabases, _checksumJob, &run);
+
+		initTable(&result, 2, headers);
+		result.right_align[0] = true;
+
+		for (i = 0; i < nrow_level; i++)
+		{
+			if (row_level[i].error != NULL)
+			{
+				errors++;
+				continue;
+			}
+
+			differing_rows += _compareRows(&row_level[i], &result);
+		}
+
+		printTable(&result, &fset.popt);
+
+		if (differing_rows > result.ntuples)
+			printf("(%i of %li differing rows listed)\n", result.ntuples, differing_rows);
+		else
+			printf("(%i rows)\n", result.ntuples);
+
+		termTable(&result);
+	}
+
+	_freeRanges(row_level, nrow_level);
+
+	gettimeofday(&after, NULL);
+	INSTR_TIME_SUBTRACT(after, before);
+
+	if (run.ndatabases == 2)
+	{
+		printf("%li row(s) in %i chunk(s) compared; %i chunk(s) and %li row(s) differ",
+			   rows, nchunks, differing_chunks, differing_rows);
+
+		if (errors > 0)
+			printf("; %i range(s) could not be compared", errors);
+	}
+	else
+	{
+		printf("%li row(s) in %i chunk(s)", rows, nchunks);
+
+		if (errors > 0)
+			printf("; %i chunk(s) could not be checksummed", errors);
+	}
+
+	if (fset.timing)
+		printf(" (%.3f ms)", INSTR_TIME_GET_MILLISEC(after));
+
+	puts("");
+
+	_freeRun(&run);
+
+	return differing_chunks == 0 && differing_rows == 0 && errors == 0;
+}
+
+
+/**
+ * _buildQueries()
+ *
+ * Look up the table's primary key and columns, and build the queries
+ * returning the checksum of a key range and the hash of each row in
+ * a key range. Each column contributes '=' followed by its value, or
+ * 'N' if NULL, so NULLs and empty strings are distinguished.
+ *
+ * BLOB columns are not included in the checksum.
+ */
+static bool
+_buildQueries(checksumRun *run, const char *table)
+{
+	FBresult   *res;
+	FQExpBufferData row_expr;
+	FQExpBufferData query;
+	FQExpBufferData skipped;
+	char	   *table_name;
+	const char *params[1];
+	int			ncolumns = 0;
+	int			i;
+
+	params[0] = table;
+
+	res = FQexecParams(fset.conn,
+"    SELECT TRIM(rc.rdb$relation_name), TRIM(s.rdb$field_name), \n"
+"           f.rdb$field_type, f.rdb$field_scale, \n"
+"           (SELECT COUNT(*) FROM rdb$index_segments s2 \n"
+"             WHERE s2.rdb$index_name = rc.rdb$index_name) \n"
+"      FROM rdb$relation_constraints rc \n"
+"INNER JOIN rdb$index_segments s \n"
+"        ON s.rdb$index_name = rc.rdb$index_name \n"
+"INNER JOIN rdb$relation_fields rf \n"
+"        ON rf.rdb$relation_name = rc.rdb$relation_name \n"
+"       AND rf.rdb$field_name = s.rdb$field_name \n"
+"INNER JOIN rdb$fields f \n"
+"        ON f.rdb$field_name = rf.rdb$field_source \n"
+"     WHERE TRIM(LOWER(rc.rdb$relation_name)) = LOWER(?) \n"
+"       AND rc.rdb$constraint_type = 'PRIMARY KEY' \n"
+"       AND s.rdb$field_position = 0",
+						 1, NULL, params, NULL, NULL, 0);
+
+	if (FQresultStatus(res) != FBRES_TUPLES_OK || FQntuples(res) == 0)
+	{
+		if (FQresultStatus(res) == FBRES_TUPLES_OK)
+			fbsql_error("\\checksum: table \"%s\" not found or has no primary key\n", table);
+		else
+			fbsql_error("\\checksum: unable to read table metadata\n%s\n", FQresultErrorMessage(res));
+
+		FQclear(res);
+		return false;
+	}
+
+	if (atoi(FQgetvalue(res, 0, 4)) != 1
+	 || atoi(FQgetvalue(res, 0, 3)) != 0
+	 || (atoi(FQgetvalue(res, 0, 2)) != FIELD_TYPE_SMALLINT
+		 && atoi(FQgetvalue(res, 0, 2)) != FIELD_TYPE_INTEGER
+		 && atoi(FQgetvalue(res, 0, 2)) != FIELD_TYPE_BIGINT))
+	{
+		fbsql_error("\\checksum: the primary key of \"%s\" must be a single integer column\n", table);
+		FQclear(res);
+		return false;
+	}
+
+	table_name = strdup(FQgetvalue(res, 0, 0));
+	run->key_name = strdup(FQgetvalue(res, 0, 1));
+	FQclear(res);
+
+	initFQExpBuffer(&query);
+	appendSQLIdentifier(&query, table_name);
+	run->table_ident = query.data;
+
+	initFQExpBuffer(&query);
+	appendSQLIdentifier(&query, run->key_name);
+	run->key_ident = query.data;
+
+	params[0] = table_name;
+
+	res = FQexecParams(fset.conn,
+"    SELECT TRIM(rf.rdb$field_name), f.rdb$field_type \n"
+"      FROM rdb$relation_fields rf \n"
+"INNER JOIN rdb$fields f \n"
+"        ON f.rdb$field_name = rf.rdb$field_source \n"
+"     WHERE rf.rdb$relation_name = ? \n"
+"       AND f.rdb$computed_blr IS NULL \n"
+"  ORDER BY rf.rdb$field_position",
+					   1, NULL, params, NULL, NULL, 0);
+
+	if (FQresultStatus(res) != FBRES_TUPLES_OK)
+	{
+		fbsql_error("\\checksum: unable to read table columns\n%s\n", FQresultErrorMessage(res));
+		FQclear(res);
+		free(table_name);
+		return false;
+	}
+
+	initFQExpBuffer(&row_expr);
+	initFQExpBuffer(&skipped);
+
+	for (i = 0; i < FQntuples(res); i++)
+	{
+		const char *column = FQgetvalue(res, i, 0);
+
+		if (atoi(FQgetvalue(res, i, 1)) == FIELD_TYPE_BLOB)
+		{
+			appendFQExpBuffer(&skipped, "%s%s", skipped.len > 0 ? ", " : "", column);
+			continue;
+		}
+
+		if (ncolumns++ > 0)
+			appendFQExpBufferStr(&row_expr, " || '|' || ");
+
+		appendFQExpBufferStr(&row_expr, "COALESCE('=' || ");
+		appendSQLIdentifier(&row_expr, column);
+		appendFQExpBufferStr(&row_expr, ", 'N')");
+	}
+
+	FQclear(res);
+
+	if (skipped.len > 0)
+		printf("Note: BLOB columns are not compared: %s\n", skipped.data);
+
+	termFQExpBuffer(&skipped);
+
+	/* chunk checksum */
+	initFQExpBuffer(&query);
+	appendFQExpBuffer(&query,
+					  "SELECT COUNT(*), SUM(HASH(%s)) FROM %s WHERE %s BETWEEN ? AND ?",
+					  row_expr.data, run->table_ident, run->key_ident);
+	run->chunk_query = query.data;
+
+	/* row hashes */
+	initFQExpBuffer(&query);
+	appendFQExpBuffer(&query,
+					  "SELECT %s, HASH(%s) FROM %s WHERE %s BETWEEN ? AND ? ORDER BY %s",
+					  run->key_ident, row_expr.data, run->table_ident,
+					  run->key_ident, run->key_ident);
+	run->row_query = query.data;
+
+	termFQExpBuffer(&row_expr);
+	free(table_name);
+
+	return true;
+}
+
+
+/**
+ * _getKeyRange()
+ *
+ * Determine the range of key values and the (larger) row count across
+ * the databases.
+ */
+static bool
+_getKeyRange(checksumRun *run, long long *lo, long long *hi, long *rows)
+{
+	FQExpBufferData buf;
+	char	   *query;
+	int			i;
+	bool		found = false;
+
+	initFQExpBuffer(&buf);
+	appendFQExpBuffer(&buf, "SELECT MIN(%s), MAX(%s), COUNT(*) FROM %s",
+					  run->key_ident, run->key_ident, run->table_ident);
+	query = buf.data;
+
+	*rows = 0;
+
+	for (i = 0; i < run->ndatabases; i++)
+	{
+		FBconn	   *conn = i == 0 ? fset.conn : fbsql_connect(run->dbpath[i]);
+		FBresult   *res;
+
+		if (FQstatus(conn) == CONNECTION_BAD)
+		{
+			fbsql_error("\\checksum: unable to connect to \"%s\":\n%s\n",
+						run->dbpath[i], FQerrorMessage(conn));
+			FQfinish(conn);
+			free(query);
+			return false;
+		}
+
+		res = i == 0 ? FQexecTransaction(conn, query) : FQexec(conn, query);
+
+		if (FQresultStatus(res) != FBRES_TUPLES_OK)
+		{
+			fbsql_error("\\checksum: unable to read key range from \"%s\":\n%s\n",
+						run->dbpath[i], FQresultErrorMessage(res));
+			FQclear(res);
+
+			if (i > 0)
+				FQfinish(conn);
+
+			free(query);
+			return false;
+		}
+
+		if (FQgetisnull(res, 0, 0) == false)
+		{
+			long long min = strtoll(FQgetvalue(res, 0, 0), NULL, 10);
+			long long max = strtoll(FQgetvalue(res, 0, 1), NULL, 10);
+
+			if (found == false || min < *lo)
+				*lo = min;
+			if (found == false || max > *hi)
+				*hi = max;
+
+			found = true;
+		}
+
+		if (atol(FQgetvalue(res, 0, 2)) > *rows)
+			*rows = atol(FQgetvalue(res, 0, 2));
+
+		FQclear(res);
+
+		if (i > 0)
+			FQfinish(conn);
+	}
+
+	free(query);
+
+	return true;
+}
+
+
+/**
+ * _checksumJob()
+ *
+ * Worker function: compute the checksum (or row hashes) of one range in
+ * one database, using the worker's connection to that database.
+ */
+static bool
+_checksumJob(FBconn *conn, int worker, int job, void *arg)
+{
+	checksumRun *run = (checksumRun *)arg;
+	checksumRange *range = &run->ranges[job / run->ndatabases];
+	int			db = job % run->ndatabases;
+	char		lo[32], hi[32];
+	const char *params[2];
+	FBresult   *res;
+	bool		success = true;
+
+	conn = run->conns[worker][db];
+
+	if (conn == NULL)
+	{
+		conn = fbsql_connect(run->dbpath[db]);
+
+		if (FQstatus(conn) == CONNECTION_BAD)
+		{
+			pthread_mutex_lock(&run->error_lock);
+			if (range->error == NULL)
+				range->error = strdup(FQerrorMessage(conn));
+			pthread_mutex_unlock(&run->error_lock);
+
+			parallelOutputLock();
+			printf("unable to connect to \"%s\":\n%s\n", run->dbpath[db], FQerrorMessage(conn));
+			parallelOutputUnlock();
+
+			FQfinish(conn);
+			return false;
+		}
+
+		FQsetAutocommit(conn, true);
+		run->conns[worker][db] = conn;
+	}
+
+	snprintf(lo, sizeof(lo), "%lld", range->lo);
+	snprintf(hi, sizeof(hi), "%lld", range->hi);
+	params[0] = lo;
+	params[1] = hi;
+
+	res = FQexecParams(conn, run->row_level ? run->row_query : run->chunk_query,
+					   2, NULL, params, NULL, NULL, 0);
+
+	if (FQresultStatus(res) != FBRES_TUPLES_OK)
+	{
+		pthread_mutex_lock(&run->error_lock);
+		if (range->error == NULL)
+			range->error = strdup(res ? FQresultErrorMessage(res) : FQerrorMessage(conn));
+		pthread_mutex_unlock(&run->error_lock);
+
+		parallelOutputLock();
+		printf("error checksumming range %s to %s in \"%s\":\n%s\n",
+			   lo, hi, run->dbpath[db], res ? FQresultErrorMessage(res) : FQerrorMessage(conn));
+		parallelOutputUnlock();
+
+		if (res != NULL)
+			FQclear(res);
+
+		return false;
+	}
+
+	if (run->row_level)
+	{
+		range->row_hashes[db] = res;
+		return success;
+	}
+
+	range->rows[db] = atol(FQgetvalue(res, 0, 0));
+	range->hash[db] = FQgetisnull(res, 0, 1) ? NULL : strdup(FQgetvalue(res, 0, 1));
+
+	FQclear(res);
+
+	return success;
+}
+
+
+static void
+_addRange(checksumRange **ranges, int *nranges, int *alloc_ranges, long long lo, long long hi)
+{
+	if (*nranges == *alloc_ranges)
+	{
+		*alloc_ranges = *alloc_ranges == 0 ? 16 : *alloc_ranges * 2;
+		*ranges = (checksumRange *)realloc(*ranges, *alloc_ranges * sizeof(checksumRange));
+	}
+
+	memset(&(*ranges)[*nranges], 0, sizeof(checksumRange));
+	(*ranges)[*nranges].lo = lo;
+	(*ranges)[*nranges].hi = hi;
+	(*nranges)++;
+}
+
+
+/**
+ * _splitRange()
+ *
+ * Divide the key range lo..hi into up to "parts" ranges of equal width.
+ */
+static void
+_splitRange(checksumRange **ranges, int *nranges, int *alloc_ranges,
+			long long lo, long long hi, long parts)
+{
+	unsigned long long width = ((unsigned long long)hi - (unsigned long long)lo) / parts + 1;
+	unsigned long long start = (unsigned long long)lo;
+
+	for (;;)
+	{
+		unsigned long long end = start + width - 1;
+
+		/* end would pass hi (or wrap) */
+		if (end < start || end >= (unsigned long long)hi)
+		{
+			_addRange(ranges, nranges, alloc_ranges, (long long)start, hi);
+			break;
+		}
+
+		_addRange(ranges, nranges, alloc_ranges, (long long)start, (long long)end);
+		start = end + 1;
+	}
+}
+
+
+/**
+ * _compareRows()
+ *
+ * Compare the row hashes of a range (ordered by key) between the two
+ * databases, adding the differing keys to "table" (up to
+ * CHECKSUM_MAX_REPORTED_ROWS in total). Returns the number of differing
+ * rows.
+ */
+static long
+_compareRows(const checksumRange *range, fbsqlTable *table)
+{
+	const FBresult *a = range->row_hashes[0];
+	const FBresult *b = range->row_hashes[1];
+	int			i = 0, j = 0;
+	long		differing = 0;
+
+	while (i < FQntuples(a) || j < FQntuples(b))
+	{
+		const char *values[2];
+		long long	key_a = i < FQntuples(a) ? strtoll(FQgetvalue(a, i, 0), NULL, 10) : 0;
+		long long	key_b = j < FQntuples(b) ? strtoll(FQgetvalue(b, j, 0), NULL, 10) : 0;
+
+		if (j >= FQntuples(b) || (i < FQntuples(a) && key_a < key_b))
+		{
+			values[0] = FQgetvalue(a, i, 0);
+			values[1] = "missing in other database";
+			i++;
+		}
+		else if (i >= FQntuples(a) || key_b < key_a)
+		{
+			values[0] = FQgetvalue(b, j, 0);
+			values[1] = "missing in this database";
+			j++;
+		}
+		else
+		{
+			bool same = FQgetisnull(a, i, 1) == FQgetisnull(b, j, 1)
+				&& (FQgetisnull(a, i, 1) || strcmp(FQgetvalue(a, i, 1), FQgetvalue(b, j, 1)) == 0);
+
+			values[0] = FQgetvalue(a, i, 0);
+			values[1] = "values differ";
+			i++;
+			j++;
+
+			if (same)
+				continue;
+		}
+
+		differing++;
+
+		if (table->ntuples < CHECKSUM_MAX_REPORTED_ROWS)
+			addTableRow(table, values);
+	}
+
+	return differing;
+}
+
+
+static void
+_freeRanges(checksumRange *ranges, int nranges)
+{
+	int			i, db;
+
+	for (i = 0; i < nranges; i++)
+	{
+		for (db = 0; db < 2; db++)
+		{
+			free(ranges[i].hash[db]);
+
+			if (ranges[i].row_hashes[db] != NULL)
+				FQclear(ranges[i].row_hashes[db]);
+		}
+
+		free(ranges[i].error);
+	}
+
+	free(ranges);
+}
+
+
+static void
+_freeRun(checksumRun *run)
+{
+	int			w, db;
+
+	for (w = 0; w < PARALLEL_MAX_WORKERS; w++)
+	{
+		for (db = 0; db < 2; db++)
+		{
+			if (run->conns[w][db] != NULL)
+				FQfinish(run->conns[w][db]);
+		}
+	}
+
+	free(run->key_name);
+	free(run->key_ident);
+	free(run->table_ident);
+	free(run->chunk_query);
+	free(run->row_query);
+	pthread_mutex_destroy(&run->error_lock);
+}
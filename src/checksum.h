@@ -0,0 +1,21 @@
+#ifndef CHECKSUM_H
+#define CHECKSUM_H
+
+#include "settings.h"
+
+/* Target number of rows per chunk in the initial comparison */
+#define CHECKSUM_DEFAULT_CHUNK_ROWS 10000
+
+/* Number of sub-ranges a mismatching chunk is divided into */
+#define CHECKSUM_SPLIT_FACTOR 10
+
+/* Mismatching chunks with at most this many rows are compared row by row */
+#define CHECKSUM_ROW_LEVEL_ROWS 1000
+
+/* Maximum number of differing rows to list */
+#define CHECKSUM_MAX_REPORTED_ROWS 1000
+
+extern bool
+checksumTable(const char *table, const char *other_dsn, long chunk_rows, int nworkers);
+
+#endif   /* CHECKSUM_H */
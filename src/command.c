@@ -15,7 +15,11 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <ctype.h>
+#include <limits.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 
 #include "libfq.h"
@@ -24,9 +28,29 @@
 #include "settings.h"
 #include "query.h"
 #include "common.h"
+#include "checksum.h"
+#include "copytable.h"
+#include "events.h"
+#include "fanout.h"
+#include "parallel.h"
+#include "parallelblock.h"
+#include "planhistory.h"
+#include "querystats.h"
+#include "txmode.h"
+#include "recorder.h"
+#include "services.h"
+#include "util.h"
+#include "workload.h"
+
+typedef struct cacheStatsSample
+{
+	long		fetches;
+	long		reads;
+	long		writes;
+	long		marks;
+} cacheStatsSample;
 
 
-static FBresult* commandExec(const char *query);
 static void commandExecPrint(const char *query, const printQueryOpt *pqopt);
 
 static void showUsage(void);
@@ -38,21 +62,31 @@ static void describeTable(const char *name);
 static void describeView(const char *name);
 static void describeIndex(const char *name);
 
-static bool execUtil(char *command);
-static bool _execUtilSetIndexStatistics(void);
+static backslashResult execUtil(char *command, FbsqlScanState scan_state);
 
 static void listDatabaseInfo(void);
+static backslashResult showCacheStats(FbsqlScanState scan_state);
+static bool _sampleDatabaseIO(cacheStatsSample *sample, long *page_buffers, long *page_size, long *pages);
 static void listFunctions(char *pattern);
 static void listIndexes(char *pattern, bool show_system, bool show_extended);
 static void listProcedures(char *pattern);
 static void listSequences(char *pattern, bool show_system);
-static void listTables(char *pattern, bool show_system);
+static void listTables(char *pattern, bool show_system, bool show_extended, bool show_stats);
+static void _listTablesExtended(char *pattern, bool show_system, bool show_stats);
 static void listUsers(void);
 static void listViews(char *pattern);
 
 static char *_listIndexSegments(char *index_name);
 
 static void showActivity(void);
+static backslashResult showTxGap(FbsqlScanState scan_state);
+static bool _printTxGap(long threshold, bool watch);
+static void _printTxGapHolders(void);
+static backslashResult listenCommand(FbsqlScanState scan_state);
+static backslashResult fanoutCommand(FbsqlScanState scan_state);
+static backslashResult checksumCommand(FbsqlScanState scan_state);
+static backslashResult copyTableCommand(FbsqlScanState scan_state);
+static void showPlanCache(void);
 static void showCopyright(void);
 static void showUtilOptions(void);
 
@@ -60,16 +94,21 @@ static bool do_plan_display(const char *value);
 static char *render_plan_display(short plan_display);
 
 static bool do_explain_display(const char *value);
+
+static bool setVariable(const char *name, const char *value);
+static bool unsetVariable(const char *name);
+static bool setAutocommit(bool autocommit, int batch, int batch_ms);
+static bool setTransactionMode(const char *mode);
+static bool _parseBoolean(const char *value, bool *result);
 static char *render_explain_display(short explain_display);
 
-static void _wildcard_pattern_clause(char *pattern, char *field, FQExpBufferData *buf);
 static const char *_align2string(enum printFormat in);
 static const char *_border2string(enum borderFormat in);
 static char *_sqlFieldType(void);
 
 
 
-static FBresult*
+FBresult*
 commandExec(const char *query)
 {
 	if (fset.echo_hidden == true)
@@ -172,7 +211,7 @@ execSlashCommand(const char *cmd,
 	show_system = strchr(cmd, 'S') ? true : false;
 
 	/* \q - quit session */
-	if (strncmp(cmd, "q", 1) == 0)
+	if (strcmp(cmd, "q") == 0 || strcmp(cmd, "quit") == 0)
 	{
 		status = FBSQL_CMD_TERMINATE;
 	}
@@ -189,23 +228,130 @@ execSlashCommand(const char *cmd,
 		showActivity();
 	}
 
-	/* \autocommit */
+	/* \replay-stats - display recorded monitoring snapshots */
+	else if (strcmp(cmd, "replay-stats") == 0)
+	{
+		success = replayStats(scan_state);
+	}
+
+	/* \plancache - show compiled statement cache (Firebird 5.0 and later) */
+	else if (strcmp(cmd, "plancache") == 0)
+	{
+		showPlanCache();
+	}
+
+	/* \txgap - show transaction marker gaps */
+	else if (strcmp(cmd, "txgap") == 0)
+	{
+		status = showTxGap(scan_state);
+	}
+
+	/* \txmode - set transaction parameters */
+	else if (strcmp(cmd, "txmode") == 0)
+	{
+		char *opt = fbsql_scan_slash_option(scan_state,
+											OT_WHOLE_LINE, NULL, false);
+
+		if (!opt || opt[0] == '\0')
+			printf("Transaction mode: %s\n", fset.txmode != NULL ? fset.txmode : "default");
+		else
+			success = setTransactionMode(opt);
+
+		free(opt);
+	}
+
+	/* \listen - wait for database events */
+	else if (strcmp(cmd, "listen") == 0)
+	{
+		status = listenCommand(scan_state);
+	}
+
+	/* \analyze_workload - report natural scans in a script's statements */
+	else if (strncmp(cmd, "analyze_workload", 16) == 0)
+	{
+		char *opt0 = fbsql_scan_slash_option(scan_state,
+											 OT_NORMAL, NULL, false);
+		char *opt1 = fbsql_scan_slash_option(scan_state,
+											 OT_NORMAL, NULL, false);
+
+		if (!opt0)
+		{
+			fbsql_error("\\%s: missing required argument\n", cmd);
+			success = false;
+		}
+		else
+		{
+			long min_rows = WORKLOAD_LARGE_TABLE_ROWS;
+			char *end = NULL;
+
+			if (opt1)
+				min_rows = strtol(opt1, &end, 10);
+
+			if (opt1 && (*opt1 == '\0' || *end != '\0' || min_rows < 0))
+			{
+				fbsql_error("\\%s: MIN_ROWS must be a non-negative number\n", cmd);
+				success = false;
+			}
+			else if (analyzeWorkload(opt0, min_rows) == false)
+			{
+				status = FBSQL_CMD_FAILED;
+			}
+		}
+
+		free(opt0);
+		free(opt1);
+	}
+
+	/* \autocommit [on|off|batch N [MS]] */
 	else if (strncmp(cmd, "autocommit", 10) == 0)
 	{
-		if (fset.autocommit == true)
+		char	   *opt0 = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+
+		if (!opt0)
+		{
+			success = setAutocommit(!fset.autocommit, 0, 0);
+		}
+		else if (strcmp(opt0, "batch") == 0)
 		{
-			fset.autocommit = false;
-			if (fset.conn)
-				FQsetAutocommit(fset.conn, false);
-			puts("Autocommit off");
+			char	   *opt1 = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+			char	   *opt2 = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+			int			batch = opt1 ? atoi(opt1) : 0;
+			int			batch_ms = opt2 ? atoi(opt2) : AUTOCOMMIT_BATCH_DEFAULT_MS;
+
+			if (batch <= 0)
+			{
+				fbsql_error("\\autocommit batch: a positive number of statements is required\n");
+				success = false;
+			}
+			else if (batch_ms < 0)
+			{
+				fbsql_error("\\autocommit batch: invalid duration \"%s\"\n", opt2);
+				success = false;
+			}
+			else
+			{
+				success = setAutocommit(true, batch, batch_ms);
+			}
+
+			free(opt1);
+			free(opt2);
 		}
 		else
 		{
-			fset.autocommit = true;
-			if (fset.conn)
-				FQsetAutocommit(fset.conn, true);
-			puts("Autocommit on");
+			bool		autocommit;
+
+			if (_parseBoolean(opt0, &autocommit) == false)
+			{
+				fbsql_error("\\autocommit: unrecognized value \"%s\"; expected on, off or batch\n", opt0);
+				success = false;
+			}
+			else
+			{
+				success = setAutocommit(autocommit, 0, 0);
+			}
 		}
+
+		free(opt0);
 	}
 
 	/* \a - toggle output align mode */
@@ -284,7 +430,7 @@ execSlashCommand(const char *cmd,
 		char *opt0 = fbsql_scan_slash_option(scan_state,
 											 OT_NORMAL, NULL, false);
 
-		listTables(opt0, show_system);
+		listTables(opt0, show_system, show_extended, strstr(cmd, "++") != NULL);
 
 		free(opt0);
 	}
@@ -322,6 +468,114 @@ execSlashCommand(const char *cmd,
 		}
 	}
 
+	/* \gexec - execute query, then execute each value of its result */
+	else if (strcmp(cmd, "gexec") == 0)
+	{
+		char *opt;
+
+		fset.gexec_batch = 0;
+		fset.gexec_workers = 1;
+
+		while (success == true
+			   && (opt = fbsql_scan_slash_option(scan_state,
+												 OT_NORMAL, NULL, false)))
+		{
+			char *value = NULL;
+
+			if (strcmp(opt, "batch") == 0 || strcmp(opt, "workers") == 0)
+				value = fbsql_scan_slash_option(scan_state,
+												OT_NORMAL, NULL, false);
+
+			if (strcmp(opt, "batch") == 0)
+			{
+				fset.gexec_batch = value ? atoi(value) : 0;
+
+				if (fset.gexec_batch < 1)
+				{
+					fbsql_error("\\gexec: \"batch\" must be followed by a positive number\n");
+					success = false;
+				}
+			}
+			else if (strcmp(opt, "workers") == 0)
+			{
+				fset.gexec_workers = parseWorkerCount(value);
+
+				if (fset.gexec_workers < 1)
+				{
+					fbsql_error("\\gexec: \"workers\" must be followed by a number between 1 and %i\n",
+								PARALLEL_MAX_WORKERS);
+					success = false;
+				}
+			}
+			else
+			{
+				fbsql_error("\\gexec: unexpected option \"%s\"\n", opt);
+				success = false;
+			}
+
+			free(value);
+			free(opt);
+		}
+
+		if (success == true && parallelBlockActive() == true)
+		{
+			fbsql_error("\\gexec: not available in a \\parallel block\n");
+			success = false;
+		}
+
+		if (success == true)
+		{
+			fset.gexec_flag = true;
+			status = FBSQL_CMD_SEND;
+		}
+	}
+
+	/* \fanout - execute a query on a list of databases */
+	else if (strcmp(cmd, "fanout") == 0)
+	{
+		status = fanoutCommand(scan_state);
+	}
+
+	/* \checksum - compare a table's contents with another database */
+	else if (strcmp(cmd, "checksum") == 0)
+	{
+		status = checksumCommand(scan_state);
+	}
+
+	/* \copy_table - copy a table's rows to another database */
+	else if (strcmp(cmd, "copy_table") == 0)
+	{
+		status = copyTableCommand(scan_state);
+	}
+
+	/* \parallel [N] - start collecting statements to execute in parallel */
+	else if (strcmp(cmd, "parallel") == 0)
+	{
+		char *opt = fbsql_scan_slash_option(scan_state,
+											OT_NORMAL, NULL, false);
+		int nworkers = opt ? parseWorkerCount(opt) : PARALLEL_DEFAULT_WORKERS;
+
+		if (nworkers < 1)
+		{
+			fbsql_error("\\parallel: number of workers must be between 1 and %i\n",
+						PARALLEL_MAX_WORKERS);
+			success = false;
+		}
+		else
+		{
+			success = parallelBlockBegin(nworkers);
+		}
+
+		free(opt);
+	}
+
+	/* \endparallel - execute the statements collected since \parallel */
+	else if (strcmp(cmd, "endparallel") == 0)
+	{
+		if (parallelBlockEnd() == false)
+			status = FBSQL_CMD_FAILED;
+	}
+
 	/* \g - execute command */
 	else if (strncmp(cmd, "g", 1) == 0)
 	{
@@ -361,6 +615,12 @@ execSlashCommand(const char *cmd,
 		listDatabaseInfo();
 	}
 
+	/* \cachestats - sample page cache efficiency */
+	else if (strcmp(cmd, "cachestats") == 0)
+	{
+		status = showCacheStats(scan_state);
+	}
+
 	/* \explain - on|off */
 	else if (strcmp(cmd, "explain") == 0)
 	{
@@ -397,6 +657,93 @@ execSlashCommand(const char *cmd,
 		free(opt0);
 	}
 
+	/* \querystats - on|off|reset|replay FILE */
+	else if (strcmp(cmd, "querystats") == 0)
+	{
+		char *opt0 = fbsql_scan_slash_option(scan_state,
+											 OT_NORMAL, NULL, false);
+
+		if (!opt0)
+		{
+			if (fset.query_stats == false)
+				puts("Query statistics collection is off");
+
+			showQueryStats();
+		}
+		else if (strcmp("on", opt0) == 0)
+		{
+			fset.query_stats = true;
+			puts("Query statistics collection is on");
+		}
+		else if (strcmp("off", opt0) == 0)
+		{
+			fset.query_stats = false;
+			puts("Query statistics collection is off");
+		}
+		else if (strcmp("reset", opt0) == 0)
+		{
+			resetQueryStats();
+		}
+		else if (strcmp("replay", opt0) == 0)
+		{
+			char *opt1 = fbsql_scan_slash_option(scan_state,
+												 OT_NORMAL, NULL, false);
+
+			if (!opt1)
+			{
+				fbsql_error("\\%s replay: missing required argument\n", cmd);
+				success = false;
+			}
+			else if (replayQueryStats(opt1) == false)
+			{
+				status = FBSQL_CMD_FAILED;
+			}
+
+			free(opt1);
+		}
+		else
+		{
+			printf("\\querystats: allowed options are on, off, reset, replay FILE\n");
+			success = false;
+		}
+
+		free(opt0);
+	}
+
+	/* \planhistory - on|off|reset */
+	else if (strcmp(cmd, "planhistory") == 0)
+	{
+		char *opt0 = fbsql_scan_slash_option(scan_state,
+											 OT_NORMAL, NULL, false);
+
+		if (!opt0)
+		{
+			printf("Plan history is currently %s\n", fset.plan_history ? "on" : "off");
+		}
+		else if (strcmp("on", opt0) == 0)
+		{
+			fset.plan_history = true;
+			puts("Plan history is on");
+		}
+		else if (strcmp("off", opt0) == 0)
+		{
+			fset.plan_history = false;
+			planHistorySave();
+			puts("Plan history is off");
+		}
+		else if (strcmp("reset", opt0) == 0)
+		{
+			planHistoryReset();
+		}
+		else
+		{
+			printf("\\planhistory: allowed options are on, off, reset\n");
+			success = false;
+		}
+
+		free(opt0);
+	}
+
 
 	/* \format - set printing parameters */
 	else if (strcmp(cmd, "format") == 0)
@@ -418,6 +765,58 @@ execSlashCommand(const char *cmd,
 		free(opt1);
 	}
 
+	/* \set - set or list variables */
+	else if (strcmp(cmd, "set") == 0)
+	{
+		char *opt0 = fbsql_scan_slash_option(scan_state,
+											 OT_NORMAL, NULL, false);
+
+		if (!opt0)
+		{
+			PrintVariables(fset.vars);
+		}
+		else
+		{
+			FQExpBufferData value;
+			char *opt;
+
+			/* the value is the concatenation of all remaining arguments */
+			initFQExpBuffer(&value);
+
+			while ((opt = fbsql_scan_slash_option(scan_state,
+												  OT_NORMAL, NULL, false)))
+			{
+				appendFQExpBufferStr(&value, opt);
+				free(opt);
+			}
+
+			success = setVariable(opt0, value.data);
+
+			termFQExpBuffer(&value);
+		}
+
+		free(opt0);
+	}
+
+	/* \unset - delete a variable */
+	else if (strcmp(cmd, "unset") == 0)
+	{
+		char *opt0 = fbsql_scan_slash_option(scan_state,
+											 OT_NORMAL, NULL, false);
+
+		if (!opt0)
+		{
+			fbsql_error("\\%s: missing required argument\n", cmd);
+			success = false;
+		}
+		else
+		{
+			success = unsetVariable(opt0);
+		}
+
+		free(opt0);
+	}
+
 	/* \timing - toggle timing */
 	else if (strncmp(cmd, "timing", 6) == 0)
 	{
@@ -460,7 +859,7 @@ execSlashCommand(const char *cmd,
 		}
 		else
 		{
-			execUtil(opt0);
+			status = execUtil(opt0, scan_state);
 		}
 
 		free(opt0);
@@ -588,41 +987,212 @@ do_plan_display(const char *value)
 }
 
 
-static char *
-render_plan_display(short plan_display)
+/**
+ * setVariable()
+ *
+ * \set NAME [VALUE]
+ *
+ * Set a client-side variable. Variables which control fbsql's behaviour
+ * are validated and applied here:
+ *
+ *   bind_variables   on: pass :var and :'var' references in SQL as bound
+ *                    parameters rather than substituting their values
+ *
+ *   retry_on_conflict
+ *                    N: retry statements which fail due to a lock conflict,
+ *                    update conflict or deadlock up to N times, in
+ *                    transactions started by fbsql (autocommit mode)
+ */
+static bool
+setVariable(const char *name, const char *value)
 {
-	switch(plan_display)
+	if (ValidVariableName(name) == false)
 	{
-		case PLAN_DISPLAY_ON:
-			return "on";
-		case PLAN_DISPLAY_ONLY:
-			return "only";
-		case PLAN_DISPLAY_OFF:
-			return "off";
-		default:
-			return "unknown";
+		fbsql_error("\\set: invalid variable name \"%s\"\n", name);
+		return false;
 	}
-}
 
-
-bool
-do_explain_display(const char *value)
-{
-	if (strcmp("off", value) == 0)
+	if (strcmp(name, "bind_variables") == 0)
 	{
-		fset.explain_display = EXPLAIN_DISPLAY_OFF;
+		if (_parseBoolean(value, &fset.bind_variables) == false)
+		{
+			fbsql_error("\\set: \"%s\" must be \"on\" or \"off\"\n", name);
+			return false;
+		}
+
+		if (fset.bind_variables == false)
+			preparedStatementsClear();
 	}
-	else if (strcmp("on", value) == 0)
+	else if (strcmp(name, "retry_on_conflict") == 0)
 	{
-		fset.explain_display = EXPLAIN_DISPLAY_ON;
+		char	   *end;
+		long		retries = strtol(value, &end, 10);
+
+		if (*value == '\0' || *end != '\0' || retries < 0 || retries > INT_MAX)
+		{
+			fbsql_error("\\set: \"%s\" must be a non-negative integer\n", name);
+			return false;
+		}
+
+		fset.retry_on_conflict = (int)retries;
 	}
-	else
+
+	return SetVariable(fset.vars, name, value);
+}
+
+
+/**
+ * unsetVariable()
+ *
+ * \unset NAME
+ *
+ * Delete a client-side variable, restoring the default for variables
+ * which control fbsql's behaviour.
+ */
+static bool
+unsetVariable(const char *name)
+{
+	if (strcmp(name, "bind_variables") == 0)
 	{
-		printf("\\explain: allowed options are on, off\n");
-		return false;
+		fset.bind_variables = false;
+		preparedStatementsClear();
 	}
+	else if (strcmp(name, "retry_on_conflict") == 0)
+		fset.retry_on_conflict = 0;
+
+	DeleteVariable(fset.vars, name);
 
-	printf("Explain display is %s\n", render_explain_display(fset.explain_display));
+	return true;
+}
+
+
+/**
+ * setAutocommit()
+ *
+ * \autocommit [on|off|batch N [MS]]
+ *
+ * In batched mode ("batch" > 0), autocommit remains on as far as the
+ * user is concerned, but statements are executed in a shared transaction
+ * which is committed every "batch" statements or "batch_ms" milliseconds
+ * (see SendQueryParams()). Any statements pending from batched mode are
+ * committed before the mode is changed.
+ */
+static bool
+setAutocommit(bool autocommit, int batch, int batch_ms)
+{
+	if (autocommitBatchFlush() == false)
+		return false;
+
+	fset.autocommit = autocommit;
+	fset.autocommit_batch = batch;
+	fset.autocommit_batch_ms = batch_ms;
+
+	if (fset.conn)
+		FQsetAutocommit(fset.conn, autocommit == true && autocommitManaged() == false);
+
+	if (autocommit == false)
+		puts("Autocommit off");
+	else if (batch == 0)
+		puts("Autocommit on");
+	else if (batch_ms == 0)
+		printf("Autocommit on, committing every %i statement(s)\n", batch);
+	else
+		printf("Autocommit on, committing every %i statement(s) or %i ms\n", batch, batch_ms);
+
+	return true;
+}
+
+
+/**
+ * setTransactionMode()
+ *
+ * \txmode MODE
+ *
+ * Set the parameters of each transaction subsequently started on the
+ * session's connection (see parseTransactionMode() for the syntax). In
+ * autocommit mode, any statements pending from batched mode are
+ * committed, so the new mode applies to the next statement; otherwise
+ * it applies from the start of the next transaction.
+ */
+static bool
+setTransactionMode(const char *mode)
+{
+	bool		valid;
+	char	   *txmode = parseTransactionMode(mode, &valid);
+
+	if (valid == false)
+		return false;
+
+	if (autocommitBatchFlush() == false)
+	{
+		free(txmode);
+		return false;
+	}
+
+	free(fset.txmode);
+	fset.txmode = txmode;
+
+	if (fset.conn)
+		FQsetAutocommit(fset.conn, fset.autocommit == true && autocommitManaged() == false);
+
+	printf("Transaction mode: %s\n", fset.txmode != NULL ? fset.txmode : "default");
+
+	if (fset.autocommit == false && FQisActiveTransaction(fset.conn))
+		puts("Note: the current transaction is not affected");
+
+	return true;
+}
+
+
+static bool
+_parseBoolean(const char *value, bool *result)
+{
+	if (strcmp(value, "on") == 0 || strcmp(value, "true") == 0 || strcmp(value, "1") == 0)
+		*result = true;
+	else if (strcmp(value, "off") == 0 || strcmp(value, "false") == 0 || strcmp(value, "0") == 0)
+		*result = false;
+	else
+		return false;
+
+	return true;
+}
+
+
+static char *
+render_plan_display(short plan_display)
+{
+	switch(plan_display)
+	{
+		case PLAN_DISPLAY_ON:
+			return "on";
+		case PLAN_DISPLAY_ONLY:
+			return "only";
+		case PLAN_DISPLAY_OFF:
+			return "off";
+		default:
+			return "unknown";
+	}
+}
+
+
+bool
+do_explain_display(const char *value)
+{
+	if (strcmp("off", value) == 0)
+	{
+		fset.explain_display = EXPLAIN_DISPLAY_OFF;
+	}
+	else if (strcmp("on", value) == 0)
+	{
+		fset.explain_display = EXPLAIN_DISPLAY_ON;
+	}
+	else
+	{
+		printf("\\explain: allowed options are on, off\n");
+		return false;
+	}
+
+	printf("Explain display is %s\n", render_explain_display(fset.explain_display));
 	return true;
 }
 
@@ -642,8 +1212,8 @@ render_explain_display(short explain_display)
 }
 
 
-static void
-_wildcard_pattern_clause(char *pattern, char *field, FQExpBufferData *buf)
+void
+wildcardPatternClause(char *pattern, char *field, FQExpBufferData *buf)
 {
 	size_t pattern_len = strlen(pattern);
 
@@ -693,57 +1263,947 @@ _align2string(enum printFormat in)
 			return "html";
 	}
 
-	return "unknown";
-}
+	return "unknown";
+}
+
+
+static const char *
+_border2string(enum borderFormat in)
+{
+	switch (in)
+	{
+		case BORDER_MINIMAL:
+			return "minimal";
+		case BORDER_CLASSIC:
+			/* XXX TODO: implement BORDER_BOX */
+		case BORDER_BOX:
+			return "classic";
+	}
+
+	return "unknown";
+}
+
+
+/**
+ * showActivity()
+ *
+ * \activity
+ */
+static void
+showActivity(void)
+{
+	char *query;
+	printQueryOpt pqopt = fset.popt;
+
+	pqopt.header = "Current activity";
+
+	query =
+"    SELECT TRIM(mon$user) AS \"User\",\n"
+"           mon$timestamp AS \"Connection start\",\n"
+"           COALESCE(mon$remote_address, '-') AS \"Client address\",\n"
+"           COALESCE(mon$remote_process, '-') AS \"Client application\",\n"
+"           COALESCE(TRIM(mon$role), '-') AS \"Role\",\n"
+"           mon$state AS \"State\",\n"
+"           mon$server_pid AS \"Server PID\",\n"
+"           COALESCE(mon$remote_pid, '-') AS \"Client PID\",\n"
+"           TRIM(rdb$character_set_name) AS \"Client encoding\"\n"
+"      FROM mon$attachments\n"
+"INNER JOIN rdb$character_sets\n"
+"        ON mon$character_set_id = rdb$character_set_id";
+
+	commandExecPrint(query, &pqopt);
+}
+
+/**
+ * showTxGap()
+ *
+ * \txgap [watch [SECS]] [threshold N]
+ *
+ * Display the transaction markers from MON$DATABASE, the gaps between
+ * them and the next transaction, and the attachments holding the oldest
+ * active transactions (which prevent the OAT and OST from advancing).
+ *
+ * In watch mode, the markers are displayed every SECS (default:
+ * TXGAP_WATCH_INTERVAL) seconds until CTRL-C is pressed, with the
+ * oldest active transactions shown only if a gap exceeds "threshold".
+ *
+ * Returns FBSQL_CMD_ERROR if the options are invalid, and
+ * FBSQL_CMD_FAILED if the transaction markers could not be read.
+ */
+static backslashResult
+showTxGap(FbsqlScanState scan_state)
+{
+	char	   *opt;
+	bool		watch = false;
+	long		interval = TXGAP_WATCH_INTERVAL;
+	long		threshold = 0;
+
+	while ((opt = fbsql_scan_slash_option(scan_state,
+										  OT_NORMAL, NULL, false)))
+	{
+		if (strcmp(opt, "watch") == 0)
+		{
+			watch = true;
+		}
+		else if (strcmp(opt, "threshold") == 0)
+		{
+			char *value = fbsql_scan_slash_option(scan_state,
+												  OT_NORMAL, NULL, false);
+
+			threshold = value ? atol(value) : 0;
+			free(value);
+
+			if (threshold < 1)
+			{
+				fbsql_error("\\txgap: \"threshold\" must be followed by a positive number\n");
+				free(opt);
+				return FBSQL_CMD_ERROR;
+			}
+		}
+		else if (watch == true && atol(opt) > 0)
+		{
+			interval = atol(opt);
+		}
+		else
+		{
+			fbsql_error("\\txgap: unexpected option \"%s\"\n", opt);
+			free(opt);
+			return FBSQL_CMD_ERROR;
+		}
+
+		free(opt);
+	}
+
+	if (watch == false)
+	{
+		if (_printTxGap(threshold, false) == false)
+			return FBSQL_CMD_FAILED;
+
+		_printTxGapHolders();
+
+		return FBSQL_CMD_SKIP_LINE;
+	}
+
+	printf("Watching transaction markers every %li s", interval);
+	if (threshold > 0)
+		printf(", alerting when a gap exceeds %li", threshold);
+	puts("; press CTRL-C to stop");
+
+	cancel_pressed = false;
+
+	while (cancel_pressed == false)
+	{
+		long elapsed;
+
+		if (_printTxGap(threshold, true) == false)
+			return FBSQL_CMD_FAILED;
+
+		fflush(stdout);
+
+		for (elapsed = 0; elapsed < interval && cancel_pressed == false; elapsed++)
+			sleep(1);
+	}
+
+	return FBSQL_CMD_SKIP_LINE;
+}
+
+
+/**
+ * listenCommand()
+ *
+ * \listen NAME [NAME ...] [do QUERY]
+ *
+ * Wait for the named events until CTRL-C is pressed, optionally
+ * executing QUERY each time one is received.
+ *
+ * Returns FBSQL_CMD_ERROR if the command is malformed, and
+ * FBSQL_CMD_FAILED if the events could not be registered.
+ */
+static backslashResult
+listenCommand(FbsqlScanState scan_state)
+{
+	char	   *names[EVENTS_MAX];
+	char	   *query = NULL;
+	char	   *opt;
+	int			nevents = 0;
+	bool		success = true;
+	backslashResult status = FBSQL_CMD_SKIP_LINE;
+	int			i;
+
+	while ((opt = fbsql_scan_slash_option(scan_state,
+										  OT_NORMAL, NULL, false)))
+	{
+		if (strcmp(opt, "do") == 0)
+		{
+			free(opt);
+			query = fbsql_scan_slash_option(scan_state,
+											OT_WHOLE_LINE, NULL, false);
+			break;
+		}
+
+		if (nevents == EVENTS_MAX)
+		{
+			fbsql_error("\\listen: a maximum of %i events can be specified\n", EVENTS_MAX);
+			free(opt);
+			success = false;
+			break;
+		}
+
+		names[nevents++] = opt;
+	}
+
+	if (success == true && nevents == 0)
+	{
+		fbsql_error("\\listen: at least one event name must be provided\n");
+		success = false;
+	}
+	else if (success == true && query != NULL && query[0] == '\0')
+	{
+		fbsql_error("\\listen: \"do\" must be followed by a query\n");
+		success = false;
+	}
+
+	if (success == true
+		&& listenEvents(names, nevents, query, false) == false)
+		status = FBSQL_CMD_FAILED;
+
+	for (i = 0; i < nevents; i++)
+		free(names[i]);
+
+	free(query);
+
+	if (success == false)
+		return FBSQL_CMD_ERROR;
+
+	return status;
+}
+
+
+/**
+ * fanoutCommand()
+ *
+ * \fanout FILE [order by COLUMN [asc|desc]] [limit N] [merge sum|min|max]
+ *         [workers N] QUERY
+ *
+ * The query starts with the first word which is not one of the options,
+ * and continues to the end of the line.
+ */
+static backslashResult
+fanoutCommand(FbsqlScanState scan_state)
+{
+	backslashResult status = FBSQL_CMD_SKIP_LINE;
+	fanoutOptions options;
+	FQExpBufferData query;
+	char	   *filename;
+	char	   *opt;
+	char	   *pending = NULL;
+	bool		success = true;
+
+	memset(&options, 0, sizeof(options));
+	options.limit = -1;
+	options.merge = FANOUT_MERGE_NONE;
+
+	filename = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+
+	if (!filename)
+	{
+		fbsql_error("\\fanout: missing required argument\n");
+		return FBSQL_CMD_ERROR;
+	}
+
+	initFQExpBuffer(&query);
+
+	while (success == true)
+	{
+		char	   *value = NULL;
+
+		if (pending != NULL)
+		{
+			opt = pending;
+			pending = NULL;
+		}
+		else
+		{
+			opt = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+		}
+
+		if (!opt)
+			break;
+
+		if (strcmp(opt, "order") == 0)
+		{
+			value = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+
+			if (!value || strcmp(value, "by") != 0)
+			{
+				fbsql_error("\\fanout: \"order\" must be followed by \"by\" and a column\n");
+				success = false;
+			}
+			else
+			{
+				free(value);
+				value = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+
+				if (!value)
+				{
+					fbsql_error("\\fanout: \"order by\" must be followed by a column\n");
+					success = false;
+				}
+				else
+				{
+					free(options.order_by);
+					options.order_by = value;
+					value = NULL;
+
+					/* optional sort direction */
+					pending = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+
+					if (pending && (strcmp(pending, "asc") == 0 || strcmp(pending, "desc") == 0))
+					{
+						options.order_desc = strcmp(pending, "desc") == 0;
+						free(pending);
+						pending = NULL;
+					}
+				}
+			}
+		}
+		else if (strcmp(opt, "limit") == 0)
+		{
+			char	   *end = NULL;
+
+			value = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+
+			if (value)
+				options.limit = strtol(value, &end, 10);
+
+			if (!value || *value == '\0' || *end != '\0' || options.limit < 0)
+			{
+				fbsql_error("\\fanout: \"limit\" must be followed by a non-negative number\n");
+				success = false;
+			}
+		}
+		else if (strcmp(opt, "merge") == 0)
+		{
+			value = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+
+			if (value && strcmp(value, "sum") == 0)
+				options.merge = FANOUT_MERGE_SUM;
+			else if (value && strcmp(value, "min") == 0)
+				options.merge = FANOUT_MERGE_MIN;
+			else if (value && strcmp(value, "max") == 0)
+				options.merge = FANOUT_MERGE_MAX;
+			else
+			{
+				fbsql_error("\\fanout: \"merge\" must be followed by \"sum\", \"min\" or \"max\"\n");
+				success = false;
+			}
+		}
+		else if (strcmp(opt, "workers") == 0)
+		{
+			value = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+			options.nworkers = parseWorkerCount(value);
+
+			if (options.nworkers < 1)
+			{
+				fbsql_error("\\fanout: \"workers\" must be followed by a number between 1 and %i\n",
+							PARALLEL_MAX_WORKERS);
+				success = false;
+			}
+		}
+		else
+		{
+			/* start of the query */
+			char	   *rest = fbsql_scan_slash_option(scan_state, OT_WHOLE_LINE, NULL, false);
+
+			appendFQExpBufferStr(&query, opt);
+
+			if (rest)
+			{
+				appendFQExpBuffer(&query, " %s", rest);
+				free(rest);
+			}
+
+			free(opt);
+			break;
+		}
+
+		free(value);
+		free(opt);
+	}
+
+	free(pending);
+
+	/* a trailing semicolon is not part of the statement */
+	while (query.len > 0
+		   && (isspace((unsigned char)query.data[query.len - 1]) || query.data[query.len - 1] == ';'))
+		query.data[--query.len] = '\0';
+
+	if (success == true && query.len == 0)
+	{
+		fbsql_error("\\fanout: missing query\n");
+		success = false;
+	}
+
+	if (success == false)
+		status = FBSQL_CMD_ERROR;
+	else if (execFanout(filename, query.data, &options) == false)
+		status = FBSQL_CMD_FAILED;
+
+	termFQExpBuffer(&query);
+	free(options.order_by);
+	free(filename);
+
+	return status;
+}
+
+
+/**
+ * checksumCommand()
+ *
+ * \checksum TABLE [DSN] [chunk N] [workers N]
+ *
+ * Returns FBSQL_CMD_ERROR if the command is malformed, and
+ * FBSQL_CMD_FAILED if the comparison fails or finds differences.
+ */
+static backslashResult
+checksumCommand(FbsqlScanState scan_state)
+{
+	char	   *table;
+	char	   *other_dsn = NULL;
+	char	   *opt;
+	long		chunk_rows = CHECKSUM_DEFAULT_CHUNK_ROWS;
+	int			nworkers = PARALLEL_DEFAULT_WORKERS;
+	bool		success = true;
+	backslashResult status = FBSQL_CMD_SKIP_LINE;
+
+	table = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+
+	if (!table)
+	{
+		fbsql_error("\\checksum: missing required argument\n");
+		return FBSQL_CMD_ERROR;
+	}
+
+	while (success == true
+		   && (opt = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false)))
+	{
+		char	   *value = NULL;
+
+		if (strcmp(opt, "chunk") == 0)
+		{
+			value = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+			chunk_rows = value ? atol(value) : 0;
+
+			if (chunk_rows < 1)
+			{
+				fbsql_error("\\checksum: \"chunk\" must be followed by a positive number\n");
+				success = false;
+			}
+		}
+		else if (strcmp(opt, "workers") == 0)
+		{
+			value = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+			nworkers = parseWorkerCount(value);
+
+			if (nworkers < 1)
+			{
+				fbsql_error("\\checksum: \"workers\" must be followed by a number between 1 and %i\n",
+							PARALLEL_MAX_WORKERS);
+				success = false;
+			}
+		}
+		else if (other_dsn == NULL)
+		{
+			other_dsn = opt;
+			opt = NULL;
+		}
+		else
+		{
+			fbsql_error("\\checksum: unexpected option \"%s\"\n", opt);
+			success = false;
+		}
+
+		free(value);
+		free(opt);
+	}
+
+	if (success == true
+		&& checksumTable(table, other_dsn, chunk_rows, nworkers) == false)
+		status = FBSQL_CMD_FAILED;
+
+	free(table);
+	free(other_dsn);
+
+	if (success == false)
+		return FBSQL_CMD_ERROR;
+
+	return status;
+}
+
+
+/**
+ * copyTableCommand()
+ *
+ * \copy_table SRC to DSN [as DST] [batch N] [workers N] [disable_indexes]
+ *             [where CONDITION]
+ *
+ * Returns FBSQL_CMD_ERROR if the command is malformed, and
+ * FBSQL_CMD_FAILED if the copy fails.
+ */
+static backslashResult
+copyTableCommand(FbsqlScanState scan_state)
+{
+	char	   *src_table;
+	char	   *dsn = NULL;
+	char	   *dst_table = NULL;
+	char	   *where = NULL;
+	char	   *opt;
+	long		batch = COPY_TABLE_DEFAULT_BATCH;
+	int			nworkers = 1;
+	bool		disable_indexes = false;
+	bool		success = true;
+	backslashResult status = FBSQL_CMD_SKIP_LINE;
+
+	src_table = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+	opt = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+
+	if (opt && pg_strcasecmp(opt, "to") == 0)
+		dsn = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+
+	free(opt);
+
+	if (!src_table || !dsn)
+	{
+		fbsql_error("\\copy_table: usage: \\copy_table SRC to DSN [as DST] [batch N] [workers N] [disable_indexes] [where CONDITION]\n");
+		free(src_table);
+		free(dsn);
+		return FBSQL_CMD_ERROR;
+	}
+
+	while (success == true
+		   && (opt = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false)))
+	{
+		char	   *value = NULL;
+
+		if (strcmp(opt, "as") == 0 && dst_table == NULL)
+		{
+			dst_table = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+
+			if (!dst_table)
+			{
+				fbsql_error("\\copy_table: \"as\" must be followed by a table name\n");
+				success = false;
+			}
+		}
+		else if (strcmp(opt, "batch") == 0)
+		{
+			value = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+			batch = value ? atol(value) : 0;
+
+			if (batch < 1)
+			{
+				fbsql_error("\\copy_table: \"batch\" must be followed by a positive number\n");
+				success = false;
+			}
+		}
+		else if (strcmp(opt, "workers") == 0)
+		{
+			value = fbsql_scan_slash_option(scan_state, OT_NORMAL, NULL, false);
+			nworkers = parseWorkerCount(value);
+
+			if (nworkers < 1)
+			{
+				fbsql_error("\\copy_table: \"workers\" must be followed by a number between 1 and %i\n",
+							PARALLEL_MAX_WORKERS);
+				success = false;
+			}
+		}
+		else if (strcmp(opt, "disable_indexes") == 0)
+		{
+			disable_indexes = true;
+		}
+		else if (strcmp(opt, "where") == 0)
+		{
+			/* the condition is the rest of the line */
+			where = fbsql_scan_slash_option(scan_state, OT_WHOLE_LINE, NULL, false);
+
+			if (where)
+			{
+				int			len = strlen(where);
+
+				/* a trailing semicolon is not part of the condition */
+				while (len > 0 && (isspace((unsigned char)where[len - 1]) || where[len - 1] == ';'))
+					where[--len] = '\0';
+			}
+
+			if (!where || *where == '\0')
+			{
+				fbsql_error("\\copy_table: \"where\" must be followed by a condition\n");
+				success = false;
+			}
+
+			free(opt);
+			break;
+		}
+		else
+		{
+			fbsql_error("\\copy_table: unexpected option \"%s\"\n", opt);
+			success = false;
+		}
+
+		free(value);
+		free(opt);
+	}
+
+	if (success == true
+		&& copyTable(src_table, dsn, dst_table, where, batch, nworkers, disable_indexes) == false)
+		status = FBSQL_CMD_FAILED;
+
+	free(src_table);
+	free(dsn);
+	free(dst_table);
+	free(where);
+
+	if (success == false)
+		return FBSQL_CMD_ERROR;
+
+	return status;
+}
+
+
+/**
+ * _printTxGap()
+ *
+ * Print the current transaction markers; in watch mode as a single
+ * timestamped line, followed by an alert and the oldest active
+ * transactions if any gap exceeds "threshold".
+ *
+ * The query is executed in a separate transaction so the monitoring
+ * snapshot is always current.
+ */
+static bool
+_printTxGap(long threshold, bool watch)
+{
+	FBresult   *res;
+	long		oit, oat, ost, next;
+	long		max_gap;
+
+	res = FQexecTransaction(fset.conn,
+"SELECT mon$oldest_transaction, mon$oldest_active, \n"
+"       mon$oldest_snapshot, mon$next_transaction \n"
+"  FROM mon$database");
+
+	if (FQresultStatus(res) != FBRES_TUPLES_OK || FQntuples(res) == 0)
+	{
+		fbsql_error("\\txgap: unable to read transaction markers\n%s",
+					FQresultErrorMessage(res));
+		FQclear(res);
+		return false;
+	}
+
+	oit = atol(FQgetvalue(res, 0, 0));
+	oat = atol(FQgetvalue(res, 0, 1));
+	ost = atol(FQgetvalue(res, 0, 2));
+	next = atol(FQgetvalue(res, 0, 3));
+
+	FQclear(res);
+
+	/* OIT <= OST <= OAT under normal circumstances, but don't rely on it */
+	max_gap = next - oit;
+	if (next - ost > max_gap)
+		max_gap = next - ost;
+	if (next - oat > max_gap)
+		max_gap = next - oat;
+
+	if (watch == true)
+	{
+		char		timestamp[32];
+		time_t		now = time(NULL);
+
+		strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+		printf("%s  OIT %li (gap %li)  OAT %li (gap %li)  OST %li (gap %li)  next %li\n",
+			   timestamp,
+			   oit, next - oit,
+			   oat, next - oat,
+			   ost, next - ost,
+			   next);
+	}
+	else
+	{
+		printf("Transaction markers\n");
+		printf("  Oldest interesting (OIT): %li (gap: %li)\n", oit, next - oit);
+		printf("  Oldest active (OAT):      %li (gap: %li)\n", oat, next - oat);
+		printf("  Oldest snapshot (OST):    %li (gap: %li)\n", ost, next - ost);
+		printf("  Next transaction:         %li\n", next);
+		puts("");
+	}
+
+	if (threshold > 0 && max_gap > threshold)
+	{
+		printf("ALERT: transaction gap %li exceeds threshold %li\n", max_gap, threshold);
+
+		if (watch == true)
+			_printTxGapHolders();
+	}
+
+	return true;
+}
+
+
+/**
+ * _printTxGapHolders()
+ *
+ * Display the oldest active transactions, with the attachment, user and
+ * statement holding each; the first row is the transaction holding back
+ * the OAT. For idle transactions, the most recently started statement
+ * prepared by the attachment is shown.
+ */
+static void
+_printTxGapHolders(void)
+{
+	FBresult   *res;
+	printQueryOpt pqopt = fset.popt;
+
+	res = FQexecTransaction(fset.conn,
+"    SELECT FIRST 5 \n"
+"           t.mon$transaction_id AS \"Transaction\",\n"
+"           t.mon$timestamp AS \"Transaction start\",\n"
+"           DATEDIFF(SECOND FROM t.mon$timestamp TO CURRENT_TIMESTAMP) AS \"Age (s)\",\n"
+"           a.mon$attachment_id AS \"Attachment\",\n"
+"           TRIM(a.mon$user) AS \"User\",\n"
+"           COALESCE(a.mon$remote_address, '-') AS \"Client address\",\n"
+"           COALESCE(a.mon$remote_process, '-') AS \"Client application\",\n"
+"           CASE WHEN a.mon$attachment_id = CURRENT_CONNECTION THEN 'yes' ELSE 'no' END AS \"This session\",\n"
+"           COALESCE(\n"
+"             (SELECT FIRST 1 CAST(SUBSTRING(s.mon$sql_text FROM 1 FOR 200) AS VARCHAR(200))\n"
+"                FROM mon$statements s\n"
+"               WHERE s.mon$transaction_id = t.mon$transaction_id\n"
+"            ORDER BY s.mon$state DESC, s.mon$timestamp DESC),\n"
+"             (SELECT FIRST 1 CAST(SUBSTRING(s.mon$sql_text FROM 1 FOR 200) AS VARCHAR(200))\n"
+"                FROM mon$statements s\n"
+"               WHERE s.mon$attachment_id = t.mon$attachment_id\n"
+"            ORDER BY s.mon$timestamp DESC NULLS LAST),\n"
+"             '-') AS \"Statement\"\n"
+"      FROM mon$transactions t\n"
+"INNER JOIN mon$attachments a\n"
+"        ON a.mon$attachment_id = t.mon$attachment_id\n"
+"     WHERE t.mon$state = 1\n"
+"       AND t.mon$transaction_id <> CURRENT_TRANSACTION\n"
+"  ORDER BY t.mon$transaction_id");
+
+	if (FQresultStatus(res) != FBRES_TUPLES_OK)
+	{
+		fbsql_error("\\txgap: unable to read active transactions\n%s",
+					FQresultErrorMessage(res));
+		FQclear(res);
+		return;
+	}
+
+	if (FQntuples(res) == 0)
+	{
+		puts("No other active transactions");
+	}
+	else
+	{
+		pqopt.header = "Oldest active transactions";
+		printQuery(res, &pqopt);
+		puts("");
+	}
+
+	FQclear(res);
+}
+
+
+/**
+ * showPlanCache()
+ *
+ * \plancache
+ *
+ * List the compiled statements held in the statement cache (Firebird 5.0
+ * and later), with their explained plan, the number of statement handles
+ * and attachments currently using each, and the page fetches made by
+ * them, followed by a summary of the cache's memory usage compared with
+ * MaxStatementCacheSize.
+ *
+ * MaxStatementCacheSize applies to each attachment's cache, but an
+ * administrator sees the compiled statements of all attachments, and
+ * MON$COMPILED_STATEMENTS does not say which attachment a cached
+ * statement belongs to. The unused memory is therefore compared with the
+ * limit multiplied by the number of user attachments: if it exceeds
+ * that, at least one attachment's cache must be near its limit.
+ *
+ * Firebird does not expose execution counts for compiled statements;
+ * the number of handles sharing a compiled statement, and the number of
+ * cached statements not currently in use, indicate how well prepared
+ * statements are being reused.
+ */
+static void
+showPlanCache(void)
+{
+	FBresult   *res;
+	fbsqlTable	table;
+	printQueryOpt pqopt = fset.popt;
+	long		ncompiled, in_use = 0, handles = 0;
+	long		nattachments = 1;
+	double		memory = 0, unused_memory = 0, limit = -1;
+	int			i;
+
+	static const char *const headers[] =
+		{"ID", "Object", "Statement", "Plan", "Handles", "Attachments",
+		 "Memory (KB)", "Fetches"};
+
+	if (FQserverVersion(fset.conn) < 50000)
+	{
+		puts("\\plancache requires Firebird 5.0 or later");
+		return;
+	}
+
+	res = FQexecTransaction(fset.conn,
+"    SELECT cs.mon$compiled_statement_id, \n"
+"           COALESCE(TRIM(cs.mon$package_name) || '.', '') || COALESCE(TRIM(cs.mon$object_name), ''), \n"
+"           CAST(SUBSTRING(cs.mon$sql_text FROM 1 FOR 1000) AS VARCHAR(1000)), \n"
+"           CAST(SUBSTRING(cs.mon$explained_plan FROM 1 FOR 2000) AS VARCHAR(2000)), \n"
+"           (SELECT COUNT(*) \n"
+"              FROM mon$statements s \n"
+"             WHERE s.mon$compiled_statement_id = cs.mon$compiled_statement_id), \n"
+"           (SELECT LIST(DISTINCT s.mon$attachment_id) \n"
+"              FROM mon$statements s \n"
+"             WHERE s.mon$compiled_statement_id = cs.mon$compiled_statement_id), \n"
+"           COALESCE(m.mon$memory_used, 0), \n"
+"           COALESCE(io.mon$page_fetches, 0) \n"
+"      FROM mon$compiled_statements cs \n"
+" LEFT JOIN mon$memory_usage m \n"
+"        ON m.mon$stat_id = cs.mon$stat_id \n"
+" LEFT JOIN mon$io_stats io \n"
+"        ON io.mon$stat_id = cs.mon$stat_id \n"
+"  ORDER BY 5 DESC, 8 DESC");
+
+	if (FQresultStatus(res) != FBRES_TUPLES_OK)
+	{
+		fbsql_error("\\plancache: unable to read compiled statements\n%s",
+					FQresultErrorMessage(res));
+		FQclear(res);
+		return;
+	}
+
+	ncompiled = FQntuples(res);
+
+	if (ncompiled == 0)
+	{
+		puts("No compiled statements found");
+		FQclear(res);
+		return;
+	}
+
+	initTable(&table, lengthof(headers), headers);
+
+	table.right_align[0] = true;
+	for (i = 4; i < lengthof(headers); i++)
+		table.right_align[i] = true;
+
+	for (i = 0; i < ncompiled; i++)
+	{
+		const char *values[8];
+		char	   *statement = NULL;
+		char	   *plan = NULL;
+		char		memory_kb[32];
+		long		statement_handles = atol(FQgetvalue(res, i, 4));
+		double		memory_used = atof(FQgetvalue(res, i, 6));
+
+		if (!FQgetisnull(res, i, 2))
+			statement = condenseText(FQgetvalue(res, i, 2),
+									 strlen(FQgetvalue(res, i, 2)),
+									 PLANCACHE_TEXT_LEN);
+
+		if (!FQgetisnull(res, i, 3))
+			plan = condenseText(FQgetvalue(res, i, 3),
+								strlen(FQgetvalue(res, i, 3)),
+								PLANCACHE_TEXT_LEN);
+
+		snprintf(memory_kb, sizeof(memory_kb), "%.1f", memory_used / 1024);
+
+		values[0] = FQgetvalue(res, i, 0);
+		values[1] = FQgetvalue(res, i, 1);
+		values[2] = statement;
+		values[3] = plan;
+		values[4] = FQgetvalue(res, i, 4);
+		values[5] = FQgetisnull(res, i, 5) ? NULL : FQgetvalue(res, i, 5);
+		values[6] = memory_kb;
+		values[7] = FQgetvalue(res, i, 7);
+
+		addTableRow(&table, values);
+
+		memory += memory_used;
+
+		if (statement_handles > 0)
+		{
+			in_use++;
+			handles += statement_handles;
+		}
+		else
+		{
+			unused_memory += memory_used;
+		}
+
+		free(statement);
+		free(plan);
+	}
+
+	FQclear(res);
+
+	pqopt.header = "Compiled statement cache";
+	printTable(&table, &pqopt);
+	puts("");
 
+	termTable(&table);
 
-static const char *
-_border2string(enum borderFormat in)
-{
-	switch (in)
-	{
-		case BORDER_MINIMAL:
-			return "minimal";
-		case BORDER_CLASSIC:
-			/* XXX TODO: implement BORDER_BOX */
-		case BORDER_BOX:
-			return "classic";
-	}
+	/* only visible to administrators */
+	res = FQexecTransaction(fset.conn,
+"SELECT rdb$config_value \n"
+"  FROM rdb$config \n"
+" WHERE rdb$config_name = 'MaxStatementCacheSize'");
 
-	return "unknown";
-}
+	if (FQresultStatus(res) == FBRES_TUPLES_OK && FQntuples(res) > 0 && !FQgetisnull(res, 0, 0))
+		limit = atof(FQgetvalue(res, 0, 0));
 
+	FQclear(res);
 
-/**
- * showActivity()
- *
- * \activity
- */
-static void
-showActivity(void)
-{
-	char *query;
-	printQueryOpt pqopt = fset.popt;
+	/* attachments whose statement caches are included above; system attachments have none */
+	res = FQexecTransaction(fset.conn,
+"SELECT COUNT(*) \n"
+"  FROM mon$attachments \n"
+" WHERE mon$system_flag = 0");
 
-	pqopt.header = "Current activity";
+	if (FQresultStatus(res) == FBRES_TUPLES_OK && FQntuples(res) > 0 && atol(FQgetvalue(res, 0, 0)) > 1)
+		nattachments = atol(FQgetvalue(res, 0, 0));
 
-	query =
-"    SELECT TRIM(mon$user) AS \"User\",\n"
-"           mon$timestamp AS \"Connection start\",\n"
-"           COALESCE(mon$remote_address, '-') AS \"Client address\",\n"
-"           COALESCE(mon$remote_process, '-') AS \"Client application\",\n"
-"           COALESCE(TRIM(mon$role), '-') AS \"Role\",\n"
-"           mon$state AS \"State\",\n"
-"           mon$server_pid AS \"Server PID\",\n"
-"           COALESCE(mon$remote_pid, '-') AS \"Client PID\",\n"
-"           TRIM(rdb$character_set_name) AS \"Client encoding\"\n"
-"      FROM mon$attachments\n"
-"INNER JOIN rdb$character_sets\n"
-"        ON mon$character_set_id = rdb$character_set_id";
+	FQclear(res);
 
-	commandExecPrint(query, &pqopt);
-}
+	printf("%li compiled statement(s): %li in use by %li statement handle(s), %li cached but unused\n",
+		   ncompiled, in_use, handles, ncompiled - in_use);
+	printf("Memory used: %.1f KB (%.1f KB by unused cached statements)", memory / 1024, unused_memory / 1024);
+
+	if (nattachments > 1)
+		printf(" across %li attachments", nattachments);
+
+	if (limit >= 0)
+		printf("; MaxStatementCacheSize: %.1f KB per attachment\n", limit / 1024);
+	else
+		puts("; MaxStatementCacheSize not available");
 
+	if (limit > 0 && unused_memory >= PLANCACHE_FULL_RATIO * limit * nattachments)
+	{
+		if (nattachments > 1)
+			puts("The statement cache of at least one attachment is near its limit; statements are\n"
+				 "likely being evicted and recompiled");
+		else
+			puts("The statement cache is near its limit; statements are likely being evicted and recompiled");
+	}
+	else if (in_use > 0 && handles > in_use)
+		printf("On average each compiled statement is shared by %.1f statement handles\n",
+			   (double)handles / in_use);
+}
 
 /**
  * showCopyright()
@@ -766,6 +2226,29 @@ showUsage(void)
 	printf("General\n");
 	printf("  \\copyright             Show fbsql copyright information\n");
 	printf("  \\g or ;                execute query\n");
+	printf("  \\gexec [batch N] [workers N]\n");
+	printf("                         execute query, then execute each value of its result as\n");
+	printf("                           a statement, committing every N statements in autocommit\n");
+	printf("                           mode, optionally in parallel on N connections\n");
+	printf("  \\fanout FILE [order by COL [asc|desc]] [limit N] [merge sum|min|max] [workers N] QUERY\n");
+	printf("                         execute QUERY concurrently on each database listed in FILE,\n");
+	printf("                           displaying the combined rows with their database, or\n");
+	printf("                           with \"merge\", aggregating numeric columns across databases\n");
+	printf("  \\checksum TABLE [DSN] [chunk N] [workers N]\n");
+	printf("                         compare TABLE with the same table in DSN using checksums of\n");
+	printf("                           primary key ranges of N (default: %i) rows, listing the\n",
+		   CHECKSUM_DEFAULT_CHUNK_ROWS);
+	printf("                           differing rows; without DSN, show the chunk checksums\n");
+	printf("  \\copy_table SRC to DSN [as DST] [batch N] [workers N] [disable_indexes] [where CONDITION]\n");
+	printf("                         copy the rows of SRC (matching CONDITION) into DST (default:\n");
+	printf("                           SRC) in DSN, committing every N (default: %i) rows, on\n",
+		   COPY_TABLE_DEFAULT_BATCH);
+	printf("                           N connections, optionally rebuilding indexes afterwards\n");
+	printf("  \\parallel [N] ... \\endparallel\n");
+	printf("                         execute the statements between \\parallel and \\endparallel\n");
+	printf("                           in parallel on N (default: %i) connections, reporting\n",
+		   PARALLEL_DEFAULT_WORKERS);
+	printf("                           any errors at the end\n");
 	printf("  \\q                     quit fbsql\n");
 	printf("\n");
 
@@ -786,26 +2269,71 @@ showUsage(void)
            fset.time_zone_names ? "on" : "off");
 	printf("\n");
 
+	printf("Variables\n");
+	printf("  \\set [NAME [VALUE]]    Set variable, or list all variables if no parameters\n");
+	printf("  \\unset NAME            Unset (delete) variable\n");
+	printf("                         Reference variables in SQL as :NAME, :'NAME' (literal) or\n");
+	printf("                           :\"NAME\" (identifier); with \"\\set bind_variables on\",\n");
+	printf("                           :NAME and :'NAME' are passed as bound parameters\n");
+	printf("                         \"\\set retry_on_conflict N\" retries statements failing\n");
+	printf("                           with a lock conflict or deadlock up to N times\n");
+	printf("                           (in autocommit mode only)\n");
+	printf("\n");
+
 	printf("Environment\n");
 	printf("  \\activity              Show information about current database activity\n");
 	printf("  \\conninfo              Show information about the current connection\n");
+	printf("  \\listen NAME [NAME ...] [do QUERY]\n");
+	printf("                         Wait for events posted with POST_EVENT until CTRL-C is\n");
+	printf("                           pressed, optionally executing QUERY on each event\n");
+	printf("  \\plancache             Show the compiled statement cache (Firebird 5.0 and later)\n");
+	printf("  \\txgap [watch [SECS]] [threshold N]\n");
+	printf("                         Show transaction marker gaps and the oldest active\n");
+	printf("                           transactions, optionally every SECS (default: %i) seconds\n",
+		   TXGAP_WATCH_INTERVAL);
+	printf("\n");
+
+	printf("Analysis\n");
+	printf("  \\analyze_workload FILE [MIN_ROWS]\n");
+	printf("                         Report statements in FILE which perform natural scans\n");
+	printf("                           on tables with at least MIN_ROWS (default: %i) rows\n",
+		   WORKLOAD_LARGE_TABLE_ROWS);
+	printf("  \\querystats [OPTION]    Show statistics per query fingerprint for this session, or\n");
+	printf("                           {on|off|reset|replay FILE} (collection currently %s)\n",
+		   fset.query_stats ? "on" : "off");
+	printf("  \\replay-stats DIR [FROM..TO|TIME]\n");
+	printf("                         Show monitoring snapshots recorded with --record\n");
+	printf("  \\planhistory [SETTING]  Record plans and warn when they change {off|on|reset}\n");
+	printf("                           (currently %s)\n",
+		   fset.plan_history ? "on" : "off");
 	printf("\n");
 
 	printf("Database\n");
 	printf("  (options: S = show system objects, + = additional detail)\n");
 	printf("  \\l                     List information about the current database\n");
-	printf("  \\autocommit            Toggle autocommit (currently %s)\n",
-           fset.autocommit ? "on" : "off");
+	printf("  \\cachestats [SECS]      Sample page cache hit ratio and write rate over SECS (default: %i) seconds\n",
+		   CACHESTATS_INTERVAL);
+	printf("  \\autocommit [on|off|batch N [MS]]\n");
+	printf("                         Toggle or set autocommit (currently %s); in batch mode,\n",
+		   fset.autocommit == false ? "off" : fset.autocommit_batch > 0 ? "batch" : "on");
+	printf("                           commit every N statements or MS (default: %i) milliseconds\n",
+		   AUTOCOMMIT_BATCH_DEFAULT_MS);
+	printf("  \\txmode [read only|read write] [read committed [read consistency|record_version]\n");
+	printf("          |snapshot [table stability]] [wait [N]|nowait] | default\n");
+	printf("                         Set the parameters of each transaction started (currently:\n");
+	printf("                           %s)\n",
+		   fset.txmode != NULL ? fset.txmode : "default");
 	printf("  \\d      NAME           List information about the specified object\n");
 	printf("  \\df     [PATTERN]      List information about functions matching [PATTERN]\n");
 	printf("  \\di[S+] [PATTERN]      List information about indexes matching [PATTERN]\n");
 	printf("  \\dp     [PATTERN]      List information about procedures matching [PATTERN]\n");
 	printf("  \\ds[S]  [PATTERN]      List information about sequences (generators) matching [PATTERN]\n");
-	printf("  \\dt[S]  [PATTERN]      List information about tables matching [PATTERN]\n");
+	printf("  \\dt[S+] [PATTERN]      List information about tables matching [PATTERN]\n");
+	printf("                           (\\dt++: include database statistics; reads all data pages)\n");
 	printf("  \\du                    List users granted privileges on this database\n");
 	printf("  \\dv     [PATTERN]      List information about views matching [PATTERN]\n");
 	printf("  \\util   [COMMAND]      execute utility command\n");
-	printf("                            {set_index_statistics}\n");
+	printf("                            {gstat|rebuild_indexes|set_index_statistics|sweep}\n");
 }
 
 
@@ -815,7 +2343,12 @@ void showUtilOptions(void)
 	puts("");
 	printf("Options for \\util:\n");
 	puts("");
-	printf("  \\util set_index_statistics		 Set global index statistics\n");
+	printf("  \\util set_index_statistics [PATTERN] [stale] [system] [workers N]\n");
+	printf("                                 Recompute index statistics, optionally only for\n");
+	printf("                                 tables matching PATTERN or where stale\n");
+	printf("  \\util rebuild_indexes [PATTERN] [workers N]\n");
+	printf("                                 Rebuild indexes by deactivating and reactivating them\n");
+	printf("  \\util sweep [workers N]          Sweep the database via the Services API\n");
 	puts("");
 }
 
@@ -836,7 +2369,7 @@ describeObject(char *pattern)
 						 "   FROM rdb$relations \n"
 						 "  WHERE rdb$view_blr IS NULL \n");
 
-	_wildcard_pattern_clause(pattern, "rdb$relation_name", &buf);
+	wildcardPatternClause(pattern, "rdb$relation_name", &buf);
 
 	appendFQExpBufferStr(&buf,
 						 "     UNION \n"
@@ -844,7 +2377,7 @@ describeObject(char *pattern)
 						 "   FROM rdb$relations \n"
 						 "  WHERE rdb$view_blr IS NOT NULL \n");
 
-	_wildcard_pattern_clause(pattern, "rdb$relation_name", &buf);
+	wildcardPatternClause(pattern, "rdb$relation_name", &buf);
 
 	appendFQExpBufferStr(&buf,
 						 "     UNION \n"
@@ -852,7 +2385,7 @@ describeObject(char *pattern)
 						 "   FROM rdb$indices \n"
 						 "  WHERE 1 = 1\n");
 
-	_wildcard_pattern_clause(pattern, "rdb$index_name", &buf);
+	wildcardPatternClause(pattern, "rdb$index_name", &buf);
 
 	query_result = commandExec(buf.data);
 
@@ -1307,48 +2840,326 @@ listDatabaseInfo(void)
 }
 
 
-/* \util [command] */
-static bool
-execUtil(char *command)
+/**
+ * showCacheStats()
+ *
+ * \cachestats [SECS]
+ *
+ * Sample MON$IO_STATS at database and attachment level once a second
+ * over SECS (default: CACHESTATS_INTERVAL) seconds, and report page
+ * fetches, reads and writes, the page cache hit ratio (the proportion of
+ * fetches not requiring a read) and the write rate.
+ *
+ * The current page buffers are displayed together with a suggestion
+ * as to whether more buffers would help, based on the hit ratio and
+ * whether reads per fetch are falling (cache warming up) or steady
+ * across the sampling interval.
+ *
+ * Returns FBSQL_CMD_ERROR if the interval is invalid, and
+ * FBSQL_CMD_FAILED if MON$IO_STATS could not be read.
+ */
+static backslashResult
+showCacheStats(FbsqlScanState scan_state)
 {
-	if (strncmp(command, "set_index_statistics", 20) == 0)
-		return _execUtilSetIndexStatistics();
+	char	   *opt;
+	long		interval = CACHESTATS_INTERVAL;
+	long		page_buffers, page_size, pages;
+	cacheStatsSample start, prev, current;
+	cacheStatsSample first_half = {0, 0, 0, 0}, second_half = {0, 0, 0, 0};
+	FBresult   *start_res, *end_res;
+	fbsqlTable	table;
+	printQueryOpt pqopt = fset.popt;
+	const char *attachment_query;
+	long		elapsed;
+	double		hit_ratio;
+	int			i, j;
 
-	printf("Unknown \\util option \"%s\"\n",
-		   command);
+	static const char *const headers[] =
+		{"Level", "Attachment", "User", "Application", "Fetches", "Reads",
+		 "Writes", "Marks", "Hit ratio", "Writes/s"};
+
+	opt = fbsql_scan_slash_option(scan_state,
+								  OT_NORMAL, NULL, false);
+
+	if (opt != NULL)
+	{
+		interval = atol(opt);
+
+		if (interval < 1)
+		{
+			fbsql_error("\\cachestats: interval must be a positive number of seconds\n");
+			free(opt);
+			return FBSQL_CMD_ERROR;
+		}
+
+		free(opt);
+	}
+
+	attachment_query =
+"    SELECT a.mon$attachment_id, \n"
+"           TRIM(a.mon$user), \n"
+"           COALESCE(a.mon$remote_process, '-'), \n"
+"           io.mon$page_fetches, io.mon$page_reads, \n"
+"           io.mon$page_writes, io.mon$page_marks \n"
+"      FROM mon$attachments a \n"
+"INNER JOIN mon$io_stats io \n"
+"        ON io.mon$stat_id = a.mon$stat_id \n"
+"  ORDER BY 1";
+
+	if (_sampleDatabaseIO(&start, &page_buffers, &page_size, &pages) == false)
+		return FBSQL_CMD_FAILED;
+
+	start_res = FQexecTransaction(fset.conn, attachment_query);
+
+	printf("Page buffers: %li (%.1f MB with %li byte pages); database size: %li pages\n",
+		   page_buffers,
+		   (double)page_buffers * page_size / (1024 * 1024),
+		   page_size,
+		   pages);
+	printf("Sampling page I/O for %li s; press CTRL-C to stop early\n", interval);
+	fflush(stdout);
+
+	prev = start;
+	cancel_pressed = false;
+
+	for (elapsed = 0; elapsed < interval && cancel_pressed == false; elapsed++)
+	{
+		cacheStatsSample *half = elapsed < interval / 2 ? &first_half : &second_half;
+
+		sleep(1);
+
+		if (_sampleDatabaseIO(&current, &page_buffers, &page_size, &pages) == false)
+		{
+			FQclear(start_res);
+			return FBSQL_CMD_FAILED;
+		}
+
+		half->fetches += current.fetches - prev.fetches;
+		half->reads += current.reads - prev.reads;
+
+		prev = current;
+	}
+
+	if (elapsed == 0)
+	{
+		FQclear(start_res);
+		return FBSQL_CMD_SKIP_LINE;
+	}
+
+	end_res = FQexecTransaction(fset.conn, attachment_query);
+
+	initTable(&table, lengthof(headers), headers);
+
+	for (i = 4; i < lengthof(headers); i++)
+		table.right_align[i] = true;
+
+	/* database level */
+	{
+		const char *values[10];
+		char		cells[10][32];
+
+		current.fetches -= start.fetches;
+		current.reads -= start.reads;
+		current.writes -= start.writes;
+		current.marks -= start.marks;
+
+		snprintf(cells[4], sizeof(cells[4]), "%li", current.fetches);
+		snprintf(cells[5], sizeof(cells[5]), "%li", current.reads);
+		snprintf(cells[6], sizeof(cells[6]), "%li", current.writes);
+		snprintf(cells[7], sizeof(cells[7]), "%li", current.marks);
+		snprintf(cells[9], sizeof(cells[9]), "%.1f", (double)current.writes / elapsed);
+
+		values[0] = "database";
+		values[1] = NULL;
+		values[2] = NULL;
+		values[3] = NULL;
+		values[4] = cells[4];
+		values[5] = cells[5];
+		values[6] = cells[6];
+		values[7] = cells[7];
+
+		if (current.fetches > 0)
+		{
+			snprintf(cells[8], sizeof(cells[8]), "%.2f%%",
+					 100.0 * (1.0 - (double)current.reads / current.fetches));
+			values[8] = cells[8];
+		}
+		else
+			values[8] = NULL;
+
+		values[9] = cells[9];
+
+		addTableRow(&table, values);
+	}
+
+	/* attachments active during the whole interval, with some page activity */
+	for (i = 0;
+		 FQresultStatus(end_res) == FBRES_TUPLES_OK && i < FQntuples(end_res);
+		 i++)
+	{
+		for (j = 0;
+			 FQresultStatus(start_res) == FBRES_TUPLES_OK && j < FQntuples(start_res);
+			 j++)
+		{
+			const char *values[10];
+			char		cells[10][32];
+			long		fetches, reads, writes, marks;
+
+			if (strcmp(FQgetvalue(start_res, j, 0), FQgetvalue(end_res, i, 0)) != 0)
+				continue;
+
+			fetches = atol(FQgetvalue(end_res, i, 3)) - atol(FQgetvalue(start_res, j, 3));
+			reads = atol(FQgetvalue(end_res, i, 4)) - atol(FQgetvalue(start_res, j, 4));
+			writes = atol(FQgetvalue(end_res, i, 5)) - atol(FQgetvalue(start_res, j, 5));
+			marks = atol(FQgetvalue(end_res, i, 6)) - atol(FQgetvalue(start_res, j, 6));
+
+			if (fetches == 0 && writes == 0)
+				break;
+
+			snprintf(cells[4], sizeof(cells[4]), "%li", fetches);
+			snprintf(cells[5], sizeof(cells[5]), "%li", reads);
+			snprintf(cells[6], sizeof(cells[6]), "%li", writes);
+			snprintf(cells[7], sizeof(cells[7]), "%li", marks);
+			snprintf(cells[9], sizeof(cells[9]), "%.1f", (double)writes / elapsed);
+
+			values[0] = "attachment";
+			values[1] = FQgetvalue(end_res, i, 0);
+			values[2] = FQgetvalue(end_res, i, 1);
+			values[3] = FQgetvalue(end_res, i, 2);
+			values[4] = cells[4];
+			values[5] = cells[5];
+			values[6] = cells[6];
+			values[7] = cells[7];
+
+			if (fetches > 0)
+			{
+				snprintf(cells[8], sizeof(cells[8]), "%.2f%%",
+						 100.0 * (1.0 - (double)reads / fetches));
+				values[8] = cells[8];
+			}
+			else
+				values[8] = NULL;
+
+			values[9] = cells[9];
+
+			addTableRow(&table, values);
+			break;
+		}
+	}
+
+	pqopt.header = "Page cache statistics";
+	printTable(&table, &pqopt);
+	puts("");
+
+	termTable(&table);
+	FQclear(start_res);
+	FQclear(end_res);
+
+	printf("Sampled for %li s\n", elapsed);
+
+	if (current.fetches == 0)
+	{
+		puts("No page fetches during the sampling interval; run \\cachestats while the workload is active");
+		return FBSQL_CMD_SKIP_LINE;
+	}
+
+	hit_ratio = 1.0 - (double)current.reads / current.fetches;
+
+	if (first_half.fetches > 0 && second_half.fetches > 0)
+		printf("Reads per 1000 fetches: %.2f (first half), %.2f (second half)\n",
+			   1000.0 * first_half.reads / first_half.fetches,
+			   1000.0 * second_half.reads / second_half.fetches);
+
+	if (pages <= page_buffers)
+	{
+		printf("The whole database (%li pages) fits in the page cache; more buffers will not help\n",
+			   pages);
+	}
+	else if (hit_ratio >= CACHESTATS_GOOD_HIT_RATIO)
+	{
+		puts("The hit ratio is good; more buffers are unlikely to help");
+	}
+	else if (first_half.fetches > 0 && second_half.fetches > 0
+			 && (double)second_half.reads / second_half.fetches
+			 < 0.8 * ((double)first_half.reads / first_half.fetches))
+	{
+		puts("Reads per fetch are falling, so the cache may still be warming up; sample again later");
+	}
+	else
+	{
+		printf("Reads per fetch are steady with a hit ratio of %.2f%%; more page buffers may help\n",
+			   100.0 * hit_ratio);
+		puts("  (set with \"gfix -buffers\" or DefaultDbCachePages in firebird.conf)");
+	}
 
-	return false;
+	return FBSQL_CMD_SKIP_LINE;
 }
 
 
-/* \util set_index_statistics */
+/**
+ * _sampleDatabaseIO()
+ *
+ * Retrieve the database-level page I/O counters, together with the page
+ * cache configuration, in a separate transaction so the values are
+ * current.
+ */
 static bool
-_execUtilSetIndexStatistics(void)
+_sampleDatabaseIO(cacheStatsSample *sample, long *page_buffers, long *page_size, long *pages)
 {
-	FBresult *res;
-	char *query = \
-"EXECUTE BLOCK AS \n"
-"  DECLARE VARIABLE index_name VARCHAR(31); \n"
-"BEGIN \n"
-"  FOR SELECT rdb$index_name FROM rdb$indices INTO :index_name DO \n"
-"    EXECUTE STATEMENT 'SET statistics INDEX ' || :index_name || ';'; \n"
-"END \n";
-
-	res = FQexec(fset.conn, query);
-	if (FQresultStatus(res) != FBRES_COMMAND_OK)
+	FBresult   *res;
+
+	res = FQexecTransaction(fset.conn,
+"    SELECT d.mon$page_buffers, d.mon$page_size, d.mon$pages, \n"
+"           io.mon$page_fetches, io.mon$page_reads, \n"
+"           io.mon$page_writes, io.mon$page_marks \n"
+"      FROM mon$database d \n"
+"INNER JOIN mon$io_stats io \n"
+"        ON io.mon$stat_id = d.mon$stat_id");
+
+	if (FQresultStatus(res) != FBRES_TUPLES_OK || FQntuples(res) == 0)
 	{
+		fbsql_error("\\cachestats: unable to read I/O statistics\n%s",
+					FQresultErrorMessage(res));
 		FQclear(res);
-		fbsql_error("error updating index statistics\n");
 		return false;
 	}
 
-	FQclear(res);
+	*page_buffers = atol(FQgetvalue(res, 0, 0));
+	*page_size = atol(FQgetvalue(res, 0, 1));
+	*pages = atol(FQgetvalue(res, 0, 2));
 
-	puts("Index statistics updated");
+	sample->fetches = atol(FQgetvalue(res, 0, 3));
+	sample->reads = atol(FQgetvalue(res, 0, 4));
+	sample->writes = atol(FQgetvalue(res, 0, 5));
+	sample->marks = atol(FQgetvalue(res, 0, 6));
+
+	FQclear(res);
 
 	return true;
 }
 
+/* \util [command] */
+static backslashResult
+execUtil(char *command, FbsqlScanState scan_state)
+{
+	if (strncmp(command, "set_index_statistics", 20) == 0)
+		return utilSetIndexStatistics(scan_state);
+
+	if (strncmp(command, "rebuild_indexes", 15) == 0)
+		return utilRebuildIndexes(scan_state);
+
+	if (strncmp(command, "sweep", 5) == 0)
+		return utilSweep(scan_state);
+
+	if (strncmp(command, "gstat", 5) == 0)
+		return utilGstat(scan_state);
+
+	printf("Unknown \\util option \"%s\"\n",
+		   command);
+
+	return FBSQL_CMD_ERROR;
+}
+
 
 /* \df */
 static void
@@ -1370,7 +3181,7 @@ listFunctions(char *pattern)
 
 	if (pattern != NULL)
 	{
-		_wildcard_pattern_clause(pattern, "rdb$function_name", &buf);
+		wildcardPatternClause(pattern, "rdb$function_name", &buf);
 	}
 
 	appendFQExpBuffer(&buf,
@@ -1411,7 +3222,7 @@ listIndexes(char *pattern, bool show_system, bool show_extended)
 		);
 
 	if (pattern != NULL)
-		_wildcard_pattern_clause(pattern, "rdb$index_name", &buf);
+		wildcardPatternClause(pattern, "rdb$index_name", &buf);
 	else if (show_system == false)
 		appendFQExpBuffer(&buf,
 "      AND rdb$system_flag = 0 \n"
@@ -1452,7 +3263,7 @@ listProcedures(char *pattern)
 		);
 
 	if (pattern != NULL)
-		_wildcard_pattern_clause(pattern, "rdb$procedure_name", &buf);
+		wildcardPatternClause(pattern, "rdb$procedure_name", &buf);
 
 	appendFQExpBuffer(&buf,
 "  ORDER BY 1"
@@ -1483,7 +3294,7 @@ listSequences(char *pattern, bool show_system)
 		);
 
 	if (pattern != NULL)
-		_wildcard_pattern_clause(pattern, "rdb$generator_name", &buf);
+		wildcardPatternClause(pattern, "rdb$generator_name", &buf);
 	else if (show_system == false)
 		appendFQExpBuffer(&buf,
 "      AND rdb$system_flag = 0\n"
@@ -1501,11 +3312,17 @@ listSequences(char *pattern, bool show_system)
 
 /* \dt */
 static void
-listTables(char *pattern, bool show_system)
+listTables(char *pattern, bool show_system, bool show_extended, bool show_stats)
 {
 	FQExpBufferData buf;
 	printQueryOpt pqopt = fset.popt;
 
+	if (show_extended == true)
+	{
+		_listTablesExtended(pattern, show_system, show_stats);
+		return;
+	}
+
 	pqopt.header = "List of tables";
 	initFQExpBuffer(&buf);
 
@@ -1519,7 +3336,7 @@ listTables(char *pattern, bool show_system)
 
 
 	if (pattern != NULL)
-		_wildcard_pattern_clause(pattern, "rdb$relation_name", &buf);
+		wildcardPatternClause(pattern, "rdb$relation_name", &buf);
 	else if (show_system == false)
 		appendFQExpBuffer(&buf,
 "      AND rdb$system_flag = 0\n"
@@ -1535,6 +3352,217 @@ listTables(char *pattern, bool show_system)
 }
 
 
+/**
+ * _listTablesExtended()
+ *
+ * \dt+, \dt++
+ *
+ * In addition to the basic table information, display the estimated row
+ * count, pointer pages and (Firebird 4.0 and later) back-version reads
+ * since the database was opened; these come from the selectivity of a
+ * unique index, RDB$PAGES and MON$RECORD_STATS respectively, so are
+ * cheap to retrieve.
+ *
+ * With \dt++, also display the record count, data pages, average page
+ * fill, record versions and longest back-version chain for each table,
+ * to help identify tables where garbage is accumulating. These are taken
+ * from the Services API database statistics (as per "gstat -d -r"),
+ * which read every data page of the tables in question, so may take
+ * some time on a large database.
+ */
+static void
+_listTablesExtended(char *pattern, bool show_system, bool show_stats)
+{
+	FQExpBufferData buf;
+	printQueryOpt pqopt = fset.popt;
+	FBresult   *query_result;
+	gstatData  *stats = NULL;
+	const char *stats_table = NULL;
+	fbsqlTable	table;
+	int			i;
+
+	static const char *const headers[] =
+		{"Name", "Owner", "Rows", "Pointer pages", "Data pages", "Avg fill",
+		 "Versions", "Max chain", "Back-version reads", "Description"};
+
+	/* without database statistics, the data page and record version columns are omitted */
+	static const char *const basic_headers[] =
+		{"Name", "Owner", "Rows", "Pointer pages", "Back-version reads", "Description"};
+
+	initFQExpBuffer(&buf);
+
+	appendFQExpBuffer(&buf,
+"   SELECT TRIM(r.rdb$relation_name), \n"
+"          TRIM(LOWER(r.rdb$owner_name)), \n"
+"          COALESCE(CAST(r.rdb$description AS VARCHAR(80)), ''), \n"
+"          (SELECT CAST(1 / MIN(i.rdb$statistics) AS BIGINT) \n"
+"             FROM rdb$indices i \n"
+"            WHERE i.rdb$relation_name = r.rdb$relation_name \n"
+"              AND i.rdb$unique_flag = 1 \n"
+"              AND i.rdb$statistics > 0), \n"
+"          (SELECT COUNT(*) \n"
+"             FROM rdb$pages p \n"
+"            WHERE p.rdb$relation_id = r.rdb$relation_id \n"
+"              AND p.rdb$page_type = 4), \n"
+		);
+
+	if (FQserverVersion(fset.conn) >= 40000)
+		appendFQExpBuffer(&buf,
+"          (SELECT rs.mon$backversion_reads \n"
+"             FROM mon$table_stats ts \n"
+"       INNER JOIN mon$record_stats rs \n"
+"               ON rs.mon$stat_id = ts.mon$record_stat_id \n"
+"            WHERE ts.mon$stat_group = 0 \n"
+"              AND ts.mon$table_name = r.rdb$relation_name) \n"
+			);
+	else
+		appendFQExpBuffer(&buf,
+"          CAST(NULL AS BIGINT) \n"
+			);
+
+	appendFQExpBuffer(&buf,
+"     FROM rdb$relations r \n"
+"    WHERE r.rdb$view_blr IS NULL \n"
+		);
+
+	if (pattern != NULL)
+		wildcardPatternClause(pattern, "r.rdb$relation_name", &buf);
+	else if (show_system == false)
+		appendFQExpBuffer(&buf,
+"      AND r.rdb$system_flag = 0\n"
+			);
+
+	appendFQExpBuffer(&buf,
+"    ORDER BY 1"
+		);
+
+	query_result = commandExec(buf.data);
+	termFQExpBuffer(&buf);
+
+	if (FQresultStatus(query_result) != FBRES_TUPLES_OK)
+	{
+		fbsql_error("%s", FQresultErrorMessage(query_result));
+		FQclear(query_result);
+		return;
+	}
+
+	if (FQntuples(query_result) == 0)
+	{
+		puts("No items found");
+		FQclear(query_result);
+		return;
+	}
+
+	if (show_stats == true)
+	{
+		/* restrict the statistics to the table in question, if only one was requested */
+		if (pattern != NULL && strchr(pattern, '*') == NULL && FQntuples(query_result) == 1)
+			stats_table = FQgetvalue(query_result, 0, 0);
+
+		stats = serviceDatabaseStats(stats_table, false, show_system || pattern != NULL, false);
+
+		initTable(&table, lengthof(headers), headers);
+
+		for (i = 2; i < 9; i++)
+			table.right_align[i] = true;
+	}
+	else
+	{
+		initTable(&table, lengthof(basic_headers), basic_headers);
+
+		for (i = 2; i < 5; i++)
+			table.right_align[i] = true;
+	}
+
+	for (i = 0; i < FQntuples(query_result); i++)
+	{
+		const char *values[10];
+		char	   *name = FQgetvalue(query_result, i, 0);
+		char	   *lower_name;
+		char		rows[32], data_pages[32], avg_fill[32], versions[32], max_chain[32];
+		gstatTable *table_stats = findDatabaseStatsTable(stats, name);
+		int			j;
+
+		lower_name = (char *)fb_malloc0(strlen(name) + 1);
+		for (j = 0; name[j] != '\0'; j++)
+			lower_name[j] = tolower((unsigned char)name[j]);
+
+		values[0] = lower_name;
+		values[1] = FQgetvalue(query_result, i, 1);
+		values[2] = NULL;
+		values[3] = FQgetisnull(query_result, i, 4) ? NULL : FQgetvalue(query_result, i, 4);
+		values[4] = NULL;
+		values[5] = NULL;
+		values[6] = NULL;
+		values[7] = NULL;
+		values[8] = FQgetisnull(query_result, i, 5) ? NULL : FQgetvalue(query_result, i, 5);
+		values[9] = FQgetvalue(query_result, i, 2);
+
+		if (table_stats != NULL)
+		{
+			if (table_stats->records >= 0)
+			{
+				snprintf(rows, sizeof(rows), "%li", table_stats->records);
+				values[2] = rows;
+			}
+
+			if (table_stats->data_pages >= 0)
+			{
+				snprintf(data_pages, sizeof(data_pages), "%li", table_stats->data_pages);
+				values[4] = data_pages;
+			}
+
+			if (table_stats->avg_fill >= 0)
+			{
+				snprintf(avg_fill, sizeof(avg_fill), "%i%%", table_stats->avg_fill);
+				values[5] = avg_fill;
+			}
+
+			if (table_stats->versions >= 0)
+			{
+				snprintf(versions, sizeof(versions), "%li", table_stats->versions);
+				values[6] = versions;
+			}
+
+			if (table_stats->max_versions >= 0)
+			{
+				snprintf(max_chain, sizeof(max_chain), "%li", table_stats->max_versions);
+				values[7] = max_chain;
+			}
+		}
+		else if (!FQgetisnull(query_result, i, 3))
+		{
+			snprintf(rows, sizeof(rows), "~%s", FQgetvalue(query_result, i, 3));
+			values[2] = rows;
+		}
+
+		if (show_stats == false)
+		{
+			values[4] = values[8];
+			values[5] = values[9];
+		}
+
+		addTableRow(&table, values);
+
+		free(lower_name);
+	}
+
+	pqopt.header = "List of tables";
+	printTable(&table, &pqopt);
+	puts("");
+
+	if (show_stats == false)
+		puts("Note: row counts (~) are estimated from unique index selectivity; use \\dt++\n"
+			 "      for database statistics (reads all data pages of the listed tables)");
+	else if (stats == NULL)
+		puts("Note: database statistics not available via the Services API; row counts (~)\n"
+			 "      are estimated from unique index selectivity");
+
+	termTable(&table);
+	freeDatabaseStats(stats);
+	FQclear(query_result);
+}
+
 /* \du */
 static void
 listUsers(void)
@@ -1587,7 +3615,7 @@ listViews(char *pattern)
 		);
 
 	if (pattern != NULL)
-		_wildcard_pattern_clause(pattern, "rdb$relation_name", &buf);
+		wildcardPatternClause(pattern, "rdb$relation_name", &buf);
 
 	appendFQExpBuffer(&buf,
 					  " ORDER BY 1"
@@ -4,6 +4,16 @@
 #include "settings.h"
 #include "fbsqlscan.h"
 
+#define TXGAP_WATCH_INTERVAL 5
+
+/* \cachestats sampling interval, and hit ratio above which the cache is sufficient */
+#define CACHESTATS_INTERVAL 10
+#define CACHESTATS_GOOD_HIT_RATIO 0.99
+
+/* \plancache display width of statement text and plans, and "cache full" ratio */
+#define PLANCACHE_TEXT_LEN 60
+#define PLANCACHE_FULL_RATIO 0.9
+
 typedef enum _backslashResult
 {
 	FBSQL_CMD_UNKNOWN = 0,	  /* internal only status implying parsing incomplete */
@@ -11,10 +21,16 @@ typedef enum _backslashResult
 	FBSQL_CMD_SKIP_LINE,	  /* keep building query */
 	FBSQL_CMD_TERMINATE,	  /* quit program */
 	FBSQL_CMD_NEWEDIT,		  /* query buffer was changed (e.g., via \e) */
-	FBSQL_CMD_ERROR			  /* the execution of the backslash command
+	FBSQL_CMD_ERROR,		  /* the execution of the backslash command
 							   * resulted in an error */
+	FBSQL_CMD_FAILED		  /* the command was valid but failed; the
+							   * error has already been reported */
 } backslashResult;
 
+extern FBresult *commandExec(const char *query);
+
+extern void wildcardPatternClause(char *pattern, char *field, FQExpBufferData *buf);
+
 extern backslashResult HandleSlashCmds(FbsqlScanState scan_state,
 									   FQExpBuffer query_buf);
 
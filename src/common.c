@@ -16,8 +16,11 @@
 #include <unistd.h>
 #include <pwd.h>
 
+#include "libfq.h"
+
 #include "fbsql.h"
 #include "common.h"
+#include "query.h"
 #include "settings.h"
 
 volatile bool sigint_interrupt_enabled = false;
@@ -71,7 +74,7 @@ handle_signals(int signo)
 	}
 
 	/* else, set cancel flag to stop any long-running loops */
-	//cancel_pressed = true;
+	cancel_pressed = true;
 
 }
 
@@ -102,6 +105,185 @@ get_home_path()
 }
 
 
+/**
+ * fbsql_connect()
+ *
+ * Open a connection to the specified database using the current
+ * session's credentials and settings. Used both for the main
+ * connection and for any additional connections opened by
+ * fbsql itself (e.g. for parallel operations).
+ *
+ * If parallel workers were requested, these are set for the connection
+ * (Firebird 5.0 and later).
+ *
+ * The caller must check the connection status.
+ */
+FBconn *
+fbsql_connect(const char *dbpath)
+{
+	const char *kw[FBCONN_MAX_PARAMS + 1];
+	const char *val[FBCONN_MAX_PARAMS + 1];
+	int i = 0;
+	FBconn *conn;
+
+	kw[i] = "db_path";
+	val[i] = dbpath;
+	i++;
+
+	kw[i] = "user";
+	val[i] = fset.username;
+	i++;
+
+	kw[i] = "password";
+	val[i] = fset.password;
+	i++;
+
+	kw[i] = "client_encoding";
+	val[i] = fset.client_encoding;
+	i++;
+
+	kw[i] = "client_min_messages";
+	val[i] = "INFO";
+	i++;
+
+	kw[i] = "time_zone_names";
+	val[i] = fset.time_zone_names ? "true" : "false";
+	i++;
+
+	kw[i] = "isql_values";
+	val[i] = "false";
+	i++;
+
+	kw[i] = NULL;
+	val[i] = NULL;
+
+	conn = FQconnectdbParams(kw, val);
+
+	/*
+	 * libfq does not provide a connection parameter for the DPB's parallel
+	 * workers setting, so set the equivalent session value instead.
+	 */
+	if (FQstatus(conn) != CONNECTION_BAD
+	 && fset.parallel_workers > 0
+	 && FQserverVersion(conn) >= 50000)
+	{
+		FQExpBufferData buf;
+		FBresult   *res;
+
+		initFQExpBuffer(&buf);
+		appendFQExpBuffer(&buf, "SET PARALLEL WORKERS %i", fset.parallel_workers);
+
+		res = FQexec(conn, buf.data);
+
+		if (FQresultStatus(res) != FBRES_COMMAND_OK)
+			fbsql_error("unable to set parallel workers:\n%s\n", FQresultErrorMessage(res));
+
+		FQclear(res);
+		termFQExpBuffer(&buf);
+	}
+
+	return conn;
+}
+
+
+/**
+ * appendSQLIdentifier()
+ *
+ * Append a double-quoted SQL identifier to the buffer.
+ */
+void
+appendSQLIdentifier(FQExpBuffer buf, const char *ident)
+{
+	const char *p;
+
+	appendFQExpBufferChar(buf, '"');
+
+	for (p = ident; *p; p++)
+	{
+		if (*p == '"')
+			appendFQExpBufferChar(buf, '"');
+		appendFQExpBufferChar(buf, *p);
+	}
+
+	appendFQExpBufferChar(buf, '"');
+}
+
+
+/**
+ * appendSQLLiteral()
+ *
+ * Append a single-quoted SQL string literal to the buffer.
+ */
+void
+appendSQLLiteral(FQExpBuffer buf, const char *str)
+{
+	const char *p;
+
+	appendFQExpBufferChar(buf, '\'');
+
+	for (p = str; *p; p++)
+	{
+		if (*p == '\'')
+			appendFQExpBufferChar(buf, '\'');
+		appendFQExpBufferChar(buf, *p);
+	}
+
+	appendFQExpBufferChar(buf, '\'');
+}
+
+
+/**
+ * parseInterval()
+ *
+ * Parse an interval such as "15", "15s", "2m" or "1h" into seconds;
+ * returns -1 if invalid.
+ */
+int
+parseInterval(const char *value)
+{
+	char	   *endptr;
+	long		interval;
+
+	if (value == NULL)
+		return -1;
+
+	interval = strtol(value, &endptr, 10);
+
+	if (endptr == value || interval < 1)
+		return -1;
+
+	if (strcmp(endptr, "m") == 0)
+		interval *= 60;
+	else if (strcmp(endptr, "h") == 0)
+		interval *= 3600;
+	else if (*endptr != '\0' && strcmp(endptr, "s") != 0)
+		return -1;
+
+	return (int)interval;
+}
+
+
+/**
+ * hashString()
+ *
+ * Return the 64-bit FNV-1a hash of "text".
+ */
+unsigned long long
+hashString(const char *text)
+{
+	unsigned long long hash = 14695981039346656037ULL;
+	const char *p;
+
+	for (p = text; *p; p++)
+	{
+		hash ^= (unsigned char) *p;
+		hash *= 1099511628211ULL;
+	}
+
+	return hash;
+}
+
+
 /**
  * fb_malloc0()
  *
@@ -165,9 +347,13 @@ init_settings(void)
 	{
 		fset.fbsql_history = (char *)malloc(strlen(fset.home_path) + 1 + strlen(FBSQL_HISTORY) + 1);
 		sprintf(fset.fbsql_history, "%s/%s", fset.home_path, FBSQL_HISTORY);
+
+		fset.plan_history_file = (char *)malloc(strlen(fset.home_path) + 1 + strlen(FBSQL_PLAN_HISTORY) + 1);
+		sprintf(fset.plan_history_file, "%s/%s", fset.home_path, FBSQL_PLAN_HISTORY);
 	}
 	else
     {
+		fset.plan_history_file = NULL;
 		puts("init_settings(): unable to get home directory");
 	}
 
@@ -176,7 +362,27 @@ init_settings(void)
 	fset.lc_fold = true;
 	fset.echo_hidden = false;
 	fset.autocommit = true;
+	fset.autocommit_batch = 0;
+	fset.autocommit_batch_ms = AUTOCOMMIT_BATCH_DEFAULT_MS;
+	fset.txmode = NULL;
 	fset.plan_display = PLAN_DISPLAY_OFF;
+	fset.plan_history = false;
+	fset.query_stats = false;
+	fset.discard_results = false;
+	fset.parallel_workers = 0;
+	fset.record_dir = NULL;
+	fset.exporter_file = NULL;
+	fset.listen_events = NULL;
+	fset.on_event_query = NULL;
+	fset.daemon_socket = NULL;
+	fset.via_socket = NULL;
+	fset.pool_size = DAEMON_DEFAULT_POOL_SIZE;
+	fset.protocol = false;
+	fset.vars = CreateVariableSpace();
+	fset.bind_variables = false;
+	fset.retry_on_conflict = 0;
+	fset.gexec_flag = false;
+	fset.monitor_interval = MONITOR_DEFAULT_INTERVAL;
 
 	fset.popt.nullPrint = strdup("NULL");
 	fset.popt.header = NULL;
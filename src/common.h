@@ -3,6 +3,7 @@
 #define MAXPATH 1024
 
 #include <setjmp.h>
+#include "libfq.h"
 #include "settings.h"
 
 extern volatile bool sigint_interrupt_enabled;
@@ -15,6 +16,15 @@ extern volatile bool cancel_pressed;
 extern void handle_signals(int signo);
 extern char *get_home_path(void);
 
+extern FBconn *fbsql_connect(const char *dbpath);
+
+extern void appendSQLIdentifier(FQExpBuffer buf, const char *ident);
+extern void appendSQLLiteral(FQExpBuffer buf, const char *str);
+
+extern int parseInterval(const char *value);
+
+extern unsigned long long hashString(const char *text);
+
 extern void *fb_malloc0(size_t size);
 
 extern void fbsql_error(const char *fmt,...);
@@ -0,0 +1,832 @@
+/* ---------------------------------------------------------------------
+ *
+ * copytable.c
+ *
+ * \copy_table: copy a table's rows directly to a table in another
+ * database
+ *
+ * The rows are read from the current database in batches, all within
+ * one read-only snapshot transaction, and are queued for worker threads
+ * each inserting into the destination database on their own
+ * connection; reading the next batch therefore overlaps with inserting
+ * the previous ones.
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "common.h"
+#include "copytable.h"
+#include "parallel.h"
+#include "query.h"
+#include "settings.h"
+
+typedef struct copyBatch
+{
+	FBresult   *rows;
+	struct copyBatch *next;
+} copyBatch;
+
+typedef struct copyRun
+{
+	const char *dsn;
+	char	   *insert_query;
+	int			ncolumns;
+
+	pthread_mutex_t lock;
+	pthread_cond_t batch_added;
+	pthread_cond_t batch_taken;
+	copyBatch  *head;
+	copyBatch  *tail;
+	int			nbatches;
+	int			max_batches;	/* limit on batches read ahead */
+	bool		done;			/* no more batches will be added */
+	bool		failed;
+	char	   *error;
+	long		rows_copied;
+} copyRun;
+
+static char *_resolveTable(FBconn *conn, const char *table);
+static bool _buildQueries(FBconn *conn, const char *src_table, const char *dst_table, const char *where, long batch,
+						  char **first_query, char **next_query, char **insert_query,
+						  int *ncolumns, int *key_column);
+static int	_deactivateIndexes(FBconn *conn, const char *table, char ***indexes);
+static void _setIndexesActive(FBconn *conn, char **indexes, int nindexes, bool active);
+static bool _beginSnapshot(FBconn *conn);
+static bool _addBatch(copyRun *run, FBresult *rows);
+static copyBatch *_takeBatch(copyRun *run);
+static void _copyFailed(copyRun *run, const char *message);
+static void *_copyWorker(void *arg);
+
+
+/**
+ * copyTable()
+ *
+ * \copy_table SRC to DSN [as DST] [batch N] [workers N] [disable_indexes]
+ *             [where CONDITION]
+ *
+ * Copy the rows of "src_table" (optionally only those matching "where")
+ * into "dst_table" (by default, the table of the same name) in the
+ * database "dsn", which must have the same columns.
+ *
+ * The rows are read "batch" at a time on a separate connection, in a
+ * single read-only SNAPSHOT transaction, so the copy is consistent even
+ * if the table is modified meanwhile (uncommitted changes made in the
+ * current session are not copied). If the source table has a
+ * single-column primary key, each batch resumes after the last key
+ * read; otherwise batches are read by position using "ROWS m TO n".
+ * The rows of each batch are inserted using a prepared statement and
+ * committed together, by one of "nworkers" connections.
+ *
+ * With "disable_indexes", the destination table's indexes which do not
+ * enforce a constraint are deactivated during the copy and reactivated
+ * (i.e. rebuilt) afterwards.
+ *
+ * Returns false if the copy could not be started or failed; errors
+ * occurring during the copy are reported, together with the number of
+ * rows copied (and committed) before the error.
+ */
+bool
+copyTable(const char *src_table, const char *dsn, const char *dst_table,
+		  const char *where, long batch, int nworkers, bool disable_indexes)
+{
+	copyRun		run;
+	pthread_t	workers[PARALLEL_MAX_WORKERS];
+	FBconn	   *reader;
+	FBconn	   *control;
+	char	   *src_name;
+	char	   *dst_name;
+	char	   *first_query = NULL;
+	char	   *next_query = NULL;
+	char	  **indexes = NULL;
+	char	   *last_key = NULL;
+	int			nindexes = 0;
+	int			key_column = -1;
+	int			nstarted = 0;
+	long		rows_read = 0;
+	query_time	before, after;
+	int			i;
+
+	/*
+	 * connection reading the source table; all batches are read in the
+	 * same snapshot, independently of the session's own transaction
+	 */
+	reader = fbsql_connect(fset.dbpath);
+
+	if (FQstatus(reader) == CONNECTION_BAD)
+	{
+		fbsql_error("\\copy_table: unable to connect to \"%s\":\n%s\n", fset.dbpath, FQerrorMessage(reader));
+		FQfinish(reader);
+		return false;
+	}
+
+	FQsetAutocommit(reader, false);
+
+	if (_beginSnapshot(reader) == false)
+	{
+		FQfinish(reader);
+		return false;
+	}
+
+	src_name = _resolveTable(reader, src_table);
+
+	if (src_name == NULL)
+	{
+		fbsql_error("\\copy_table: table \"%s\" not found\n", src_table);
+		FQfinish(reader);
+		return false;
+	}
+
+	/* connection for checking the destination table and managing its indexes */
+	control = fbsql_connect(dsn);
+
+	if (FQstatus(control) == CONNECTION_BAD)
+	{
+		fbsql_error("\\copy_table: unable to connect to \"%s\":\n%s\n", dsn, FQerrorMessage(control));
+		FQfinish(control);
+		FQfinish(reader);
+		free(src_name);
+		return false;
+	}
+
+	FQsetAutocommit(control, true);
+
+	dst_name = _resolveTable(control, dst_table != NULL ? dst_table : src_name);
+
+	if (dst_name == NULL)
+	{
+		fbsql_error("\\copy_table: table \"%s\" not found in \"%s\"\n",
+					dst_table != NULL ? dst_table : src_name, dsn);
+		FQfinish(control);
+		FQfinish(reader);
+		free(src_name);
+		return false;
+	}
+
+	memset(&run, 0, sizeof(run));
+
+	if (_buildQueries(reader, src_name, dst_name, where, batch, &first_query, &next_query,
+					  &run.insert_query, &run.ncolumns, &key_column) == false)
+	{
+		FQfinish(control);
+		FQfinish(reader);
+		free(src_name);
+		free(dst_name);
+		return false;
+	}
+
+	if (key_column < 0)
+		printf("Note: \"%s\" has no single-column primary key, so batches are read by position\n", src_name);
+
+	if (disable_indexes == true)
+	{
+		nindexes = _deactivateIndexes(control, dst_name, &indexes);
+
+		if (nindexes > 0)
+			printf("Deactivated %i index(es) on \"%s\"\n", nindexes, dst_name);
+	}
+
+	run.dsn = dsn;
+	run.max_batches = nworkers * 2;
+	pthread_mutex_init(&run.lock, NULL);
+	pthread_cond_init(&run.batch_added, NULL);
+	pthread_cond_init(&run.batch_taken, NULL);
+
+	printf("Copying \"%s\" to \"%s\" in \"%s\" using %i worker(s)\n",
+		   src_name, dst_name, dsn, nworkers);
+	fflush(stdout);
+
+	gettimeofday(&before, NULL);
+
+	for (i = 0; i < nworkers; i++)
+	{
+		if (pthread_create(&workers[i], NULL, _copyWorker, &run) != 0)
+			break;
+		nstarted++;
+	}
+
+	/* read batches until the source is exhausted or a worker fails */
+	cancel_pressed = false;
+
+	for (;;)
+	{
+		FBresult   *rows;
+		int			nrows;
+
+		if (cancel_pressed == true)
+		{
+			_copyFailed(&run, "cancelled");
+			break;
+		}
+
+		if (key_column < 0)
+		{
+			/* the snapshot guarantees the positions are stable between batches */
+			FQExpBufferData query;
+
+			initFQExpBuffer(&query);
+			appendFQExpBuffer(&query, "%s ROWS %li TO %li",
+							  first_query, rows_read + 1, rows_read + batch);
+			rows = FQexec(reader, query.data);
+			termFQExpBuffer(&query);
+		}
+		else if (last_key == NULL)
+		{
+			rows = FQexec(reader, first_query);
+		}
+		else
+		{
+			const char *params[1];
+
+			params[0] = last_key;
+			rows = FQexecParams(reader, next_query, 1, NULL, params, NULL, NULL, 0);
+		}
+
+		if (FQresultStatus(rows) != FBRES_TUPLES_OK)
+		{
+			_copyFailed(&run, rows ? FQresultErrorMessage(rows) : FQerrorMessage(reader));
+
+			if (rows != NULL)
+				FQclear(rows);
+
+			break;
+		}
+
+		nrows = FQntuples(rows);
+
+		if (nrows == 0)
+		{
+			FQclear(rows);
+			break;
+		}
+
+		if (key_column >= 0)
+		{
+			free(last_key);
+			last_key = strdup(FQgetvalue(rows, nrows - 1, key_column));
+		}
+
+		if (_addBatch(&run, rows) == false)
+		{
+			FQclear(rows);
+			break;
+		}
+
+		rows_read += nrows;
+
+		if (nrows < batch)
+			break;
+	}
+
+	/* end the read-only transaction */
+	FQclear(FQexec(reader, "COMMIT"));
+
+	pthread_mutex_lock(&run.lock);
+	run.done = true;
+	pthread_cond_broadcast(&run.batch_added);
+	pthread_mutex_unlock(&run.lock);
+
+	for (i = 0; i < nstarted; i++)
+		pthread_join(workers[i], NULL);
+
+	gettimeofday(&after, NULL);
+	INSTR_TIME_SUBTRACT(after, before);
+
+	if (nindexes > 0)
+	{
+		printf("Reactivating %i index(es) on \"%s\"\n", nindexes, dst_name);
+		fflush(stdout);
+		_setIndexesActive(control, indexes, nindexes, true);
+	}
+
+	if (nstarted == 0)
+		fbsql_error("\\copy_table: unable to start worker threads\n");
+	else if (run.failed == true)
+		fbsql_error("\\copy_table: error copying \"%s\":\n%s\n", src_name, run.error);
+
+	printf("%li of %li row(s) copied", run.rows_copied, rows_read);
+
+	if (fset.timing)
+		printf(" (%.3f ms)", INSTR_TIME_GET_MILLISEC(after));
+
+	puts("");
+
+	for (i = 0; i < nindexes; i++)
+		free(indexes[i]);
+
+	free(indexes);
+	free(last_key);
+	free(first_query);
+	free(next_query);
+	free(run.insert_query);
+	free(run.error);
+	free(src_name);
+	free(dst_name);
+
+	pthread_cond_destroy(&run.batch_added);
+	pthread_cond_destroy(&run.batch_taken);
+	pthread_mutex_destroy(&run.lock);
+
+	FQfinish(control);
+	FQfinish(reader);
+
+	return nstarted > 0 && run.failed == false;
+}
+
+
+/**
+ * _beginSnapshot()
+ *
+ * Start the read-only SNAPSHOT transaction in which the source table is
+ * read.
+ */
+static bool
+_beginSnapshot(FBconn *conn)
+{
+	FBresult   *res;
+
+	res = FQexec(conn, "SET TRANSACTION READ ONLY ISOLATION LEVEL SNAPSHOT");
+
+	switch (FQresultStatus(res))
+	{
+		case FBRES_EMPTY_QUERY:
+		case FBRES_BAD_RESPONSE:
+		case FBRES_NONFATAL_ERROR:
+		case FBRES_FATAL_ERROR:
+			fbsql_error("\\copy_table: unable to start the read transaction\n%s",
+						res ? FQresultErrorMessage(res) : FQerrorMessage(conn));
+
+			if (res != NULL)
+				FQclear(res);
+
+			return false;
+
+		default:
+			break;
+	}
+
+	FQclear(res);
+
+	return true;
+}
+
+
+/**
+ * _resolveTable()
+ *
+ * Return the name of the table matching "table" case-insensitively, as
+ * stored in the system tables, or NULL if there is no such table.
+ */
+static char *
+_resolveTable(FBconn *conn, const char *table)
+{
+	FBresult   *res;
+	char	   *name = NULL;
+	const char *params[1];
+
+	params[0] = table;
+
+	res = FQexecParams(conn,
+"SELECT TRIM(rdb$relation_name) \n"
+"  FROM rdb$relations \n"
+" WHERE TRIM(LOWER(rdb$relation_name)) = LOWER(?) \n"
+"   AND rdb$view_blr IS NULL",
+					   1, NULL, params, NULL, NULL, 0);
+
+	if (FQresultStatus(res) == FBRES_TUPLES_OK && FQntuples(res) > 0)
+		name = strdup(FQgetvalue(res, 0, 0));
+
+	if (res != NULL)
+		FQclear(res);
+
+	return name;
+}
+
+
+/**
+ * _buildQueries()
+ *
+ * Build the queries reading the first and subsequent batches of rows
+ * from the source table (the latter taking the last key read as
+ * parameter), and the statement inserting a row into the destination
+ * table. Computed columns are not copied.
+ *
+ * If the table has no single-column primary key, "first_query" selects
+ * all rows and is completed with a "ROWS m TO n" clause for each batch,
+ * and "next_query" is not set.
+ */
+static bool
+_buildQueries(FBconn *conn, const char *src_table, const char *dst_table, const char *where, long batch,
+			  char **first_query, char **next_query, char **insert_query,
+			  int *ncolumns, int *key_column)
+{
+	FBresult   *res;
+	FQExpBufferData columns;
+	FQExpBufferData buf;
+	FQExpBufferData key;
+	const char *params[1];
+	int			i;
+
+	params[0] = src_table;
+
+	res = FQexecParams(conn,
+"    SELECT TRIM(rf.rdb$field_name), \n"
+"           (SELECT COUNT(*) \n"
+"              FROM rdb$relation_constraints rc \n"
+"        INNER JOIN rdb$index_segments s \n"
+"                ON s.rdb$index_name = rc.rdb$index_name \n"
+"             WHERE rc.rdb$relation_name = rf.rdb$relation_name \n"
+"               AND rc.rdb$constraint_type = 'PRIMARY KEY' \n"
+"               AND s.rdb$field_name = rf.rdb$field_name), \n"
+"           (SELECT COUNT(*) \n"
+"              FROM rdb$relation_constraints rc \n"
+"        INNER JOIN rdb$index_segments s \n"
+"                ON s.rdb$index_name = rc.rdb$index_name \n"
+"             WHERE rc.rdb$relation_name = rf.rdb$relation_name \n"
+"               AND rc.rdb$constraint_type = 'PRIMARY KEY') \n"
+"      FROM rdb$relation_fields rf \n"
+"INNER JOIN rdb$fields f \n"
+"        ON f.rdb$field_name = rf.rdb$field_source \n"
+"     WHERE rf.rdb$relation_name = ? \n"
+"       AND f.rdb$computed_blr IS NULL \n"
+"  ORDER BY rf.rdb$field_position",
+					   1, NULL, params, NULL, NULL, 0);
+
+	if (FQresultStatus(res) != FBRES_TUPLES_OK || FQntuples(res) == 0)
+	{
+		fbsql_error("\\copy_table: unable to read the columns of \"%s\"\n%s\n",
+					src_table, FQresultStatus(res) == FBRES_TUPLES_OK ? "" : FQresultErrorMessage(res));
+		FQclear(res);
+		return false;
+	}
+
+	*ncolumns = FQntuples(res);
+	*key_column = -1;
+
+	initFQExpBuffer(&columns);
+	initFQExpBuffer(&key);
+
+	for (i = 0; i < *ncolumns; i++)
+	{
+		if (i > 0)
+			appendFQExpBufferStr(&columns, ", ");
+
+		appendSQLIdentifier(&columns, FQgetvalue(res, i, 0));
+
+		if (atoi(FQgetvalue(res, i, 1)) == 1 && atoi(FQgetvalue(res, i, 2)) == 1)
+		{
+			*key_column = i;
+			appendSQLIdentifier(&key, FQgetvalue(res, i, 0));
+		}
+	}
+
+	FQclear(res);
+
+	/* first batch */
+	initFQExpBuffer(&buf);
+	appendFQExpBuffer(&buf, "SELECT %s FROM ", columns.data);
+	appendSQLIdentifier(&buf, src_table);
+
+	if (where != NULL)
+		appendFQExpBuffer(&buf, " WHERE (%s)", where);
+
+	if (*key_column >= 0)
+		appendFQExpBuffer(&buf, " ORDER BY %s ROWS %li", key.data, batch);
+
+	*first_query = buf.data;
+
+	/* subsequent batches */
+	*next_query = NULL;
+
+	if (*key_column >= 0)
+	{
+		initFQExpBuffer(&buf);
+		appendFQExpBuffer(&buf, "SELECT %s FROM ", columns.data);
+		appendSQLIdentifier(&buf, src_table);
+		appendFQExpBufferStr(&buf, " WHERE ");
+
+		if (where != NULL)
+			appendFQExpBuffer(&buf, "(%s) AND ", where);
+
+		appendFQExpBuffer(&buf, "%s > ? ORDER BY %s ROWS %li", key.data, key.data, batch);
+
+		*next_query = buf.data;
+	}
+
+	/* insert */
+	initFQExpBuffer(&buf);
+	appendFQExpBufferStr(&buf, "INSERT INTO ");
+	appendSQLIdentifier(&buf, dst_table);
+	appendFQExpBuffer(&buf, " (%s) VALUES (", columns.data);
+
+	for (i = 0; i < *ncolumns; i++)
+		appendFQExpBufferStr(&buf, i > 0 ? ", ?" : "?");
+
+	appendFQExpBufferChar(&buf, ')');
+
+	*insert_query = buf.data;
+
+	termFQExpBuffer(&columns);
+	termFQExpBuffer(&key);
+
+	return true;
+}
+
+
+/**
+ * _deactivateIndexes()
+ *
+ * Deactivate the active indexes of "table" which do not enforce a
+ * constraint (which cannot be deactivated), returning their names in
+ * "indexes". Returns the number of indexes.
+ */
+static int
+_deactivateIndexes(FBconn *conn, const char *table, char ***indexes)
+{
+	FBresult   *res;
+	const char *params[1];
+	int			nindexes;
+	int			i;
+
+	params[0] = table;
+
+	res = FQexecParams(conn,
+"SELECT TRIM(i.rdb$index_name) \n"
+"  FROM rdb$indices i \n"
+" WHERE i.rdb$relation_name = ? \n"
+"   AND COALESCE(i.rdb$index_inactive, 0) = 0 \n"
+"   AND COALESCE(i.rdb$system_flag, 0) = 0 \n"
+"   AND NOT EXISTS (SELECT 1 FROM rdb$relation_constraints rc \n"
+"                    WHERE rc.rdb$index_name = i.rdb$index_name)",
+					   1, NULL, params, NULL, NULL, 0);
+
+	if (FQresultStatus(res) != FBRES_TUPLES_OK)
+	{
+		printf("unable to read indexes of \"%s\":\n%s\n", table,
+			   res ? FQresultErrorMessage(res) : FQerrorMessage(conn));
+
+		if (res != NULL)
+			FQclear(res);
+
+		return 0;
+	}
+
+	nindexes = FQntuples(res);
+	*indexes = (char **)fb_malloc0((nindexes + 1) * sizeof(char *));
+
+	for (i = 0; i < nindexes; i++)
+		(*indexes)[i] = strdup(FQgetvalue(res, i, 0));
+
+	FQclear(res);
+
+	_setIndexesActive(conn, *indexes, nindexes, false);
+
+	return nindexes;
+}
+
+
+/**
+ * _setIndexesActive()
+ *
+ * Activate or deactivate each of "indexes"; activating an index rebuilds
+ * it.
+ */
+static void
+_setIndexesActive(FBconn *conn, char **indexes, int nindexes, bool active)
+{
+	int			i;
+
+	for (i = 0; i < nindexes; i++)
+	{
+		FQExpBufferData statement;
+		FBresult   *res;
+
+		initFQExpBuffer(&statement);
+		appendFQExpBufferStr(&statement, "ALTER INDEX ");
+		appendSQLIdentifier(&statement, indexes[i]);
+		appendFQExpBufferStr(&statement, active ? " ACTIVE" : " INACTIVE");
+
+		res = FQexec(conn, statement.data);
+
+		if (FQresultStatus(res) != FBRES_COMMAND_OK)
+			printf("unable to %s index \"%s\":\n%s\n",
+				   active ? "reactivate" : "deactivate",
+				   indexes[i], res ? FQresultErrorMessage(res) : FQerrorMessage(conn));
+
+		if (res != NULL)
+			FQclear(res);
+
+		termFQExpBuffer(&statement);
+	}
+}
+
+
+/**
+ * _addBatch()
+ *
+ * Queue a batch of rows for insertion, waiting while the maximum number
+ * of batches are queued. Returns false if the copy has failed.
+ */
+static bool
+_addBatch(copyRun *run, FBresult *rows)
+{
+	copyBatch  *batch;
+
+	pthread_mutex_lock(&run->lock);
+
+	while (run->nbatches >= run->max_batches && run->failed == false)
+		pthread_cond_wait(&run->batch_taken, &run->lock);
+
+	if (run->failed == true)
+	{
+		pthread_mutex_unlock(&run->lock);
+		return false;
+	}
+
+	batch = (copyBatch *)fb_malloc0(sizeof(copyBatch));
+	batch->rows = rows;
+
+	if (run->tail != NULL)
+		run->tail->next = batch;
+	else
+		run->head = batch;
+
+	run->tail = batch;
+	run->nbatches++;
+
+	pthread_cond_signal(&run->batch_added);
+	pthread_mutex_unlock(&run->lock);
+
+	return true;
+}
+
+
+/**
+ * _takeBatch()
+ *
+ * Remove the next batch from the queue, waiting for one to be added;
+ * returns NULL once the queue is empty and no more batches will be added.
+ */
+static copyBatch *
+_takeBatch(copyRun *run)
+{
+	copyBatch  *batch;
+
+	pthread_mutex_lock(&run->lock);
+
+	while (run->head == NULL && run->done == false)
+		pthread_cond_wait(&run->batch_added, &run->lock);
+
+	batch = run->head;
+
+	if (batch != NULL)
+	{
+		run->head = batch->next;
+
+		if (run->head == NULL)
+			run->tail = NULL;
+
+		run->nbatches--;
+		pthread_cond_signal(&run->batch_taken);
+	}
+
+	pthread_mutex_unlock(&run->lock);
+
+	return batch;
+}
+
+
+/**
+ * _copyFailed()
+ *
+ * Record the first error, which stops the copy.
+ */
+static void
+_copyFailed(copyRun *run, const char *message)
+{
+	pthread_mutex_lock(&run->lock);
+
+	if (run->failed == false)
+	{
+		run->failed = true;
+		run->error = strdup(message);
+	}
+
+	pthread_cond_broadcast(&run->batch_taken);
+	pthread_mutex_unlock(&run->lock);
+}
+
+
+/**
+ * _copyWorker()
+ *
+ * Worker thread: insert each batch taken from the queue in a single
+ * transaction on the worker's own connection. After a failure, remaining
+ * batches are discarded.
+ */
+static void *
+_copyWorker(void *arg)
+{
+	copyRun    *run = (copyRun *)arg;
+	FBconn	   *conn;
+	FBresult   *stmt = NULL;
+	const char **values = (const char **)fb_malloc0(run->ncolumns * sizeof(char *));
+	copyBatch  *batch;
+	bool		ready = false;
+
+	conn = fbsql_connect(run->dsn);
+
+	if (FQstatus(conn) == CONNECTION_BAD)
+	{
+		_copyFailed(run, FQerrorMessage(conn));
+	}
+	else
+	{
+		FQsetAutocommit(conn, false);
+
+		stmt = FQprepare(conn, run->insert_query, run->ncolumns);
+
+		if (stmt == NULL || FQresultStatus(stmt) == FBRES_FATAL_ERROR)
+			_copyFailed(run, stmt ? FQresultErrorMessage(stmt) : FQerrorMessage(conn));
+		else
+			ready = true;
+	}
+
+	while ((batch = _takeBatch(run)) != NULL)
+	{
+		int			nrows = FQntuples(batch->rows);
+		int			i, j;
+
+		for (i = 0; ready == true && run->failed == false && i < nrows; i++)
+		{
+			FBresult   *res;
+
+			for (j = 0; j < run->ncolumns; j++)
+				values[j] = FQgetisnull(batch->rows, i, j) ? NULL : FQgetvalue(batch->rows, i, j);
+
+			res = FQexecPrepared(conn, stmt, run->ncolumns, NULL, values, NULL, NULL, 0);
+
+			switch (FQresultStatus(res))
+			{
+				case FBRES_EMPTY_QUERY:
+				case FBRES_BAD_RESPONSE:
+				case FBRES_NONFATAL_ERROR:
+				case FBRES_FATAL_ERROR:
+					_copyFailed(run, res ? FQresultErrorMessage(res) : FQerrorMessage(conn));
+					break;
+
+				default:
+					break;
+			}
+
+			if (res != NULL)
+				FQclear(res);
+		}
+
+		if (ready == true && FQisActiveTransaction(conn))
+		{
+			FBresult   *res;
+
+			if (i == nrows && run->failed == false)
+			{
+				res = FQexec(conn, "COMMIT");
+
+				if (FQresultStatus(res) == FBRES_TRANSACTION_COMMIT)
+				{
+					pthread_mutex_lock(&run->lock);
+					run->rows_copied += nrows;
+					pthread_mutex_unlock(&run->lock);
+				}
+				else
+				{
+					_copyFailed(run, res ? FQresultErrorMessage(res) : FQerrorMessage(conn));
+				}
+			}
+			else
+			{
+				res = FQexec(conn, "ROLLBACK");
+			}
+
+			if (res != NULL)
+				FQclear(res);
+		}
+
+		FQclear(batch->rows);
+		free(batch);
+	}
+
+	if (stmt != NULL)
+		FQclear(stmt);
+
+	FQfinish(conn);
+	free(values);
+
+	return NULL;
+}
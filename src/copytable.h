@@ -0,0 +1,13 @@
+#ifndef COPYTABLE_H
+#define COPYTABLE_H
+
+#include "settings.h"
+
+/* Default number of rows fetched and inserted (and committed) together */
+#define COPY_TABLE_DEFAULT_BATCH 1000
+
+extern bool
+copyTable(const char *src_table, const char *dsn, const char *dst_table,
+		  const char *where, long batch, int nworkers, bool disable_indexes);
+
+#endif   /* COPYTABLE_H */
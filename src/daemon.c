@@ -0,0 +1,675 @@
+/* ---------------------------------------------------------------------
+ *
+ * daemon.c
+ *
+ * Connection pool daemon ("fbsql --daemon SOCKET") and its client
+ * ("fbsql --via SOCKET")
+ *
+ * The daemon keeps a pool of attachments open and executes statements
+ * received over a Unix domain socket, so short-lived fbsql invocations
+ * do not each pay the cost of attaching to the database. Each client
+ * session is assigned one pooled connection for its duration, so
+ * transactions can span several statements; any transaction left open
+ * is rolled back when the session ends.
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "common.h"
+#include "daemon.h"
+#include "protocol.h"
+#include "query.h"
+#include "settings.h"
+#include "workload.h"
+
+typedef struct daemonPool
+{
+	int			size;
+	FBconn	  **conns;
+	bool	   *busy;
+	int			nbusy;
+	pthread_mutex_t lock;
+	pthread_cond_t available;
+} daemonPool;
+
+typedef struct daemonSession
+{
+	int			fd;
+	daemonPool *pool;
+} daemonSession;
+
+static int _socketAddress(const char *socket_path, struct sockaddr_un *addr);
+static void *_sessionMain(void *arg);
+static FBconn *_acquireConnection(daemonPool *pool, int *slot);
+static void _releaseConnection(daemonPool *pool, int slot);
+static bool _sendResult(int fd, FBconn *conn, const char *query);
+static bool _receiveResult(int fd, FQExpBuffer payload, bool *connection_lost);
+
+
+/**
+ * daemonRun()
+ *
+ * fbsql --daemon SOCKET [--pool-size N]
+ *
+ * Open "pool_size" connections to the current database (the session's
+ * main connection being the first) and serve client sessions on the
+ * Unix domain socket "socket_path" until interrupted. All connections,
+ * including the main connection, are closed on exit.
+ *
+ * The socket is created with mode 0600, as clients can execute any
+ * statement with the daemon's credentials.
+ *
+ * Returns the program exit code.
+ */
+int
+daemonRun(const char *socket_path, int pool_size)
+{
+	/* static, as detached session threads may still be using it when this returns */
+	static daemonPool pool;
+	struct sockaddr_un addr;
+	struct stat st;
+	int			listen_fd;
+	long		nsessions = 0;
+	int			i;
+
+	if (_socketAddress(socket_path, &addr) == -1)
+		return 1;
+
+	pool.size = pool_size;
+	pool.conns = (FBconn **)fb_malloc0(pool_size * sizeof(FBconn *));
+	pool.busy = (bool *)fb_malloc0(pool_size * sizeof(bool));
+	pool.nbusy = 0;
+	pthread_mutex_init(&pool.lock, NULL);
+	pthread_cond_init(&pool.available, NULL);
+
+	/* like the other pooled connections, the main connection uses libfq's autocommit */
+	FQsetAutocommit(fset.conn, fset.autocommit);
+	pool.conns[0] = fset.conn;
+
+	/* open all connections up front, so problems are reported immediately */
+	for (i = 1; i < pool_size; i++)
+	{
+		FBconn *conn = fbsql_connect(fset.dbpath);
+
+		if (FQstatus(conn) == CONNECTION_BAD)
+		{
+			fbsql_error("unable to open pool connection:\n%s\n", FQerrorMessage(conn));
+			FQfinish(conn);
+			pool.size = i;
+			break;
+		}
+
+		FQsetAutocommit(conn, fset.autocommit);
+		pool.conns[i] = conn;
+	}
+
+	/* remove a socket left behind by a previous daemon */
+	if (lstat(socket_path, &st) == 0 && S_ISSOCK(st.st_mode))
+		unlink(socket_path);
+
+	listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (listen_fd == -1
+	 || bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == -1
+	 || chmod(socket_path, S_IRUSR | S_IWUSR) == -1
+	 || listen(listen_fd, SOMAXCONN) == -1)
+	{
+		fbsql_error("unable to listen on \"%s\": %s\n", socket_path, strerror(errno));
+
+		if (listen_fd != -1)
+			close(listen_fd);
+
+		for (i = 1; i < pool.size; i++)
+			FQfinish(pool.conns[i]);
+
+		free(pool.conns);
+		free(pool.busy);
+		return 1;
+	}
+
+	signal(SIGINT, handle_signals);
+	signal(SIGTERM, handle_signals);
+	/* a client going away is handled as a write error */
+	signal(SIGPIPE, SIG_IGN);
+
+	printf("Listening on \"%s\" with %i pooled connection(s); press CTRL-C to stop\n",
+		   socket_path, pool.size);
+	fflush(stdout);
+
+	cancel_pressed = false;
+
+	while (cancel_pressed == false)
+	{
+		struct pollfd pfd;
+		daemonSession *session;
+		pthread_t	thread;
+		int			fd;
+
+		/* wake up periodically to check for CTRL-C */
+		pfd.fd = listen_fd;
+		pfd.events = POLLIN;
+
+		if (poll(&pfd, 1, 1000) <= 0)
+			continue;
+
+		fd = accept(listen_fd, NULL, NULL);
+
+		if (fd == -1)
+			continue;
+
+		session = (daemonSession *)fb_malloc0(sizeof(daemonSession));
+		session->fd = fd;
+		session->pool = &pool;
+
+		if (pthread_create(&thread, NULL, _sessionMain, session) != 0)
+		{
+			close(fd);
+			free(session);
+			continue;
+		}
+
+		pthread_detach(thread);
+		nsessions++;
+	}
+
+	close(listen_fd);
+	unlink(socket_path);
+
+	printf("%li client session(s) served\n", nsessions);
+
+	/* connections still in use by client sessions are closed at process exit */
+	pthread_mutex_lock(&pool.lock);
+
+	for (i = 0; i < pool.size; i++)
+	{
+		if (pool.busy[i] == false)
+			FQfinish(pool.conns[i]);
+	}
+
+	pthread_mutex_unlock(&pool.lock);
+
+	return 0;
+}
+
+
+/**
+ * daemonClientRun()
+ *
+ * fbsql --via SOCKET
+ *
+ * Read statements from standard input and execute them using a
+ * connection from the daemon listening on "socket_path", displaying the
+ * results as if they had been executed directly. Backslash commands are
+ * not supported and are skipped.
+ *
+ * Returns the program exit code.
+ */
+int
+daemonClientRun(const char *socket_path)
+{
+	struct sockaddr_un addr;
+	FQExpBufferData payload;
+	workloadStatement *statements;
+	int			nstatements = 0;
+	int			fd;
+	char		type;
+	int			result = 0;
+	int			i;
+
+	if (_socketAddress(socket_path, &addr) == -1)
+		return 1;
+
+	fd = socket(AF_UNIX, SOCK_STREAM, 0);
+
+	if (fd == -1 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1)
+	{
+		fbsql_error("unable to connect to fbsql daemon at \"%s\": %s\n",
+					socket_path, strerror(errno));
+		if (fd != -1)
+			close(fd);
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	initFQExpBuffer(&payload);
+
+	/* blocks until the daemon has a free connection */
+	if (protocolRecvFrame(fd, &type, &payload) == false || type != DAEMON_MSG_READY)
+	{
+		fbsql_error("fbsql daemon at \"%s\" closed the connection\n", socket_path);
+		termFQExpBuffer(&payload);
+		close(fd);
+		return 1;
+	}
+
+	/* the lexer and output formatting need the connection's encoding */
+	fset.client_encoding_id = (int)strtol(payload.data, NULL, 10);
+
+	statements = readWorkloadScript("-", &nstatements);
+
+	for (i = 0; i < nstatements; i++)
+	{
+		bool		connection_lost = false;
+		bool		sent;
+		char	   *query;
+
+		/* the protocol carries statement text only, so bound values are inlined */
+		query = workloadStatementText(&statements[i]);
+		sent = protocolSendFrame(fd, DAEMON_MSG_QUERY, query, strlen(query));
+		free(query);
+
+		if (sent == false)
+		{
+			fbsql_error("unable to send statement to fbsql daemon: %s\n", strerror(errno));
+			result = 1;
+			break;
+		}
+
+		if (_receiveResult(fd, &payload, &connection_lost) == false)
+		{
+			result = 1;
+
+			/* a statement error leaves the session usable */
+			if (connection_lost == true)
+			{
+				fbsql_error("fbsql daemon closed the connection\n");
+				break;
+			}
+		}
+	}
+
+	if (statements != NULL)
+		freeWorkloadStatements(statements, nstatements);
+
+	protocolSendFrame(fd, DAEMON_MSG_TERMINATE, NULL, 0);
+
+	termFQExpBuffer(&payload);
+	close(fd);
+
+	return result;
+}
+
+
+static int
+_socketAddress(const char *socket_path, struct sockaddr_un *addr)
+{
+	memset(addr, 0, sizeof(struct sockaddr_un));
+	addr->sun_family = AF_UNIX;
+
+	if (strlen(socket_path) >= sizeof(addr->sun_path))
+	{
+		fbsql_error("socket path \"%s\" is too long (maximum %i characters)\n",
+					socket_path, (int)sizeof(addr->sun_path) - 1);
+		return -1;
+	}
+
+	strcpy(addr->sun_path, socket_path);
+
+	return 0;
+}
+
+
+/**
+ * _sessionMain()
+ *
+ * Serve one client session: wait for a free connection, then execute
+ * each statement received until the client terminates the session.
+ */
+static void *
+_sessionMain(void *arg)
+{
+	daemonSession *session = (daemonSession *)arg;
+	FQExpBufferData payload;
+	FBconn	   *conn;
+	char		type;
+	char		encoding_id[16];
+	int			slot;
+
+	conn = _acquireConnection(session->pool, &slot);
+
+	snprintf(encoding_id, sizeof(encoding_id), "%i", FQclientEncodingId(conn));
+
+	initFQExpBuffer(&payload);
+
+	if (protocolSendFrame(session->fd, DAEMON_MSG_READY, encoding_id, strlen(encoding_id)) == true)
+	{
+		while (protocolRecvFrame(session->fd, &type, &payload) == true
+			   && type == DAEMON_MSG_QUERY)
+		{
+			if (_sendResult(session->fd, conn, payload.data) == false)
+				break;
+		}
+	}
+
+	termFQExpBuffer(&payload);
+	close(session->fd);
+
+	_releaseConnection(session->pool, slot);
+
+	free(session);
+
+	return NULL;
+}
+
+
+static FBconn *
+_acquireConnection(daemonPool *pool, int *slot)
+{
+	int i;
+
+	pthread_mutex_lock(&pool->lock);
+
+	while (pool->nbusy == pool->size)
+		pthread_cond_wait(&pool->available, &pool->lock);
+
+	for (i = 0; pool->busy[i] == true; i++)
+		;
+
+	pool->busy[i] = true;
+	pool->nbusy++;
+
+	pthread_mutex_unlock(&pool->lock);
+
+	*slot = i;
+
+	return pool->conns[i];
+}
+
+
+/**
+ * _releaseConnection()
+ *
+ * Return a connection to the pool, rolling back any transaction the
+ * client left open, and replacing the connection if it was lost.
+ */
+static void
+_releaseConnection(daemonPool *pool, int slot)
+{
+	FBconn *conn = pool->conns[slot];
+
+	if (FQstatus(conn) != CONNECTION_BAD && FQisActiveTransaction(conn))
+	{
+		FBresult *res = FQexec(conn, "ROLLBACK");
+		FQclear(res);
+	}
+
+	if (FQstatus(conn) == CONNECTION_BAD)
+	{
+		FBconn *new_conn = fbsql_connect(fset.dbpath);
+
+		if (FQstatus(new_conn) == CONNECTION_BAD)
+		{
+			/* keep the broken connection; the next session will retry */
+			FQfinish(new_conn);
+		}
+		else
+		{
+			FQsetAutocommit(new_conn, fset.autocommit);
+			FQfinish(conn);
+
+			conn = new_conn;
+		}
+	}
+
+	pthread_mutex_lock(&pool->lock);
+
+	pool->conns[slot] = conn;
+	pool->busy[slot] = false;
+	pool->nbusy--;
+
+	pthread_cond_signal(&pool->available);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+
+/**
+ * _sendResult()
+ *
+ * Execute "query" and send the result to the client. Returns false if
+ * the client connection failed.
+ */
+static bool
+_sendResult(int fd, FBconn *conn, const char *query)
+{
+	FBresult   *query_result;
+	FQExpBufferData buf;
+	bool		success = true;
+	int			nfields, ntuples = 0;
+	int			i, j;
+
+	query_result = FQexec(conn, query);
+
+	switch (FQresultStatus(query_result))
+	{
+		case FBRES_EMPTY_QUERY:
+		case FBRES_BAD_RESPONSE:
+		case FBRES_NONFATAL_ERROR:
+		case FBRES_FATAL_ERROR:
+		{
+			const char *message = query_result != NULL
+				? FQresultErrorMessage(query_result)
+				: FQerrorMessage(conn);
+
+			success = protocolSendFrame(fd, DAEMON_MSG_ERROR, message, strlen(message));
+
+			if (query_result != NULL)
+				FQclear(query_result);
+
+			return success;
+		}
+		default:
+			break;
+	}
+
+	initFQExpBuffer(&buf);
+
+	if (FQresultStatus(query_result) == FBRES_TUPLES_OK)
+	{
+		nfields = FQnfields(query_result);
+		ntuples = FQntuples(query_result);
+
+		protocolAppendUint32(&buf, nfields);
+
+		for (j = 0; j < nfields; j++)
+		{
+			bool right_align;
+
+			switch (FQftype(query_result, j))
+			{
+				case SQL_SHORT:
+				case SQL_LONG:
+				case SQL_INT64:
+#if defined SQL_INT128
+				case SQL_INT128:
+#endif
+				case SQL_FLOAT:
+				case SQL_DOUBLE:
+					right_align = true;
+					break;
+				default:
+					right_align = false;
+			}
+
+			appendFQExpBufferChar(&buf, right_align ? 1 : 0);
+			appendBinaryFQExpBuffer(&buf, FQfname(query_result, j), strlen(FQfname(query_result, j)) + 1);
+		}
+
+		success = protocolSendFrame(fd, DAEMON_MSG_ROW_DESC, buf.data, buf.len);
+
+		for (i = 0; i < ntuples && success == true; i++)
+		{
+			resetFQExpBuffer(&buf);
+
+			for (j = 0; j < nfields; j++)
+			{
+				if (FQgetisnull(query_result, i, j))
+				{
+					protocolAppendUint32(&buf, PROTOCOL_NULL_LENGTH);
+				}
+				else if (FQftype(query_result, j) == SQL_DB_KEY)
+				{
+					char *value = FQformatDbKey(query_result, i, j);
+
+					protocolAppendUint32(&buf, strlen(value));
+					appendFQExpBufferStr(&buf, value);
+					free(value);
+				}
+				else
+				{
+					const char *value = FQgetvalue(query_result, i, j);
+
+					protocolAppendUint32(&buf, strlen(value));
+					appendFQExpBufferStr(&buf, value);
+				}
+			}
+
+			success = protocolSendFrame(fd, DAEMON_MSG_DATA_ROW, buf.data, buf.len);
+		}
+	}
+
+	if (success == true)
+	{
+		resetFQExpBuffer(&buf);
+		appendFQExpBuffer(&buf, "%i %i", (int)FQresultStatus(query_result), ntuples);
+		success = protocolSendFrame(fd, DAEMON_MSG_COMPLETE, buf.data, buf.len);
+	}
+
+	termFQExpBuffer(&buf);
+	FQclear(query_result);
+
+	return success;
+}
+
+
+/**
+ * _receiveResult()
+ *
+ * Receive and display the result of one statement, in the same format
+ * as SendQuery(). Returns false if the statement failed, or if the
+ * daemon connection was lost, in which case "connection_lost" is set.
+ */
+static bool
+_receiveResult(int fd, FQExpBuffer payload, bool *connection_lost)
+{
+	fbsqlTable	table;
+	bool		have_table = false;
+	char		type;
+
+	*connection_lost = false;
+
+	while (protocolRecvFrame(fd, &type, payload) == true)
+	{
+		if (type == DAEMON_MSG_ROW_DESC)
+		{
+			const char *p = payload->data + 4;
+			int			nfields = protocolGetUint32(payload->data);
+			const char **headers = (const char **)fb_malloc0(nfields * sizeof(char *));
+			bool	   *right_align = (bool *)fb_malloc0(nfields * sizeof(bool));
+			int			j;
+
+			for (j = 0; j < nfields; j++)
+			{
+				right_align[j] = *p++ == 1;
+				headers[j] = p;
+				p += strlen(p) + 1;
+			}
+
+			initTable(&table, nfields, headers);
+			memcpy(table.right_align, right_align, nfields * sizeof(bool));
+			have_table = true;
+
+			free(headers);
+			free(right_align);
+		}
+		else if (type == DAEMON_MSG_DATA_ROW && have_table == true)
+		{
+			const char **values = (const char **)fb_malloc0(table.nfields * sizeof(char *));
+			char	   *p = payload->data;
+			int			j;
+
+			for (j = 0; j < table.nfields; j++)
+			{
+				uint32_t len = protocolGetUint32(p);
+
+				p += 4;
+
+				if (len == PROTOCOL_NULL_LENGTH)
+					continue;
+
+				values[j] = strndup(p, len);
+				p += len;
+			}
+
+			addTableRow(&table, values);
+
+			for (j = 0; j < table.nfields; j++)
+				free((char *)values[j]);
+
+			free(values);
+		}
+		else if (type == DAEMON_MSG_COMPLETE)
+		{
+			int status = 0, ntuples = 0;
+
+			sscanf(payload->data, "%i %i", &status, &ntuples);
+
+			switch (status)
+			{
+				case FBRES_TUPLES_OK:
+					if (have_table == true)
+						printTable(&table, &fset.popt);
+					printf("(%i rows)\n", ntuples);
+					break;
+				case FBRES_TRANSACTION_START:
+					puts("START");
+					break;
+				case FBRES_TRANSACTION_COMMIT:
+					puts("COMMIT");
+					break;
+				case FBRES_TRANSACTION_ROLLBACK:
+					puts("ROLLBACK");
+					break;
+				default:
+					puts("");
+			}
+
+			if (have_table == true)
+				termTable(&table);
+
+			return true;
+		}
+		else if (type == DAEMON_MSG_ERROR)
+		{
+			printf("%s\n", payload->data);
+
+			if (have_table == true)
+				termTable(&table);
+
+			return false;
+		}
+	}
+
+	if (have_table == true)
+		termTable(&table);
+
+	*connection_lost = true;
+
+	return false;
+}
+
@@ -0,0 +1,27 @@
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include "settings.h"
+
+/* Maximum number of connections kept open by "fbsql --daemon" */
+#define DAEMON_MAX_POOL_SIZE 64
+
+/*
+ * Messages exchanged over the daemon socket; each is framed as a
+ * one-byte type followed by a 4-byte big-endian payload length.
+ */
+#define DAEMON_MSG_READY		'R'		/* daemon: connection assigned; payload is client encoding id */
+#define DAEMON_MSG_QUERY		'Q'		/* client: SQL statement */
+#define DAEMON_MSG_TERMINATE	'X'		/* client: end of session */
+#define DAEMON_MSG_ROW_DESC		'T'		/* daemon: column count, then per column alignment flag and name */
+#define DAEMON_MSG_DATA_ROW		'D'		/* daemon: per column, value length (or -1 for NULL) and value */
+#define DAEMON_MSG_COMPLETE		'C'		/* daemon: "STATUS NTUPLES" */
+#define DAEMON_MSG_ERROR		'E'		/* daemon: error message */
+
+extern int
+daemonRun(const char *socket_path, int pool_size);
+
+extern int
+daemonClientRun(const char *socket_path);
+
+#endif   /* DAEMON_H */
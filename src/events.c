@@ -0,0 +1,337 @@
+/* ---------------------------------------------------------------------
+ *
+ * events.c
+ *
+ * Wait for events posted with POST_EVENT (\listen, fbsql --listen)
+ *
+ * libfq does not provide access to the event API, so a separate
+ * attachment is made using the client library directly.
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+
+#include "ibase.h"
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "common.h"
+#include "events.h"
+#include "query.h"
+#include "settings.h"
+
+typedef struct eventListener
+{
+	isc_db_handle db;
+	ISC_LONG	event_id;
+	ISC_UCHAR  *event_buffer;
+	ISC_UCHAR  *result_buffer;
+	short		buffer_len;
+	/* protected by lock */
+	pthread_mutex_t lock;
+	pthread_cond_t cond;
+	bool		fired;
+} eventListener;
+
+static bool _eventAttach(isc_db_handle *db);
+static bool _queueEvents(eventListener *listener);
+static bool _waitForEvents(eventListener *listener);
+static void _eventCallback(void *arg, ISC_USHORT length, const ISC_UCHAR *updated);
+static void _eventError(const char *message, const ISC_STATUS *status);
+
+
+/**
+ * listenEvents()
+ *
+ * \listen NAME [NAME ...] [do QUERY]
+ * fbsql --listen NAME[,NAME...] [--on-event QUERY]
+ *
+ * Register interest in the named events and block until interrupted,
+ * printing the name and count of each event as it is posted; if "query"
+ * is provided, it is executed (on the session's connection) after each
+ * notification. In batch mode, notifications are printed as
+ * tab-separated "timestamp name count" lines.
+ *
+ * Events are re-registered before the query is executed, so events posted
+ * while it runs are not lost.
+ */
+bool
+listenEvents(char **names, int nevents, const char *query, bool batch)
+{
+	eventListener listener;
+	ISC_STATUS_ARRAY status;
+	ISC_UCHAR  *p;
+	size_t		len = 1;
+	bool		success = true;
+	int			i;
+
+	if (nevents > EVENTS_MAX)
+	{
+		fbsql_error("a maximum of %i events can be waited for at once\n", EVENTS_MAX);
+		return false;
+	}
+
+	for (i = 0; i < nevents; i++)
+	{
+		size_t name_len = strlen(names[i]);
+
+		if (name_len == 0 || name_len > 255)
+		{
+			fbsql_error("invalid event name \"%s\"\n", names[i]);
+			return false;
+		}
+
+		/* length byte, name and 32-bit count */
+		len += 1 + name_len + 4;
+	}
+
+	memset(&listener, 0, sizeof(listener));
+
+	if (_eventAttach(&listener.db) == false)
+		return false;
+
+	/* build the event parameter block, as per isc_event_block() */
+	listener.buffer_len = (short)len;
+	listener.event_buffer = (ISC_UCHAR *)fb_malloc0(len);
+	listener.result_buffer = (ISC_UCHAR *)fb_malloc0(len);
+
+	p = listener.event_buffer;
+	*p++ = EPB_version1;
+
+	for (i = 0; i < nevents; i++)
+	{
+		size_t name_len = strlen(names[i]);
+
+		*p++ = (ISC_UCHAR)name_len;
+		memcpy(p, names[i], name_len);
+		p += name_len + 4;
+	}
+
+	memcpy(listener.result_buffer, listener.event_buffer, len);
+
+	pthread_mutex_init(&listener.lock, NULL);
+	pthread_cond_init(&listener.cond, NULL);
+
+	if (batch == true)
+	{
+		signal(SIGINT, handle_signals);
+		signal(SIGTERM, handle_signals);
+	}
+
+	cancel_pressed = false;
+
+	/*
+	 * The first notification is delivered immediately and only establishes
+	 * the current counts.
+	 */
+	if (_queueEvents(&listener) == false || _waitForEvents(&listener) == false)
+	{
+		success = false;
+	}
+	else
+	{
+		ISC_ULONG	counts[EVENTS_MAX];
+
+		isc_event_counts(counts, listener.buffer_len, listener.event_buffer, listener.result_buffer);
+
+		if (_queueEvents(&listener) == false)
+			success = false;
+	}
+
+	if (success == true && batch == false)
+	{
+		printf("Listening for %i event(s); press CTRL-C to stop\n", nevents);
+		fflush(stdout);
+	}
+
+	while (success == true && _waitForEvents(&listener) == true)
+	{
+		ISC_ULONG	counts[EVENTS_MAX];
+		char		timestamp[32];
+		time_t		now = time(NULL);
+
+		isc_event_counts(counts, listener.buffer_len, listener.event_buffer, listener.result_buffer);
+
+		if (_queueEvents(&listener) == false)
+			success = false;
+
+		strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", localtime(&now));
+
+		for (i = 0; i < nevents; i++)
+		{
+			if (counts[i] == 0)
+				continue;
+
+			if (batch == true)
+				printf("%s\t%s\t%lu\n", timestamp, names[i], (unsigned long)counts[i]);
+			else
+				printf("%s  event \"%s\" received (count: %lu)\n",
+					   timestamp, names[i], (unsigned long)counts[i]);
+		}
+
+		fflush(stdout);
+
+		if (query != NULL)
+			SendQuery(query);
+	}
+
+	if (listener.event_id != 0)
+		isc_cancel_events(status, &listener.db, &listener.event_id);
+
+	isc_detach_database(status, &listener.db);
+
+	pthread_cond_destroy(&listener.cond);
+	pthread_mutex_destroy(&listener.lock);
+	free(listener.event_buffer);
+	free(listener.result_buffer);
+
+	return success;
+}
+
+
+/**
+ * _eventAttach()
+ *
+ * Attach to the current database with the session's credentials.
+ */
+static bool
+_eventAttach(isc_db_handle *db)
+{
+	ISC_STATUS_ARRAY status;
+	FQExpBufferData dpb;
+	bool		success = true;
+	const char *params[3];
+	char		tags[3] = { isc_dpb_user_name, isc_dpb_password, isc_dpb_lc_ctype };
+	int			i;
+
+	params[0] = fset.username;
+	params[1] = fset.password;
+	params[2] = fset.client_encoding;
+
+	initFQExpBuffer(&dpb);
+	appendFQExpBufferChar(&dpb, isc_dpb_version1);
+
+	for (i = 0; i < lengthof(tags); i++)
+	{
+		size_t len;
+
+		if (params[i] == NULL)
+			continue;
+
+		len = strlen(params[i]);
+		if (len > 255)
+			len = 255;
+
+		appendFQExpBufferChar(&dpb, tags[i]);
+		appendFQExpBufferChar(&dpb, (char)len);
+		appendBinaryFQExpBuffer(&dpb, params[i], len);
+	}
+
+	if (isc_attach_database(status, 0, fset.dbpath, db, (short)dpb.len, dpb.data))
+	{
+		_eventError("unable to attach to database for event notification", status);
+		success = false;
+	}
+
+	termFQExpBuffer(&dpb);
+
+	return success;
+}
+
+
+static bool
+_queueEvents(eventListener *listener)
+{
+	ISC_STATUS_ARRAY status;
+
+	pthread_mutex_lock(&listener->lock);
+	listener->fired = false;
+	pthread_mutex_unlock(&listener->lock);
+
+	if (isc_que_events(status, &listener->db, &listener->event_id,
+					   listener->buffer_len, listener->event_buffer,
+					   _eventCallback, listener))
+	{
+		_eventError("unable to register events", status);
+		listener->event_id = 0;
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * _waitForEvents()
+ *
+ * Block until the queued events fire; returns false if interrupted.
+ */
+static bool
+_waitForEvents(eventListener *listener)
+{
+	bool		fired = false;
+
+	pthread_mutex_lock(&listener->lock);
+
+	while (listener->fired == false && cancel_pressed == false)
+	{
+		struct timeval now;
+		struct timespec timeout;
+
+		/* wake up periodically to check for CTRL-C */
+		gettimeofday(&now, NULL);
+		timeout.tv_sec = now.tv_sec + 1;
+		timeout.tv_nsec = now.tv_usec * 1000;
+
+		pthread_cond_timedwait(&listener->cond, &listener->lock, &timeout);
+	}
+
+	fired = listener->fired;
+
+	pthread_mutex_unlock(&listener->lock);
+
+	return fired && cancel_pressed == false;
+}
+
+
+/**
+ * _eventCallback()
+ *
+ * Called by the client library from its own thread when an event fires
+ * (or the request is cancelled, in which case "updated" may be NULL).
+ */
+static void
+_eventCallback(void *arg, ISC_USHORT length, const ISC_UCHAR *updated)
+{
+	eventListener *listener = (eventListener *)arg;
+
+	pthread_mutex_lock(&listener->lock);
+
+	if (updated != NULL && length <= listener->buffer_len)
+		memcpy(listener->result_buffer, updated, length);
+
+	listener->fired = true;
+	pthread_cond_signal(&listener->cond);
+
+	pthread_mutex_unlock(&listener->lock);
+}
+
+
+static void
+_eventError(const char *message, const ISC_STATUS *status)
+{
+	char		buf[512];
+	const ISC_STATUS *pvector = status;
+
+	fbsql_error("%s\n", message);
+
+	while (fb_interpret(buf, sizeof(buf), &pvector))
+		fbsql_error("  %s\n", buf);
+}
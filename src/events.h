@@ -0,0 +1,12 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include "settings.h"
+
+/* Maximum number of events which can be waited for at once */
+#define EVENTS_MAX 15
+
+extern bool
+listenEvents(char **names, int nevents, const char *query, bool batch);
+
+#endif   /* EVENTS_H */
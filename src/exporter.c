@@ -0,0 +1,347 @@
+/* ---------------------------------------------------------------------
+ *
+ * exporter.c
+ *
+ * Prometheus textfile exporter mode (fbsql --exporter FILE): periodically
+ * write database-level metrics from the monitoring tables in Prometheus
+ * text exposition format, for collection by node_exporter's textfile
+ * collector
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "common.h"
+#include "exporter.h"
+#include "query.h"
+#include "settings.h"
+
+typedef struct exporterMetric
+{
+	const char *name;
+	const char *type;
+	const char *help;
+	const char *label;			/* "name=\"value\"" or NULL */
+	int			column;
+} exporterMetric;
+
+/*
+ * All metrics are taken from a single row; the exporter's attachment
+ * itself is excluded from attachment, transaction and statement
+ * counts.
+ */
+static const char *exporter_query =
+"    SELECT d.mon$oldest_transaction, d.mon$oldest_active, \n"
+"           d.mon$oldest_snapshot, d.mon$next_transaction, \n"
+"           d.mon$next_transaction - d.mon$oldest_transaction, \n"
+"           d.mon$next_transaction - d.mon$oldest_active, \n"
+"           d.mon$next_transaction - d.mon$oldest_snapshot, \n"
+"           d.mon$page_buffers, \n"
+"           io.mon$page_fetches, io.mon$page_reads, \n"
+"           io.mon$page_writes, io.mon$page_marks, \n"
+"           COALESCE(m.mon$memory_used, 0), COALESCE(m.mon$memory_allocated, 0), \n"
+"           rs.mon$record_seq_reads, rs.mon$record_idx_reads, \n"
+"           rs.mon$record_inserts, rs.mon$record_updates, rs.mon$record_deletes, \n"
+"           rs.mon$record_backouts, rs.mon$record_purges, rs.mon$record_expunges, \n"
+"           (SELECT COUNT(*) FROM mon$attachments a \n"
+"             WHERE a.mon$state = 1 AND a.mon$attachment_id <> CURRENT_CONNECTION), \n"
+"           (SELECT COUNT(*) FROM mon$attachments a \n"
+"             WHERE a.mon$state = 0 AND a.mon$attachment_id <> CURRENT_CONNECTION), \n"
+"           (SELECT COUNT(*) FROM mon$transactions t \n"
+"             WHERE t.mon$state = 1 AND t.mon$attachment_id <> CURRENT_CONNECTION), \n"
+"           COALESCE((SELECT MAX(DATEDIFF(MILLISECOND FROM s.mon$timestamp TO CURRENT_TIMESTAMP)) \n"
+"                       FROM mon$statements s \n"
+"                      WHERE s.mon$state = 1 AND s.mon$attachment_id <> CURRENT_CONNECTION), 0) / 1000.0 \n"
+"      FROM mon$database d \n"
+"INNER JOIN mon$io_stats io \n"
+"        ON io.mon$stat_id = d.mon$stat_id \n"
+"INNER JOIN mon$record_stats rs \n"
+"        ON rs.mon$stat_id = d.mon$stat_id \n"
+" LEFT JOIN mon$memory_usage m \n"
+"        ON m.mon$stat_id = d.mon$stat_id";
+
+/* metrics sharing a name must be listed consecutively */
+static const exporterMetric metrics[] = {
+	{"firebird_transaction_marker", "gauge", "Transaction marker from MON$DATABASE", "marker=\"oldest_interesting\"", 0},
+	{"firebird_transaction_marker", "gauge", NULL, "marker=\"oldest_active\"", 1},
+	{"firebird_transaction_marker", "gauge", NULL, "marker=\"oldest_snapshot\"", 2},
+	{"firebird_transaction_marker", "gauge", NULL, "marker=\"next\"", 3},
+	{"firebird_transaction_gap", "gauge", "Difference between the next transaction and a transaction marker", "marker=\"oldest_interesting\"", 4},
+	{"firebird_transaction_gap", "gauge", NULL, "marker=\"oldest_active\"", 5},
+	{"firebird_transaction_gap", "gauge", NULL, "marker=\"oldest_snapshot\"", 6},
+	{"firebird_page_buffers", "gauge", "Number of pages in the page cache", NULL, 7},
+	{"firebird_page_fetches_total", "counter", "Page fetches since the database was opened", NULL, 8},
+	{"firebird_page_reads_total", "counter", "Page reads since the database was opened", NULL, 9},
+	{"firebird_page_writes_total", "counter", "Page writes since the database was opened", NULL, 10},
+	{"firebird_page_marks_total", "counter", "Page marks since the database was opened", NULL, 11},
+	{"firebird_memory_used_bytes", "gauge", "Memory in use by the database", NULL, 12},
+	{"firebird_memory_allocated_bytes", "gauge", "Memory allocated from the operating system by the database", NULL, 13},
+	{"firebird_record_operations_total", "counter", "Record-level operations since the database was opened", "operation=\"seq_read\"", 14},
+	{"firebird_record_operations_total", "counter", NULL, "operation=\"idx_read\"", 15},
+	{"firebird_record_operations_total", "counter", NULL, "operation=\"insert\"", 16},
+	{"firebird_record_operations_total", "counter", NULL, "operation=\"update\"", 17},
+	{"firebird_record_operations_total", "counter", NULL, "operation=\"delete\"", 18},
+	{"firebird_record_operations_total", "counter", NULL, "operation=\"backout\"", 19},
+	{"firebird_record_operations_total", "counter", NULL, "operation=\"purge\"", 20},
+	{"firebird_record_operations_total", "counter", NULL, "operation=\"expunge\"", 21},
+	{"firebird_attachments", "gauge", "Attachments to the database", "state=\"active\"", 22},
+	{"firebird_attachments", "gauge", NULL, "state=\"idle\"", 23},
+	{"firebird_active_transactions", "gauge", "Active transactions", NULL, 24},
+	{"firebird_longest_statement_seconds", "gauge", "Age of the longest-running active statement", NULL, 25},
+};
+
+
+static FBresult *_prepareQuery(FBconn *conn);
+static bool _writeMetrics(const char *path, FBresult *res, double scrape_seconds);
+static void _appendLabels(FQExpBuffer buf, const char *database_label, const char *label);
+
+
+/**
+ * exporterRun()
+ *
+ * fbsql --exporter FILE [--interval N]
+ *
+ * Every "interval" seconds, query the monitoring tables and write the
+ * metrics to FILE, until interrupted with CTRL-C or SIGTERM. The file
+ * is written under a temporary name and renamed into place, so the
+ * collector never reads a partial file.
+ *
+ * The session's connection is used throughout, with the monitoring query
+ * prepared once; if the connection is lost, it is re-established at the
+ * next interval and "firebird_up" is reported as 0 in the meantime.
+ *
+ * Returns the program exit code.
+ */
+int
+exporterRun(const char *path, int interval)
+{
+	FBresult   *stmt;
+	long		nscrapes = 0;
+
+	signal(SIGINT, handle_signals);
+	signal(SIGTERM, handle_signals);
+
+	/* each execution in its own transaction, so monitoring data is current */
+	FQsetAutocommit(fset.conn, true);
+
+	stmt = _prepareQuery(fset.conn);
+
+	if (stmt == NULL)
+		return 1;
+
+	printf("Writing metrics every %i s to \"%s\"; press CTRL-C to stop\n",
+		   interval, path);
+	fflush(stdout);
+
+	cancel_pressed = false;
+
+	while (cancel_pressed == false)
+	{
+		FBresult   *res = NULL;
+		query_time	before, after;
+		int			elapsed;
+
+		/* attempt to reconnect if the server went away */
+		if (stmt == NULL)
+		{
+			if (FQstatus(fset.conn) == CONNECTION_BAD)
+			{
+				FBconn *conn = fbsql_connect(fset.dbpath);
+
+				if (FQstatus(conn) != CONNECTION_BAD)
+				{
+					FQfinish(fset.conn);
+					fset.conn = conn;
+					FQsetAutocommit(fset.conn, true);
+				}
+				else
+				{
+					FQfinish(conn);
+				}
+			}
+
+			if (FQstatus(fset.conn) != CONNECTION_BAD)
+				stmt = _prepareQuery(fset.conn);
+		}
+
+		gettimeofday(&before, NULL);
+
+		if (stmt != NULL)
+			res = FQexecPrepared(fset.conn, stmt, 0, NULL, NULL, NULL, NULL, 0);
+
+		gettimeofday(&after, NULL);
+		INSTR_TIME_SUBTRACT(after, before);
+
+		if (stmt != NULL && (FQresultStatus(res) != FBRES_TUPLES_OK || FQntuples(res) == 0))
+		{
+			fbsql_error("unable to read monitoring tables\n%s",
+						res ? FQresultErrorMessage(res) : FQerrorMessage(fset.conn));
+
+			if (res != NULL)
+				FQclear(res);
+			res = NULL;
+
+			if (FQstatus(fset.conn) == CONNECTION_BAD)
+			{
+				FQclear(stmt);
+				stmt = NULL;
+			}
+		}
+
+		if (_writeMetrics(path, res, INSTR_TIME_GET_MILLISEC(after) / 1000) == false)
+		{
+			if (res != NULL)
+				FQclear(res);
+			if (stmt != NULL)
+				FQclear(stmt);
+			return 1;
+		}
+
+		if (res != NULL)
+		{
+			nscrapes++;
+			FQclear(res);
+		}
+
+		for (elapsed = 0; elapsed < interval && cancel_pressed == false; elapsed++)
+			sleep(1);
+	}
+
+	printf("%li metrics update(s) written\n", nscrapes);
+
+	if (stmt != NULL)
+		FQclear(stmt);
+
+	return 0;
+}
+
+
+static FBresult *
+_prepareQuery(FBconn *conn)
+{
+	FBresult   *stmt = FQprepare(conn, exporter_query, 0);
+
+	if (stmt == NULL || FQresultStatus(stmt) == FBRES_FATAL_ERROR)
+	{
+		fbsql_error("unable to prepare monitoring query\n%s",
+					stmt ? FQresultErrorMessage(stmt) : FQerrorMessage(conn));
+
+		if (stmt != NULL)
+			FQclear(stmt);
+
+		return NULL;
+	}
+
+	return stmt;
+}
+
+
+/**
+ * _writeMetrics()
+ *
+ * Write the metrics from "res" to a temporary file and atomically
+ * rename it to "path"; if "res" is NULL, only "firebird_up 0" is
+ * written.
+ */
+static bool
+_writeMetrics(const char *path, FBresult *res, double scrape_seconds)
+{
+	FQExpBufferData buf;
+	FQExpBufferData database_label;
+	FQExpBufferData tmp_path;
+	FILE	   *fp;
+	const char *p;
+	int			i;
+	bool		success = true;
+
+	/* label values escape backslashes and double quotes */
+	initFQExpBuffer(&database_label);
+	appendFQExpBufferStr(&database_label, "database=\"");
+
+	for (p = fset.dbpath; *p != '\0'; p++)
+	{
+		if (*p == '\\' || *p == '"')
+			appendFQExpBufferChar(&database_label, '\\');
+		appendFQExpBufferChar(&database_label, *p);
+	}
+
+	appendFQExpBufferChar(&database_label, '"');
+
+	initFQExpBuffer(&buf);
+
+	appendFQExpBufferStr(&buf, "# HELP firebird_up Whether the monitoring tables could be read\n");
+	appendFQExpBufferStr(&buf, "# TYPE firebird_up gauge\n");
+	appendFQExpBuffer(&buf, "firebird_up{%s} %i\n", database_label.data, res != NULL ? 1 : 0);
+
+	appendFQExpBufferStr(&buf, "# HELP firebird_exporter_scrape_duration_seconds Time taken to read the monitoring tables\n");
+	appendFQExpBufferStr(&buf, "# TYPE firebird_exporter_scrape_duration_seconds gauge\n");
+	appendFQExpBuffer(&buf, "firebird_exporter_scrape_duration_seconds{%s} %.6f\n",
+					  database_label.data, scrape_seconds);
+
+	for (i = 0; res != NULL && i < lengthof(metrics); i++)
+	{
+		if (metrics[i].help != NULL)
+		{
+			appendFQExpBuffer(&buf, "# HELP %s %s\n", metrics[i].name, metrics[i].help);
+			appendFQExpBuffer(&buf, "# TYPE %s %s\n", metrics[i].name, metrics[i].type);
+		}
+
+		if (FQgetisnull(res, 0, metrics[i].column))
+			continue;
+
+		appendFQExpBufferStr(&buf, metrics[i].name);
+		_appendLabels(&buf, database_label.data, metrics[i].label);
+		appendFQExpBuffer(&buf, " %s\n", FQgetvalue(res, 0, metrics[i].column));
+	}
+
+	initFQExpBuffer(&tmp_path);
+	appendFQExpBuffer(&tmp_path, "%s.tmp", path);
+
+	fp = fopen(tmp_path.data, "w");
+
+	if (fp == NULL)
+	{
+		fbsql_error("unable to open \"%s\" for writing\n", tmp_path.data);
+		success = false;
+	}
+	else
+	{
+		if (fwrite(buf.data, 1, buf.len, fp) != buf.len)
+			success = false;
+
+		if (fclose(fp) != 0)
+			success = false;
+
+		if (success == false || rename(tmp_path.data, path) != 0)
+		{
+			fbsql_error("unable to write \"%s\"\n", path);
+			unlink(tmp_path.data);
+			success = false;
+		}
+	}
+
+	termFQExpBuffer(&tmp_path);
+	termFQExpBuffer(&buf);
+	termFQExpBuffer(&database_label);
+
+	return success;
+}
+
+
+static void
+_appendLabels(FQExpBuffer buf, const char *database_label, const char *label)
+{
+	if (label != NULL)
+		appendFQExpBuffer(buf, "{%s,%s}", database_label, label);
+	else
+		appendFQExpBuffer(buf, "{%s}", database_label);
+}
@@ -0,0 +1,9 @@
+#ifndef EXPORTER_H
+#define EXPORTER_H
+
+#include "settings.h"
+
+extern int
+exporterRun(const char *path, int interval);
+
+#endif   /* EXPORTER_H */
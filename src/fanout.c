@@ -0,0 +1,652 @@
+/* ---------------------------------------------------------------------
+ *
+ * fanout.c
+ *
+ * \fanout: execute a query concurrently on a list of databases and
+ * display the merged results
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "common.h"
+#include "fanout.h"
+#include "parallel.h"
+#include "port.h"
+#include "query.h"
+#include "settings.h"
+
+typedef struct fanoutSource
+{
+	char	   *dbpath;
+	FBresult   *result;
+	char	   *error;
+} fanoutSource;
+
+typedef struct fanoutRun
+{
+	const char *query;
+	fanoutSource *sources;
+	int			nsources;
+} fanoutRun;
+
+/*
+ * Merged result; each row is an array of "ncolumns" values, NULL
+ * representing a NULL value.
+ */
+typedef struct fanoutResult
+{
+	int			ncolumns;
+	char	  **headers;
+	bool	   *numeric;
+	char	 ***rows;
+	long		nrows;
+	long		alloc_rows;
+} fanoutResult;
+
+/* sort parameters, for the qsort() comparison functions */
+static const fanoutResult *sort_result = NULL;
+static int	sort_column = -1;
+static bool sort_desc = false;
+
+static int _readDatabaseList(const char *filename, fanoutSource **sources);
+static bool _fanoutJob(FBconn *conn, int worker, int job, void *arg);
+static bool _collectRows(fanoutRun *run, fanoutResult *result, bool add_source);
+static void _mergeRows(fanoutResult *result, fanoutMerge merge);
+static int	_findColumn(const fanoutResult *result, const char *name);
+static int	_compareValues(const char *a, const char *b, bool numeric);
+static int	_compareKeys(const void *a, const void *b);
+static int	_compareColumn(const void *a, const void *b);
+static char *_combineValues(const char *a, const char *b, fanoutMerge merge);
+static int	_decimalPlaces(const char *value);
+static bool _isNumericType(short type);
+
+
+/**
+ * execFanout()
+ *
+ * \fanout FILE [order by COLUMN [asc|desc]] [limit N] [merge sum|min|max]
+ *         [workers N] QUERY
+ *
+ * Execute "query" on each database listed in "filename", each on its own
+ * connection and concurrently (up to "nworkers" at a time), and display
+ * the rows returned by all databases as a single result, with an
+ * additional first column containing the database each row came from.
+ *
+ * With "merge", the rows are instead combined client-side by grouping on
+ * the non-numeric columns and aggregating the numeric ones (e.g. to
+ * combine per-database COUNT(*) or SUM() results), without the database
+ * column. The merged rows are then sorted and limited as specified.
+ *
+ * Errors are reported per database after the result; returns false if
+ * any database could not be queried.
+ */
+bool
+execFanout(const char *filename, const char *query, const fanoutOptions *options)
+{
+	fanoutRun	run;
+	fanoutResult result;
+	fbsqlTable	table;
+	query_time	before, after;
+	int			nworkers;
+	int			nfailed = 0;
+	int			order_column = -1;
+	long		i;
+	int			j;
+	bool		success = true;
+
+	memset(&run, 0, sizeof(run));
+	memset(&result, 0, sizeof(result));
+
+	run.nsources = _readDatabaseList(filename, &run.sources);
+
+	if (run.nsources < 0)
+		return false;
+
+	if (run.nsources == 0)
+	{
+		fbsql_error("\\fanout: no databases listed in \"%s\"\n", filename);
+		free(run.sources);
+		return false;
+	}
+
+	run.query = query;
+
+	nworkers = options->nworkers > 0 ? options->nworkers : run.nsources;
+
+	if (nworkers > PARALLEL_MAX_WORKERS)
+		nworkers = PARALLEL_MAX_WORKERS;
+
+	gettimeofday(&before, NULL);
+
+	runParallelTasks(nworkers, run.nsources, _fanoutJob, &run);
+
+	if (_collectRows(&run, &result, options->merge == FANOUT_MERGE_NONE) == true)
+	{
+		if (options->merge != FANOUT_MERGE_NONE)
+			_mergeRows(&result, options->merge);
+
+		if (options->order_by != NULL)
+		{
+			order_column = _findColumn(&result, options->order_by);
+
+			if (order_column < 0)
+			{
+				fbsql_error("\\fanout: column \"%s\" not found in result\n", options->order_by);
+				success = false;
+			}
+			else
+			{
+				sort_result = &result;
+				sort_column = order_column;
+				sort_desc = options->order_desc;
+				qsort(result.rows, result.nrows, sizeof(char **), _compareColumn);
+			}
+		}
+
+		if (options->limit >= 0 && result.nrows > options->limit)
+		{
+			for (i = options->limit; i < result.nrows; i++)
+			{
+				for (j = 0; j < result.ncolumns; j++)
+					free(result.rows[i][j]);
+				free(result.rows[i]);
+			}
+
+			result.nrows = options->limit;
+		}
+
+		gettimeofday(&after, NULL);
+		INSTR_TIME_SUBTRACT(after, before);
+
+		if (success == true)
+		{
+			initTable(&table, result.ncolumns, (const char * const *)result.headers);
+
+			for (j = 0; j < result.ncolumns; j++)
+				table.right_align[j] = result.numeric[j];
+
+			for (i = 0; i < result.nrows; i++)
+				addTableRow(&table, (const char * const *)result.rows[i]);
+
+			printTable(&table, &fset.popt);
+			printf("(%li rows)\n", result.nrows);
+
+			termTable(&table);
+		}
+	}
+	else
+	{
+		gettimeofday(&after, NULL);
+		INSTR_TIME_SUBTRACT(after, before);
+	}
+
+	/* report errors in database list order */
+	for (j = 0; j < run.nsources; j++)
+	{
+		if (run.sources[j].error == NULL)
+			continue;
+
+		nfailed++;
+		printf("error querying database \"%s\":\n%s\n",
+			   run.sources[j].dbpath, run.sources[j].error);
+	}
+
+	printf("%i of %i database(s) queried successfully", run.nsources - nfailed, run.nsources);
+
+	if (fset.timing)
+		printf(" (%.3f ms)", INSTR_TIME_GET_MILLISEC(after));
+
+	puts("");
+
+	for (i = 0; i < result.nrows; i++)
+	{
+		for (j = 0; j < result.ncolumns; j++)
+			free(result.rows[i][j]);
+		free(result.rows[i]);
+	}
+
+	for (j = 0; j < result.ncolumns; j++)
+		free(result.headers[j]);
+
+	free(result.rows);
+	free(result.headers);
+	free(result.numeric);
+
+	for (j = 0; j < run.nsources; j++)
+	{
+		if (run.sources[j].result != NULL)
+			FQclear(run.sources[j].result);
+
+		free(run.sources[j].dbpath);
+		free(run.sources[j].error);
+	}
+
+	free(run.sources);
+
+	return success && nfailed == 0;
+}
+
+
+/**
+ * _readDatabaseList()
+ *
+ * Read database paths from "filename", one per line; blank lines and
+ * lines beginning with '#' are ignored. Returns the number of databases,
+ * or -1 if the file could not be read.
+ */
+static int
+_readDatabaseList(const char *filename, fanoutSource **sources)
+{
+	FILE	   *fp = fopen(filename, "r");
+	char	   *line = NULL;
+	size_t		line_len = 0;
+	int			nsources = 0;
+	int			alloc_sources = 16;
+
+	if (fp == NULL)
+	{
+		fbsql_error("\\fanout: unable to open \"%s\": %s\n", filename, strerror(errno));
+		return -1;
+	}
+
+	*sources = (fanoutSource *)fb_malloc0(alloc_sources * sizeof(fanoutSource));
+
+	while (getline(&line, &line_len, fp) != -1)
+	{
+		char	   *start = line;
+		char	   *end;
+
+		while (isspace((unsigned char)*start))
+			start++;
+
+		end = start + strlen(start);
+
+		while (end > start && isspace((unsigned char)end[-1]))
+			end--;
+
+		*end = '\0';
+
+		if (*start == '\0' || *start == '#')
+			continue;
+
+		if (nsources == alloc_sources)
+		{
+			alloc_sources *= 2;
+			*sources = (fanoutSource *)realloc(*sources, alloc_sources * sizeof(fanoutSource));
+		}
+
+		memset(&(*sources)[nsources], 0, sizeof(fanoutSource));
+		(*sources)[nsources++].dbpath = strdup(start);
+	}
+
+	free(line);
+	fclose(fp);
+
+	return nsources;
+}
+
+
+/**
+ * _fanoutJob()
+ *
+ * Worker function: connect to one database and execute the query,
+ * retaining the result.
+ */
+static bool
+_fanoutJob(FBconn *conn, int worker, int job, void *arg)
+{
+	fanoutRun  *run = (fanoutRun *)arg;
+	fanoutSource *source = &run->sources[job];
+	FBresult   *res;
+
+	conn = fbsql_connect(source->dbpath);
+
+	if (FQstatus(conn) == CONNECTION_BAD)
+	{
+		source->error = strdup(FQerrorMessage(conn));
+		FQfinish(conn);
+		return false;
+	}
+
+	FQsetAutocommit(conn, true);
+
+	res = FQexec(conn, run->query);
+
+	switch (FQresultStatus(res))
+	{
+		case FBRES_TUPLES_OK:
+			source->result = res;
+			break;
+
+		case FBRES_EMPTY_QUERY:
+		case FBRES_BAD_RESPONSE:
+		case FBRES_NONFATAL_ERROR:
+		case FBRES_FATAL_ERROR:
+			source->error = strdup(res ? FQresultErrorMessage(res) : FQerrorMessage(conn));
+			break;
+
+		default:
+			source->error = strdup("query did not return a result");
+	}
+
+	if (res != NULL && source->result == NULL)
+		FQclear(res);
+
+	FQfinish(conn);
+
+	return source->error == NULL;
+}
+
+
+/**
+ * _collectRows()
+ *
+ * Copy the rows of all successful results into "result", optionally
+ * preceded by the database path. A result whose columns do not match
+ * those of the first successful result is treated as an error.
+ *
+ * Returns false if no database returned a result.
+ */
+static bool
+_collectRows(fanoutRun *run, fanoutResult *result, bool add_source)
+{
+	const FBresult *first = NULL;
+	int			offset = add_source ? 1 : 0;
+	int			nfields = 0;
+	int			i, j, k;
+
+	for (i = 0; i < run->nsources && first == NULL; i++)
+		first = run->sources[i].result;
+
+	if (first == NULL)
+		return false;
+
+	nfields = FQnfields(first);
+
+	result->ncolumns = nfields + offset;
+	result->headers = (char **)fb_malloc0(result->ncolumns * sizeof(char *));
+	result->numeric = (bool *)fb_malloc0(result->ncolumns * sizeof(bool));
+	result->alloc_rows = 64;
+	result->rows = (char ***)malloc(result->alloc_rows * sizeof(char **));
+
+	if (add_source)
+		result->headers[0] = strdup("database");
+
+	for (j = 0; j < nfields; j++)
+	{
+		result->headers[j + offset] = strdup(FQfname(first, j));
+		result->numeric[j + offset] = _isNumericType(FQftype(first, j));
+	}
+
+	for (i = 0; i < run->nsources; i++)
+	{
+		fanoutSource *source = &run->sources[i];
+		const FBresult *res = source->result;
+
+		if (res == NULL)
+			continue;
+
+		if (FQnfields(res) != nfields)
+		{
+			char		message[128];
+
+			snprintf(message, sizeof(message),
+					 "query returned %i column(s), but the first database returned %i",
+					 FQnfields(res), nfields);
+
+			source->error = strdup(message);
+			continue;
+		}
+
+		for (k = 0; k < FQntuples(res); k++)
+		{
+			char	  **row;
+
+			if (result->nrows == result->alloc_rows)
+			{
+				result->alloc_rows *= 2;
+				result->rows = (char ***)realloc(result->rows, result->alloc_rows * sizeof(char **));
+			}
+
+			row = (char **)fb_malloc0(result->ncolumns * sizeof(char *));
+
+			if (add_source)
+				row[0] = strdup(source->dbpath);
+
+			for (j = 0; j < nfields; j++)
+			{
+				if (FQgetisnull(res, k, j))
+					row[j + offset] = NULL;
+				else if (FQftype(res, j) == SQL_DB_KEY)
+					row[j + offset] = FQformatDbKey(res, k, j);
+				else
+					row[j + offset] = strdup(FQgetvalue(res, k, j));
+			}
+
+			result->rows[result->nrows++] = row;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+ * _mergeRows()
+ *
+ * Combine rows with the same values in all non-numeric columns, applying
+ * "merge" to each numeric column; NULL values are ignored, as in SQL
+ * aggregate functions.
+ */
+static void
+_mergeRows(fanoutResult *result, fanoutMerge merge)
+{
+	long		i, merged = 0;
+	int			j;
+
+	if (result->nrows == 0)
+		return;
+
+	sort_result = result;
+	qsort(result->rows, result->nrows, sizeof(char **), _compareKeys);
+
+	for (i = 1; i < result->nrows; i++)
+	{
+		char	  **target = result->rows[merged];
+		char	  **row = result->rows[i];
+
+		if (_compareKeys(&target, &row) != 0)
+		{
+			result->rows[++merged] = row;
+			continue;
+		}
+
+		for (j = 0; j < result->ncolumns; j++)
+		{
+			if (result->numeric[j] == true)
+			{
+				char *combined = _combineValues(target[j], row[j], merge);
+
+				free(target[j]);
+				target[j] = combined;
+			}
+
+			free(row[j]);
+		}
+
+		free(row);
+	}
+
+	result->nrows = merged + 1;
+}
+
+
+static int
+_findColumn(const fanoutResult *result, const char *name)
+{
+	char	   *end;
+	long		column = strtol(name, &end, 10);
+	int			j;
+
+	/* column number, counting from 1 */
+	if (*name != '\0' && *end == '\0')
+		return column >= 1 && column <= result->ncolumns ? (int)column - 1 : -1;
+
+	for (j = 0; j < result->ncolumns; j++)
+	{
+		if (pg_strcasecmp(result->headers[j], name) == 0)
+			return j;
+	}
+
+	return -1;
+}
+
+
+/**
+ * _compareValues()
+ *
+ * Compare two column values, numerically if "numeric"; NULLs sort last.
+ */
+static int
+_compareValues(const char *a, const char *b, bool numeric)
+{
+	if (a == NULL || b == NULL)
+		return (a == NULL) - (b == NULL);
+
+	if (numeric == true)
+	{
+		long double x = strtold(a, NULL);
+		long double y = strtold(b, NULL);
+
+		return (x > y) - (x < y);
+	}
+
+	return strcmp(a, b);
+}
+
+
+/* qsort() comparison function for grouping on non-numeric columns */
+static int
+_compareKeys(const void *a, const void *b)
+{
+	char	  **x = *(char ***)a;
+	char	  **y = *(char ***)b;
+	int			j;
+
+	for (j = 0; j < sort_result->ncolumns; j++)
+	{
+		int cmp;
+
+		if (sort_result->numeric[j] == true)
+			continue;
+
+		cmp = _compareValues(x[j], y[j], false);
+
+		if (cmp != 0)
+			return cmp;
+	}
+
+	return 0;
+}
+
+
+/* qsort() comparison function for "order by" */
+static int
+_compareColumn(const void *a, const void *b)
+{
+	char	  **x = *(char ***)a;
+	char	  **y = *(char ***)b;
+	int			cmp;
+
+	/* NULLs sort last in either direction */
+	if (x[sort_column] == NULL || y[sort_column] == NULL)
+		return _compareValues(x[sort_column], y[sort_column], false);
+
+	cmp = _compareValues(x[sort_column], y[sort_column], sort_result->numeric[sort_column]);
+
+	return sort_desc ? -cmp : cmp;
+}
+
+
+/**
+ * _combineValues()
+ *
+ * Apply "merge" to two numeric values, returning a newly allocated value
+ * with as many decimal places as the more precise of the two.
+ */
+static char *
+_combineValues(const char *a, const char *b, fanoutMerge merge)
+{
+	long double x, y, combined;
+	int			decimals;
+	char		buf[128];
+
+	if (a == NULL || b == NULL)
+		return a == NULL ? (b == NULL ? NULL : strdup(b)) : strdup(a);
+
+	x = strtold(a, NULL);
+	y = strtold(b, NULL);
+
+	switch (merge)
+	{
+		case FANOUT_MERGE_MIN:
+			return strdup(x <= y ? a : b);
+
+		case FANOUT_MERGE_MAX:
+			return strdup(x >= y ? a : b);
+
+		default:
+			combined = x + y;
+	}
+
+	decimals = _decimalPlaces(a) > _decimalPlaces(b) ? _decimalPlaces(a) : _decimalPlaces(b);
+
+	snprintf(buf, sizeof(buf), "%.*Lf", decimals, combined);
+
+	return strdup(buf);
+}
+
+
+static int
+_decimalPlaces(const char *value)
+{
+	const char *point = strchr(value, '.');
+	int			decimals = 0;
+
+	if (point == NULL)
+		return 0;
+
+	for (point++; isdigit((unsigned char)*point); point++)
+		decimals++;
+
+	return decimals;
+}
+
+
+static bool
+_isNumericType(short type)
+{
+	switch (type)
+	{
+		case SQL_SHORT:
+		case SQL_LONG:
+		case SQL_INT64:
+#if defined SQL_INT128
+		case SQL_INT128:
+#endif
+		case SQL_FLOAT:
+		case SQL_DOUBLE:
+			return true;
+		default:
+			return false;
+	}
+}
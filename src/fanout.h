@@ -0,0 +1,26 @@
+#ifndef FANOUT_H
+#define FANOUT_H
+
+#include "settings.h"
+
+typedef enum
+{
+	FANOUT_MERGE_NONE,
+	FANOUT_MERGE_SUM,
+	FANOUT_MERGE_MIN,
+	FANOUT_MERGE_MAX
+} fanoutMerge;
+
+typedef struct fanoutOptions
+{
+	char	   *order_by;		/* column name or number; NULL: none */
+	bool		order_desc;
+	long		limit;			/* -1: no limit */
+	fanoutMerge merge;
+	int			nworkers;		/* 0: one per database */
+} fanoutOptions;
+
+extern bool
+execFanout(const char *filename, const char *query, const fanoutOptions *options);
+
+#endif   /* FANOUT_H */
@@ -51,6 +51,12 @@ extern char *fbsql_scan_slash_option(FbsqlScanState state,
 
 extern void fbsql_scan_slash_command_end(FbsqlScanState state);
 
+extern int fbsql_scan_bind_values(FbsqlScanState state,
+					   const char * const **values);
+extern void fbsql_scan_clear_bind_values(FbsqlScanState state);
+
+extern char *fbsql_fingerprint(const char *query);
+
 
 
 #endif   /* FBSQLSCAN_H */
@@ -0,0 +1,325 @@
+/* ---------------------------------------------------------------------
+ *
+ * gexec.c
+ *
+ * \gexec: execute each value of a query result as a statement
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "common.h"
+#include "gexec.h"
+#include "parallel.h"
+#include "query.h"
+#include "settings.h"
+#include "txmode.h"
+
+typedef struct gexecRun
+{
+	char	  **statements;
+	int			nstatements;
+	int			batch;			/* statements per job */
+	int			executed;
+	int			failed;
+} gexecRun;
+
+static bool _gexecSerial(gexecRun *run);
+static bool _gexecJob(FBconn *conn, int worker, int job, void *arg);
+static bool _endTransaction(FBconn *conn, const char *command);
+
+
+/**
+ * execGexec()
+ *
+ * \gexec [batch N] [workers N]
+ *
+ * Execute "query", then execute each non-NULL value of the result (in
+ * row order, and column order within each row) as a statement, stopping
+ * at the first error. The query is executed in a transaction started
+ * with the session's transaction mode (\txmode), if set.
+ *
+ * In autocommit mode, the statements are executed in a single
+ * transaction, or if "batch" is set, a transaction per "batch"
+ * statements; otherwise they are executed in the session's current
+ * transaction. Statements executed beforehand in batched autocommit mode
+ * are committed first.
+ *
+ * If "nworkers" is greater than 1, the statements are divided into jobs
+ * of "batch" statements (default: 1) executed in parallel on separate
+ * connections, each job in its own transaction; a failed job does not
+ * prevent the others from being executed.
+ */
+bool
+execGexec(const char *query, int nparams, const char * const *params,
+		  int batch, int nworkers)
+{
+	FBresult   *query_result;
+	gexecRun	run;
+	query_time	before, after;
+	bool		success = true;
+	int			i, j;
+
+	if (autocommitBatchFlush() == false)
+		return false;
+
+	if (startTransaction(fset.conn, query) == false)
+		return false;
+
+	if (nparams > 0)
+		query_result = FQexecParams(fset.conn, query, nparams, NULL, params, NULL, NULL, 0);
+	else
+		query_result = FQexec(fset.conn, query);
+
+	if (FQresultStatus(query_result) != FBRES_TUPLES_OK)
+	{
+		if (FQresultStatus(query_result) == FBRES_COMMAND_OK)
+			fbsql_error("\\gexec: query did not return a result\n");
+		else
+			printf("%s\n", query_result ? FQresultErrorMessage(query_result) : FQerrorMessage(fset.conn));
+
+		if (query_result != NULL)
+			FQclear(query_result);
+
+		return false;
+	}
+
+	memset(&run, 0, sizeof(run));
+	run.statements = (char **)fb_malloc0((FQntuples(query_result) * FQnfields(query_result) + 1) * sizeof(char *));
+
+	for (i = 0; i < FQntuples(query_result); i++)
+	{
+		for (j = 0; j < FQnfields(query_result); j++)
+		{
+			if (FQgetisnull(query_result, i, j) == false)
+				run.statements[run.nstatements++] = strdup(FQgetvalue(query_result, i, j));
+		}
+	}
+
+	FQclear(query_result);
+
+	run.batch = batch;
+
+	if (run.nstatements == 0)
+	{
+		/* nothing to do */
+	}
+	else if (nworkers > 1)
+	{
+		int njobs;
+
+		if (run.batch == 0)
+			run.batch = 1;
+
+		njobs = (run.nstatements + run.batch - 1) / run.batch;
+
+		printf("Executing %i statement(s) using %i worker(s)\n",
+			   run.nstatements,
+			   nworkers < njobs ? nworkers : njobs);
+
+		gettimeofday(&before, NULL);
+
+		success = runParallelJobs(nworkers, njobs, _gexecJob, &run);
+
+		gettimeofday(&after, NULL);
+		INSTR_TIME_SUBTRACT(after, before);
+
+		printf("%i of %i statement(s) executed", run.executed, run.nstatements);
+
+		if (run.failed > 0)
+			printf("; %i job(s) failed", run.failed);
+
+		printf(" (%.3f ms)\n", INSTR_TIME_GET_MILLISEC(after));
+	}
+	else
+	{
+		success = _gexecSerial(&run);
+	}
+
+	for (i = 0; i < run.nstatements; i++)
+		free(run.statements[i]);
+
+	free(run.statements);
+
+	return success;
+}
+
+
+/**
+ * _gexecSerial()
+ *
+ * Execute the statements on the session's connection, displaying each
+ * result as usual.
+ */
+static bool
+_gexecSerial(gexecRun *run)
+{
+	bool		commit_batches = fset.autocommit;
+	int			uncommitted = 0;
+	int			i;
+
+	/* statements are committed explicitly, per batch, rather than by libfq or fbsql */
+	if (commit_batches == true)
+	{
+		if (autocommitBatchFlush() == false)
+			return false;
+
+		autocommitSuspend(true);
+		FQsetAutocommit(fset.conn, false);
+	}
+
+	for (i = 0; i < run->nstatements; i++)
+	{
+		if (SendQuery(run->statements[i]) == false)
+		{
+			run->failed++;
+			break;
+		}
+
+		run->executed++;
+		uncommitted++;
+
+		if (commit_batches == true && run->batch > 0 && uncommitted == run->batch)
+		{
+			if (_endTransaction(fset.conn, "COMMIT") == false)
+			{
+				run->failed++;
+				break;
+			}
+
+			uncommitted = 0;
+		}
+	}
+
+	if (commit_batches == true)
+	{
+		if (run->failed == 0)
+		{
+			if (_endTransaction(fset.conn, "COMMIT") == false)
+				run->failed++;
+		}
+		else
+		{
+			_endTransaction(fset.conn, "ROLLBACK");
+		}
+
+		/* restore the session's mode, which may be managed by fbsql */
+		autocommitSuspend(false);
+		FQsetAutocommit(fset.conn, autocommitManaged() == false);
+	}
+
+	if (run->failed > 0)
+	{
+		fbsql_error("\\gexec: statement %i of %i failed", i + 1, run->nstatements);
+
+		if (commit_batches == true && uncommitted > 0)
+			fbsql_error("; %i uncommitted statement(s) rolled back", uncommitted);
+
+		fbsql_error("\n");
+
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * _gexecJob()
+ *
+ * Worker function for parallel execution: execute one batch of
+ * statements in a single transaction.
+ */
+static bool
+_gexecJob(FBconn *conn, int worker, int job, void *arg)
+{
+	gexecRun   *run = (gexecRun *)arg;
+	int			first = job * run->batch;
+	int			last = first + run->batch;
+	int			i;
+
+	if (last > run->nstatements)
+		last = run->nstatements;
+
+	FQsetAutocommit(conn, false);
+
+	for (i = first; i < last; i++)
+	{
+		FBresult   *res = FQexec(conn, run->statements[i]);
+
+		switch (FQresultStatus(res))
+		{
+			case FBRES_EMPTY_QUERY:
+			case FBRES_BAD_RESPONSE:
+			case FBRES_NONFATAL_ERROR:
+			case FBRES_FATAL_ERROR:
+				parallelOutputLock();
+				run->failed++;
+				printf("error executing statement %i:\n%s\n%s\n",
+					   i + 1, run->statements[i],
+					   res ? FQresultErrorMessage(res) : FQerrorMessage(conn));
+				parallelOutputUnlock();
+
+				if (res != NULL)
+					FQclear(res);
+
+				_endTransaction(conn, "ROLLBACK");
+				FQsetAutocommit(conn, true);
+
+				return false;
+
+			default:
+				FQclear(res);
+		}
+	}
+
+	if (_endTransaction(conn, "COMMIT") == false)
+	{
+		parallelOutputLock();
+		run->failed++;
+		printf("error committing statements %i to %i:\n%s\n",
+			   first + 1, last, FQerrorMessage(conn));
+		parallelOutputUnlock();
+
+		FQsetAutocommit(conn, true);
+
+		return false;
+	}
+
+	parallelOutputLock();
+	run->executed += last - first;
+	parallelOutputUnlock();
+
+	FQsetAutocommit(conn, true);
+
+	return true;
+}
+
+
+static bool
+_endTransaction(FBconn *conn, const char *command)
+{
+	FBresult   *res;
+	bool		success;
+
+	if (FQisActiveTransaction(conn) == false)
+		return true;
+
+	res = FQexec(conn, command);
+	success = FQresultStatus(res) == FBRES_TRANSACTION_COMMIT
+		|| FQresultStatus(res) == FBRES_TRANSACTION_ROLLBACK;
+
+	if (success == false)
+		printf("%s\n", res ? FQresultErrorMessage(res) : FQerrorMessage(conn));
+
+	if (res != NULL)
+		FQclear(res);
+
+	return success;
+}
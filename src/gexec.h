@@ -0,0 +1,10 @@
+#ifndef GEXEC_H
+#define GEXEC_H
+
+#include "settings.h"
+
+extern bool
+execGexec(const char *query, int nparams, const char * const *params,
+		  int batch, int nworkers);
+
+#endif   /* GEXEC_H */
@@ -22,12 +22,16 @@
 #include "command.h"
 #include "query.h"
 #include "fbsqlscan.h"
+#include "parallelblock.h"
 
 char prompt[128] = "";
 
 char *
 _formatPrompt(void);
 
+static bool
+_sendQuery(FbsqlScanState scan_state, const char *query);
+
 /*
  * Main loop for processing input
  *
@@ -57,6 +61,7 @@ InputLoop(FILE *source)
 	bool		success;
 	int			added_nl_pos;
 	bool		line_saved_in_history;
+	bool		in_transaction;
 
 	volatile bool die_on_error = false;
 
@@ -148,7 +153,7 @@ InputLoop(FILE *source)
 				}
 
 				/* execute query */
-				success = SendQuery(query_buf->data);
+				success = _sendQuery(scan_state, query_buf->data);
 
 				/* transfer query to previous_buf by pointer-swapping */
 				{
@@ -188,13 +193,22 @@ InputLoop(FILE *source)
 
 
 				/* execute backslash command */
+				in_transaction = FQisActiveTransaction(fset.conn);
+
 				slashCmdStatus = HandleSlashCmds(scan_state,
 												 query_buf->len > 0 ?
 												 query_buf : previous_buf);
 
+				/*
+				 * If fbsql is managing autocommit, don't leave open a
+				 * transaction started by the command's own queries.
+				 */
+				if (in_transaction == false && slashCmdStatus != FBSQL_CMD_SEND)
+					autocommitBatchFlush();
+
 				if (slashCmdStatus == FBSQL_CMD_SEND)
 				{
-					success = SendQuery(query_buf->data);
+					success = _sendQuery(scan_state, query_buf->data);
 
 					/* transfer query to previous_buf by pointer-swapping */
 					{
@@ -212,6 +226,8 @@ InputLoop(FILE *source)
 					break;
 				else if (slashCmdStatus == FBSQL_CMD_ERROR)
 					printf("Invalid slash command \"%s\". Show help with \\? \n", line);
+				else if (slashCmdStatus == FBSQL_CMD_FAILED)
+					success = false;
 			}
 
 			/* fall out of loop if lexer reached EOL */
@@ -239,6 +255,12 @@ InputLoop(FILE *source)
 
 	destroyFQExpBuffer(query_buf);
 
+	if (parallelBlockActive() == true)
+	{
+		fbsql_error("\\parallel block not terminated with \\endparallel; statements not executed\n");
+		parallelBlockDiscard();
+	}
+
 	return successResult;
 }
 
@@ -258,3 +280,28 @@ _formatPrompt(void)
 
 	return prompt;
 }
+
+
+/**
+ * _sendQuery()
+ *
+ * Execute the query, binding any variable values collected by the lexer,
+ * or add it to the current \parallel block.
+ */
+static bool
+_sendQuery(FbsqlScanState scan_state, const char *query)
+{
+	const char * const *params;
+	int			nparams = fbsql_scan_bind_values(scan_state, &params);
+	bool		success = true;
+
+	/* statements in a \parallel block are executed at \endparallel */
+	if (parallelBlockActive() == true)
+		parallelBlockAdd(query, nparams, params);
+	else
+		success = SendQueryParams(query, nparams, params);
+
+	fbsql_scan_clear_bind_values(scan_state);
+
+	return success;
+}
@@ -25,7 +25,27 @@
 #include "input.h"
 #include "inputloop.h"
 #include "common.h"
-
+#include "planhistory.h"
+#include "query.h"
+#include "protocol.h"
+#include "daemon.h"
+#include "events.h"
+#include "exporter.h"
+#include "recorder.h"
+#include "txmode.h"
+
+
+/* long options without a short equivalent */
+#define OPT_RECORD		1001
+#define OPT_INTERVAL	1002
+#define OPT_EXPORTER	1003
+#define OPT_LISTEN		1004
+#define OPT_ON_EVENT	1005
+#define OPT_DAEMON		1006
+#define OPT_VIA			1007
+#define OPT_POOL_SIZE	1008
+#define OPT_PROTOCOL	1009
+#define OPT_TXMODE		1010
 
 /*
  * Global fbsql options
@@ -46,9 +66,6 @@ static void show_version(void);
 int
 main(int argc, char *argv[])
 {
-	const char *kw[FBCONN_MAX_PARAMS + 1];
-	const char *val[FBCONN_MAX_PARAMS + 1];
-	int i = 0;
 	int result;
 
 	init_settings();
@@ -58,6 +75,13 @@ main(int argc, char *argv[])
 
 	parse_fbsql_options(argc, argv);
 
+	/* the daemon holds the connection, so no connection parameters are needed */
+	if (fset.via_socket != NULL)
+		return daemonClientRun(fset.via_socket);
+
+	if (fset.protocol == true)
+		protocolRedirectOutput();
+
 	printf("fbsql %s\n", FBSQL_VERSION);
 
 	/* The Firebird library will pick up the ISC_* variables by itself, but
@@ -82,38 +106,7 @@ main(int argc, char *argv[])
 		}
 	}
 
-	kw[i] = "db_path";
-	val[i] = fset.dbpath;
-	i++;
-
-	kw[i] = "user";
-	val[i] = fset.username;
-	i++;
-
-	kw[i] = "password";
-	val[i] = fset.password;
-	i++;
-
-	kw[i] = "client_encoding";
-	val[i] = fset.client_encoding;
-	i++;
-
-	kw[i] = "client_min_messages";
-	val[i] = "INFO";
-	i++;
-
-	kw[i] = "time_zone_names";
-	val[i] = fset.time_zone_names ? "true" : "false";
-	i++;
-
-	kw[i] = "isql_values";
-	val[i] = "false";
-	i++;
-
-	kw[i] = NULL;
-	val[i] = NULL;
-
-	fset.conn = FQconnectdbParams(kw, val);
+	fset.conn = fbsql_connect(fset.dbpath);
 
 	if (FQstatus(fset.conn) == CONNECTION_BAD)
 	{
@@ -137,11 +130,73 @@ main(int argc, char *argv[])
 		   fset.sversion, FQlibVersionString());
 #endif
 
-	FQsetAutocommit(fset.conn, fset.autocommit);
+	FQsetAutocommit(fset.conn, fset.autocommit == true && autocommitManaged() == false);
+
+	if (fset.parallel_workers > 0 && FQserverVersion(fset.conn) < 50000)
+		puts("Note: parallel workers are only supported by Firebird 5.0 and later");
+
+	/* non-interactive monitoring mode */
+	if (fset.record_dir != NULL)
+	{
+		result = recorderRun(fset.record_dir, fset.monitor_interval);
+		FQfinish(fset.conn);
+		return result;
+	}
+
+	if (fset.daemon_socket != NULL)
+		return daemonRun(fset.daemon_socket, fset.pool_size);
+
+	if (fset.protocol == true)
+	{
+		result = protocolRun();
+		FQfinish(fset.conn);
+		return result;
+	}
+
+	if (fset.exporter_file != NULL)
+	{
+		result = exporterRun(fset.exporter_file, fset.monitor_interval);
+		FQfinish(fset.conn);
+		return result;
+	}
+
+	if (fset.listen_events != NULL)
+	{
+		char	   *names[EVENTS_MAX];
+		char	   *name;
+		int			nevents = 0;
+
+		for (name = strtok(fset.listen_events, ","); name != NULL; name = strtok(NULL, ","))
+		{
+			if (nevents == EVENTS_MAX)
+			{
+				fbsql_error("a maximum of %i events can be provided to --listen\n", EVENTS_MAX);
+				FQfinish(fset.conn);
+				return 1;
+			}
+
+			names[nevents++] = name;
+		}
+
+		if (nevents == 0)
+		{
+			fbsql_error("no event names provided to --listen\n");
+			FQfinish(fset.conn);
+			return 1;
+		}
+
+		result = listenEvents(names, nevents, fset.on_event_query, true) ? 0 : 1;
+		FQfinish(fset.conn);
+		return result;
+	}
 
 	result = InputLoop(stdin);
 
 	save_history(fset.fbsql_history);
+	planHistorySave();
+
+	/* statements executed in autocommit mode managed by fbsql are committed as usual */
+	autocommitBatchFlush();
 
 	if (FQisActiveTransaction(fset.conn))
 		puts("Rolling back uncommitted transaction");
@@ -167,6 +222,17 @@ parse_fbsql_options(int argc, char *argv[])
 		{"username", required_argument, NULL, 'u'},
 		{"password", required_argument, NULL, 'p'},
 		{"client-encoding", required_argument, NULL, 'C'},
+		{"parallel-workers", required_argument, NULL, 'W'},
+		{"record", required_argument, NULL, OPT_RECORD},
+		{"interval", required_argument, NULL, OPT_INTERVAL},
+		{"exporter", required_argument, NULL, OPT_EXPORTER},
+		{"listen", required_argument, NULL, OPT_LISTEN},
+		{"on-event", required_argument, NULL, OPT_ON_EVENT},
+		{"daemon", required_argument, NULL, OPT_DAEMON},
+		{"via", required_argument, NULL, OPT_VIA},
+		{"pool-size", required_argument, NULL, OPT_POOL_SIZE},
+		{"protocol", no_argument, NULL, OPT_PROTOCOL},
+		{"txmode", required_argument, NULL, OPT_TXMODE},
 		{"help", no_argument, NULL, '?'},
 		{"version", no_argument, NULL, 'V'},
 		{NULL, 0, NULL, 0}
@@ -177,7 +243,7 @@ parse_fbsql_options(int argc, char *argv[])
 	extern int	optind;
 	int			c;
 
-	while ((c = getopt_long(argc, argv, "d:Eu:p:C:?V",
+	while ((c = getopt_long(argc, argv, "d:Eu:p:C:W:?V",
 							long_options, &optindex)) != -1)
 	{
 
@@ -203,6 +269,75 @@ parse_fbsql_options(int argc, char *argv[])
 				fset.client_encoding = strdup(optarg);
 				break;
 
+			case 'W':
+				fset.parallel_workers = atoi(optarg);
+				if (fset.parallel_workers < 1)
+				{
+					printf("invalid value for --parallel-workers: \"%s\"\n", optarg);
+					exit(1);
+				}
+				break;
+
+			case OPT_RECORD:
+				fset.record_dir = strdup(optarg);
+				break;
+
+			case OPT_EXPORTER:
+				fset.exporter_file = strdup(optarg);
+				break;
+
+			case OPT_LISTEN:
+				fset.listen_events = strdup(optarg);
+				break;
+
+			case OPT_ON_EVENT:
+				fset.on_event_query = strdup(optarg);
+				break;
+
+			case OPT_DAEMON:
+				fset.daemon_socket = strdup(optarg);
+				break;
+
+			case OPT_VIA:
+				fset.via_socket = strdup(optarg);
+				break;
+
+			case OPT_POOL_SIZE:
+				fset.pool_size = atoi(optarg);
+				if (fset.pool_size < 1 || fset.pool_size > DAEMON_MAX_POOL_SIZE)
+				{
+					printf("invalid value for --pool-size: \"%s\" (1 to %i)\n",
+						   optarg, DAEMON_MAX_POOL_SIZE);
+					exit(1);
+				}
+				break;
+
+			case OPT_PROTOCOL:
+				fset.protocol = true;
+				break;
+
+			case OPT_TXMODE:
+			{
+				bool valid;
+
+				fset.txmode = parseTransactionMode(optarg, &valid);
+				if (valid == false)
+				{
+					printf("invalid value for --txmode: \"%s\"\n", optarg);
+					exit(1);
+				}
+				break;
+			}
+
+			case OPT_INTERVAL:
+				fset.monitor_interval = parseInterval(optarg);
+				if (fset.monitor_interval < 1)
+				{
+					printf("invalid value for --interval: \"%s\"\n", optarg);
+					exit(1);
+				}
+				break;
+
 			case '?':
 				usage();
 				exit(0);
@@ -226,6 +361,13 @@ parse_fbsql_options(int argc, char *argv[])
 
 		optind++;
 	}
+
+	/* pooled connections don't apply the transaction mode, so would leave it unused */
+	if (fset.txmode != NULL && fset.daemon_socket != NULL)
+	{
+		fbsql_error("--txmode cannot be used with --daemon\n");
+		exit(1);
+	}
 }
 
 
@@ -283,6 +425,12 @@ usage(void)
 
 	printf("  -C, --client-encoding    client encoding (default: UTF-8)\n");
 
+	printf("  -W, --parallel-workers=N parallel workers per connection, for index\n");
+	printf("                           creation etc. (Firebird 5.0 and later)\n");
+	printf("  --txmode=MODE            parameters of each transaction started, e.g.\n");
+	printf("                           \"read only\" or \"snapshot nowait\" (see \\txmode);\n");
+	printf("                           not available with --daemon\n");
+
 	printf("\n");
 
 	printf("Display options:\n");
@@ -290,4 +438,43 @@ usage(void)
 	printf("  -E, --echo-internal      display queries generated by internal commands\n");
 
 	printf("\n");
+
+	printf("Monitoring options:\n");
+
+	printf("  --record=DIR             record monitoring table snapshots to a ring buffer\n");
+	printf("                           file in DIR until interrupted, instead of running\n");
+	printf("                           interactively (view with \\replay-stats)\n");
+	printf("  --exporter=FILE          write Prometheus metrics to FILE (for the node_exporter\n");
+	printf("                           textfile collector) until interrupted, instead of\n");
+	printf("                           running interactively\n");
+	printf("  --listen=NAME[,NAME...]  wait for the named events until interrupted, printing\n");
+	printf("                           timestamp, event name and count for each event,\n");
+	printf("                           instead of running interactively\n");
+	printf("  --on-event=QUERY         execute QUERY each time a --listen event is received\n");
+	printf("  --interval=N[s|m|h]      polling interval for --record and --exporter\n");
+	printf("                           (default: %is)\n",
+		   MONITOR_DEFAULT_INTERVAL);
+
+	printf("\n");
+
+	printf("Connection pool options:\n");
+
+	printf("  --daemon=SOCKET          keep a pool of open connections and execute\n");
+	printf("                           statements received on the Unix domain socket\n");
+	printf("                           SOCKET until interrupted\n");
+	printf("  --pool-size=N            number of connections kept open by --daemon\n");
+	printf("                           (default: %i)\n",
+		   DAEMON_DEFAULT_POOL_SIZE);
+	printf("  --via=SOCKET             execute statements read from standard input using\n");
+	printf("                           a connection from the daemon listening on SOCKET\n");
+
+	printf("\n");
+
+	printf("Coprocess options:\n");
+
+	printf("  --protocol               execute length-prefixed requests (statement and bind\n");
+	printf("                           parameters) read from standard input, writing framed\n");
+	printf("                           results, errors and timings to standard output\n");
+
+	printf("\n");
 }
@@ -0,0 +1,228 @@
+/* ---------------------------------------------------------------------
+ *
+ * parallel.c
+ *
+ * Simple worker pool for executing independent jobs in parallel, with
+ * each worker thread using its own database connection
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "common.h"
+#include "parallel.h"
+#include "settings.h"
+
+typedef struct parallelPool
+{
+	int			njobs;
+	int			next_job;
+	int			failed_jobs;
+	parallelJobFunc func;
+	void	   *arg;
+	pthread_mutex_t job_lock;
+} parallelPool;
+
+typedef struct parallelWorker
+{
+	int			worker;
+	FBconn	   *conn;
+	parallelPool *pool;
+	pthread_t	thread;
+} parallelWorker;
+
+static pthread_mutex_t output_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static bool _runPool(int nworkers, int njobs, parallelJobFunc func, void *arg, bool connect);
+static void *_workerMain(void *arg);
+
+
+/**
+ * runParallelJobs()
+ *
+ * Execute "njobs" jobs using up to "nworkers" threads, each with its own
+ * connection to the current database. Jobs are handed out in order, so
+ * callers should order them by decreasing expected duration where
+ * possible.
+ *
+ * Worker connections use autocommit mode, independently of the session
+ * setting.
+ *
+ * Returns true if all jobs succeeded.
+ */
+bool
+runParallelJobs(int nworkers, int njobs, parallelJobFunc func, void *arg)
+{
+	return _runPool(nworkers, njobs, func, arg, true);
+}
+
+
+/**
+ * runParallelTasks()
+ *
+ * As runParallelJobs(), but without opening worker connections, for jobs
+ * which connect to other databases themselves; "conn" is passed to the
+ * job function as NULL.
+ */
+bool
+runParallelTasks(int nworkers, int njobs, parallelJobFunc func, void *arg)
+{
+	return _runPool(nworkers, njobs, func, arg, false);
+}
+
+
+static bool
+_runPool(int nworkers, int njobs, parallelJobFunc func, void *arg, bool connect)
+{
+	parallelPool pool;
+	parallelWorker *workers;
+	int i, nconnected = 0;
+
+	if (njobs == 0)
+		return true;
+
+	if (nworkers > njobs)
+		nworkers = njobs;
+
+	pool.njobs = njobs;
+	pool.next_job = 0;
+	pool.failed_jobs = 0;
+	pool.func = func;
+	pool.arg = arg;
+	pthread_mutex_init(&pool.job_lock, NULL);
+
+	workers = (parallelWorker *)fb_malloc0(nworkers * sizeof(parallelWorker));
+
+	/* open all connections up front, so problems are reported immediately */
+	for (i = 0; i < nworkers; i++)
+	{
+		FBconn *conn;
+
+		if (connect == false)
+		{
+			workers[i].worker = i;
+			workers[i].conn = NULL;
+			workers[i].pool = &pool;
+			nconnected++;
+			continue;
+		}
+
+		conn = fbsql_connect(fset.dbpath);
+
+		if (FQstatus(conn) == CONNECTION_BAD)
+		{
+			fbsql_error("unable to open worker connection:\n%s\n", FQerrorMessage(conn));
+			FQfinish(conn);
+			break;
+		}
+
+		FQsetAutocommit(conn, true);
+
+		workers[i].worker = i;
+		workers[i].conn = conn;
+		workers[i].pool = &pool;
+		nconnected++;
+	}
+
+	if (nconnected == 0)
+	{
+		free(workers);
+		pthread_mutex_destroy(&pool.job_lock);
+		return false;
+	}
+
+	for (i = 0; i < nconnected; i++)
+		pthread_create(&workers[i].thread, NULL, _workerMain, &workers[i]);
+
+	for (i = 0; i < nconnected; i++)
+	{
+		pthread_join(workers[i].thread, NULL);
+
+		if (workers[i].conn != NULL)
+			FQfinish(workers[i].conn);
+	}
+
+	free(workers);
+	pthread_mutex_destroy(&pool.job_lock);
+
+	return pool.failed_jobs == 0;
+}
+
+
+/**
+ * parallelOutputLock()
+ *
+ * Serialise output from worker threads, so progress messages are not
+ * interleaved.
+ */
+void
+parallelOutputLock(void)
+{
+	pthread_mutex_lock(&output_lock);
+}
+
+
+void
+parallelOutputUnlock(void)
+{
+	fflush(stdout);
+	pthread_mutex_unlock(&output_lock);
+}
+
+
+/**
+ * parseWorkerCount()
+ *
+ * Parse a "workers N" option value; returns -1 if invalid.
+ */
+int
+parseWorkerCount(const char *value)
+{
+	char *endptr;
+	long nworkers;
+
+	if (value == NULL)
+		return -1;
+
+	nworkers = strtol(value, &endptr, 10);
+
+	if (*endptr != '\0' || nworkers < 1 || nworkers > PARALLEL_MAX_WORKERS)
+		return -1;
+
+	return (int)nworkers;
+}
+
+
+static void *
+_workerMain(void *arg)
+{
+	parallelWorker *worker = (parallelWorker *)arg;
+	parallelPool *pool = worker->pool;
+
+	for (;;)
+	{
+		int job;
+
+		pthread_mutex_lock(&pool->job_lock);
+		job = pool->next_job < pool->njobs ? pool->next_job++ : -1;
+		pthread_mutex_unlock(&pool->job_lock);
+
+		if (job < 0)
+			break;
+
+		if (pool->func(worker->conn, worker->worker, job, pool->arg) == false)
+		{
+			pthread_mutex_lock(&pool->job_lock);
+			pool->failed_jobs++;
+			pthread_mutex_unlock(&pool->job_lock);
+		}
+	}
+
+	return NULL;
+}
@@ -0,0 +1,31 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include "libfq.h"
+#include "settings.h"
+
+#define PARALLEL_DEFAULT_WORKERS 4
+#define PARALLEL_MAX_WORKERS	 64
+
+/*
+ * Function executed for each job; "conn" is the calling worker's own
+ * connection. Returns false if the job failed.
+ */
+typedef bool (*parallelJobFunc)(FBconn *conn, int worker, int job, void *arg);
+
+extern bool
+runParallelJobs(int nworkers, int njobs, parallelJobFunc func, void *arg);
+
+extern bool
+runParallelTasks(int nworkers, int njobs, parallelJobFunc func, void *arg);
+
+extern void
+parallelOutputLock(void);
+
+extern void
+parallelOutputUnlock(void);
+
+extern int
+parseWorkerCount(const char *value);
+
+#endif   /* PARALLEL_H */
@@ -0,0 +1,272 @@
+/* ---------------------------------------------------------------------
+ *
+ * parallelblock.c
+ *
+ * \parallel N ... \endparallel: collect the statements in a script
+ * block and execute them in parallel on separate connections
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "common.h"
+#include "parallel.h"
+#include "parallelblock.h"
+#include "query.h"
+#include "settings.h"
+
+typedef struct blockStatement
+{
+	char	   *query;
+	int			nparams;
+	char	  **params;
+	bool		executed;
+	char	   *error;			/* error message if execution failed */
+} blockStatement;
+
+typedef struct parallelBlock
+{
+	bool		active;
+	int			nworkers;
+	int			nstatements;
+	int			alloc_statements;
+	blockStatement *statements;
+} parallelBlock;
+
+static parallelBlock block = {false, 0, 0, 0, NULL};
+
+static bool _blockJob(FBconn *conn, int worker, int job, void *arg);
+
+
+/**
+ * parallelBlockBegin()
+ *
+ * \parallel [N]
+ *
+ * Start collecting statements, which will be executed on up to
+ * "nworkers" connections when \endparallel is reached.
+ */
+bool
+parallelBlockBegin(int nworkers)
+{
+	if (block.active == true)
+	{
+		fbsql_error("\\parallel: a \\parallel block is already in progress\n");
+		return false;
+	}
+
+	block.active = true;
+	block.nworkers = nworkers;
+	block.nstatements = 0;
+
+	return true;
+}
+
+
+bool
+parallelBlockActive(void)
+{
+	return block.active;
+}
+
+
+/**
+ * parallelBlockAdd()
+ *
+ * Add a statement (and any bound variable values) to the current block;
+ * the values are copied.
+ */
+void
+parallelBlockAdd(const char *query, int nparams, const char * const *params)
+{
+	blockStatement *statement;
+	int			i;
+
+	if (block.nstatements == block.alloc_statements)
+	{
+		block.alloc_statements = block.alloc_statements == 0 ? 16 : block.alloc_statements * 2;
+		block.statements = (blockStatement *)realloc(block.statements,
+													 block.alloc_statements * sizeof(blockStatement));
+	}
+
+	statement = &block.statements[block.nstatements++];
+	statement->query = strdup(query);
+	statement->nparams = nparams;
+	statement->params = NULL;
+	statement->executed = false;
+	statement->error = NULL;
+
+	if (nparams > 0)
+	{
+		statement->params = (char **)fb_malloc0(nparams * sizeof(char *));
+
+		for (i = 0; i < nparams; i++)
+			statement->params[i] = params[i] == NULL ? NULL : strdup(params[i]);
+	}
+}
+
+
+/**
+ * parallelBlockEnd()
+ *
+ * \endparallel
+ *
+ * Execute the statements collected since \parallel, each in its own
+ * transaction on one of the worker connections, in no particular order
+ * relative to each other. Errors are collected and reported once all
+ * statements have been executed, in statement order. Returns false if
+ * any statement failed or could not be executed.
+ *
+ * Statements executed by the session's own connection in batched
+ * autocommit mode are committed first, so they are visible to the
+ * block's statements.
+ */
+bool
+parallelBlockEnd(void)
+{
+	query_time	before, after;
+	bool		success = true;
+	int			succeeded = 0;
+	int			failed = 0;
+	int			i;
+
+	if (block.active == false)
+	{
+		fbsql_error("\\endparallel: no \\parallel block is in progress\n");
+		return false;
+	}
+
+	block.active = false;
+
+	if (block.nstatements == 0)
+		return true;
+
+	if (autocommitBatchFlush() == false)
+	{
+		parallelBlockDiscard();
+		return false;
+	}
+
+	printf("Executing %i statement(s) using %i worker(s)\n",
+		   block.nstatements,
+		   block.nworkers < block.nstatements ? block.nworkers : block.nstatements);
+	fflush(stdout);
+
+	gettimeofday(&before, NULL);
+
+	success = runParallelJobs(block.nworkers, block.nstatements, _blockJob, &block);
+
+	gettimeofday(&after, NULL);
+	INSTR_TIME_SUBTRACT(after, before);
+
+	for (i = 0; i < block.nstatements; i++)
+	{
+		blockStatement *statement = &block.statements[i];
+
+		if (statement->executed == true && statement->error == NULL)
+			succeeded++;
+
+		if (statement->error == NULL)
+			continue;
+
+		failed++;
+		printf("error executing statement %i:\n%s\n%s\n",
+			   i + 1, statement->query, statement->error);
+	}
+
+	printf("%i of %i statement(s) executed successfully", succeeded, block.nstatements);
+
+	if (failed > 0)
+		printf("; %i failed", failed);
+
+	if (fset.timing)
+		printf(" (%.3f ms)", INSTR_TIME_GET_MILLISEC(after));
+
+	puts("");
+
+	if (failed > 0)
+		success = false;
+
+	parallelBlockDiscard();
+
+	return success;
+}
+
+
+/**
+ * parallelBlockDiscard()
+ *
+ * Free the collected statements, e.g. if the input ends within a block.
+ */
+void
+parallelBlockDiscard(void)
+{
+	int			i, j;
+
+	for (i = 0; i < block.nstatements; i++)
+	{
+		blockStatement *statement = &block.statements[i];
+
+		for (j = 0; j < statement->nparams; j++)
+			free(statement->params[j]);
+
+		free(statement->params);
+		free(statement->query);
+		free(statement->error);
+	}
+
+	free(block.statements);
+
+	block.active = false;
+	block.statements = NULL;
+	block.nstatements = 0;
+	block.alloc_statements = 0;
+}
+
+
+/**
+ * _blockJob()
+ *
+ * Worker function: execute one statement, recording any error.
+ */
+static bool
+_blockJob(FBconn *conn, int worker, int job, void *arg)
+{
+	parallelBlock *pb = (parallelBlock *)arg;
+	blockStatement *statement = &pb->statements[job];
+	FBresult   *res;
+	bool		success = true;
+
+	if (statement->nparams > 0)
+		res = FQexecParams(conn, statement->query, statement->nparams, NULL,
+						   (const char * const *)statement->params, NULL, NULL, 0);
+	else
+		res = FQexec(conn, statement->query);
+
+	statement->executed = true;
+
+	switch (FQresultStatus(res))
+	{
+		case FBRES_EMPTY_QUERY:
+		case FBRES_BAD_RESPONSE:
+		case FBRES_NONFATAL_ERROR:
+		case FBRES_FATAL_ERROR:
+			statement->error = strdup(res ? FQresultErrorMessage(res) : FQerrorMessage(conn));
+			success = false;
+			break;
+
+		default:
+			break;
+	}
+
+	if (res != NULL)
+		FQclear(res);
+
+	return success;
+}
@@ -0,0 +1,21 @@
+#ifndef PARALLELBLOCK_H
+#define PARALLELBLOCK_H
+
+#include "settings.h"
+
+extern bool
+parallelBlockBegin(int nworkers);
+
+extern bool
+parallelBlockActive(void);
+
+extern void
+parallelBlockAdd(const char *query, int nparams, const char * const *params);
+
+extern bool
+parallelBlockEnd(void);
+
+extern void
+parallelBlockDiscard(void);
+
+#endif   /* PARALLELBLOCK_H */
@@ -0,0 +1,622 @@
+/* ---------------------------------------------------------------------
+ *
+ * planhistory.c
+ *
+ * Record the plan used by each executed statement and warn when a
+ * previously seen statement is executed with a different plan
+ *
+ * Plans are stored in a local file (~/.fbsql_plan_history), keyed by
+ * database path and statement fingerprint, in the format:
+ *
+ *   dbpath <TAB> fingerprint <TAB> last seen <TAB> explained <TAB> elapsed ms <TAB> plan
+ *
+ * with tabs, newlines and backslashes in the plan escaped.
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "common.h"
+#include "planhistory.h"
+#include "settings.h"
+
+typedef struct planHistoryEntry
+{
+	char	   *dbkey;
+	char	   *fingerprint;
+	time_t		last_seen;
+	bool		explained;		/* explained plan (Firebird 3.0 and later) */
+	double		elapsed_msec;	/* execution time when last seen with this plan */
+	char	   *plan;
+} planHistoryEntry;
+
+static planHistoryEntry *entries = NULL;
+static int nentries = 0;
+static int alloc_entries = 0;
+static bool history_loaded = false;
+static bool history_dirty = false;
+
+
+static void _loadHistory(const char *filename, bool merge);
+static void _writeHistory(void);
+static int	_compareLastSeen(const void *a, const void *b);
+static planHistoryEntry *_findEntry(const char *dbkey, const char *fingerprint);
+static planHistoryEntry *_addEntry(void);
+static void _freeEntry(planHistoryEntry *entry);
+static char *_hashFingerprint(const char *fingerprint);
+static void _printPlanDiff(const char *old_plan, const char *new_plan);
+static char **_splitLines(const char *text, int *nlines);
+static void _appendEscaped(FQExpBuffer buf, const char *text);
+static char *_unescape(const char *text);
+
+
+/**
+ * planHistoryRecord()
+ *
+ * Retrieve the plan of the just-executed statement and compare it with
+ * the plan recorded the last time a statement with the same fingerprint
+ * was executed against the current database. If the plan has changed,
+ * display a warning with a line-by-line diff and the change in
+ * execution time.
+ */
+void
+planHistoryRecord(const char *query, const char *query_fingerprint, double elapsed_msec)
+{
+	planHistoryEntry *entry;
+	char *fingerprint;
+	char *plan;
+	bool explained = FQserverVersion(fset.conn) >= 30000;
+
+	if (fset.plan_history_file == NULL)
+		return;
+
+	if (history_loaded == false)
+	{
+		_loadHistory(fset.plan_history_file, false);
+		history_loaded = true;
+	}
+
+	if (explained)
+		plan = FQexplainStatement(fset.conn, query);
+	else
+		plan = FQplanStatement(fset.conn, query);
+
+	if (plan == NULL)
+		return;
+
+	fingerprint = _hashFingerprint(query_fingerprint);
+	entry = _findEntry(fset.dbpath, fingerprint);
+
+	if (entry == NULL)
+	{
+		entry = _addEntry();
+		entry->dbkey = strdup(fset.dbpath);
+		entry->fingerprint = fingerprint;
+		entry->explained = explained;
+		entry->elapsed_msec = elapsed_msec;
+		entry->plan = plan;
+		entry->last_seen = time(NULL);
+
+		history_dirty = true;
+		return;
+	}
+
+	free(fingerprint);
+
+	/* plan format differs (e.g. server upgrade) - replace silently */
+	if (entry->explained != explained)
+	{
+		free(entry->plan);
+		entry->plan = plan;
+		entry->explained = explained;
+	}
+	else if (strcmp(entry->plan, plan) != 0)
+	{
+		char last_seen[32];
+
+		strftime(last_seen, sizeof(last_seen), "%Y-%m-%d %H:%M:%S",
+				 localtime(&entry->last_seen));
+
+		printf("WARNING: plan has changed since this statement was last executed (%s)\n",
+			   last_seen);
+		_printPlanDiff(entry->plan, plan);
+
+		if (entry->elapsed_msec > 0)
+			printf("Execution time: %.3f ms (previously %.3f ms, %+.1f%%)\n",
+				   elapsed_msec,
+				   entry->elapsed_msec,
+				   (elapsed_msec - entry->elapsed_msec) * 100.0 / entry->elapsed_msec);
+		else
+			printf("Execution time: %.3f ms (previously %.3f ms)\n",
+				   elapsed_msec,
+				   entry->elapsed_msec);
+
+		free(entry->plan);
+		entry->plan = plan;
+		entry->elapsed_msec = elapsed_msec;
+		entry->last_seen = time(NULL);
+		history_dirty = true;
+
+		/* persist immediately, so other sessions don't report the same change */
+		planHistorySave();
+
+		return;
+	}
+	else
+	{
+		free(plan);
+	}
+
+	entry->elapsed_msec = elapsed_msec;
+	entry->last_seen = time(NULL);
+	history_dirty = true;
+}
+
+
+/**
+ * planHistoryReset()
+ *
+ * Discard all recorded plans for the current database. Entries written
+ * by other fbsql sessions since the history was loaded are merged in
+ * first, so only the current database's entries are lost.
+ */
+void
+planHistoryReset(void)
+{
+	int i, j;
+	int removed = 0;
+
+	if (fset.plan_history_file != NULL)
+	{
+		_loadHistory(fset.plan_history_file, history_loaded);
+		history_loaded = true;
+	}
+
+	for (i = 0, j = 0; i < nentries; i++)
+	{
+		if (strcmp(entries[i].dbkey, fset.dbpath) == 0)
+		{
+			_freeEntry(&entries[i]);
+			removed++;
+			continue;
+		}
+
+		entries[j++] = entries[i];
+	}
+
+	nentries = j;
+
+	printf("%i recorded plan(s) removed\n", removed);
+
+	/* written without merging, so the removed entries are not read back */
+	if (fset.plan_history_file != NULL)
+		_writeHistory();
+}
+
+
+/**
+ * planHistorySave()
+ *
+ * Write the recorded plans to the plan history file. Entries written
+ * by other fbsql sessions in the meantime are merged in, so concurrent
+ * sessions do not overwrite each other's history.
+ */
+void
+planHistorySave(void)
+{
+	if (history_dirty == false || fset.plan_history_file == NULL)
+		return;
+
+	_loadHistory(fset.plan_history_file, true);
+	_writeHistory();
+}
+
+
+/**
+ * _writeHistory()
+ *
+ * Replace the plan history file with the entries in memory, discarding
+ * the least recently used entries if over the limit.
+ */
+static void
+_writeHistory(void)
+{
+	FILE *fp;
+	FQExpBufferData buf;
+	char *tmpfile;
+	int i;
+
+	if (nentries > PLAN_HISTORY_MAX_ENTRIES)
+	{
+		qsort(entries, nentries, sizeof(planHistoryEntry), _compareLastSeen);
+
+		for (i = PLAN_HISTORY_MAX_ENTRIES; i < nentries; i++)
+			_freeEntry(&entries[i]);
+
+		nentries = PLAN_HISTORY_MAX_ENTRIES;
+	}
+
+	tmpfile = (char *)malloc(strlen(fset.plan_history_file) + 32);
+	sprintf(tmpfile, "%s.%i", fset.plan_history_file, (int)getpid());
+
+	fp = fopen(tmpfile, "w");
+
+	if (fp == NULL)
+	{
+		fbsql_error("unable to write plan history file \"%s\"\n", tmpfile);
+		free(tmpfile);
+		return;
+	}
+
+	initFQExpBuffer(&buf);
+
+	for (i = 0; i < nentries; i++)
+	{
+		resetFQExpBuffer(&buf);
+
+		appendFQExpBuffer(&buf, "%s\t%s\t%li\t%i\t%.3f\t",
+						  entries[i].dbkey,
+						  entries[i].fingerprint,
+						  (long)entries[i].last_seen,
+						  entries[i].explained ? 1 : 0,
+						  entries[i].elapsed_msec);
+		_appendEscaped(&buf, entries[i].plan);
+		appendFQExpBufferChar(&buf, '\n');
+
+		fputs(buf.data, fp);
+	}
+
+	termFQExpBuffer(&buf);
+
+	if (fclose(fp) != 0 || rename(tmpfile, fset.plan_history_file) != 0)
+	{
+		fbsql_error("unable to write plan history file \"%s\"\n", fset.plan_history_file);
+		unlink(tmpfile);
+	}
+	else
+	{
+		history_dirty = false;
+	}
+
+	free(tmpfile);
+}
+
+
+/**
+ * _loadHistory()
+ *
+ * Read the plan history file. If "merge" is true, entries already
+ * present in memory are only replaced by those in the file if the
+ * file's entry was seen more recently.
+ */
+static void
+_loadHistory(const char *filename, bool merge)
+{
+	FILE *fp;
+	FQExpBuffer line_buf;
+	char chunk[1024];
+
+	fp = fopen(filename, "r");
+
+	/* file does not exist yet */
+	if (fp == NULL)
+		return;
+
+	line_buf = createFQExpBuffer();
+
+	for (;;)
+	{
+		char *fields[6];
+		char *p;
+		int nfields = 0;
+		bool eof = true;
+		planHistoryEntry *entry;
+		time_t last_seen;
+
+		resetFQExpBuffer(line_buf);
+
+		while (fgets(chunk, sizeof(chunk), fp) != NULL)
+		{
+			eof = false;
+			appendFQExpBufferStr(line_buf, chunk);
+
+			if (line_buf->data[line_buf->len - 1] == '\n')
+			{
+				line_buf->data[--line_buf->len] = '\0';
+				break;
+			}
+		}
+
+		if (eof == true)
+			break;
+
+		p = line_buf->data;
+		fields[nfields++] = p;
+
+		while (nfields < 6 && (p = strchr(p, '\t')) != NULL)
+		{
+			*p++ = '\0';
+			fields[nfields++] = p;
+		}
+
+		/* ignore malformed lines */
+		if (nfields < 6)
+			continue;
+
+		last_seen = (time_t)atol(fields[2]);
+		entry = _findEntry(fields[0], fields[1]);
+
+		if (entry != NULL)
+		{
+			if (merge == false || entry->last_seen >= last_seen)
+				continue;
+
+			free(entry->plan);
+		}
+		else
+		{
+			entry = _addEntry();
+			entry->dbkey = strdup(fields[0]);
+			entry->fingerprint = strdup(fields[1]);
+		}
+
+		entry->last_seen = last_seen;
+		entry->explained = atoi(fields[3]) == 1;
+		entry->elapsed_msec = atof(fields[4]);
+		entry->plan = _unescape(fields[5]);
+	}
+
+	destroyFQExpBuffer(line_buf);
+	fclose(fp);
+}
+
+
+/* qsort() comparison function: most recently seen first */
+static int
+_compareLastSeen(const void *a, const void *b)
+{
+	const planHistoryEntry *ea = (const planHistoryEntry *)a;
+	const planHistoryEntry *eb = (const planHistoryEntry *)b;
+
+	if (ea->last_seen == eb->last_seen)
+		return 0;
+
+	return ea->last_seen > eb->last_seen ? -1 : 1;
+}
+
+
+static planHistoryEntry *
+_findEntry(const char *dbkey, const char *fingerprint)
+{
+	int i;
+
+	for (i = 0; i < nentries; i++)
+	{
+		if (strcmp(entries[i].fingerprint, fingerprint) == 0
+		 && strcmp(entries[i].dbkey, dbkey) == 0)
+			return &entries[i];
+	}
+
+	return NULL;
+}
+
+
+static planHistoryEntry *
+_addEntry(void)
+{
+	if (nentries == alloc_entries)
+	{
+		alloc_entries = alloc_entries == 0 ? 64 : alloc_entries * 2;
+		entries = (planHistoryEntry *)realloc(entries, alloc_entries * sizeof(planHistoryEntry));
+	}
+
+	memset(&entries[nentries], 0, sizeof(planHistoryEntry));
+
+	return &entries[nentries++];
+}
+
+
+static void
+_freeEntry(planHistoryEntry *entry)
+{
+	free(entry->dbkey);
+	free(entry->fingerprint);
+	free(entry->plan);
+}
+
+
+/**
+ * _hashFingerprint()
+ *
+ * Return a compact hash of the statement's normalised fingerprint (as
+ * generated by fbsql_fingerprint()) for use as the history key, as a
+ * malloc'd string in hexadecimal format.
+ */
+static char *
+_hashFingerprint(const char *fingerprint)
+{
+	char *result;
+
+	result = (char *)malloc(17);
+	snprintf(result, 17, "%016llx", hashString(fingerprint));
+
+	return result;
+}
+
+
+/**
+ * _printPlanDiff()
+ *
+ * Display a line-based diff of the two plans, with removed lines
+ * prefixed with "-" and added lines with "+".
+ */
+static void
+_printPlanDiff(const char *old_plan, const char *new_plan)
+{
+	char **old_lines, **new_lines;
+	int nold, nnew;
+	int *lcs;
+	int i, j;
+
+	old_lines = _splitLines(old_plan, &nold);
+	new_lines = _splitLines(new_plan, &nnew);
+
+	/* lcs[i][j]: length of the longest common subsequence of old[i..], new[j..] */
+	lcs = (int *)fb_malloc0((nold + 1) * (nnew + 1) * sizeof(int));
+
+#define LCS(i, j) lcs[(i) * (nnew + 1) + (j)]
+
+	for (i = nold - 1; i >= 0; i--)
+	{
+		for (j = nnew - 1; j >= 0; j--)
+		{
+			if (strcmp(old_lines[i], new_lines[j]) == 0)
+				LCS(i, j) = LCS(i + 1, j + 1) + 1;
+			else if (LCS(i + 1, j) >= LCS(i, j + 1))
+				LCS(i, j) = LCS(i + 1, j);
+			else
+				LCS(i, j) = LCS(i, j + 1);
+		}
+	}
+
+	i = 0;
+	j = 0;
+
+	while (i < nold || j < nnew)
+	{
+		if (i < nold && j < nnew && strcmp(old_lines[i], new_lines[j]) == 0)
+		{
+			printf("  %s\n", old_lines[i]);
+			i++;
+			j++;
+		}
+		else if (j >= nnew || (i < nold && LCS(i + 1, j) >= LCS(i, j + 1)))
+		{
+			printf("- %s\n", old_lines[i]);
+			i++;
+		}
+		else
+		{
+			printf("+ %s\n", new_lines[j]);
+			j++;
+		}
+	}
+
+#undef LCS
+
+	free(lcs);
+
+	for (i = 0; i < nold; i++)
+		free(old_lines[i]);
+	free(old_lines);
+
+	for (j = 0; j < nnew; j++)
+		free(new_lines[j]);
+	free(new_lines);
+}
+
+
+static char **
+_splitLines(const char *text, int *nlines)
+{
+	char **lines;
+	int alloc_lines = 16;
+	const char *p = text;
+
+	lines = (char **)malloc(alloc_lines * sizeof(char *));
+	*nlines = 0;
+
+	while (*p)
+	{
+		const char *line_end = strchr(p, '\n');
+		int line_len = line_end == NULL ? strlen(p) : line_end - p;
+
+		/* skip empty lines */
+		if (line_len > 0)
+		{
+			if (*nlines == alloc_lines)
+			{
+				alloc_lines *= 2;
+				lines = (char **)realloc(lines, alloc_lines * sizeof(char *));
+			}
+
+			lines[*nlines] = (char *)malloc(line_len + 1);
+			memcpy(lines[*nlines], p, line_len);
+			lines[*nlines][line_len] = '\0';
+			(*nlines)++;
+		}
+
+		if (line_end == NULL)
+			break;
+
+		p = line_end + 1;
+	}
+
+	return lines;
+}
+
+
+static void
+_appendEscaped(FQExpBuffer buf, const char *text)
+{
+	const char *p;
+
+	for (p = text; *p; p++)
+	{
+		switch (*p)
+		{
+			case '\\':
+				appendFQExpBufferStr(buf, "\\\\");
+				break;
+			case '\n':
+				appendFQExpBufferStr(buf, "\\n");
+				break;
+			case '\t':
+				appendFQExpBufferStr(buf, "\\t");
+				break;
+			case '\r':
+				break;
+			default:
+				appendFQExpBufferChar(buf, *p);
+		}
+	}
+}
+
+
+static char *
+_unescape(const char *text)
+{
+	char *result = (char *)malloc(strlen(text) + 1);
+	char *q = result;
+	const char *p;
+
+	for (p = text; *p; p++)
+	{
+		if (*p == '\\' && p[1] != '\0')
+		{
+			p++;
+
+			if (*p == 'n')
+				*q++ = '\n';
+			else if (*p == 't')
+				*q++ = '\t';
+			else
+				*q++ = *p;
+		}
+		else
+		{
+			*q++ = *p;
+		}
+	}
+
+	*q = '\0';
+
+	return result;
+}
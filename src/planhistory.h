@@ -0,0 +1,18 @@
+#ifndef PLANHISTORY_H
+#define PLANHISTORY_H
+
+#include "settings.h"
+
+/* Maximum number of plans retained across all databases */
+#define PLAN_HISTORY_MAX_ENTRIES 5000
+
+extern void
+planHistoryRecord(const char *query, const char *query_fingerprint, double elapsed_msec);
+
+extern void
+planHistoryReset(void);
+
+extern void
+planHistorySave(void);
+
+#endif   /* PLANHISTORY_H */
@@ -0,0 +1,503 @@
+/* ---------------------------------------------------------------------
+ *
+ * protocol.c
+ *
+ * Length-prefixed message protocol on standard input/output
+ * ("fbsql --protocol"), for programs which keep fbsql running as a
+ * coprocess, and the message framing shared with the connection pool
+ * daemon
+ *
+ * Each request carries a statement and its (text) bind parameters; the
+ * response is a row description and batches of rows as returned by
+ * libfq, without display formatting, followed by an error message if
+ * applicable and a completion message with the status, row count and
+ * execution time.
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "common.h"
+#include "protocol.h"
+#include "query.h"
+#include "settings.h"
+#include "txmode.h"
+
+/* file descriptor of the original standard output */
+static int protocol_fd = STDOUT_FILENO;
+
+static bool _executeRequest(const FQExpBuffer request);
+static bool _sendRows(const FBresult *query_result);
+static const char *_statusName(FQexecStatusType status);
+
+
+/**
+ * protocolRedirectOutput()
+ *
+ * Reserve standard output for protocol messages by redirecting any
+ * other output (startup messages, notices from libfq etc.) to standard
+ * error. Must be called before anything is written to standard output.
+ */
+void
+protocolRedirectOutput(void)
+{
+	fflush(stdout);
+
+	protocol_fd = dup(STDOUT_FILENO);
+	dup2(STDERR_FILENO, STDOUT_FILENO);
+}
+
+
+/**
+ * protocolRun()
+ *
+ * fbsql --protocol
+ *
+ * Execute requests read from standard input until it is closed or a
+ * terminate message is received.
+ *
+ * Returns the program exit code.
+ */
+int
+protocolRun(void)
+{
+	FQExpBufferData request;
+	const char *version = fset.sversion != NULL ? fset.sversion : "";
+	char		type;
+	int			result = 0;
+
+	if (protocolSendFrame(protocol_fd, PROTOCOL_MSG_READY, version, strlen(version)) == false)
+		return 1;
+
+	initFQExpBuffer(&request);
+
+	while (protocolRecvFrame(STDIN_FILENO, &type, &request) == true)
+	{
+		if (type == PROTOCOL_MSG_TERMINATE)
+			break;
+
+		if (type != PROTOCOL_MSG_EXECUTE)
+		{
+			fbsql_error("unexpected protocol message type '%c'\n", type);
+			result = 1;
+			break;
+		}
+
+		if (_executeRequest(&request) == false)
+		{
+			fbsql_error("unable to write protocol message: %s\n", strerror(errno));
+			result = 1;
+			break;
+		}
+	}
+
+	termFQExpBuffer(&request);
+	close(protocol_fd);
+
+	return result;
+}
+
+
+/**
+ * _executeRequest()
+ *
+ * Execute the statement in an execute message and send the response.
+ * Returns false if the response could not be written.
+ */
+static bool
+_executeRequest(const FQExpBuffer request)
+{
+	FBresult   *query_result = NULL;
+	FQExpBufferData buf;
+	query_time	before, after;
+	const char *p = request->data;
+	const char *end = request->data + request->len;
+	const char **param_values = NULL;
+	char	   *query = NULL;
+	uint32_t	query_len, nparams = 0;
+	uint32_t	i;
+	bool		malformed = false;
+	bool		started = false;
+	bool		success = true;
+	FQexecStatusType status;
+	int			ntuples = 0;
+
+	/* statement */
+	if (end - p < 4 || (query_len = protocolGetUint32(p)) > (uint32_t)(end - p - 4))
+		malformed = true;
+	else
+	{
+		query = strndup(p + 4, query_len);
+		p += 4 + query_len;
+	}
+
+	/* parameters; values are copied so they can be NUL-terminated */
+	if (malformed == false)
+	{
+		if (end - p < 4)
+			malformed = true;
+		else
+		{
+			nparams = protocolGetUint32(p);
+			p += 4;
+
+			if (nparams > (uint32_t)(end - p) / 4)
+				malformed = true;
+			else
+				param_values = (const char **)fb_malloc0((nparams + 1) * sizeof(char *));
+		}
+	}
+
+	for (i = 0; malformed == false && i < nparams; i++)
+	{
+		uint32_t len;
+
+		if (end - p < 4)
+		{
+			malformed = true;
+			break;
+		}
+
+		len = protocolGetUint32(p);
+		p += 4;
+
+		if (len == PROTOCOL_NULL_LENGTH)
+			continue;
+
+		if (len > (uint32_t)(end - p))
+		{
+			malformed = true;
+			break;
+		}
+
+		param_values[i] = strndup(p, len);
+		p += len;
+	}
+
+	gettimeofday(&before, NULL);
+
+	if (malformed == false)
+		started = startTransaction(fset.conn, query);
+
+	if (malformed == false && started == true)
+	{
+		if (nparams == 0)
+			query_result = FQexec(fset.conn, query);
+		else
+			query_result = FQexecParams(fset.conn, query, nparams, NULL,
+										param_values, NULL, NULL, 0);
+	}
+
+	/* commit the statement if fbsql is managing autocommit (\txmode) */
+	if (query_result != NULL)
+		autocommitBatchFlush();
+
+	gettimeofday(&after, NULL);
+	INSTR_TIME_SUBTRACT(after, before);
+
+	if (malformed == true)
+		status = FBRES_BAD_RESPONSE;
+	else if (started == false)
+		status = FBRES_FATAL_ERROR;
+	else
+		status = FQresultStatus(query_result);
+
+	initFQExpBuffer(&buf);
+
+	switch (status)
+	{
+		case FBRES_TUPLES_OK:
+			ntuples = FQntuples(query_result);
+			success = _sendRows(query_result);
+			break;
+
+		case FBRES_EMPTY_QUERY:
+		case FBRES_BAD_RESPONSE:
+		case FBRES_NONFATAL_ERROR:
+		case FBRES_FATAL_ERROR:
+			if (malformed == true)
+			{
+				appendFQExpBufferStr(&buf, "malformed execute message");
+				appendFQExpBufferChar(&buf, '\0');
+			}
+			else if (started == false)
+			{
+				appendFQExpBuffer(&buf, "unable to start transaction with \"%s\"", fset.txmode);
+				appendFQExpBufferChar(&buf, '\0');
+			}
+			else
+			{
+				char *fields = query_result != NULL
+					? FQresultErrorFieldsAsString(query_result, "")
+					: NULL;
+
+				appendFQExpBufferStr(&buf, query_result != NULL
+									 ? FQresultErrorMessage(query_result)
+									 : FQerrorMessage(fset.conn));
+				appendFQExpBufferChar(&buf, '\0');
+
+				if (fields != NULL)
+				{
+					appendFQExpBufferStr(&buf, fields);
+					free(fields);
+				}
+			}
+
+			success = protocolSendFrame(protocol_fd, PROTOCOL_MSG_ERROR, buf.data, buf.len);
+			break;
+
+		default:
+			break;
+	}
+
+	if (success == true)
+	{
+		resetFQExpBuffer(&buf);
+		appendFQExpBuffer(&buf, "%s %i %.3f",
+						  _statusName(status),
+						  ntuples,
+						  INSTR_TIME_GET_MILLISEC(after));
+
+		success = protocolSendFrame(protocol_fd, PROTOCOL_MSG_COMPLETE, buf.data, buf.len);
+	}
+
+	termFQExpBuffer(&buf);
+
+	if (query_result != NULL)
+		FQclear(query_result);
+
+	if (param_values != NULL)
+	{
+		for (i = 0; i < nparams; i++)
+			free((char *)param_values[i]);
+		free(param_values);
+	}
+
+	free(query);
+
+	return success;
+}
+
+
+/**
+ * _sendRows()
+ *
+ * Send the row description and the rows of a result, in batches of up
+ * to PROTOCOL_BATCH_ROWS rows.
+ */
+static bool
+_sendRows(const FBresult *query_result)
+{
+	FQExpBufferData buf;
+	int			nfields = FQnfields(query_result);
+	int			ntuples = FQntuples(query_result);
+	int			row = 0;
+	int			j;
+	bool		success;
+
+	initFQExpBuffer(&buf);
+
+	protocolAppendUint32(&buf, nfields);
+
+	for (j = 0; j < nfields; j++)
+	{
+		const char *name = FQfname(query_result, j);
+
+		protocolAppendUint32(&buf, (uint32_t)FQftype(query_result, j));
+		appendBinaryFQExpBuffer(&buf, name, strlen(name) + 1);
+	}
+
+	success = protocolSendFrame(protocol_fd, PROTOCOL_MSG_ROW_DESC, buf.data, buf.len);
+
+	while (success == true && row < ntuples)
+	{
+		int batch_rows = ntuples - row < PROTOCOL_BATCH_ROWS
+			? ntuples - row
+			: PROTOCOL_BATCH_ROWS;
+		int i;
+
+		resetFQExpBuffer(&buf);
+		protocolAppendUint32(&buf, batch_rows);
+
+		for (i = row; i < row + batch_rows; i++)
+		{
+			for (j = 0; j < nfields; j++)
+			{
+				if (FQgetisnull(query_result, i, j))
+				{
+					protocolAppendUint32(&buf, PROTOCOL_NULL_LENGTH);
+				}
+				else if (FQftype(query_result, j) == SQL_DB_KEY)
+				{
+					char *value = FQformatDbKey(query_result, i, j);
+
+					protocolAppendUint32(&buf, strlen(value));
+					appendFQExpBufferStr(&buf, value);
+					free(value);
+				}
+				else
+				{
+					const char *value = FQgetvalue(query_result, i, j);
+
+					protocolAppendUint32(&buf, strlen(value));
+					appendFQExpBufferStr(&buf, value);
+				}
+			}
+		}
+
+		success = protocolSendFrame(protocol_fd, PROTOCOL_MSG_DATA_ROWS, buf.data, buf.len);
+		row += batch_rows;
+	}
+
+	termFQExpBuffer(&buf);
+
+	return success;
+}
+
+
+static const char *
+_statusName(FQexecStatusType status)
+{
+	switch (status)
+	{
+		case FBRES_EMPTY_QUERY:
+			return "EMPTY_QUERY";
+		case FBRES_COMMAND_OK:
+			return "COMMAND_OK";
+		case FBRES_TUPLES_OK:
+			return "TUPLES_OK";
+		case FBRES_BAD_RESPONSE:
+			return "BAD_RESPONSE";
+		case FBRES_NONFATAL_ERROR:
+			return "NONFATAL_ERROR";
+		case FBRES_FATAL_ERROR:
+			return "FATAL_ERROR";
+		case FBRES_TRANSACTION_START:
+			return "TRANSACTION_START";
+		case FBRES_TRANSACTION_COMMIT:
+			return "TRANSACTION_COMMIT";
+		case FBRES_TRANSACTION_ROLLBACK:
+			return "TRANSACTION_ROLLBACK";
+		default:
+			return "NO_ACTION";
+	}
+}
+
+
+/**
+ * protocolSendFrame()
+ *
+ * Write a message of "len" bytes with the given type.
+ */
+bool
+protocolSendFrame(int fd, char type, const char *data, uint32_t len)
+{
+	char		header[5];
+	const char *p;
+	size_t		remaining;
+	int			part;
+
+	header[0] = type;
+	header[1] = (char)((len >> 24) & 0xFF);
+	header[2] = (char)((len >> 16) & 0xFF);
+	header[3] = (char)((len >> 8) & 0xFF);
+	header[4] = (char)(len & 0xFF);
+
+	for (part = 0; part < 2; part++)
+	{
+		p = part == 0 ? header : data;
+		remaining = part == 0 ? sizeof(header) : len;
+
+		while (remaining > 0)
+		{
+			ssize_t written = write(fd, p, remaining);
+
+			if (written == -1)
+			{
+				if (errno == EINTR)
+					continue;
+				return false;
+			}
+
+			p += written;
+			remaining -= written;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+ * protocolRecvFrame()
+ *
+ * Read one message into "payload", which is NUL-terminated. Returns false
+ * if the connection was closed or failed.
+ */
+bool
+protocolRecvFrame(int fd, char *type, FQExpBuffer payload)
+{
+	char		header[5];
+	char		chunk[8192];
+	size_t		received = 0;
+	uint32_t	len;
+
+	while (received < sizeof(header))
+	{
+		ssize_t nread = read(fd, header + received, sizeof(header) - received);
+
+		if (nread == -1 && errno == EINTR)
+			continue;
+		if (nread <= 0)
+			return false;
+
+		received += nread;
+	}
+
+	*type = header[0];
+	len = protocolGetUint32(header + 1);
+
+	resetFQExpBuffer(payload);
+
+	while (payload->len < len)
+	{
+		size_t wanted = len - payload->len;
+		ssize_t nread = read(fd, chunk, wanted < sizeof(chunk) ? wanted : sizeof(chunk));
+
+		if (nread == -1 && errno == EINTR)
+			continue;
+		if (nread <= 0)
+			return false;
+
+		appendBinaryFQExpBuffer(payload, chunk, nread);
+	}
+
+	return true;
+}
+
+
+void
+protocolAppendUint32(FQExpBuffer buf, uint32_t value)
+{
+	appendFQExpBufferChar(buf, (char)((value >> 24) & 0xFF));
+	appendFQExpBufferChar(buf, (char)((value >> 16) & 0xFF));
+	appendFQExpBufferChar(buf, (char)((value >> 8) & 0xFF));
+	appendFQExpBufferChar(buf, (char)(value & 0xFF));
+}
+
+
+uint32_t
+protocolGetUint32(const char *data)
+{
+	const unsigned char *p = (const unsigned char *)data;
+
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
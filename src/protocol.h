@@ -0,0 +1,45 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stdint.h>
+
+#include "libfq.h"
+#include "settings.h"
+
+/* Maximum number of rows sent in each data message */
+#define PROTOCOL_BATCH_ROWS 500
+
+/* Value length denoting NULL */
+#define PROTOCOL_NULL_LENGTH UINT32_MAX
+
+/*
+ * "fbsql --protocol" messages; framed as a one-byte type followed by a
+ * 4-byte big-endian payload length. All integers are 4-byte big-endian.
+ */
+#define PROTOCOL_MSG_READY		'R'		/* fbsql: server version */
+#define PROTOCOL_MSG_EXECUTE	'Q'		/* client: SQL length, SQL, parameter count, per parameter length and value */
+#define PROTOCOL_MSG_TERMINATE	'X'		/* client: end of session */
+#define PROTOCOL_MSG_ROW_DESC	'T'		/* fbsql: column count, per column SQL type and NUL-terminated name */
+#define PROTOCOL_MSG_DATA_ROWS	'D'		/* fbsql: row count, per row and column value length and value */
+#define PROTOCOL_MSG_ERROR		'E'		/* fbsql: NUL-terminated message, then error fields */
+#define PROTOCOL_MSG_COMPLETE	'C'		/* fbsql: "STATUS ROWS ELAPSED_MS" */
+
+extern void
+protocolRedirectOutput(void);
+
+extern int
+protocolRun(void);
+
+extern bool
+protocolSendFrame(int fd, char type, const char *data, uint32_t len);
+
+extern bool
+protocolRecvFrame(int fd, char *type, FQExpBuffer payload);
+
+extern void
+protocolAppendUint32(FQExpBuffer buf, uint32_t value);
+
+extern uint32_t
+protocolGetUint32(const char *data);
+
+#endif   /* PROTOCOL_H */
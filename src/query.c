@@ -12,14 +12,72 @@
 #include <string.h>
 #include <sys/time.h>
 #include <ctype.h>
+#include <unistd.h>
 
 #include "libfq.h"
 #include "fbsql.h"
 #include "query.h"
 #include "settings.h"
+#include "common.h"
+#include "fbsqlscan.h"
+#include "gexec.h"
+#include "planhistory.h"
+#include "querystats.h"
+#include "txmode.h"
+#include "workload.h"
 
 #define SPRINTF_FORMAT_LEN 32
 
+/*
+ * Statements executed with bound variables are prepared once and the
+ * handles reused while they remain in this cache.
+ */
+typedef struct preparedStatement
+{
+	char	   *query;
+	FBresult   *stmt;
+} preparedStatement;
+
+static preparedStatement prepared_statements[PREPARED_STATEMENT_CACHE_SIZE];
+static int next_prepared_statement = 0;
+
+static FBresult *
+_getPreparedStatement(const char *query, int nparams);
+
+/*
+ * Batched autocommit (\autocommit batch N [MS]): statements executed
+ * since the current transaction was started, and when it was started.
+ */
+static int batch_statements = 0;
+static query_time batch_start;
+
+/* set while a caller commits the statements itself (\gexec) */
+static bool autocommit_suspended = false;
+
+static void
+_autocommitBatch(void);
+
+/*
+ * Messages of the errors (SQLSTATE 40001) which \set retry_on_conflict
+ * retries; libfq does not expose the GDS code itself. Each must match a
+ * complete line of the error message (e.g. "-deadlock"), so text such
+ * as a user exception's message containing these words does not.
+ */
+static const char *const conflict_messages[] =
+{
+	"deadlock",
+	"lock conflict on no wait transaction",
+	"lock time-out on wait transaction",
+	"update conflicts with concurrent update",
+	NULL
+};
+
+static bool
+_isConflictError(const FBresult *query_result);
+
+static bool
+_retryDelay(int retry);
+
 
 static char *
 _formatColumn(const FBresult *query_result, int row, int column, char *value, bool for_header);
@@ -45,15 +103,113 @@ _printTableHeader(const FBresult *query_result, const printQueryOpt *pqopt);
  */
 bool
 SendQuery(const char *query)
+{
+	return SendQueryParams(query, 0, NULL);
+}
+
+
+/**
+ * SendQueryParams()
+ *
+ * As SendQuery(), binding "params" to the query's "?" placeholders
+ * (generated by the lexer from variable references when bind_variables
+ * is set). Such queries are executed using a cached prepared statement,
+ * so repeated executions with different values are not parsed again.
+ */
+bool
+SendQueryParams(const char *query, int nparams, const char * const *params)
 {
 	FBresult   *query_result;
-	query_time	before, after;
+	query_time	before, after, executed;
 	double		elapsed_msec = 0;
+	double		exec_msec = 0;
+	char	   *fingerprint = NULL;
+	int			retries = 0;
+	bool		user_transaction;
+
+	/* query sent with \gexec */
+	if (fset.gexec_flag == true)
+	{
+		fset.gexec_flag = false;
+		return execGexec(query, nparams, params, fset.gexec_batch, fset.gexec_workers);
+	}
+
+	/* cached prepared statements would prevent DDL on the objects they use */
+	if (isAnalysableStatement(query) == false && isTransactionControl(query) == false)
+		preparedStatementsClear();
+
+	gettimeofday(&before, NULL);
+
+	/*
+	 * A conflicting statement is only retried if fbsql (or libfq's
+	 * autocommit) owns the transaction; in the user's own transaction,
+	 * the conflict would usually recur (e.g. in a snapshot transaction),
+	 * and the transaction's earlier statements cannot be re-executed.
+	 */
+	user_transaction = fset.autocommit == false
+		|| (autocommitManaged() == false && FQisActiveTransaction(fset.conn) == true);
+
+	for (;;)
+	{
+		if (FQisActiveTransaction(fset.conn) == false)
+		{
+			/* this statement will start a new batch transaction */
+			if (autocommitManaged() == true)
+			{
+				batch_statements = 0;
+				gettimeofday(&batch_start, NULL);
+			}
+
+			if (startTransaction(fset.conn, query) == false)
+				return false;
+		}
+
+		if (nparams > 0)
+		{
+			FBresult *stmt = _getPreparedStatement(query, nparams);
+
+			/* if preparation failed, FQexecParams() will report the error */
+			if (stmt != NULL)
+				query_result = FQexecPrepared(fset.conn, stmt, nparams, NULL, params, NULL, NULL, 0);
+			else
+				query_result = FQexecParams(fset.conn, query, nparams, NULL, params, NULL, NULL, 0);
+		}
+		else
+		{
+			query_result = FQexec(fset.conn, query);
+		}
 
-	if (fset.timing)
-		gettimeofday(&before, NULL);
+		/* \set retry_on_conflict N */
+		if (retries == fset.retry_on_conflict || user_transaction == true
+		 || _isConflictError(query_result) == false)
+			break;
 
-	query_result = FQexec(fset.conn, query);
+		retries++;
+
+		if (_retryDelay(retries) == false)
+			break;
+
+		FQclear(query_result);
+
+		/*
+		 * The failed statement's changes have been undone, but in a
+		 * snapshot transaction the conflict would recur; if fbsql is
+		 * managing autocommit, commit any statements already executed
+		 * in this transaction so the retry starts a new one. (In
+		 * libfq's autocommit mode, the transaction has already been
+		 * rolled back.)
+		 */
+		if (autocommitManaged() == true && autocommitBatchFlush() == false)
+			return false;
+	}
+
+	/* execution time only, excluding output, for query statistics and plan history */
+	gettimeofday(&executed, NULL);
+	INSTR_TIME_SUBTRACT(executed, before);
+	exec_msec = INSTR_TIME_GET_MILLISEC(executed);
+
+	if (fset.query_stats == true || fset.plan_history == true)
+		fingerprint = fbsql_fingerprint(query);
 
 	switch(FQresultStatus(query_result))
 	{
@@ -62,12 +218,31 @@ SendQuery(const char *query)
 		case FBRES_NONFATAL_ERROR:
 		case FBRES_FATAL_ERROR:
 		{
+			/* errors are reported even if results are discarded */
 			printf("%s\n", FQresultErrorMessage(query_result));
 			/* TODO: print line/column info, when available from libfq */
+
+			if (retries > 0)
+				printf("Statement failed after %i %s\n",
+					   retries, retries == 1 ? "retry" : "retries");
+			else if (fset.retry_on_conflict > 0 && user_transaction == true
+				  && _isConflictError(query_result) == true)
+				puts("Not retried, as the statement is part of a transaction not started by fbsql");
+
 			FQclear(query_result);
+
+			_autocommitBatch();
+
+			if (fset.query_stats == true)
+				queryStatsRecord(fingerprint, exec_msec, 0, true);
+
+			free(fingerprint);
 			return false;
 		}
 		case FBRES_TUPLES_OK:
+			if (fset.discard_results == true)
+				break;
+
 			if (fset.plan_display != PLAN_DISPLAY_ONLY)
 			{
 				printQuery(query_result, &fset.popt);
@@ -97,36 +272,357 @@ SendQuery(const char *query)
 			break;
 
 		case FBRES_COMMAND_OK:
-			puts("");
+			if (fset.discard_results == false)
+				puts("");
 			break;
 		case FBRES_TRANSACTION_START:
-			puts("START");
+			if (fset.discard_results == false)
+				puts("START");
 			break;
 		case FBRES_TRANSACTION_COMMIT:
-			puts("COMMIT");
+			if (fset.discard_results == false)
+				puts("COMMIT");
 			break;
 		case FBRES_TRANSACTION_ROLLBACK:
-			puts("ROLLBACK");
+			if (fset.discard_results == false)
+				puts("ROLLBACK");
 			break;
 		default:
 			/* should never reach here */
 			puts("Unexpected result code");
 	}
 
+	if (fset.query_stats == true)
+		queryStatsRecord(fingerprint,
+						 exec_msec,
+						 FQresultStatus(query_result) == FBRES_TUPLES_OK ? FQntuples(query_result) : 0,
+						 false);
+
+	if (fset.plan_history == true
+	 && (FQresultStatus(query_result) == FBRES_TUPLES_OK || FQresultStatus(query_result) == FBRES_COMMAND_OK)
+	 && isAnalysableStatement(query))
+		planHistoryRecord(query, fingerprint, exec_msec);
+
 	FQclear(query_result);
+	free(fingerprint);
 
-	if (fset.timing)
+	_autocommitBatch();
+
+	if (fset.timing && fset.discard_results == false)
 	{
 		gettimeofday(&after, NULL);
 		INSTR_TIME_SUBTRACT(after, before);
 		elapsed_msec = INSTR_TIME_GET_MILLISEC(after);
-		printf("Time: %.3f ms\n", elapsed_msec);
+
+		if (retries > 0)
+			printf("Time: %.3f ms (%i %s after conflict)\n", elapsed_msec,
+				   retries, retries == 1 ? "retry" : "retries");
+		else
+			printf("Time: %.3f ms\n", elapsed_msec);
 	}
 
 	return true;
 }
 
 
+/**
+ * _autocommitBatch()
+ *
+ * In batched autocommit mode, the session's connection is not in libfq's
+ * autocommit mode; instead the transaction started by the first statement
+ * of a batch is used by the following statements (including read-only
+ * ones, which would otherwise each start and commit a transaction of
+ * their own), and committed once "autocommit_batch" statements have been
+ * executed, or "autocommit_batch_ms" milliseconds have elapsed since it
+ * was started.
+ *
+ * The elapsed time is only checked after each statement, so an idle
+ * session may hold the transaction open for longer.
+ *
+ * If a transaction mode is set (\txmode) without batching, each statement
+ * is committed individually in the same way.
+ */
+static void
+_autocommitBatch(void)
+{
+	query_time	now;
+
+	if (autocommitManaged() == false)
+		return;
+
+	/* statement ended the transaction itself */
+	if (FQisActiveTransaction(fset.conn) == false)
+	{
+		batch_statements = 0;
+		return;
+	}
+
+	batch_statements++;
+
+	gettimeofday(&now, NULL);
+	INSTR_TIME_SUBTRACT(now, batch_start);
+
+	if (batch_statements >= fset.autocommit_batch
+	 || (fset.autocommit_batch_ms > 0 && INSTR_TIME_GET_MILLISEC(now) >= fset.autocommit_batch_ms))
+		autocommitBatchFlush();
+}
+
+
+/**
+ * _isConflictError()
+ *
+ * Determine whether a statement failed due to a lock conflict, update
+ * conflict or deadlock with a concurrent transaction.
+ */
+static bool
+_isConflictError(const FBresult *query_result)
+{
+	const char *message;
+	int			i;
+
+	switch (FQresultStatus(query_result))
+	{
+		case FBRES_NONFATAL_ERROR:
+		case FBRES_FATAL_ERROR:
+			break;
+		default:
+			return false;
+	}
+
+	message = FQresultErrorMessage(query_result);
+
+	if (message == NULL)
+		return false;
+
+	while (*message != '\0')
+	{
+		const char *line_end = strchr(message, '\n');
+		size_t		line_len;
+
+		if (line_end == NULL)
+			line_end = message + strlen(message);
+
+		/* subsequent lines of the status vector are prefixed with "-" */
+		while (message < line_end && (*message == '-' || isspace((unsigned char)*message)))
+			message++;
+
+		line_len = line_end - message;
+
+		while (line_len > 0 && isspace((unsigned char)message[line_len - 1]))
+			line_len--;
+
+		for (i = 0; conflict_messages[i] != NULL; i++)
+		{
+			if (strlen(conflict_messages[i]) == line_len
+			 && strncmp(message, conflict_messages[i], line_len) == 0)
+				return true;
+		}
+
+		message = *line_end == '\n' ? line_end + 1 : line_end;
+	}
+
+	return false;
+}
+
+
+/**
+ * _retryDelay()
+ *
+ * Wait before retrying a statement after a conflict. The delay doubles
+ * with each retry (up to RETRY_MAX_DELAY_MS), and a random part of it
+ * is omitted so that concurrent sessions which conflicted with each
+ * other do not retry in step.
+ *
+ * Returns false if CTRL-C was pressed while waiting.
+ */
+static bool
+_retryDelay(int retry)
+{
+	static bool seeded = false;
+	long		delay = RETRY_BASE_DELAY_MS;
+	long		remaining;
+	int			i;
+
+	if (seeded == false)
+	{
+		struct timeval now;
+
+		gettimeofday(&now, NULL);
+		srandom((unsigned int)(now.tv_sec ^ now.tv_usec ^ getpid()));
+		seeded = true;
+	}
+
+	for (i = 1; i < retry && delay < RETRY_MAX_DELAY_MS; i++)
+		delay *= 2;
+
+	if (delay > RETRY_MAX_DELAY_MS)
+		delay = RETRY_MAX_DELAY_MS;
+
+	delay = delay / 2 + random() % (delay / 2 + 1);
+
+	printf("Conflict with a concurrent transaction; retrying in %li ms (retry %i of %i)\n",
+		   delay, retry, fset.retry_on_conflict);
+	fflush(stdout);
+
+	cancel_pressed = false;
+
+	for (remaining = delay; remaining > 0 && cancel_pressed == false; remaining -= 100)
+		usleep((remaining < 100 ? remaining : 100) * 1000);
+
+	return cancel_pressed == false;
+}
+
+
+/**
+ * autocommitManaged()
+ *
+ * Determine whether, in autocommit mode, fbsql rather than libfq starts
+ * and commits transactions on the session's connection, either to batch
+ * statements or to apply the transaction mode.
+ */
+bool
+autocommitManaged(void)
+{
+	return fset.autocommit == true
+		&& autocommit_suspended == false
+		&& (fset.autocommit_batch > 0 || fset.txmode != NULL);
+}
+
+
+/**
+ * autocommitSuspend()
+ *
+ * Suspend or resume the management of autocommit by fbsql, for callers
+ * which execute statements with SendQuery() and commit them themselves.
+ * Any statements not yet committed should be flushed first.
+ */
+void
+autocommitSuspend(bool suspend)
+{
+	autocommit_suspended = suspend;
+}
+
+
+/**
+ * autocommitBatchFlush()
+ *
+ * Commit any statements executed in batched autocommit mode which have
+ * not yet been committed. If the commit fails, the transaction is rolled
+ * back and false returned.
+ */
+bool
+autocommitBatchFlush(void)
+{
+	FBresult   *res;
+	bool		success = true;
+	int			uncommitted = batch_statements;
+
+	batch_statements = 0;
+
+	if (autocommitManaged() == false)
+		return true;
+
+	if (fset.conn == NULL || FQisActiveTransaction(fset.conn) == false)
+		return true;
+
+	res = FQexec(fset.conn, "COMMIT");
+
+	if (FQresultStatus(res) != FBRES_TRANSACTION_COMMIT)
+	{
+		printf("%s\n", res ? FQresultErrorMessage(res) : FQerrorMessage(fset.conn));
+		fbsql_error("unable to commit batched statements; %i statement(s) rolled back\n",
+					uncommitted);
+
+		if (res != NULL)
+			FQclear(res);
+
+		res = FQexec(fset.conn, "ROLLBACK");
+		success = false;
+	}
+
+	if (res != NULL)
+		FQclear(res);
+
+	return success;
+}
+
+
+/**
+ * _getPreparedStatement()
+ *
+ * Return a prepared statement handle for "query" from the cache,
+ * preparing it if necessary (replacing the oldest entry); returns NULL
+ * if the statement could not be prepared.
+ */
+static FBresult *
+_getPreparedStatement(const char *query, int nparams)
+{
+	preparedStatement *entry;
+	FBresult   *stmt;
+	int			i;
+
+	for (i = 0; i < PREPARED_STATEMENT_CACHE_SIZE; i++)
+	{
+		if (prepared_statements[i].query != NULL
+		 && strcmp(prepared_statements[i].query, query) == 0)
+			return prepared_statements[i].stmt;
+	}
+
+	stmt = FQprepare(fset.conn, query, nparams);
+
+	if (stmt == NULL || FQresultStatus(stmt) == FBRES_FATAL_ERROR)
+	{
+		if (stmt != NULL)
+			FQclear(stmt);
+
+		return NULL;
+	}
+
+	entry = &prepared_statements[next_prepared_statement];
+	next_prepared_statement = (next_prepared_statement + 1) % PREPARED_STATEMENT_CACHE_SIZE;
+
+	if (entry->query != NULL)
+	{
+		free(entry->query);
+		FQclear(entry->stmt);
+	}
+
+	entry->query = strdup(query);
+	entry->stmt = stmt;
+
+	return stmt;
+}
+
+
+/**
+ * preparedStatementsClear()
+ *
+ * Release all cached prepared statements. While prepared, a statement
+ * keeps the objects it references in use, so they cannot be altered or
+ * dropped; the cache is therefore cleared before any statement other
+ * than DML or transaction control, and when bind_variables is turned off.
+ */
+void
+preparedStatementsClear(void)
+{
+	int			i;
+
+	for (i = 0; i < PREPARED_STATEMENT_CACHE_SIZE; i++)
+	{
+		if (prepared_statements[i].query == NULL)
+			continue;
+
+		free(prepared_statements[i].query);
+		FQclear(prepared_statements[i].stmt);
+
+		prepared_statements[i].query = NULL;
+		prepared_statements[i].stmt = NULL;
+	}
+
+	next_prepared_statement = 0;
+}
+
+
 /**
  * printQuery()
  *
@@ -176,6 +672,199 @@ printQuery(const FBresult *query_result, const printQueryOpt *pqopt)
 }
 
 
+/**
+ * initTable()
+ *
+ * Initialise a client-side result table with the provided column
+ * headers. All columns are initially left-aligned.
+ */
+void
+initTable(fbsqlTable *table, int nfields, const char * const *headers)
+{
+	int i;
+
+	table->nfields = nfields;
+	table->ntuples = 0;
+	table->alloc_tuples = 16;
+	table->headers = (char **)malloc(nfields * sizeof(char *));
+	table->right_align = (bool *)fb_malloc0(nfields * sizeof(bool));
+	table->cells = (char **)malloc(table->alloc_tuples * nfields * sizeof(char *));
+
+	for (i = 0; i < nfields; i++)
+		table->headers[i] = strdup(headers[i]);
+}
+
+
+/**
+ * addTableRow()
+ *
+ * Append a row to a client-side result table; the values are copied.
+ * NULL values are displayed using the current null display setting.
+ */
+void
+addTableRow(fbsqlTable *table, const char * const *values)
+{
+	int i;
+
+	if (table->ntuples == table->alloc_tuples)
+	{
+		table->alloc_tuples *= 2;
+		table->cells = (char **)realloc(table->cells,
+										table->alloc_tuples * table->nfields * sizeof(char *));
+	}
+
+	for (i = 0; i < table->nfields; i++)
+	{
+		table->cells[(table->ntuples * table->nfields) + i] =
+			values[i] == NULL ? NULL : strdup(values[i]);
+	}
+
+	table->ntuples++;
+}
+
+
+/**
+ * printTable()
+ *
+ * Display a client-side result table in the same format as printQuery().
+ */
+void
+printTable(const fbsqlTable *table, const printQueryOpt *pqopt)
+{
+	int *widths;
+	int i, j, total_width = 0;
+	bool aligned = pqopt->topt.format == PRINT_ALIGNED;
+	const printTextFormat *border_format = pqopt->topt.border_format;
+
+	if (table->ntuples == 0)
+		return;
+
+	widths = (int *)fb_malloc0(table->nfields * sizeof(int));
+
+	for (j = 0; j < table->nfields; j++)
+	{
+		widths[j] = FQdspstrlen(table->headers[j], fset.client_encoding_id);
+
+		for (i = 0; i < table->ntuples; i++)
+		{
+			const char *value = table->cells[(i * table->nfields) + j];
+			int width = FQdspstrlen(value == NULL ? pqopt->nullPrint : value,
+									fset.client_encoding_id);
+
+			if (width > widths[j])
+				widths[j] = width;
+		}
+
+		total_width += widths[j];
+	}
+
+	/* Print overall table header, if set */
+	if (pqopt->header != NULL)
+	{
+		if (aligned)
+		{
+			/* Add padding and border column width */
+			total_width += (table->nfields * 3);
+			printf("%*s\n",
+				   total_width - ((total_width - (int)strlen(pqopt->header)) / 2),
+				   pqopt->header);
+		}
+		else
+		{
+			printf("%s\n", pqopt->header);
+		}
+	}
+
+	/* Print column headers, then data rows */
+	for (i = -1; i < table->ntuples; i++)
+	{
+		for (j = 0; j < table->nfields; j++)
+		{
+			const char *value;
+			int padding = 0;
+
+			if (i < 0)
+				value = table->headers[j];
+			else
+				value = table->cells[(i * table->nfields) + j];
+
+			if (value == NULL)
+				value = pqopt->nullPrint;
+
+			if (j)
+				printf("%s", border_format->divider);
+
+			if (!aligned)
+			{
+				printf("%s", value);
+				continue;
+			}
+
+			padding = widths[j] - FQdspstrlen(value, fset.client_encoding_id);
+
+			if (border_format->padding)
+				printf(" ");
+
+			if (i >= 0 && table->right_align[j] == true)
+				printf("%*s%s", padding, "", value);
+			else
+				printf("%s%*s", value, padding, "");
+
+			if (border_format->padding)
+				printf(" ");
+		}
+		puts("");
+
+		/* print column header underline (PRINT_ALIGNED mode only) */
+		if (i < 0 && aligned)
+		{
+			for (j = 0; j < table->nfields; j++)
+			{
+				int k, underline_len = widths[j] + (border_format->padding ? 2 : 0);
+
+				if (j)
+					printf("%s", border_format->junction);
+
+				for (k = 0; k < underline_len; k++)
+					putchar(border_format->header_underline[0]);
+			}
+			puts("");
+		}
+	}
+
+	free(widths);
+}
+
+
+/**
+ * termTable()
+ *
+ * Free all memory associated with a client-side result table
+ * (but not the table struct itself).
+ */
+void
+termTable(fbsqlTable *table)
+{
+	int i;
+
+	for (i = 0; i < table->nfields; i++)
+		free(table->headers[i]);
+
+	for (i = 0; i < table->ntuples * table->nfields; i++)
+	{
+		if (table->cells[i] != NULL)
+			free(table->cells[i]);
+	}
+
+	free(table->headers);
+	free(table->right_align);
+	free(table->cells);
+
+	table->nfields = 0;
+	table->ntuples = 0;
+}
+
+
 /**
  * _formatColumn()
  *
@@ -6,12 +6,63 @@
 
 typedef struct timeval query_time;
 
+/* Number of prepared statements kept for queries with bound variables */
+#define PREPARED_STATEMENT_CACHE_SIZE 16
+
+/* Delay before the first retry after a conflict, doubled for each further retry */
+#define RETRY_BASE_DELAY_MS 50
+#define RETRY_MAX_DELAY_MS 5000
+
+/* Default maximum duration of a transaction in batched autocommit mode */
+#define AUTOCOMMIT_BATCH_DEFAULT_MS 1000
+
+/*
+ * Result table assembled on the client side, for displaying data which
+ * is not (or not only) the direct result of a single query.
+ */
+typedef struct fbsqlTable
+{
+	int			nfields;
+	int			ntuples;
+	int			alloc_tuples;
+	char	  **headers;
+	bool	   *right_align;	/* per column; numeric columns */
+	char	  **cells;			/* ntuples * nfields; NULL is a NULL value */
+} fbsqlTable;
+
 extern bool
 SendQuery(const char *query);
 
+extern bool
+SendQueryParams(const char *query, int nparams, const char * const *params);
+
+extern bool
+autocommitManaged(void);
+
+extern bool
+autocommitBatchFlush(void);
+
+extern void
+autocommitSuspend(bool suspend);
+
+extern void
+preparedStatementsClear(void);
+
 extern void
 printQuery(const FBresult *query_result, const printQueryOpt *pqopt);
 
+extern void
+initTable(fbsqlTable *table, int nfields, const char * const *headers);
+
+extern void
+addTableRow(fbsqlTable *table, const char * const *values);
+
+extern void
+printTable(const fbsqlTable *table, const printQueryOpt *pqopt);
+
+extern void
+termTable(fbsqlTable *table);
+
 #define INSTR_TIME_SUBTRACT(x,y) \
 	do { \
 		(x).tv_sec -= (y).tv_sec; \
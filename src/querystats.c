@@ -0,0 +1,425 @@
+/* ---------------------------------------------------------------------
+ *
+ * querystats.c
+ *
+ * Collect and display execution statistics aggregated by statement
+ * fingerprint, either for the current session or for a replayed script
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "common.h"
+#include "fbsqlscan.h"
+#include "query.h"
+#include "querystats.h"
+#include "settings.h"
+#include "workload.h"
+
+#define QUERYSTATS_FINGERPRINT_LEN 80
+#define QUERYSTATS_OTHER_FINGERPRINTS "(other fingerprints)"
+
+/* hash index slots; a power of 2, more than twice the maximum number of entries */
+#define QUERYSTATS_INDEX_SIZE 4096
+
+typedef struct queryStatsEntry
+{
+	char	   *fingerprint;
+	long		calls;			/* successful executions */
+	long		errors;
+	double		total_msec;
+	long		total_rows;
+	double	   *samples;		/* reservoir sample of execution times */
+	int			nsamples;
+	int			alloc_samples;
+} queryStatsEntry;
+
+typedef struct queryStats
+{
+	int			nentries;
+	int			alloc_entries;
+	queryStatsEntry *entries;
+	int		   *index;			/* hash index of entries by fingerprint:
+								 * entry number + 1, or 0 if unused */
+} queryStats;
+
+static queryStats session_stats = {0, 0, NULL, NULL};
+
+/* statistics the executed statements are added to */
+static queryStats *current_stats = &session_stats;
+
+
+static void _statsRecord(queryStats *stats, const char *fingerprint, double elapsed_msec, long rows, bool error);
+static queryStatsEntry *_statsEntry(queryStats *stats, const char *fingerprint);
+static void _statsPrint(queryStats *stats, const char *header);
+static void _statsFree(queryStats *stats);
+static double _percentile(const queryStatsEntry *entry, double fraction);
+static int _compareTotalTime(const void *a, const void *b);
+static int _compareDouble(const void *a, const void *b);
+
+
+/**
+ * queryStatsRecord()
+ *
+ * Add the execution of a statement to the session's statistics, or
+ * those of the script being replayed.
+ */
+void
+queryStatsRecord(const char *fingerprint, double elapsed_msec, long rows, bool error)
+{
+	if (fingerprint == NULL)
+		return;
+
+	_statsRecord(current_stats, fingerprint, elapsed_msec, rows, error);
+}
+
+
+/**
+ * showQueryStats()
+ *
+ * \querystats
+ *
+ * Display statistics for statements executed in the current session.
+ */
+void
+showQueryStats(void)
+{
+	if (session_stats.nentries == 0)
+	{
+		puts("No query statistics collected");
+		return;
+	}
+
+	_statsPrint(&session_stats, "Query statistics for this session");
+}
+
+
+/**
+ * resetQueryStats()
+ *
+ * \querystats reset
+ */
+void
+resetQueryStats(void)
+{
+	_statsFree(&session_stats);
+	puts("Query statistics reset");
+}
+
+
+/**
+ * replayQueryStats()
+ *
+ * \querystats replay FILE
+ *
+ * Execute each statement in the provided script, discarding the result
+ * sets, and display statistics aggregated by fingerprint. Note that
+ * statements are executed as normal (with SendQueryParams(), so
+ * autocommit and transaction mode settings apply), i.e. any data
+ * modifications will take place.
+ *
+ * The session's own statistics are not affected.
+ */
+bool
+replayQueryStats(const char *filename)
+{
+	workloadStatement *statements;
+	queryStats replay_stats = {0, 0, NULL, NULL};
+	bool		query_stats = fset.query_stats;
+	int nstatements = 0;
+	int i;
+	long errors = 0;
+	FQExpBufferData header;
+
+	statements = readWorkloadScript(filename, &nstatements);
+
+	if (statements == NULL)
+		return false;
+
+	current_stats = &replay_stats;
+	fset.query_stats = true;
+	fset.discard_results = true;
+
+	for (i = 0; i < nstatements; i++)
+	{
+		if (SendQueryParams(statements[i].query, statements[i].nparams,
+							(const char * const *)statements[i].params) == false)
+		{
+			printf("(line %i)\n", statements[i].lineno);
+			errors++;
+		}
+	}
+
+	current_stats = &session_stats;
+	fset.query_stats = query_stats;
+	fset.discard_results = false;
+
+	initFQExpBuffer(&header);
+	appendFQExpBuffer(&header, "Query statistics for \"%s\"", filename);
+
+	_statsPrint(&replay_stats, header.data);
+
+	printf("%i statement(s) executed, %li error(s)\n", nstatements, errors);
+
+	termFQExpBuffer(&header);
+	_statsFree(&replay_stats);
+	freeWorkloadStatements(statements, nstatements);
+
+	return errors == 0;
+}
+
+
+static void
+_statsRecord(queryStats *stats, const char *fingerprint, double elapsed_msec, long rows, bool error)
+{
+	queryStatsEntry *entry = _statsEntry(stats, fingerprint);
+
+	if (error == true)
+	{
+		entry->errors++;
+		return;
+	}
+
+	entry->calls++;
+	entry->total_msec += elapsed_msec;
+	entry->total_rows += rows;
+
+	/* retain a uniform sample of execution times for percentile calculation */
+	if (entry->nsamples < QUERYSTATS_MAX_SAMPLES)
+	{
+		if (entry->nsamples == entry->alloc_samples)
+		{
+			entry->alloc_samples = entry->alloc_samples == 0 ? 8 : entry->alloc_samples * 2;
+
+			if (entry->alloc_samples > QUERYSTATS_MAX_SAMPLES)
+				entry->alloc_samples = QUERYSTATS_MAX_SAMPLES;
+
+			entry->samples = (double *)realloc(entry->samples, entry->alloc_samples * sizeof(double));
+		}
+
+		entry->samples[entry->nsamples++] = elapsed_msec;
+	}
+	else
+	{
+		long j = random() % entry->calls;
+
+		if (j < QUERYSTATS_MAX_SAMPLES)
+			entry->samples[j] = elapsed_msec;
+	}
+}
+
+
+/**
+ * _statsEntry()
+ *
+ * Return the entry for "fingerprint", creating it if necessary. Once
+ * QUERYSTATS_MAX_FINGERPRINTS entries exist, the entry for all other
+ * fingerprints is returned instead.
+ */
+static queryStatsEntry *
+_statsEntry(queryStats *stats, const char *fingerprint)
+{
+	queryStatsEntry *entry;
+	unsigned int slot;
+
+	if (stats->index == NULL)
+		stats->index = (int *)fb_malloc0(QUERYSTATS_INDEX_SIZE * sizeof(int));
+
+	for (;;)
+	{
+		slot = (unsigned int)(hashString(fingerprint) & (QUERYSTATS_INDEX_SIZE - 1));
+
+		while (stats->index[slot] != 0)
+		{
+			entry = &stats->entries[stats->index[slot] - 1];
+
+			if (strcmp(entry->fingerprint, fingerprint) == 0)
+				return entry;
+
+			slot = (slot + 1) & (QUERYSTATS_INDEX_SIZE - 1);
+		}
+
+		if (stats->nentries < QUERYSTATS_MAX_FINGERPRINTS
+		 || strcmp(fingerprint, QUERYSTATS_OTHER_FINGERPRINTS) == 0)
+			break;
+
+		fingerprint = QUERYSTATS_OTHER_FINGERPRINTS;
+	}
+
+	if (stats->nentries == stats->alloc_entries)
+	{
+		stats->alloc_entries = stats->alloc_entries == 0 ? 32 : stats->alloc_entries * 2;
+		stats->entries = (queryStatsEntry *)realloc(stats->entries,
+													stats->alloc_entries * sizeof(queryStatsEntry));
+	}
+
+	entry = &stats->entries[stats->nentries++];
+	memset(entry, 0, sizeof(queryStatsEntry));
+	entry->fingerprint = strdup(fingerprint);
+
+	stats->index[slot] = stats->nentries;
+
+	return entry;
+}
+
+
+/**
+ * _statsPrint()
+ *
+ * Display the collected statistics, ordered by total execution time.
+ */
+static void
+_statsPrint(queryStats *stats, const char *header)
+{
+	fbsqlTable table;
+	printQueryOpt pqopt = fset.popt;
+	queryStatsEntry **sorted;
+	int i;
+
+	static const char *const headers[] =
+		{"Calls", "Errors", "Total ms", "Mean ms", "P95 ms", "Rows", "Fingerprint"};
+
+	sorted = (queryStatsEntry **)malloc(stats->nentries * sizeof(queryStatsEntry *));
+
+	for (i = 0; i < stats->nentries; i++)
+		sorted[i] = &stats->entries[i];
+
+	qsort(sorted, stats->nentries, sizeof(queryStatsEntry *), _compareTotalTime);
+
+	initTable(&table, lengthof(headers), headers);
+
+	for (i = 0; i < 6; i++)
+		table.right_align[i] = true;
+
+	for (i = 0; i < stats->nentries; i++)
+	{
+		queryStatsEntry *entry = sorted[i];
+		const char *values[7];
+		char calls[32], errors[32], total[32], mean[32], p95[32], rows[32];
+		char *fingerprint;
+
+		snprintf(calls, sizeof(calls), "%li", entry->calls);
+		snprintf(errors, sizeof(errors), "%li", entry->errors);
+		snprintf(total, sizeof(total), "%.3f", entry->total_msec);
+		snprintf(rows, sizeof(rows), "%li", entry->total_rows);
+
+		if (entry->calls > 0)
+		{
+			snprintf(mean, sizeof(mean), "%.3f", entry->total_msec / entry->calls);
+			snprintf(p95, sizeof(p95), "%.3f", _percentile(entry, 0.95));
+		}
+		else
+		{
+			strcpy(mean, "-");
+			strcpy(p95, "-");
+		}
+
+		fingerprint = condenseText(entry->fingerprint,
+								   strlen(entry->fingerprint),
+								   QUERYSTATS_FINGERPRINT_LEN);
+
+		values[0] = calls;
+		values[1] = errors;
+		values[2] = total;
+		values[3] = mean;
+		values[4] = p95;
+		values[5] = rows;
+		values[6] = fingerprint;
+
+		addTableRow(&table, values);
+
+		free(fingerprint);
+	}
+
+	pqopt.header = (char *)header;
+	printTable(&table, &pqopt);
+	printf("(%i fingerprints)\n", stats->nentries);
+
+	termTable(&table);
+	free(sorted);
+}
+
+
+static void
+_statsFree(queryStats *stats)
+{
+	int i;
+
+	for (i = 0; i < stats->nentries; i++)
+	{
+		free(stats->entries[i].fingerprint);
+		free(stats->entries[i].samples);
+	}
+
+	free(stats->entries);
+	free(stats->index);
+
+	stats->entries = NULL;
+	stats->index = NULL;
+	stats->nentries = 0;
+	stats->alloc_entries = 0;
+}
+
+
+/**
+ * _percentile()
+ *
+ * Return the nearest-rank percentile of the sampled execution times.
+ */
+static double
+_percentile(const queryStatsEntry *entry, double fraction)
+{
+	double *samples;
+	double result;
+	int rank;
+
+	if (entry->nsamples == 0)
+		return 0;
+
+	samples = (double *)malloc(entry->nsamples * sizeof(double));
+	memcpy(samples, entry->samples, entry->nsamples * sizeof(double));
+	qsort(samples, entry->nsamples, sizeof(double), _compareDouble);
+
+	rank = (int)(fraction * entry->nsamples + 0.999999);
+
+	if (rank < 1)
+		rank = 1;
+
+	result = samples[rank - 1];
+	free(samples);
+
+	return result;
+}
+
+
+static int
+_compareTotalTime(const void *a, const void *b)
+{
+	const queryStatsEntry *entry_a = *(const queryStatsEntry * const *) a;
+	const queryStatsEntry *entry_b = *(const queryStatsEntry * const *) b;
+
+	if (entry_a->total_msec > entry_b->total_msec)
+		return -1;
+	if (entry_a->total_msec < entry_b->total_msec)
+		return 1;
+	return 0;
+}
+
+
+static int
+_compareDouble(const void *a, const void *b)
+{
+	double value_a = *(const double *) a;
+	double value_b = *(const double *) b;
+
+	if (value_a < value_b)
+		return -1;
+	if (value_a > value_b)
+		return 1;
+	return 0;
+}
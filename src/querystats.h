@@ -0,0 +1,27 @@
+#ifndef QUERYSTATS_H
+#define QUERYSTATS_H
+
+#include "settings.h"
+
+/* Maximum number of execution times retained per fingerprint for percentiles */
+#define QUERYSTATS_MAX_SAMPLES 1000
+
+/*
+ * Maximum number of fingerprints tracked; statements with further
+ * fingerprints are aggregated in a single "(other fingerprints)" entry
+ */
+#define QUERYSTATS_MAX_FINGERPRINTS 1000
+
+extern void
+queryStatsRecord(const char *fingerprint, double elapsed_msec, long rows, bool error);
+
+extern void
+showQueryStats(void);
+
+extern void
+resetQueryStats(void);
+
+extern bool
+replayQueryStats(const char *filename);
+
+#endif   /* QUERYSTATS_H */
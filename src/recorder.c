@@ -0,0 +1,973 @@
+/* ---------------------------------------------------------------------
+ *
+ * recorder.c
+ *
+ * Background recording of monitoring table snapshots to a ring buffer
+ * file (fbsql --record DIR), and display of recorded snapshots
+ * (\replay-stats)
+ *
+ * The ring buffer file consists of a header followed by a fixed number of
+ * fixed-size slots, each holding one snapshot:
+ *
+ *   header:   magic (8) | version | slots | slot size | next slot |
+ *             used slots | interval       (32-bit values, 64 bytes total)
+ *   slot:     payload length (32-bit) | timestamp (64-bit) | payload
+ *   payload:  for each section: section id (8-bit) | rows (16-bit) |
+ *             columns (8-bit) | cells
+ *   cell:     length (16-bit; 0xFFFF for NULL) | text
+ *
+ * All integers are little-endian. Rows which do not fit in the slot are
+ * omitted.
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#define _XOPEN_SOURCE 700
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "common.h"
+#include "query.h"
+#include "recorder.h"
+#include "settings.h"
+
+#define RECORDER_MAGIC "FBSQLRB1"
+#define RECORDER_VERSION 1
+#define RECORDER_HEADER_SIZE 64
+#define RECORDER_SLOT_HEADER_SIZE 12
+#define RECORDER_NULL_CELL 0xFFFF
+#define RECORDER_MAX_COLUMNS 12
+
+typedef enum
+{
+	SECTION_DATABASE = 0,
+	SECTION_ATTACHMENTS,
+	SECTION_STATEMENTS,
+	SECTION_TRANSACTIONS,
+	RECORDER_SECTIONS
+} recorderSectionId;
+
+typedef struct recorderSection
+{
+	const char *name;
+	const char *query;
+	int			ncols;
+	const char *headers[RECORDER_MAX_COLUMNS];
+} recorderSection;
+
+typedef struct recorderHeader
+{
+	uint32_t	nslots;
+	uint32_t	slot_size;
+	uint32_t	next_slot;
+	uint32_t	used_slots;
+	uint32_t	interval;
+} recorderHeader;
+
+typedef struct recorderSnapshot
+{
+	time_t		timestamp;
+	int			nrows[RECORDER_SECTIONS];
+	int			ncols[RECORDER_SECTIONS];
+	char	  **cells[RECORDER_SECTIONS];	/* nrows * ncols; NULL is a NULL value */
+} recorderSnapshot;
+
+/*
+ * Monitoring queries, in section id order; the recording attachment
+ * itself is excluded.
+ */
+static const recorderSection sections[RECORDER_SECTIONS] = {
+	{
+		"Database",
+"    SELECT d.mon$oldest_transaction, d.mon$oldest_active, \n"
+"           d.mon$oldest_snapshot, d.mon$next_transaction, \n"
+"           io.mon$page_fetches, io.mon$page_reads, io.mon$page_writes, \n"
+"           m.mon$memory_used \n"
+"      FROM mon$database d \n"
+"INNER JOIN mon$io_stats io \n"
+"        ON io.mon$stat_id = d.mon$stat_id \n"
+" LEFT JOIN mon$memory_usage m \n"
+"        ON m.mon$stat_id = d.mon$stat_id",
+		8,
+		{"OIT", "OAT", "OST", "Next", "Fetches", "Reads", "Writes", "Memory"}
+	},
+	{
+		"Attachments",
+"    SELECT a.mon$attachment_id, TRIM(a.mon$user), \n"
+"           COALESCE(a.mon$remote_address, '-'), \n"
+"           COALESCE(a.mon$remote_process, '-'), \n"
+"           a.mon$state, \n"
+"           io.mon$page_fetches, io.mon$page_reads, io.mon$page_writes, \n"
+"           rs.mon$record_seq_reads, rs.mon$record_idx_reads, \n"
+"           rs.mon$record_inserts + rs.mon$record_updates + rs.mon$record_deletes, \n"
+"           m.mon$memory_used \n"
+"      FROM mon$attachments a \n"
+"INNER JOIN mon$io_stats io \n"
+"        ON io.mon$stat_id = a.mon$stat_id \n"
+"INNER JOIN mon$record_stats rs \n"
+"        ON rs.mon$stat_id = a.mon$stat_id \n"
+" LEFT JOIN mon$memory_usage m \n"
+"        ON m.mon$stat_id = a.mon$stat_id \n"
+"     WHERE a.mon$attachment_id <> CURRENT_CONNECTION \n"
+"  ORDER BY 1",
+		12,
+		{"Attachment", "User", "Client address", "Application", "State",
+		 "Fetches", "Reads", "Writes", "Seq reads", "Idx reads", "Modified", "Memory"}
+	},
+	{
+		"Active statements",
+"    SELECT s.mon$attachment_id, s.mon$transaction_id, s.mon$timestamp, \n"
+"           DATEDIFF(SECOND FROM s.mon$timestamp TO CURRENT_TIMESTAMP), \n"
+"           rs.mon$record_seq_reads, rs.mon$record_idx_reads, \n"
+"           REPLACE(CAST(SUBSTRING(s.mon$sql_text FROM 1 FOR 200) AS VARCHAR(200)), ASCII_CHAR(10), ' ') \n"
+"      FROM mon$statements s \n"
+"INNER JOIN mon$record_stats rs \n"
+"        ON rs.mon$stat_id = s.mon$stat_id \n"
+"     WHERE s.mon$state = 1 \n"
+"       AND s.mon$attachment_id <> CURRENT_CONNECTION \n"
+"  ORDER BY 3",
+		7,
+		{"Attachment", "Transaction", "Started", "Age (s)", "Seq reads", "Idx reads", "Statement"}
+	},
+	{
+		"Oldest active transactions",
+"    SELECT FIRST 10 \n"
+"           t.mon$transaction_id, t.mon$attachment_id, t.mon$timestamp, \n"
+"           t.mon$isolation_mode, t.mon$read_only \n"
+"      FROM mon$transactions t \n"
+"     WHERE t.mon$state = 1 \n"
+"       AND t.mon$attachment_id <> CURRENT_CONNECTION \n"
+"  ORDER BY 1",
+		5,
+		{"Transaction", "Attachment", "Started", "Isolation", "Read only"}
+	}
+};
+
+
+static char *_ringFilePath(const char *dir);
+static bool _readHeader(int fd, recorderHeader *header);
+static bool _writeHeader(int fd, const recorderHeader *header);
+static bool _takeSnapshot(FBconn *conn, FQExpBuffer payload, size_t limit);
+static void _appendSection(FQExpBuffer payload, int section, FBresult *res, size_t limit);
+static bool _writeSlot(int fd, recorderHeader *header, time_t timestamp, FQExpBuffer payload);
+static bool _readSnapshot(int fd, const recorderHeader *header, uint32_t slot, recorderSnapshot *snapshot);
+static void _freeSnapshot(recorderSnapshot *snapshot);
+static void _printTimeline(recorderSnapshot *snapshots, int nsnapshots);
+static void _printSnapshot(recorderSnapshot *snapshot);
+static bool _parseTimeRange(const char *range, time_t *from, time_t *to, bool *single);
+static bool _parseTime(const char *value, time_t *result);
+static void _formatTime(char *buf, size_t buf_len, time_t timestamp);
+static void _putUint16(FQExpBuffer buf, uint16_t value);
+static void _encodeUint32(unsigned char *dest, uint32_t value);
+static uint16_t _decodeUint16(const unsigned char *src);
+static uint32_t _decodeUint32(const unsigned char *src);
+
+
+/**
+ * recorderRun()
+ *
+ * fbsql --record DIR [--interval N]
+ *
+ * Poll the monitoring tables every "interval" seconds on the session's
+ * connection, appending each snapshot to the ring buffer file in "dir"
+ * (created if necessary) until interrupted with CTRL-C or SIGTERM. An
+ * existing recording in "dir" is continued.
+ *
+ * Each snapshot is taken in a single transaction, so all sections are
+ * consistent with each other; only SELECTs on the monitoring tables are
+ * executed.
+ *
+ * Returns the program exit code.
+ */
+int
+recorderRun(const char *dir, int interval)
+{
+	recorderHeader header;
+	FQExpBufferData payload;
+	char	   *path;
+	int			fd;
+	int			result = 0;
+	long		nsnapshots = 0;
+
+	if (mkdir(dir, 0700) != 0 && errno != EEXIST)
+	{
+		fbsql_error("unable to create recording directory \"%s\": %s\n", dir, strerror(errno));
+		return 1;
+	}
+
+	path = _ringFilePath(dir);
+
+	fd = open(path, O_RDWR | O_CREAT, 0600);
+
+	if (fd < 0)
+	{
+		fbsql_error("unable to open \"%s\": %s\n", path, strerror(errno));
+		free(path);
+		return 1;
+	}
+
+	if (_readHeader(fd, &header) == false)
+	{
+		struct stat st;
+
+		if (fstat(fd, &st) != 0 || st.st_size > 0)
+		{
+			fbsql_error("\"%s\" is not an fbsql monitoring recording\n", path);
+			close(fd);
+			free(path);
+			return 1;
+		}
+
+		header.nslots = RECORDER_SLOTS;
+		header.slot_size = RECORDER_SLOT_SIZE;
+		header.next_slot = 0;
+		header.used_slots = 0;
+		header.interval = interval;
+
+		if (_writeHeader(fd, &header) == false)
+		{
+			fbsql_error("unable to write \"%s\": %s\n", path, strerror(errno));
+			close(fd);
+			free(path);
+			return 1;
+		}
+	}
+	else
+	{
+		header.interval = interval;
+	}
+
+	signal(SIGINT, handle_signals);
+	signal(SIGTERM, handle_signals);
+
+	/* each snapshot is committed explicitly */
+	FQsetAutocommit(fset.conn, false);
+
+	printf("Recording monitoring snapshots every %i s to \"%s\" (%u of %u slots used); press CTRL-C to stop\n",
+		   interval, path, header.used_slots, header.nslots);
+	fflush(stdout);
+
+	initFQExpBuffer(&payload);
+	cancel_pressed = false;
+
+	while (cancel_pressed == false)
+	{
+		time_t		now = time(NULL);
+		int			elapsed;
+
+		resetFQExpBuffer(&payload);
+
+		if (_takeSnapshot(fset.conn, &payload, header.slot_size - RECORDER_SLOT_HEADER_SIZE) == true)
+		{
+			if (_writeSlot(fd, &header, now, &payload) == false)
+			{
+				fbsql_error("unable to write \"%s\": %s\n", path, strerror(errno));
+				result = 1;
+				break;
+			}
+
+			nsnapshots++;
+		}
+		else if (FQstatus(fset.conn) == CONNECTION_BAD)
+		{
+			fbsql_error("connection to the database lost\n");
+			result = 1;
+			break;
+		}
+
+		for (elapsed = 0; elapsed < interval && cancel_pressed == false; elapsed++)
+			sleep(1);
+	}
+
+	printf("%li snapshot(s) recorded\n", nsnapshots);
+
+	termFQExpBuffer(&payload);
+	close(fd);
+	free(path);
+
+	return result;
+}
+
+
+/**
+ * replayStats()
+ *
+ * \replay-stats DIR [FROM..TO | TIME]
+ *
+ * Display snapshots recorded with --record. With a range, a timeline of
+ * the snapshots taken between FROM and TO (either of which may be
+ * omitted) is shown, followed by the last of those snapshots in detail;
+ * with a single TIME, the last snapshot taken at or before that time is
+ * shown. Times are "YYYY-MM-DD HH:MM[:SS]" or "HH:MM[:SS]" (today), and
+ * must be quoted if they contain spaces or colons.
+ */
+bool
+replayStats(FbsqlScanState scan_state)
+{
+	char	   *dir;
+	char	   *range;
+	char	   *path;
+	recorderHeader header;
+	recorderSnapshot *snapshots;
+	time_t		from = 0, to = (time_t)INT64_MAX;
+	bool		single = false;
+	int			fd;
+	int			nsnapshots = 0;
+	uint32_t	first, i;
+
+	dir = fbsql_scan_slash_option(scan_state,
+								  OT_NORMAL, NULL, false);
+
+	if (dir == NULL)
+	{
+		fbsql_error("\\replay-stats: missing required argument\n");
+		return false;
+	}
+
+	range = fbsql_scan_slash_option(scan_state,
+									OT_NORMAL, NULL, false);
+
+	if (range != NULL && _parseTimeRange(range, &from, &to, &single) == false)
+	{
+		fbsql_error("\\replay-stats: invalid time range \"%s\"\n", range);
+		free(range);
+		free(dir);
+		return false;
+	}
+
+	free(range);
+
+	path = _ringFilePath(dir);
+	free(dir);
+
+	fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+	{
+		fbsql_error("\\replay-stats: unable to open \"%s\": %s\n", path, strerror(errno));
+		free(path);
+		return false;
+	}
+
+	if (_readHeader(fd, &header) == false)
+	{
+		fbsql_error("\\replay-stats: \"%s\" is not an fbsql monitoring recording\n", path);
+		close(fd);
+		free(path);
+		return false;
+	}
+
+	free(path);
+
+	if (header.used_slots == 0)
+	{
+		puts("No snapshots recorded");
+		close(fd);
+		return true;
+	}
+
+	snapshots = (recorderSnapshot *)fb_malloc0(header.used_slots * sizeof(recorderSnapshot));
+
+	/* read snapshots oldest first */
+	first = header.used_slots < header.nslots ? 0 : header.next_slot;
+
+	for (i = 0; i < header.used_slots; i++)
+	{
+		recorderSnapshot *snapshot = &snapshots[nsnapshots];
+
+		if (_readSnapshot(fd, &header, (first + i) % header.nslots, snapshot) == false)
+			continue;
+
+		if (snapshot->timestamp < from || snapshot->timestamp > to)
+		{
+			_freeSnapshot(snapshot);
+			continue;
+		}
+
+		nsnapshots++;
+	}
+
+	close(fd);
+
+	if (nsnapshots == 0)
+	{
+		puts("No snapshots recorded in the specified period");
+	}
+	else
+	{
+		if (single == false && nsnapshots > 1)
+			_printTimeline(snapshots, nsnapshots);
+
+		_printSnapshot(&snapshots[nsnapshots - 1]);
+	}
+
+	for (i = 0; i < (uint32_t)nsnapshots; i++)
+		_freeSnapshot(&snapshots[i]);
+
+	free(snapshots);
+
+	return true;
+}
+
+
+static char *
+_ringFilePath(const char *dir)
+{
+	char *path = (char *)malloc(strlen(dir) + 1 + strlen(RECORDER_FILE) + 1);
+
+	sprintf(path, "%s/%s", dir, RECORDER_FILE);
+
+	return path;
+}
+
+
+static bool
+_readHeader(int fd, recorderHeader *header)
+{
+	unsigned char buf[RECORDER_HEADER_SIZE];
+
+	if (pread(fd, buf, sizeof(buf), 0) != sizeof(buf))
+		return false;
+
+	if (memcmp(buf, RECORDER_MAGIC, 8) != 0
+		|| _decodeUint32(buf + 8) != RECORDER_VERSION)
+		return false;
+
+	header->nslots = _decodeUint32(buf + 12);
+	header->slot_size = _decodeUint32(buf + 16);
+	header->next_slot = _decodeUint32(buf + 20);
+	header->used_slots = _decodeUint32(buf + 24);
+	header->interval = _decodeUint32(buf + 28);
+
+	if (header->nslots == 0
+		|| header->slot_size <= RECORDER_SLOT_HEADER_SIZE
+		|| header->next_slot >= header->nslots
+		|| header->used_slots > header->nslots)
+		return false;
+
+	return true;
+}
+
+
+static bool
+_writeHeader(int fd, const recorderHeader *header)
+{
+	unsigned char buf[RECORDER_HEADER_SIZE];
+
+	memset(buf, 0, sizeof(buf));
+	memcpy(buf, RECORDER_MAGIC, 8);
+
+	_encodeUint32(buf + 8, RECORDER_VERSION);
+	_encodeUint32(buf + 12, header->nslots);
+	_encodeUint32(buf + 16, header->slot_size);
+	_encodeUint32(buf + 20, header->next_slot);
+	_encodeUint32(buf + 24, header->used_slots);
+	_encodeUint32(buf + 28, header->interval);
+
+	return pwrite(fd, buf, sizeof(buf), 0) == sizeof(buf);
+}
+
+
+/**
+ * _takeSnapshot()
+ *
+ * Execute each monitoring query, in a read-only transaction, and
+ * serialise the results into "payload", which may not exceed "limit"
+ * bytes. Returns false if the transaction could not be started or the
+ * database-level statistics could not be read.
+ */
+static bool
+_takeSnapshot(FBconn *conn, FQExpBuffer payload, size_t limit)
+{
+	FBresult   *res;
+	bool		success = true;
+	int			i;
+
+	/* all sections are read from the monitoring snapshot taken by this transaction */
+	res = FQexec(conn, "SET TRANSACTION READ ONLY ISOLATION LEVEL READ COMMITTED");
+
+	switch (FQresultStatus(res))
+	{
+		case FBRES_EMPTY_QUERY:
+		case FBRES_BAD_RESPONSE:
+		case FBRES_NONFATAL_ERROR:
+		case FBRES_FATAL_ERROR:
+		{
+			char		timestamp[32];
+
+			_formatTime(timestamp, sizeof(timestamp), time(NULL));
+			fbsql_error("%s: unable to start monitoring transaction\n%s",
+						timestamp,
+						res ? FQresultErrorMessage(res) : FQerrorMessage(conn));
+
+			if (res != NULL)
+				FQclear(res);
+
+			return false;
+		}
+
+		default:
+			break;
+	}
+
+	FQclear(res);
+
+	for (i = 0; i < RECORDER_SECTIONS; i++)
+	{
+		res = FQexec(conn, sections[i].query);
+
+		if (FQresultStatus(res) != FBRES_TUPLES_OK)
+		{
+			char		timestamp[32];
+
+			_formatTime(timestamp, sizeof(timestamp), time(NULL));
+			fbsql_error("%s: unable to read %s\n%s",
+						timestamp,
+						sections[i].name,
+						FQresultErrorMessage(res));
+
+			if (i == SECTION_DATABASE)
+				success = false;
+		}
+
+		_appendSection(payload, i, res, limit);
+
+		FQclear(res);
+	}
+
+	/* end the transaction, so the next snapshot sees current values */
+	FQclear(FQexec(conn, "COMMIT"));
+
+	return success;
+}
+
+
+static void
+_appendSection(FQExpBuffer payload, int section, FBresult *res, size_t limit)
+{
+	size_t		start = payload->len;
+	int			nrows = 0;
+	int			ncols = sections[section].ncols;
+	int			row, col;
+
+	if (start + 4 > limit)
+		return;
+
+	appendFQExpBufferChar(payload, (char)section);
+	_putUint16(payload, 0);
+	appendFQExpBufferChar(payload, (char)ncols);
+
+	if (FQresultStatus(res) == FBRES_TUPLES_OK && FQnfields(res) >= ncols)
+	{
+		for (row = 0; row < FQntuples(res) && row < 0xFFFF; row++)
+		{
+			size_t		row_len = 0;
+
+			for (col = 0; col < ncols; col++)
+			{
+				row_len += 2;
+				if (!FQgetisnull(res, row, col))
+					row_len += strlen(FQgetvalue(res, row, col));
+			}
+
+			if (payload->len + row_len > limit)
+				break;
+
+			for (col = 0; col < ncols; col++)
+			{
+				if (FQgetisnull(res, row, col))
+				{
+					_putUint16(payload, RECORDER_NULL_CELL);
+				}
+				else
+				{
+					const char *value = FQgetvalue(res, row, col);
+					size_t		len = strlen(value);
+
+					if (len >= RECORDER_NULL_CELL)
+						len = RECORDER_NULL_CELL - 1;
+
+					_putUint16(payload, (uint16_t)len);
+					appendBinaryFQExpBuffer(payload, value, len);
+				}
+			}
+
+			nrows++;
+		}
+	}
+
+	payload->data[start + 1] = (char)(nrows & 0xFF);
+	payload->data[start + 2] = (char)((nrows >> 8) & 0xFF);
+}
+
+
+static bool
+_writeSlot(int fd, recorderHeader *header, time_t timestamp, FQExpBuffer payload)
+{
+	unsigned char slot_header[RECORDER_SLOT_HEADER_SIZE];
+	off_t		offset = RECORDER_HEADER_SIZE + (off_t)header->next_slot * header->slot_size;
+	uint64_t	ts = (uint64_t)timestamp;
+
+	_encodeUint32(slot_header, (uint32_t)payload->len);
+	_encodeUint32(slot_header + 4, (uint32_t)(ts & 0xFFFFFFFF));
+	_encodeUint32(slot_header + 8, (uint32_t)(ts >> 32));
+
+	if (pwrite(fd, slot_header, sizeof(slot_header), offset) != sizeof(slot_header))
+		return false;
+
+	if (pwrite(fd, payload->data, payload->len, offset + sizeof(slot_header)) != (ssize_t)payload->len)
+		return false;
+
+	header->next_slot = (header->next_slot + 1) % header->nslots;
+
+	if (header->used_slots < header->nslots)
+		header->used_slots++;
+
+	return _writeHeader(fd, header);
+}
+
+
+static bool
+_readSnapshot(int fd, const recorderHeader *header, uint32_t slot, recorderSnapshot *snapshot)
+{
+	unsigned char *buf;
+	unsigned char *p, *end;
+	off_t		offset = RECORDER_HEADER_SIZE + (off_t)slot * header->slot_size;
+	uint32_t	len;
+
+	memset(snapshot, 0, sizeof(recorderSnapshot));
+
+	buf = (unsigned char *)malloc(header->slot_size);
+
+	if (pread(fd, buf, header->slot_size, offset) < RECORDER_SLOT_HEADER_SIZE)
+	{
+		free(buf);
+		return false;
+	}
+
+	len = _decodeUint32(buf);
+
+	if (len > header->slot_size - RECORDER_SLOT_HEADER_SIZE)
+	{
+		free(buf);
+		return false;
+	}
+
+	snapshot->timestamp = (time_t)(_decodeUint32(buf + 4) | ((uint64_t)_decodeUint32(buf + 8) << 32));
+
+	p = buf + RECORDER_SLOT_HEADER_SIZE;
+	end = p + len;
+
+	while (p + 4 <= end)
+	{
+		int			section = p[0];
+		int			nrows = _decodeUint16(p + 1);
+		int			ncols = p[3];
+		int			i;
+
+		p += 4;
+
+		if (section >= RECORDER_SECTIONS || snapshot->cells[section] != NULL)
+			break;
+
+		snapshot->nrows[section] = nrows;
+		snapshot->ncols[section] = ncols;
+		snapshot->cells[section] = (char **)fb_malloc0((nrows * ncols + 1) * sizeof(char *));
+
+		for (i = 0; i < nrows * ncols && p + 2 <= end; i++)
+		{
+			uint16_t	cell_len = _decodeUint16(p);
+
+			p += 2;
+
+			if (cell_len == RECORDER_NULL_CELL)
+				continue;
+
+			if (p + cell_len > end)
+				break;
+
+			snapshot->cells[section][i] = (char *)fb_malloc0(cell_len + 1);
+			memcpy(snapshot->cells[section][i], p, cell_len);
+			p += cell_len;
+		}
+	}
+
+	free(buf);
+
+	return true;
+}
+
+
+static void
+_freeSnapshot(recorderSnapshot *snapshot)
+{
+	int section, i;
+
+	for (section = 0; section < RECORDER_SECTIONS; section++)
+	{
+		if (snapshot->cells[section] == NULL)
+			continue;
+
+		for (i = 0; i < snapshot->nrows[section] * snapshot->ncols[section]; i++)
+			free(snapshot->cells[section][i]);
+
+		free(snapshot->cells[section]);
+		snapshot->cells[section] = NULL;
+	}
+}
+
+
+/**
+ * _printTimeline()
+ *
+ * One row per snapshot, with transaction markers, activity counts and
+ * page I/O rates since the previous snapshot.
+ */
+static void
+_printTimeline(recorderSnapshot *snapshots, int nsnapshots)
+{
+	fbsqlTable	table;
+	printQueryOpt pqopt = fset.popt;
+	int			i, j;
+
+	static const char *const headers[] =
+		{"Time", "OIT", "OAT", "Next", "Next - OAT", "Attachments", "Active statements",
+		 "Fetches/s", "Reads/s", "Writes/s"};
+
+	initTable(&table, lengthof(headers), headers);
+
+	for (j = 1; j < lengthof(headers); j++)
+		table.right_align[j] = true;
+
+	for (i = 0; i < nsnapshots; i++)
+	{
+		recorderSnapshot *snapshot = &snapshots[i];
+		char	  **db = snapshot->cells[SECTION_DATABASE];
+		const char *values[10];
+		char		cells[10][32];
+
+		memset(values, 0, sizeof(values));
+
+		_formatTime(cells[0], sizeof(cells[0]), snapshot->timestamp);
+		values[0] = cells[0];
+
+		if (db != NULL && snapshot->nrows[SECTION_DATABASE] > 0)
+		{
+			values[1] = db[0];
+			values[2] = db[1];
+			values[3] = db[3];
+
+			if (db[1] != NULL && db[3] != NULL)
+			{
+				snprintf(cells[4], sizeof(cells[4]), "%li", atol(db[3]) - atol(db[1]));
+				values[4] = cells[4];
+			}
+		}
+
+		snprintf(cells[5], sizeof(cells[5]), "%i", snapshot->nrows[SECTION_ATTACHMENTS]);
+		values[5] = cells[5];
+		snprintf(cells[6], sizeof(cells[6]), "%i", snapshot->nrows[SECTION_STATEMENTS]);
+		values[6] = cells[6];
+
+		if (i > 0 && db != NULL && snapshot->nrows[SECTION_DATABASE] > 0
+			&& snapshots[i - 1].cells[SECTION_DATABASE] != NULL
+			&& snapshots[i - 1].nrows[SECTION_DATABASE] > 0
+			&& snapshot->timestamp > snapshots[i - 1].timestamp)
+		{
+			char	  **prev = snapshots[i - 1].cells[SECTION_DATABASE];
+			double		secs = (double)(snapshot->timestamp - snapshots[i - 1].timestamp);
+
+			for (j = 0; j < 3; j++)
+			{
+				if (db[4 + j] == NULL || prev[4 + j] == NULL)
+					continue;
+
+				snprintf(cells[7 + j], sizeof(cells[7 + j]), "%.1f",
+						 (atol(db[4 + j]) - atol(prev[4 + j])) / secs);
+				values[7 + j] = cells[7 + j];
+			}
+		}
+
+		addTableRow(&table, values);
+	}
+
+	pqopt.header = "Recorded snapshots";
+	printTable(&table, &pqopt);
+	puts("");
+
+	termTable(&table);
+}
+
+
+static void
+_printSnapshot(recorderSnapshot *snapshot)
+{
+	printQueryOpt pqopt = fset.popt;
+	char		timestamp[32];
+	int			section;
+
+	_formatTime(timestamp, sizeof(timestamp), snapshot->timestamp);
+	printf("Snapshot at %s\n\n", timestamp);
+
+	for (section = 0; section < RECORDER_SECTIONS; section++)
+	{
+		fbsqlTable	table;
+		int			row;
+
+		if (snapshot->cells[section] == NULL
+			|| snapshot->ncols[section] != sections[section].ncols)
+			continue;
+
+		if (snapshot->nrows[section] == 0)
+		{
+			printf("%s: none\n\n", sections[section].name);
+			continue;
+		}
+
+		initTable(&table, sections[section].ncols, sections[section].headers);
+
+		for (row = 0; row < snapshot->nrows[section]; row++)
+			addTableRow(&table,
+						(const char * const *)&snapshot->cells[section][row * snapshot->ncols[section]]);
+
+		pqopt.header = (char *)sections[section].name;
+		printTable(&table, &pqopt);
+		puts("");
+
+		termTable(&table);
+	}
+}
+
+
+/**
+ * _parseTimeRange()
+ *
+ * Parse "FROM..TO" (either may be empty) or a single time.
+ */
+static bool
+_parseTimeRange(const char *range, time_t *from, time_t *to, bool *single)
+{
+	const char *sep = strstr(range, "..");
+
+	if (sep == NULL)
+	{
+		*single = true;
+		return _parseTime(range, to);
+	}
+
+	if (sep > range)
+	{
+		char	   *value = (char *)fb_malloc0(sep - range + 1);
+		bool		ok;
+
+		memcpy(value, range, sep - range);
+		ok = _parseTime(value, from);
+		free(value);
+
+		if (ok == false)
+			return false;
+	}
+
+	if (*(sep + 2) != '\0' && _parseTime(sep + 2, to) == false)
+		return false;
+
+	return true;
+}
+
+
+static bool
+_parseTime(const char *value, time_t *result)
+{
+	static const char *const date_formats[] =
+		{"%Y-%m-%d %H:%M:%S", "%Y-%m-%dT%H:%M:%S", "%Y-%m-%d %H:%M", "%Y-%m-%dT%H:%M", "%Y-%m-%d", NULL};
+	static const char *const time_formats[] =
+		{"%H:%M:%S", "%H:%M", NULL};
+	struct tm	tm;
+	time_t		now = time(NULL);
+	const char *end;
+	int			i;
+
+	for (i = 0; date_formats[i] != NULL; i++)
+	{
+		memset(&tm, 0, sizeof(tm));
+		end = strptime(value, date_formats[i], &tm);
+
+		if (end != NULL && *end == '\0')
+		{
+			tm.tm_isdst = -1;
+			*result = mktime(&tm);
+			return true;
+		}
+	}
+
+	/* time only: today */
+	for (i = 0; time_formats[i] != NULL; i++)
+	{
+		tm = *localtime(&now);
+		tm.tm_sec = 0;
+		end = strptime(value, time_formats[i], &tm);
+
+		if (end != NULL && *end == '\0')
+		{
+			tm.tm_isdst = -1;
+			*result = mktime(&tm);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+static void
+_formatTime(char *buf, size_t buf_len, time_t timestamp)
+{
+	strftime(buf, buf_len, "%Y-%m-%d %H:%M:%S", localtime(&timestamp));
+}
+
+
+static void
+_putUint16(FQExpBuffer buf, uint16_t value)
+{
+	appendFQExpBufferChar(buf, (char)(value & 0xFF));
+	appendFQExpBufferChar(buf, (char)((value >> 8) & 0xFF));
+}
+
+
+static void
+_encodeUint32(unsigned char *dest, uint32_t value)
+{
+	dest[0] = value & 0xFF;
+	dest[1] = (value >> 8) & 0xFF;
+	dest[2] = (value >> 16) & 0xFF;
+	dest[3] = (value >> 24) & 0xFF;
+}
+
+
+static uint16_t
+_decodeUint16(const unsigned char *src)
+{
+	return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+
+static uint32_t
+_decodeUint32(const unsigned char *src)
+{
+	return (uint32_t)src[0]
+		| ((uint32_t)src[1] << 8)
+		| ((uint32_t)src[2] << 16)
+		| ((uint32_t)src[3] << 24);
+}
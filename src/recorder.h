@@ -0,0 +1,24 @@
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include "settings.h"
+#include "fbsqlscan.h"
+
+/* Ring buffer file created in the recording directory */
+#define RECORDER_FILE "fbsql_monitor.ring"
+
+/*
+ * Ring buffer geometry: each snapshot occupies one fixed-size slot, so
+ * the file never exceeds RECORDER_SLOTS * RECORDER_SLOT_SIZE bytes (plus
+ * the header); at the default interval this retains four hours.
+ */
+#define RECORDER_SLOTS 2880
+#define RECORDER_SLOT_SIZE 16384
+
+extern int
+recorderRun(const char *dir, int interval);
+
+extern bool
+replayStats(FbsqlScanState scan_state);
+
+#endif   /* RECORDER_H */
@@ -0,0 +1,708 @@
+/* ---------------------------------------------------------------------
+ *
+ * services.c
+ *
+ * Functions using the Firebird Services API directly, as this is not
+ * available via libfq
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "ibase.h"
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "common.h"
+#include "port.h"
+#include "query.h"
+#include "services.h"
+#include "settings.h"
+
+#define SERVICE_BUFFER_LEN 1024
+
+static bool _serviceAttach(isc_svc_handle *svc_handle, char **db_name, bool report_errors);
+static bool _serviceRunning(isc_svc_handle *svc_handle, bool *running);
+static bool _serviceOutput(isc_svc_handle *svc_handle, FQExpBuffer output, bool report_errors);
+static void _serviceError(const char *message, const ISC_STATUS *status);
+static void _spbAddString(FQExpBuffer spb, char tag, const char *value, bool long_length);
+static void _spbAddInt(FQExpBuffer spb, char tag, ISC_ULONG value);
+static bool _getDatabaseIO(long *page_reads, long *page_writes);
+static void _parseDatabaseStats(gstatData *stats, char *output);
+static bool _parseObjectHeader(const char *line, char **name);
+static bool _statValue(const char *line, const char *key, const char *format, void *value);
+
+
+/**
+ * serviceSweep()
+ *
+ * Sweep the current database via the Services API, reporting progress
+ * (elapsed time and database page I/O, from the monitoring tables)
+ * until the sweep completes.
+ *
+ * "parallel_workers" is passed to the service if supported by the client
+ * library (Firebird 5.0 and later); if 0, the server default is used.
+ *
+ * Interrupting with CTRL-C stops monitoring, but the sweep will continue
+ * on the server.
+ */
+bool
+serviceSweep(int parallel_workers)
+{
+	ISC_STATUS_ARRAY status;
+	isc_svc_handle svc_handle = 0;
+	FQExpBufferData spb;
+	char	   *db_name = NULL;
+	bool		running = true;
+	bool		success = true;
+	long		start_reads = 0, start_writes = 0;
+	bool		have_io;
+	int			elapsed = 0;
+
+	if (_serviceAttach(&svc_handle, &db_name, true) == false)
+		return false;
+
+	initFQExpBuffer(&spb);
+
+	appendFQExpBufferChar(&spb, isc_action_svc_repair);
+	_spbAddString(&spb, isc_spb_dbname, db_name, true);
+	_spbAddInt(&spb, isc_spb_options, isc_spb_rpr_sweep_db);
+
+#ifdef isc_spb_rpr_par_workers
+	if (parallel_workers > 0)
+		_spbAddInt(&spb, isc_spb_rpr_par_workers, parallel_workers);
+#else
+	if (parallel_workers > 0)
+		puts("Note: parallel workers not supported by this client library; ignoring");
+#endif
+
+	have_io = _getDatabaseIO(&start_reads, &start_writes);
+
+	if (isc_service_start(status, &svc_handle, NULL, (unsigned short)spb.len, spb.data))
+	{
+		_serviceError("unable to start sweep", status);
+		termFQExpBuffer(&spb);
+		isc_service_detach(status, &svc_handle);
+		free(db_name);
+		return false;
+	}
+
+	termFQExpBuffer(&spb);
+
+	cancel_pressed = false;
+
+	while (running == true)
+	{
+		sleep(1);
+		elapsed++;
+
+		if (cancel_pressed == true)
+		{
+			puts("Monitoring cancelled; the sweep will continue on the server");
+			success = false;
+			break;
+		}
+
+		if (_serviceRunning(&svc_handle, &running) == false)
+		{
+			success = false;
+			break;
+		}
+
+		if (running == true && elapsed % SERVICE_PROGRESS_INTERVAL == 0)
+		{
+			long page_reads, page_writes;
+
+			if (have_io && _getDatabaseIO(&page_reads, &page_writes))
+				printf("  %i s elapsed; %li pages read, %li pages written\n",
+					   elapsed,
+					   page_reads - start_reads,
+					   page_writes - start_writes);
+			else
+				printf("  %i s elapsed\n", elapsed);
+
+			fflush(stdout);
+		}
+	}
+
+	isc_service_detach(status, &svc_handle);
+	free(db_name);
+
+	return success;
+}
+
+
+/**
+ * serviceDatabaseStats()
+ *
+ * Retrieve data page and record version statistics for user tables
+ * (and system tables if "system" is set) via the Services API, and parse
+ * them into a gstatData structure. If "indexes" is set, index page
+ * statistics are also retrieved. If "table" is provided, only that
+ * table is analysed.
+ *
+ * Note that the server reads every data page (and index page, if
+ * requested) of each table analysed.
+ *
+ * Returns NULL if the statistics are not available, e.g. because the
+ * user lacks the necessary privileges; errors are only printed if
+ * "report_errors" is set.
+ */
+gstatData *
+serviceDatabaseStats(const char *table, bool indexes, bool system, bool report_errors)
+{
+	ISC_STATUS_ARRAY status;
+	isc_svc_handle svc_handle = 0;
+	FQExpBufferData spb;
+	FQExpBufferData output;
+	char	   *db_name = NULL;
+	ISC_ULONG	options = isc_spb_sts_data_pages | isc_spb_sts_record_versions;
+	gstatData  *stats = NULL;
+
+	if (_serviceAttach(&svc_handle, &db_name, report_errors) == false)
+		return NULL;
+
+	if (indexes == true)
+		options |= isc_spb_sts_idx_pages;
+
+	if (system == true)
+		options |= isc_spb_sts_sys_relations;
+
+	initFQExpBuffer(&spb);
+
+	appendFQExpBufferChar(&spb, isc_action_svc_db_stats);
+	_spbAddString(&spb, isc_spb_dbname, db_name, true);
+	_spbAddInt(&spb, isc_spb_options, options);
+
+	if (table != NULL)
+		_spbAddString(&spb, isc_spb_sts_table, table, true);
+
+	if (isc_service_start(status, &svc_handle, NULL, (unsigned short)spb.len, spb.data))
+	{
+		if (report_errors)
+			_serviceError("unable to retrieve database statistics", status);
+
+		termFQExpBuffer(&spb);
+		isc_service_detach(status, &svc_handle);
+		free(db_name);
+		return NULL;
+	}
+
+	termFQExpBuffer(&spb);
+
+	initFQExpBuffer(&output);
+
+	if (_serviceOutput(&svc_handle, &output, report_errors) == true)
+	{
+		stats = (gstatData *)fb_malloc0(sizeof(gstatData));
+		_parseDatabaseStats(stats, output.data);
+	}
+
+	termFQExpBuffer(&output);
+	isc_service_detach(status, &svc_handle);
+	free(db_name);
+
+	return stats;
+}
+
+
+/**
+ * findDatabaseStatsTable()
+ *
+ * Return the statistics for the named table, or NULL if not present.
+ */
+gstatTable *
+findDatabaseStatsTable(gstatData *stats, const char *name)
+{
+	int i;
+
+	if (stats == NULL)
+		return NULL;
+
+	for (i = 0; i < stats->ntables; i++)
+	{
+		if (strcmp(stats->tables[i].name, name) == 0)
+			return &stats->tables[i];
+	}
+
+	return NULL;
+}
+
+
+void
+freeDatabaseStats(gstatData *stats)
+{
+	int i, j;
+
+	if (stats == NULL)
+		return;
+
+	for (i = 0; i < stats->ntables; i++)
+	{
+		for (j = 0; j < stats->tables[i].nindexes; j++)
+			free(stats->tables[i].indexes[j].name);
+
+		free(stats->tables[i].indexes);
+		free(stats->tables[i].name);
+	}
+
+	free(stats->tables);
+	free(stats);
+}
+
+
+/**
+ * _serviceAttach()
+ *
+ * Attach to the service manager of the server hosting the current
+ * database. For remote databases specified as "host:path" (or
+ * "host/port:path"), or in URL style as "inet://host[:port]/path"
+ * (likewise "inet4://", "inet6://" and "wnet://"), the host's service
+ * manager is used and the path returned in "db_name"; otherwise the
+ * local service manager, using the protocol given, if any (e.g.
+ * "xnet://path").
+ */
+static bool
+_serviceAttach(isc_svc_handle *svc_handle, char **db_name, bool report_errors)
+{
+	static const char *const protocols[] =
+		{"inet://", "inet4://", "inet6://", "wnet://", "xnet://", NULL};
+
+	ISC_STATUS_ARRAY status;
+	FQExpBufferData service_name;
+	FQExpBufferData spb;
+	const char *colon = strchr(fset.dbpath, ':');
+	const char *protocol = NULL;
+	bool		success = true;
+	int			i;
+
+	initFQExpBuffer(&service_name);
+
+	for (i = 0; protocols[i] != NULL; i++)
+	{
+		if (pg_strncasecmp(fset.dbpath, protocols[i], strlen(protocols[i])) == 0)
+		{
+			protocol = protocols[i];
+			break;
+		}
+	}
+
+	if (protocol != NULL)
+	{
+		const char *location = fset.dbpath + strlen(protocol);
+		const char *slash = strchr(location, '/');
+
+		appendBinaryFQExpBuffer(&service_name, fset.dbpath, strlen(protocol));
+
+		/* "xnet://" is local only; otherwise the host precedes the first slash */
+		if (pg_strcasecmp(protocol, "xnet://") != 0 && slash != NULL)
+		{
+			appendBinaryFQExpBuffer(&service_name, location, slash - location + 1);
+			*db_name = strdup(slash + 1);
+		}
+		else
+		{
+			*db_name = strdup(location);
+		}
+
+		appendFQExpBufferStr(&service_name, "service_mgr");
+	}
+	/* a colon in second position is a Windows drive letter */
+	else if (colon != NULL && colon - fset.dbpath > 1)
+	{
+		appendBinaryFQExpBuffer(&service_name, fset.dbpath, colon - fset.dbpath);
+		appendFQExpBufferStr(&service_name, ":service_mgr");
+		*db_name = strdup(colon + 1);
+	}
+	else
+	{
+		appendFQExpBufferStr(&service_name, "service_mgr");
+		*db_name = strdup(fset.dbpath);
+	}
+
+	initFQExpBuffer(&spb);
+
+	appendFQExpBufferChar(&spb, isc_spb_version);
+	appendFQExpBufferChar(&spb, isc_spb_current_version);
+
+	if (fset.username != NULL)
+		_spbAddString(&spb, isc_spb_user_name, fset.username, false);
+
+	if (fset.password != NULL)
+		_spbAddString(&spb, isc_spb_password, fset.password, false);
+
+	if (isc_service_attach(status, 0, service_name.data, svc_handle,
+						   (unsigned short)spb.len, spb.data))
+	{
+		if (report_errors)
+			_serviceError("unable to attach to service manager", status);
+		free(*db_name);
+		*db_name = NULL;
+		success = false;
+	}
+
+	termFQExpBuffer(&spb);
+	termFQExpBuffer(&service_name);
+
+	return success;
+}
+
+
+/**
+ * _serviceRunning()
+ *
+ * Determine whether the service action started on this attachment is
+ * still running.
+ */
+static bool
+_serviceRunning(isc_svc_handle *svc_handle, bool *running)
+{
+	ISC_STATUS_ARRAY status;
+	char		request[] = { isc_info_svc_running };
+	char		result[SERVICE_BUFFER_LEN];
+
+	if (isc_service_query(status, svc_handle, NULL, 0, NULL,
+						  sizeof(request), request,
+						  sizeof(result), result))
+	{
+		_serviceError("error querying service status", status);
+		return false;
+	}
+
+	if (result[0] != isc_info_svc_running)
+	{
+		fbsql_error("unexpected response from service manager\n");
+		return false;
+	}
+
+	*running = isc_vax_integer(result + 1, 4) != 0;
+
+	return true;
+}
+
+
+/**
+ * _serviceOutput()
+ *
+ * Collect the complete text output of the service action started on
+ * this attachment.
+ */
+static bool
+_serviceOutput(isc_svc_handle *svc_handle, FQExpBuffer output, bool report_errors)
+{
+	ISC_STATUS_ARRAY status;
+	char		request[] = { isc_info_svc_to_eof };
+	char		result[SERVICE_BUFFER_LEN * 8];
+
+	for (;;)
+	{
+		char	   *p = result;
+		unsigned short len;
+
+		if (isc_service_query(status, svc_handle, NULL, 0, NULL,
+							  sizeof(request), request,
+							  sizeof(result), result))
+		{
+			if (report_errors)
+				_serviceError("error retrieving service output", status);
+			return false;
+		}
+
+		if (*p++ != isc_info_svc_to_eof)
+		{
+			if (report_errors)
+				fbsql_error("unexpected response from service manager\n");
+			return false;
+		}
+
+		len = (unsigned short)isc_vax_integer(p, 2);
+		p += 2;
+
+		appendBinaryFQExpBuffer(output, p, len);
+		p += len;
+
+		/* output exceeded the buffer; fetch the remainder */
+		if (*p == isc_info_truncated)
+			continue;
+
+		if (len == 0)
+			break;
+	}
+
+	return true;
+}
+
+
+static void
+_serviceError(const char *message, const ISC_STATUS *status)
+{
+	char		buf[512];
+	const ISC_STATUS *pvector = status;
+
+	fbsql_error("%s\n", message);
+
+	while (fb_interpret(buf, sizeof(buf), &pvector))
+		fbsql_error("  %s\n", buf);
+}
+
+
+/**
+ * _spbAddString()
+ *
+ * Add a string parameter to the service parameter buffer; action
+ * parameters use a two-byte length, attachment parameters one byte.
+ */
+static void
+_spbAddString(FQExpBuffer spb, char tag, const char *value, bool long_length)
+{
+	size_t len = strlen(value);
+
+	appendFQExpBufferChar(spb, tag);
+
+	if (long_length)
+	{
+		appendFQExpBufferChar(spb, (char)(len & 0xFF));
+		appendFQExpBufferChar(spb, (char)((len >> 8) & 0xFF));
+	}
+	else
+	{
+		if (len > 255)
+			len = 255;
+		appendFQExpBufferChar(spb, (char)len);
+	}
+
+	appendBinaryFQExpBuffer(spb, value, len);
+}
+
+
+static void
+_spbAddInt(FQExpBuffer spb, char tag, ISC_ULONG value)
+{
+	appendFQExpBufferChar(spb, tag);
+	appendFQExpBufferChar(spb, (char)(value & 0xFF));
+	appendFQExpBufferChar(spb, (char)((value >> 8) & 0xFF));
+	appendFQExpBufferChar(spb, (char)((value >> 16) & 0xFF));
+	appendFQExpBufferChar(spb, (char)((value >> 24) & 0xFF));
+}
+
+
+/**
+ * _getDatabaseIO()
+ *
+ * Retrieve the database-level page reads and writes from the monitoring
+ * tables, in a separate transaction so the values are current.
+ */
+static bool
+_getDatabaseIO(long *page_reads, long *page_writes)
+{
+	FBresult   *res;
+	bool		found = false;
+
+	res = FQexecTransaction(fset.conn,
+"    SELECT io.mon$page_reads, io.mon$page_writes \n"
+"      FROM mon$database d \n"
+"INNER JOIN mon$io_stats io \n"
+"        ON io.mon$stat_id = d.mon$stat_id");
+
+	if (FQresultStatus(res) == FBRES_TUPLES_OK && FQntuples(res) > 0)
+	{
+		*page_reads = atol(FQgetvalue(res, 0, 0));
+		*page_writes = atol(FQgetvalue(res, 0, 1));
+		found = true;
+	}
+
+	FQclear(res);
+
+	return found;
+}
+
+
+/**
+ * _parseDatabaseStats()
+ *
+ * Parse the text output of the database statistics action. Each table's
+ * section starts with an unindented line "NAME (relation_id)", followed
+ * by indented "key: value" pairs, then a section for each index starting
+ * with "Index NAME (index_id)". The layout differs slightly between
+ * Firebird versions, so values are located by key rather than position.
+ */
+static void
+_parseDatabaseStats(gstatData *stats, char *output)
+{
+	gstatTable *table = NULL;
+	gstatIndex *index = NULL;
+	char	   *line = output;
+
+	while (line != NULL && *line != '\0')
+	{
+		char	   *next = strchr(line, '\n');
+		char	   *trimmed = line;
+		char	   *name;
+		int			low, high;
+		long		count;
+
+		if (next != NULL)
+			*next++ = '\0';
+
+		while (*trimmed == ' ' || *trimmed == '\t')
+			trimmed++;
+
+		if (trimmed == line && _parseObjectHeader(line, &name) == true)
+		{
+			if (stats->ntables == stats->alloc_tables)
+			{
+				stats->alloc_tables = stats->alloc_tables == 0 ? 32 : stats->alloc_tables * 2;
+				stats->tables = (gstatTable *)realloc(stats->tables,
+													  stats->alloc_tables * sizeof(gstatTable));
+			}
+
+			table = &stats->tables[stats->ntables++];
+			memset(table, 0, sizeof(gstatTable));
+
+			table->name = name;
+			table->records = -1;
+			table->avg_record_length = -1;
+			table->versions = -1;
+			table->max_versions = -1;
+			table->compression_ratio = -1;
+			table->data_pages = -1;
+			table->avg_fill = -1;
+
+			index = NULL;
+		}
+		else if (table != NULL
+				 && strncmp(trimmed, "Index ", 6) == 0
+				 && _parseObjectHeader(trimmed + 6, &name) == true)
+		{
+			if (table->nindexes == table->alloc_indexes)
+			{
+				table->alloc_indexes = table->alloc_indexes == 0 ? 8 : table->alloc_indexes * 2;
+				table->indexes = (gstatIndex *)realloc(table->indexes,
+													   table->alloc_indexes * sizeof(gstatIndex));
+			}
+
+			index = &table->indexes[table->nindexes++];
+			memset(index, 0, sizeof(gstatIndex));
+
+			index->name = name;
+			index->depth = -1;
+			index->leaf_buckets = -1;
+			index->nodes = -1;
+			index->avg_key_length = -1;
+			index->compression_ratio = -1;
+			index->total_dup = -1;
+			index->max_dup = -1;
+		}
+		else if (index != NULL)
+		{
+			/* Firebird 3.0 and later: "Root page: N, depth: N, ..." */
+			if (_statValue(line, "depth:", "%d", &index->depth) == false)
+				_statValue(line, "Depth:", "%d", &index->depth);
+			_statValue(line, "leaf buckets:", "%ld", &index->leaf_buckets);
+			_statValue(line, "nodes:", "%ld", &index->nodes);
+			/* Firebird 2.5 and earlier report "Average data length" */
+			if (_statValue(line, "Average key length:", "%lf", &index->avg_key_length) == false)
+				_statValue(line, "Average data length:", "%lf", &index->avg_key_length);
+			_statValue(line, "compression ratio:", "%lf", &index->compression_ratio);
+			_statValue(line, "total dup:", "%ld", &index->total_dup);
+			_statValue(line, "max dup:", "%ld", &index->max_dup);
+
+			if (sscanf(line, " %d - %d%% = %ld", &low, &high, &count) == 3
+				&& low >= 0 && low / 20 < GSTAT_FILL_BUCKETS)
+				index->fill[low / 20] = count;
+		}
+		else if (table != NULL)
+		{
+			_statValue(line, "Average record length:", "%lf", &table->avg_record_length);
+			_statValue(line, "total records:", "%ld", &table->records);
+			_statValue(line, "total versions:", "%ld", &table->versions);
+			_statValue(line, "max versions:", "%ld", &table->max_versions);
+			_statValue(line, "compression ratio:", "%lf", &table->compression_ratio);
+			_statValue(line, "Data pages:", "%ld", &table->data_pages);
+			_statValue(line, "average fill:", "%d", &table->avg_fill);
+
+			/* fill distribution, e.g. "    20 - 39% = 4" */
+			if (sscanf(line, " %d - %d%% = %ld", &low, &high, &count) == 3
+				&& low >= 0 && low / 20 < GSTAT_FILL_BUCKETS)
+				table->fill[low / 20] = count;
+		}
+
+		line = next;
+	}
+}
+
+
+/**
+ * _parseObjectHeader()
+ *
+ * Recognise text of the form "NAME (id)", as used for table and index
+ * headings; the name is returned without any surrounding quotes.
+ */
+static bool
+_parseObjectHeader(const char *line, char **name)
+{
+	const char *start = line;
+	const char *open;
+	const char *p;
+	size_t		len;
+
+	len = strlen(start);
+
+	while (len > 0 && (start[len - 1] == ' ' || start[len - 1] == '\r'))
+		len--;
+
+	if (len < 4 || start[len - 1] != ')')
+		return false;
+
+	open = NULL;
+	for (p = start + len - 2; p > start; p--)
+	{
+		if (*p == '(')
+		{
+			open = p;
+			break;
+		}
+
+		if (*p < '0' || *p > '9')
+			return false;
+	}
+
+	if (open == NULL || open == start + len - 2 || *(open - 1) != ' ')
+		return false;
+
+	len = open - 1 - start;
+
+	if (len > 1 && start[0] == '"' && start[len - 1] == '"')
+	{
+		start++;
+		len -= 2;
+	}
+
+	*name = (char *)fb_malloc0(len + 1);
+	memcpy(*name, start, len);
+
+	return true;
+}
+
+
+/**
+ * _statValue()
+ *
+ * If "line" contains "key", parse the value following it with the
+ * provided sscanf() format.
+ */
+static bool
+_statValue(const char *line, const char *key, const char *format, void *value)
+{
+	const char *p = strstr(line, key);
+
+	if (p == NULL)
+		return false;
+
+	return sscanf(p + strlen(key), format, value) == 1;
+}
@@ -0,0 +1,70 @@
+#ifndef SERVICES_H
+#define SERVICES_H
+
+#include "settings.h"
+
+/* Interval at which progress of long-running service actions is reported */
+#define SERVICE_PROGRESS_INTERVAL 5
+
+/* Buckets in gstat's fill distribution: 0-19%, 20-39% ... 80-99% */
+#define GSTAT_FILL_BUCKETS 5
+
+/*
+ * Per-index statistics parsed from the output of the Services API
+ * database statistics action; values not reported by the server version
+ * in use are -1.
+ */
+typedef struct gstatIndex
+{
+	char	   *name;
+	int			depth;
+	long		leaf_buckets;
+	long		nodes;
+	double		avg_key_length;
+	double		compression_ratio;
+	long		total_dup;
+	long		max_dup;
+	long		fill[GSTAT_FILL_BUCKETS];
+} gstatIndex;
+
+/*
+ * Per-table statistics parsed from the output of the Services API
+ * database statistics action (the equivalent of "gstat -d -r [-i]"); values
+ * not reported by the server version in use are -1.
+ */
+typedef struct gstatTable
+{
+	char	   *name;
+	long		records;
+	double		avg_record_length;
+	long		versions;
+	long		max_versions;
+	double		compression_ratio;
+	long		data_pages;
+	int			avg_fill;
+	long		fill[GSTAT_FILL_BUCKETS];
+	int			nindexes;
+	int			alloc_indexes;
+	gstatIndex *indexes;
+} gstatTable;
+
+typedef struct gstatData
+{
+	int			ntables;
+	int			alloc_tables;
+	gstatTable *tables;
+} gstatData;
+
+extern bool
+serviceSweep(int parallel_workers);
+
+extern gstatData *
+serviceDatabaseStats(const char *table, bool indexes, bool system, bool report_errors);
+
+extern gstatTable *
+findDatabaseStatsTable(gstatData *stats, const char *name);
+
+extern void
+freeDatabaseStats(gstatData *stats);
+
+#endif   /* SERVICES_H */
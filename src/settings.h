@@ -2,7 +2,16 @@
 #define SETTINGS_H
 
 #define FBSQL_HISTORY ".fbsql_history"
+#define FBSQL_PLAN_HISTORY ".fbsql_plan_history"
+
+/* Default polling interval for monitoring modes, in seconds */
+#define MONITOR_DEFAULT_INTERVAL 5
+
+/* Default number of connections kept open by "fbsql --daemon" */
+#define DAEMON_DEFAULT_POOL_SIZE 4
+
 #include "libfq.h"
+#include "variables.h"
 
 enum printFormat
 {
@@ -81,14 +90,37 @@ typedef struct _fbsqlSettings
 	bool			  time_zone_names;    /* instructs libfq to display time zone names if available */
 	char			 *home_path;
 	char			 *fbsql_history;
+	char			 *plan_history_file;
 	printQueryOpt	  popt;
 	bool			  timing;			  /* toggle timing display */
 	bool			  quiet;
 	bool			  lc_fold;			  /* fold column headings to lower-case? */
 	bool			  echo_hidden;
 	bool			  autocommit;
+	int				  autocommit_batch;	  /* autocommit: statements per transaction (0: one each) */
+	int				  autocommit_batch_ms; /* autocommit: maximum transaction duration when batching */
+	char			 *txmode;			  /* \txmode: SET TRANSACTION statement starting each transaction (NULL: libfq default) */
 	short			  plan_display;		  /* display query plan? */
 	short			  explain_display;	  /* display explained query plan? */
+	bool			  plan_history;		  /* record plans and warn about plan changes */
+	bool			  query_stats;		  /* collect per-fingerprint query statistics */
+	bool			  discard_results;	  /* don't display query results (\querystats replay) */
+	int				  parallel_workers;	  /* Firebird 5.0 parallel workers per connection (0: server default) */
+	char			 *record_dir;		  /* --record: write monitoring snapshots here instead of running interactively */
+	char			 *exporter_file;	  /* --exporter: write Prometheus metrics here instead of running interactively */
+	char			 *listen_events;	  /* --listen: comma-separated events to wait for instead of running interactively */
+	char			 *on_event_query;	  /* --on-event: query to execute when a --listen event is received */
+	char			 *daemon_socket;	  /* --daemon: serve pooled connections on this socket instead of running interactively */
+	char			 *via_socket;		  /* --via: execute statements using the daemon listening on this socket */
+	int				  pool_size;		  /* --pool-size: number of connections kept open by --daemon */
+	bool			  protocol;			  /* --protocol: execute framed requests from stdin instead of running interactively */
+	int				  monitor_interval;	  /* --interval: polling interval for --record and --exporter, in seconds */
+	VariableSpace	  vars;				  /* client-side variables (\set) */
+	bool			  bind_variables;	  /* pass :var references in SQL as bound parameters */
+	int				  retry_on_conflict;  /* retry statements failing with a conflict up to N times */
+	bool			  gexec_flag;		  /* \gexec: execute the values of the next query's result */
+	int				  gexec_batch;		  /* \gexec: statements per transaction (0: all) */
+	int				  gexec_workers;	  /* \gexec: connections to execute statements on */
 	HistControl		  histcontrol;
 } fbsqlSettings;
 
@@ -239,19 +239,21 @@ fbsql_completion(char *text, int start, int end)
 #define prev6_wd  (previous_words[5])
 
 	static const char *const backslash_commands[] = {
-		"\\a", "\\activity", "\\autocommit",
-		"\\conninfo", "\\copyright",
+		"\\a", "\\activity", "\\analyze_workload", "\\autocommit",
+		"\\cachestats", "\\checksum", "\\conninfo", "\\copy_table", "\\copyright",
 		"\\d", "\\df", "\\di", "\\dp", "\\ds", "\\dt", "\\du", "\\dv",
-		"\\explain",
-		"\\format",
-		"\\l",
+		"\\endparallel", "\\explain",
+		"\\fanout", "\\format",
+		"\\gexec",
+		"\\l", "\\listen",
 		"\\loglevel",
-		"\\plan",
-		"\\q",
+		"\\parallel", "\\plan", "\\plancache", "\\planhistory",
+		"\\q", "\\querystats",
+		"\\replay-stats",
 		"\\set",
-		"\\timing",
+		"\\timing", "\\txgap", "\\txmode",
 		"\\tznames",
-		"\\util",
+		"\\unset", "\\util",
 		NULL
 	};
 
@@ -460,15 +462,106 @@ fbsql_completion(char *text, int start, int end)
 		COMPLETE_WITH_LIST_CS(list_PLAN);
 	}
 
+/* \querystats */
+	else if (pg_strcasecmp(prev_wd, "\\querystats") == 0)
+	{
+		static const char *const list_QUERYSTATS[] =
+		{"on", "off", "reset", "replay", NULL};
+
+		COMPLETE_WITH_LIST_CS(list_QUERYSTATS);
+	}
+
+/* \planhistory */
+	else if (pg_strcasecmp(prev_wd, "\\planhistory") == 0)
+	{
+		static const char *const list_PLANHISTORY[] =
+		{"on", "off", "reset", NULL};
+
+		COMPLETE_WITH_LIST_CS(list_PLANHISTORY);
+	}
+
+/* \txgap */
+	else if (pg_strcasecmp(prev_wd, "\\txgap") == 0)
+	{
+		static const char *const list_TXGAP[] =
+		{"watch", "threshold", NULL};
+
+		COMPLETE_WITH_LIST_CS(list_TXGAP);
+	}
+
+/* \txmode */
+	else if (pg_strcasecmp(prev_wd, "\\txmode") == 0)
+	{
+		static const char *const list_TXMODE[] =
+		{"read", "snapshot", "wait", "nowait", "default", NULL};
+
+		COMPLETE_WITH_LIST_CS(list_TXMODE);
+	}
+
+/* \gexec */
+	else if (pg_strcasecmp(prev_wd, "\\gexec") == 0)
+	{
+		static const char *const list_GEXEC[] =
+		{"batch", "workers", NULL};
+
+		COMPLETE_WITH_LIST_CS(list_GEXEC);
+	}
+
+/* \autocommit */
+	else if (pg_strcasecmp(prev_wd, "\\autocommit") == 0)
+	{
+		static const char *const list_AUTOCOMMIT[] =
+		{"on", "off", "batch", NULL};
+
+		COMPLETE_WITH_LIST_CS(list_AUTOCOMMIT);
+	}
+
+/* \set, \unset */
+	else if (pg_strcasecmp(prev_wd, "\\set") == 0
+			 || pg_strcasecmp(prev_wd, "\\unset") == 0)
+	{
+		static const char *const list_SET[] =
+		{"bind_variables", "retry_on_conflict", NULL};
+
+		COMPLETE_WITH_LIST_CS(list_SET);
+	}
+
+/* \set bind_variables */
+	else if (pg_strcasecmp(prev2_wd, "\\set") == 0
+			 && pg_strcasecmp(prev_wd, "bind_variables") == 0)
+	{
+		static const char *const list_SET_BOOLEAN[] =
+		{"on", "off", NULL};
+
+		COMPLETE_WITH_LIST_CS(list_SET_BOOLEAN);
+	}
+
 /* \util */
 	else if (pg_strcasecmp(prev_wd, "\\util") == 0)
 	{
 		static const char *const list_UTIL[] =
-		{"set_index_statistics", NULL};
+		{"gstat", "rebuild_indexes", "set_index_statistics", "sweep", NULL};
 
 		COMPLETE_WITH_LIST_CS(list_UTIL);
 	}
 
+/* \util gstat */
+	else if (pg_strcasecmp(prev2_wd, "\\util") == 0
+			 && pg_strcasecmp(prev_wd, "gstat") == 0)
+	{
+		COMPLETE_WITH_QUERY(Query_for_list_of_tables);
+	}
+
+/* \util set_index_statistics */
+	else if (pg_strcasecmp(prev2_wd, "\\util") == 0
+			 && pg_strcasecmp(prev_wd, "set_index_statistics") == 0)
+	{
+		static const char *const list_UTIL_SET_INDEX_STATISTICS[] =
+		{"stale", "system", "workers", NULL};
+
+		COMPLETE_WITH_LIST_CS(list_UTIL_SET_INDEX_STATISTICS);
+	}
+
 	/*
 	 * Finally, we look through the list of "things", such as TABLE, INDEX and
 	 * check if that was the previous word. If so, execute the query to get a
@@ -0,0 +1,322 @@
+/* ---------------------------------------------------------------------
+ *
+ * txmode.c
+ *
+ * Transaction parameters (\txmode, --txmode) applied to each
+ * transaction started on the session's connection
+ *
+ * libfq starts transactions with its own default parameters, so a
+ * different mode is applied by starting the transaction explicitly with
+ * the corresponding SET TRANSACTION statement.
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "common.h"
+#include "port.h"
+#include "settings.h"
+#include "txmode.h"
+
+#define TXMODE_MAX_WORDS 16
+
+typedef enum
+{
+	TX_ISOLATION_DEFAULT,
+	TX_ISOLATION_READ_COMMITTED,
+	TX_ISOLATION_SNAPSHOT
+} txIsolation;
+
+static bool _nextWordIs(char **words, int nwords, int i, const char *word);
+static bool _notRepeated(bool seen, const char *option);
+
+
+/**
+ * parseTransactionMode()
+ *
+ * Parse a transaction mode, consisting of any of the following, in any
+ * order:
+ *
+ *   read only | read write
+ *   read committed [read consistency | record_version | no record_version]
+ *   snapshot [table stability]
+ *   wait [N] | nowait
+ *
+ * each at most once, and return the corresponding SET TRANSACTION
+ * statement, or NULL if the mode is "default" (libfq's default
+ * parameters) or invalid; "valid" is set to false in the latter case.
+ *
+ * A read-only mode without an explicit isolation level uses READ
+ * COMMITTED, as read-only read committed transactions do not hold back
+ * the oldest active transaction (and hence garbage collection).
+ */
+char *
+parseTransactionMode(const char *mode, bool *valid)
+{
+	char	   *buf = strdup(mode);
+	char	   *words[TXMODE_MAX_WORDS];
+	char	   *word;
+	int			nwords = 0;
+	int			i;
+	int			read_only = -1;
+	int			lock_wait = -1;
+	int			lock_timeout = 0;
+	txIsolation isolation = TX_ISOLATION_DEFAULT;
+	const char *isolation_option = "";
+	FQExpBufferData statement;
+
+	*valid = true;
+
+	for (word = strtok(buf, " \t\n"); word != NULL; word = strtok(NULL, " \t\n"))
+	{
+		if (nwords == TXMODE_MAX_WORDS)
+		{
+			fbsql_error("transaction mode has too many words\n");
+			*valid = false;
+			free(buf);
+			return NULL;
+		}
+
+		words[nwords++] = word;
+	}
+
+	if (nwords == 0 || (nwords == 1 && pg_strcasecmp(words[0], "default") == 0))
+	{
+		free(buf);
+		return NULL;
+	}
+
+	for (i = 0; i < nwords && *valid == true; i++)
+	{
+		if (pg_strcasecmp(words[i], "read") == 0 && _nextWordIs(words, nwords, i, "only"))
+		{
+			*valid = _notRepeated(read_only != -1, "access mode");
+			read_only = 1;
+			i++;
+		}
+		else if (pg_strcasecmp(words[i], "read") == 0 && _nextWordIs(words, nwords, i, "write"))
+		{
+			*valid = _notRepeated(read_only != -1, "access mode");
+			read_only = 0;
+			i++;
+		}
+		else if (pg_strcasecmp(words[i], "read") == 0 && _nextWordIs(words, nwords, i, "committed"))
+		{
+			*valid = _notRepeated(isolation != TX_ISOLATION_DEFAULT, "isolation level");
+			isolation = TX_ISOLATION_READ_COMMITTED;
+			isolation_option = "";
+			i++;
+
+			if (_nextWordIs(words, nwords, i, "read") && _nextWordIs(words, nwords, i + 1, "consistency"))
+			{
+				/* Firebird 4.0 and later */
+				isolation_option = " READ CONSISTENCY";
+				i += 2;
+			}
+			else if (_nextWordIs(words, nwords, i, "record_version"))
+			{
+				isolation_option = " RECORD_VERSION";
+				i++;
+			}
+			else if (_nextWordIs(words, nwords, i, "no") && _nextWordIs(words, nwords, i + 1, "record_version"))
+			{
+				isolation_option = " NO RECORD_VERSION";
+				i += 2;
+			}
+		}
+		else if (pg_strcasecmp(words[i], "snapshot") == 0)
+		{
+			*valid = _notRepeated(isolation != TX_ISOLATION_DEFAULT, "isolation level");
+			isolation = TX_ISOLATION_SNAPSHOT;
+			isolation_option = "";
+
+			if (_nextWordIs(words, nwords, i, "table") && _nextWordIs(words, nwords, i + 1, "stability"))
+			{
+				isolation_option = " TABLE STABILITY";
+				i += 2;
+			}
+		}
+		else if (pg_strcasecmp(words[i], "wait") == 0)
+		{
+			*valid = _notRepeated(lock_wait != -1, "lock resolution");
+			lock_wait = 1;
+			lock_timeout = 0;
+
+			if (i + 1 < nwords && isdigit((unsigned char)words[i + 1][0]))
+			{
+				char	   *end;
+				long		timeout = strtol(words[i + 1], &end, 10);
+
+				if (*end != '\0' || timeout > INT_MAX)
+				{
+					fbsql_error("invalid lock timeout \"%s\"\n", words[i + 1]);
+					*valid = false;
+				}
+				else
+				{
+					lock_timeout = (int)timeout;
+				}
+
+				i++;
+			}
+		}
+		else if (pg_strcasecmp(words[i], "nowait") == 0)
+		{
+			*valid = _notRepeated(lock_wait != -1, "lock resolution");
+			lock_wait = 0;
+			lock_timeout = 0;
+		}
+		else if (pg_strcasecmp(words[i], "no") == 0 && _nextWordIs(words, nwords, i, "wait"))
+		{
+			*valid = _notRepeated(lock_wait != -1, "lock resolution");
+			lock_wait = 0;
+			lock_timeout = 0;
+			i++;
+		}
+		else
+		{
+			fbsql_error("unrecognized transaction mode option \"%s\"\n", words[i]);
+			*valid = false;
+		}
+	}
+
+	free(buf);
+
+	if (*valid == false)
+		return NULL;
+
+	if (read_only == 1 && isolation == TX_ISOLATION_DEFAULT)
+		isolation = TX_ISOLATION_READ_COMMITTED;
+
+	initFQExpBuffer(&statement);
+	appendFQExpBufferStr(&statement, "SET TRANSACTION");
+
+	if (read_only != -1)
+		appendFQExpBufferStr(&statement, read_only == 1 ? " READ ONLY" : " READ WRITE");
+
+	if (lock_wait == 0)
+		appendFQExpBufferStr(&statement, " NO WAIT");
+	else if (lock_wait == 1)
+		appendFQExpBufferStr(&statement, " WAIT");
+
+	if (lock_timeout > 0)
+		appendFQExpBuffer(&statement, " LOCK TIMEOUT %i", lock_timeout);
+
+	if (isolation == TX_ISOLATION_READ_COMMITTED)
+		appendFQExpBuffer(&statement, " ISOLATION LEVEL READ COMMITTED%s", isolation_option);
+	else if (isolation == TX_ISOLATION_SNAPSHOT)
+		appendFQExpBuffer(&statement, " ISOLATION LEVEL SNAPSHOT%s", isolation_option);
+
+	return statement.data;
+}
+
+
+/**
+ * startTransaction()
+ *
+ * If a transaction mode has been set and no transaction is active, start
+ * a transaction with that mode before "query" is executed (unless
+ * "query" itself starts or ends a transaction). The transaction is then
+ * used by "query" in place of the one libfq would otherwise start.
+ */
+bool
+startTransaction(FBconn *conn, const char *query)
+{
+	FBresult   *res;
+	bool		success = true;
+
+	if (fset.txmode == NULL || FQisActiveTransaction(conn) == true)
+		return true;
+
+	if (query != NULL && isTransactionControl(query) == true)
+		return true;
+
+	if (fset.echo_hidden)
+		printf("%s\n", fset.txmode);
+
+	res = FQexec(conn, fset.txmode);
+
+	switch (FQresultStatus(res))
+	{
+		case FBRES_EMPTY_QUERY:
+		case FBRES_BAD_RESPONSE:
+		case FBRES_NONFATAL_ERROR:
+		case FBRES_FATAL_ERROR:
+			printf("%s\n", res ? FQresultErrorMessage(res) : FQerrorMessage(conn));
+			fbsql_error("unable to start transaction with \"%s\"\n", fset.txmode);
+			success = false;
+			break;
+
+		default:
+			break;
+	}
+
+	if (res != NULL)
+		FQclear(res);
+
+	return success;
+}
+
+
+/**
+ * isTransactionControl()
+ *
+ * Determine whether the statement is SET TRANSACTION, COMMIT or ROLLBACK.
+ */
+bool
+isTransactionControl(const char *query)
+{
+	const char *p = query;
+
+	while (isspace((unsigned char)*p))
+		p++;
+
+	if (pg_strncasecmp(p, "COMMIT", 6) == 0 || pg_strncasecmp(p, "ROLLBACK", 8) == 0)
+		return true;
+
+	if (pg_strncasecmp(p, "SET", 3) == 0 && isspace((unsigned char)p[3]))
+	{
+		p += 3;
+
+		while (isspace((unsigned char)*p))
+			p++;
+
+		if (pg_strncasecmp(p, "TRANSACTION", 11) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+
+static bool
+_nextWordIs(char **words, int nwords, int i, const char *word)
+{
+	return i + 1 < nwords && pg_strcasecmp(words[i + 1], word) == 0;
+}
+
+
+/**
+ * _notRepeated()
+ *
+ * Report an error if an option of the given kind (e.g. the access mode)
+ * has already been specified, as the options would conflict.
+ */
+static bool
+_notRepeated(bool seen, const char *option)
+{
+	if (seen == true)
+	{
+		fbsql_error("transaction mode specifies more than one %s\n", option);
+		return false;
+	}
+
+	return true;
+}
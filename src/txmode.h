@@ -0,0 +1,16 @@
+#ifndef TXMODE_H
+#define TXMODE_H
+
+#include "libfq.h"
+#include "settings.h"
+
+extern char *
+parseTransactionMode(const char *mode, bool *valid);
+
+extern bool
+startTransaction(FBconn *conn, const char *query);
+
+extern bool
+isTransactionControl(const char *query);
+
+#endif   /* TXMODE_H */
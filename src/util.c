@@ -0,0 +1,1173 @@
+/* ---------------------------------------------------------------------
+ *
+ * util.c
+ *
+ * Implementation of the \util maintenance functions
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "command.h"
+#include "common.h"
+#include "parallel.h"
+#include "query.h"
+#include "services.h"
+#include "settings.h"
+#include "util.h"
+
+typedef struct indexStatisticsJob
+{
+	char	   *index_name;
+	char	   *relation_name;
+	bool		has_expression;
+	char	   *columns;		/* quoted, comma-separated segment list */
+	bool		old_statistics_null;
+	double		old_statistics;
+} indexStatisticsJob;
+
+typedef struct indexStatisticsRun
+{
+	indexStatisticsJob *jobs;
+	int			njobs;
+	bool		stale_only;
+	/* protected by the output lock */
+	int			completed;
+	int			updated;
+	int			skipped;
+	int			failed;
+} indexStatisticsRun;
+
+typedef struct rebuildIndexesTable
+{
+	char	   *relation_name;
+	int			first_index;	/* offset into rebuildIndexesRun.indexes */
+	int			nindexes;
+} rebuildIndexesTable;
+
+typedef struct rebuildIndexesIndex
+{
+	char	   *index_name;
+	bool		inactive;
+	bool		left_inactive;	/* deactivated, but could not be reactivated */
+} rebuildIndexesIndex;
+
+typedef struct rebuildIndexesRun
+{
+	rebuildIndexesTable *tables;
+	int			ntables;
+	rebuildIndexesIndex *indexes;
+	int			nindexes;
+	/* protected by the output lock */
+	int			completed;
+	int			rebuilt;
+	int			failed;
+	int			left_inactive;
+} rebuildIndexesRun;
+
+
+static bool _setIndexStatisticsJob(FBconn *conn, int worker, int job, void *arg);
+static bool _indexStatisticsStale(FBconn *conn, indexStatisticsJob *job, char *reason, size_t reason_len);
+static bool _getIndexStatistics(FBconn *conn, const char *index_name, double *statistics);
+static void _formatSelectivity(char *buf, size_t buf_len, bool is_null, double statistics);
+static bool _rebuildIndexesJob(FBconn *conn, int worker, int job, void *arg);
+static bool _execDDL(FBconn *conn, const char *prefix, const char *ident, const char *suffix, FBresult **res);
+static bool _printTransactionCounters(const char *label, long *oit);
+static void _formatStat(char *buf, size_t buf_len, const char *format, double value, const char **cell);
+
+
+/**
+ * utilSetIndexStatistics()
+ *
+ * \util set_index_statistics [PATTERN] [stale] [system] [workers N]
+ *
+ * Recompute the selectivity of active indexes, optionally restricted to
+ * tables matching PATTERN. System indexes are only included if "system"
+ * is specified.
+ *
+ * With "stale", the stored selectivity of each index is first compared
+ * with the number of distinct keys found in a sample of the table's rows,
+ * and the statistics only recomputed if they appear to be out of date.
+ *
+ * Indexes are processed by "workers" (default: 4) parallel connections,
+ * largest tables first, and progress is reported as each index completes.
+ *
+ * Returns FBSQL_CMD_ERROR if the options are invalid, and
+ * FBSQL_CMD_FAILED if the index list could not be read or any index
+ * could not be processed.
+ */
+backslashResult
+utilSetIndexStatistics(FbsqlScanState scan_state)
+{
+	indexStatisticsRun run;
+	FQExpBufferData buf;
+	FBresult   *res;
+	char	   *pattern = NULL;
+	char	   *opt;
+	bool		show_system = false;
+	bool		success = true;
+	int			nworkers = PARALLEL_DEFAULT_WORKERS;
+	int			i;
+	query_time	before, after;
+
+	memset(&run, 0, sizeof(run));
+
+	while ((opt = fbsql_scan_slash_option(scan_state,
+										  OT_NORMAL, NULL, false)))
+	{
+		if (strcmp(opt, "stale") == 0)
+			run.stale_only = true;
+		else if (strcmp(opt, "system") == 0)
+			show_system = true;
+		else if (strcmp(opt, "workers") == 0)
+		{
+			char *value = fbsql_scan_slash_option(scan_state,
+												  OT_NORMAL, NULL, false);
+
+			nworkers = parseWorkerCount(value);
+			free(value);
+
+			if (nworkers < 0)
+			{
+				fbsql_error("\\util set_index_statistics: \"workers\" must be followed by a number between 1 and %i\n",
+							PARALLEL_MAX_WORKERS);
+				free(opt);
+				free(pattern);
+				return FBSQL_CMD_ERROR;
+			}
+		}
+		else if (pattern == NULL)
+		{
+			pattern = opt;
+			continue;
+		}
+		else
+		{
+			fbsql_error("\\util set_index_statistics: unexpected option \"%s\"\n", opt);
+			free(opt);
+			free(pattern);
+			return FBSQL_CMD_ERROR;
+		}
+
+		free(opt);
+	}
+
+	initFQExpBuffer(&buf);
+
+	appendFQExpBufferStr(&buf,
+"    SELECT TRIM(i.rdb$index_name), \n"
+"           TRIM(i.rdb$relation_name), \n"
+"           i.rdb$statistics, \n"
+"           CASE WHEN i.rdb$expression_blr IS NULL THEN 0 ELSE 1 END, \n"
+"           (SELECT COUNT(*) \n"
+"              FROM rdb$pages p \n"
+"             WHERE p.rdb$relation_id = r.rdb$relation_id \n"
+"               AND p.rdb$page_type = 4) AS pointer_pages \n"
+"      FROM rdb$indices i \n"
+"INNER JOIN rdb$relations r \n"
+"        ON r.rdb$relation_name = i.rdb$relation_name \n"
+"     WHERE COALESCE(i.rdb$index_inactive, 0) = 0 \n");
+
+	if (show_system == false)
+		appendFQExpBufferStr(&buf,
+"       AND COALESCE(i.rdb$system_flag, 0) = 0 \n");
+
+	if (pattern != NULL)
+		wildcardPatternClause(pattern, "i.rdb$relation_name", &buf);
+
+	appendFQExpBufferStr(&buf,
+"  ORDER BY 5 DESC, 2, 1");
+
+	res = commandExec(buf.data);
+
+	if (FQresultStatus(res) != FBRES_TUPLES_OK)
+	{
+		fbsql_error("error retrieving index list\n%s\n", FQresultErrorMessage(res));
+		FQclear(res);
+		termFQExpBuffer(&buf);
+		free(pattern);
+		return FBSQL_CMD_FAILED;
+	}
+
+	run.njobs = FQntuples(res);
+
+	if (run.njobs == 0)
+	{
+		puts("No matching indexes found");
+		FQclear(res);
+		termFQExpBuffer(&buf);
+		free(pattern);
+		return FBSQL_CMD_SKIP_LINE;
+	}
+
+	run.jobs = (indexStatisticsJob *)fb_malloc0(run.njobs * sizeof(indexStatisticsJob));
+
+	for (i = 0; i < run.njobs; i++)
+	{
+		run.jobs[i].index_name = strdup(FQgetvalue(res, i, 0));
+		run.jobs[i].relation_name = strdup(FQgetvalue(res, i, 1));
+		run.jobs[i].old_statistics_null = FQgetisnull(res, i, 2);
+		run.jobs[i].old_statistics = run.jobs[i].old_statistics_null ? 0 : atof(FQgetvalue(res, i, 2));
+		run.jobs[i].has_expression = atoi(FQgetvalue(res, i, 3)) == 1;
+	}
+
+	FQclear(res);
+
+	/* segment lists are only needed for the staleness check */
+	if (run.stale_only == true)
+	{
+		FQExpBufferData columns;
+		int j;
+
+		res = commandExec(
+"  SELECT TRIM(s.rdb$index_name), TRIM(s.rdb$field_name) \n"
+"    FROM rdb$index_segments s \n"
+"ORDER BY s.rdb$index_name, s.rdb$field_position");
+
+		initFQExpBuffer(&columns);
+
+		for (i = 0; i < run.njobs; i++)
+		{
+			resetFQExpBuffer(&columns);
+
+			for (j = 0; FQresultStatus(res) == FBRES_TUPLES_OK && j < FQntuples(res); j++)
+			{
+				if (strcmp(FQgetvalue(res, j, 0), run.jobs[i].index_name) != 0)
+					continue;
+
+				if (columns.len > 0)
+					appendFQExpBufferStr(&columns, ", ");
+				appendSQLIdentifier(&columns, FQgetvalue(res, j, 1));
+			}
+
+			if (columns.len > 0)
+				run.jobs[i].columns = strdup(columns.data);
+		}
+
+		termFQExpBuffer(&columns);
+		FQclear(res);
+	}
+
+	printf("Updating statistics for %i index(es) using %i worker(s)%s\n",
+		   run.njobs,
+		   nworkers < run.njobs ? nworkers : run.njobs,
+		   run.stale_only ? "; only stale statistics will be updated" : "");
+
+	gettimeofday(&before, NULL);
+
+	if (runParallelJobs(nworkers, run.njobs, _setIndexStatisticsJob, &run) == false)
+		success = false;
+
+	gettimeofday(&after, NULL);
+	INSTR_TIME_SUBTRACT(after, before);
+
+	printf("Index statistics updated for %i of %i index(es)", run.updated, run.njobs);
+
+	if (run.skipped > 0)
+		printf("; %i current", run.skipped);
+
+	if (run.failed > 0)
+		printf("; %i failed", run.failed);
+
+	printf(" (%.3f ms)\n", INSTR_TIME_GET_MILLISEC(after));
+
+	for (i = 0; i < run.njobs; i++)
+	{
+		free(run.jobs[i].index_name);
+		free(run.jobs[i].relation_name);
+		free(run.jobs[i].columns);
+	}
+
+	free(run.jobs);
+	termFQExpBuffer(&buf);
+	free(pattern);
+
+	return success ? FBSQL_CMD_SKIP_LINE : FBSQL_CMD_FAILED;
+}
+
+
+/**
+ * _setIndexStatisticsJob()
+ *
+ * Worker function for utilSetIndexStatistics(): recompute statistics for
+ * a single index, if required.
+ */
+static bool
+_setIndexStatisticsJob(FBconn *conn, int worker, int job, void *arg)
+{
+	indexStatisticsRun *run = (indexStatisticsRun *)arg;
+	indexStatisticsJob *index = &run->jobs[job];
+	FQExpBufferData buf;
+	FBresult   *res;
+	char		reason[128] = "";
+	char		old_selectivity[32], new_selectivity[32];
+	double		new_statistics = 0;
+	bool		have_new_statistics;
+	query_time	before, after;
+
+	if (run->stale_only == true
+	 && _indexStatisticsStale(conn, index, reason, sizeof(reason)) == false)
+	{
+		parallelOutputLock();
+		run->completed++;
+		run->skipped++;
+		printf("[%i/%i] %s on %s: current (%s)\n",
+			   run->completed, run->njobs,
+			   index->index_name, index->relation_name,
+			   reason);
+		parallelOutputUnlock();
+
+		return true;
+	}
+
+	initFQExpBuffer(&buf);
+	appendFQExpBufferStr(&buf, "SET STATISTICS INDEX ");
+	appendSQLIdentifier(&buf, index->index_name);
+
+	gettimeofday(&before, NULL);
+	res = FQexec(conn, buf.data);
+	gettimeofday(&after, NULL);
+	INSTR_TIME_SUBTRACT(after, before);
+
+	termFQExpBuffer(&buf);
+
+	if (FQresultStatus(res) != FBRES_COMMAND_OK)
+	{
+		parallelOutputLock();
+		run->completed++;
+		run->failed++;
+		printf("[%i/%i] %s on %s: error updating statistics\n%s\n",
+			   run->completed, run->njobs,
+			   index->index_name, index->relation_name,
+			   FQresultErrorMessage(res));
+		parallelOutputUnlock();
+
+		FQclear(res);
+		return false;
+	}
+
+	FQclear(res);
+
+	have_new_statistics = _getIndexStatistics(conn, index->index_name, &new_statistics);
+
+	_formatSelectivity(old_selectivity, sizeof(old_selectivity),
+					   index->old_statistics_null, index->old_statistics);
+	_formatSelectivity(new_selectivity, sizeof(new_selectivity),
+					   !have_new_statistics, new_statistics);
+
+	parallelOutputLock();
+	run->completed++;
+	run->updated++;
+	printf("[%i/%i] %s on %s: selectivity %s -> %s (%.3f ms)%s%s%s\n",
+		   run->completed, run->njobs,
+		   index->index_name, index->relation_name,
+		   old_selectivity, new_selectivity,
+		   INSTR_TIME_GET_MILLISEC(after),
+		   reason[0] ? " (" : "",
+		   reason,
+		   reason[0] ? ")" : "");
+	parallelOutputUnlock();
+
+	return true;
+}
+
+
+/**
+ * _indexStatisticsStale()
+ *
+ * Determine whether the index's stored statistics appear to be out of
+ * date, by counting the distinct keys in the first
+ * INDEX_STATISTICS_SAMPLE_ROWS rows of the table.
+ *
+ * As the sample is a lower bound for the number of distinct keys in the
+ * table, statistics are considered stale if the sample contains
+ * significantly more distinct keys than the stored selectivity implies.
+ * If the table is smaller than the sample, the count is exact and any
+ * significant difference is treated as stale.
+ *
+ * Expression indexes cannot be sampled and are always considered stale.
+ * A short explanation is written to "reason".
+ */
+static bool
+_indexStatisticsStale(FBconn *conn, indexStatisticsJob *index, char *reason, size_t reason_len)
+{
+	FQExpBufferData buf;
+	FBresult   *res;
+	long		sample_rows, sample_keys;
+	double		stored_keys;
+	double		difference;
+
+	if (index->old_statistics_null || index->old_statistics <= 0)
+	{
+		snprintf(reason, reason_len, "no statistics");
+		return true;
+	}
+
+	if (index->has_expression || index->columns == NULL)
+	{
+		snprintf(reason, reason_len, "expression index not sampled");
+		return true;
+	}
+
+	initFQExpBuffer(&buf);
+
+	appendFQExpBuffer(&buf,
+"SELECT (SELECT COUNT(*) FROM (SELECT FIRST %i 1 AS x FROM ",
+					  INDEX_STATISTICS_SAMPLE_ROWS);
+	appendSQLIdentifier(&buf, index->relation_name);
+	appendFQExpBuffer(&buf,
+") s), \n"
+"       (SELECT COUNT(*) FROM (SELECT DISTINCT %s FROM (SELECT FIRST %i %s FROM ",
+					  index->columns,
+					  INDEX_STATISTICS_SAMPLE_ROWS,
+					  index->columns);
+	appendSQLIdentifier(&buf, index->relation_name);
+	appendFQExpBufferStr(&buf,
+") s1) s2) \n"
+"  FROM rdb$database");
+
+	res = FQexec(conn, buf.data);
+	termFQExpBuffer(&buf);
+
+	if (FQresultStatus(res) != FBRES_TUPLES_OK || FQntuples(res) == 0)
+	{
+		FQclear(res);
+		snprintf(reason, reason_len, "unable to sample table");
+		return true;
+	}
+
+	sample_rows = atol(FQgetvalue(res, 0, 0));
+	sample_keys = atol(FQgetvalue(res, 0, 1));
+	FQclear(res);
+
+	stored_keys = 1 / index->old_statistics;
+
+	if (sample_rows < INDEX_STATISTICS_SAMPLE_ROWS)
+	{
+		/* entire table was read - count is exact */
+		double larger = (double)sample_keys > stored_keys ? (double)sample_keys : stored_keys;
+
+		difference = larger > 0 ? ((double)sample_keys - stored_keys) / larger : 0;
+
+		if (difference < 0)
+			difference = -difference;
+
+		snprintf(reason, reason_len, "%.0f keys recorded, %li found", stored_keys, sample_keys);
+	}
+	else
+	{
+		difference = ((double)sample_keys - stored_keys) / stored_keys;
+
+		snprintf(reason, reason_len, "%.0f keys recorded, %li in sample of %li rows",
+				 stored_keys, sample_keys, sample_rows);
+	}
+
+	return difference > INDEX_STATISTICS_STALE_THRESHOLD;
+}
+
+
+static bool
+_getIndexStatistics(FBconn *conn, const char *index_name, double *statistics)
+{
+	FQExpBufferData buf;
+	FBresult   *res;
+	bool		found = false;
+
+	initFQExpBuffer(&buf);
+	appendFQExpBufferStr(&buf,
+"SELECT rdb$statistics FROM rdb$indices WHERE rdb$index_name = ");
+	appendSQLLiteral(&buf, index_name);
+
+	res = FQexec(conn, buf.data);
+	termFQExpBuffer(&buf);
+
+	if (FQresultStatus(res) == FBRES_TUPLES_OK && FQntuples(res) > 0 && !FQgetisnull(res, 0, 0))
+	{
+		*statistics = atof(FQgetvalue(res, 0, 0));
+		found = true;
+	}
+
+	FQclear(res);
+
+	return found;
+}
+
+
+static void
+_formatSelectivity(char *buf, size_t buf_len, bool is_null, double statistics)
+{
+	if (is_null)
+		snprintf(buf, buf_len, "-");
+	else
+		snprintf(buf, buf_len, "%.6g", statistics);
+}
+
+
+/**
+ * utilRebuildIndexes()
+ *
+ * \util rebuild_indexes [PATTERN] [workers N]
+ *
+ * Rebuild user indexes, optionally restricted to tables matching PATTERN,
+ * by deactivating and reactivating them. Inactive indexes are activated.
+ *
+ * Indexes which enforce a constraint cannot be deactivated and are
+ * skipped.
+ *
+ * Tables are processed in parallel by "workers" (default: 4) connections,
+ * largest tables first; the indexes of each table are rebuilt in turn by
+ * the same connection, as concurrent metadata changes on a single table
+ * would conflict. With Firebird 5.0, each connection can additionally
+ * use multiple server threads (see the --parallel-workers option).
+ *
+ * Returns FBSQL_CMD_ERROR if the options are invalid, and
+ * FBSQL_CMD_FAILED if the index list could not be read or any index
+ * could not be rebuilt.
+ */
+backslashResult
+utilRebuildIndexes(FbsqlScanState scan_state)
+{
+	rebuildIndexesRun run;
+	FQExpBufferData buf;
+	FBresult   *res;
+	char	   *pattern = NULL;
+	char	   *opt;
+	bool		success = true;
+	int			nworkers = PARALLEL_DEFAULT_WORKERS;
+	int			skipped = 0;
+	int			i;
+	query_time	before, after;
+
+	memset(&run, 0, sizeof(run));
+
+	while ((opt = fbsql_scan_slash_option(scan_state,
+										  OT_NORMAL, NULL, false)))
+	{
+		if (strcmp(opt, "workers") == 0)
+		{
+			char *value = fbsql_scan_slash_option(scan_state,
+												  OT_NORMAL, NULL, false);
+
+			nworkers = parseWorkerCount(value);
+			free(value);
+
+			if (nworkers < 0)
+			{
+				fbsql_error("\\util rebuild_indexes: \"workers\" must be followed by a number between 1 and %i\n",
+							PARALLEL_MAX_WORKERS);
+				free(opt);
+				free(pattern);
+				return FBSQL_CMD_ERROR;
+			}
+		}
+		else if (pattern == NULL)
+		{
+			pattern = opt;
+			continue;
+		}
+		else
+		{
+			fbsql_error("\\util rebuild_indexes: unexpected option \"%s\"\n", opt);
+			free(opt);
+			free(pattern);
+			return FBSQL_CMD_ERROR;
+		}
+
+		free(opt);
+	}
+
+	initFQExpBuffer(&buf);
+
+	appendFQExpBufferStr(&buf,
+"    SELECT TRIM(i.rdb$relation_name), \n"
+"           TRIM(i.rdb$index_name), \n"
+"           COALESCE(i.rdb$index_inactive, 0), \n"
+"           CASE WHEN EXISTS(SELECT 1 \n"
+"                              FROM rdb$relation_constraints rc \n"
+"                             WHERE rc.rdb$index_name = i.rdb$index_name) \n"
+"                THEN 1 ELSE 0 END, \n"
+"           (SELECT COUNT(*) \n"
+"              FROM rdb$pages p \n"
+"             WHERE p.rdb$relation_id = r.rdb$relation_id \n"
+"               AND p.rdb$page_type = 4) AS pointer_pages \n"
+"      FROM rdb$indices i \n"
+"INNER JOIN rdb$relations r \n"
+"        ON r.rdb$relation_name = i.rdb$relation_name \n"
+"     WHERE COALESCE(i.rdb$system_flag, 0) = 0 \n");
+
+	if (pattern != NULL)
+		wildcardPatternClause(pattern, "i.rdb$relation_name", &buf);
+
+	appendFQExpBufferStr(&buf,
+"  ORDER BY 5 DESC, 1, 2");
+
+	res = commandExec(buf.data);
+	termFQExpBuffer(&buf);
+	free(pattern);
+
+	if (FQresultStatus(res) != FBRES_TUPLES_OK)
+	{
+		fbsql_error("error retrieving index list\n%s\n", FQresultErrorMessage(res));
+		FQclear(res);
+		return FBSQL_CMD_FAILED;
+	}
+
+	run.indexes = (rebuildIndexesIndex *)fb_malloc0((FQntuples(res) + 1) * sizeof(rebuildIndexesIndex));
+	run.tables = (rebuildIndexesTable *)fb_malloc0((FQntuples(res) + 1) * sizeof(rebuildIndexesTable));
+
+	/* group indexes by table; the result is ordered by table */
+	for (i = 0; i < FQntuples(res); i++)
+	{
+		const char *relation_name = FQgetvalue(res, i, 0);
+
+		if (atoi(FQgetvalue(res, i, 3)) == 1)
+		{
+			skipped++;
+			continue;
+		}
+
+		if (run.ntables == 0
+		 || strcmp(run.tables[run.ntables - 1].relation_name, relation_name) != 0)
+		{
+			run.tables[run.ntables].relation_name = strdup(relation_name);
+			run.tables[run.ntables].first_index = run.nindexes;
+			run.ntables++;
+		}
+
+		run.indexes[run.nindexes].index_name = strdup(FQgetvalue(res, i, 1));
+		run.indexes[run.nindexes].inactive = atoi(FQgetvalue(res, i, 2)) == 1;
+		run.nindexes++;
+
+		run.tables[run.ntables - 1].nindexes++;
+	}
+
+	FQclear(res);
+
+	if (run.nindexes == 0)
+	{
+		puts("No matching indexes found");
+	}
+	else
+	{
+		printf("Rebuilding %i index(es) on %i table(s) using %i worker(s)\n",
+			   run.nindexes,
+			   run.ntables,
+			   nworkers < run.ntables ? nworkers : run.ntables);
+
+		gettimeofday(&before, NULL);
+
+		if (runParallelJobs(nworkers, run.ntables, _rebuildIndexesJob, &run) == false)
+			success = false;
+
+		gettimeofday(&after, NULL);
+		INSTR_TIME_SUBTRACT(after, before);
+
+		printf("%i of %i index(es) rebuilt", run.rebuilt, run.nindexes);
+
+		if (run.failed > 0)
+			printf("; %i failed", run.failed);
+
+		printf(" (%.3f ms)\n", INSTR_TIME_GET_MILLISEC(after));
+
+		if (run.left_inactive > 0)
+		{
+			int			j;
+
+			printf("Warning: %i index(es) could not be reactivated and are now INACTIVE:\n",
+				   run.left_inactive);
+
+			for (i = 0; i < run.ntables; i++)
+			{
+				rebuildIndexesTable *table = &run.tables[i];
+
+				for (j = table->first_index; j < table->first_index + table->nindexes; j++)
+				{
+					if (run.indexes[j].left_inactive == true)
+						printf("  %s on %s\n", run.indexes[j].index_name, table->relation_name);
+				}
+			}
+		}
+	}
+
+	if (skipped > 0)
+		printf("%i index(es) enforcing constraints skipped\n", skipped);
+
+	for (i = 0; i < run.nindexes; i++)
+		free(run.indexes[i].index_name);
+
+	for (i = 0; i < run.ntables; i++)
+		free(run.tables[i].relation_name);
+
+	free(run.indexes);
+	free(run.tables);
+
+	return success ? FBSQL_CMD_SKIP_LINE : FBSQL_CMD_FAILED;
+}
+
+
+/**
+ * _rebuildIndexesJob()
+ *
+ * Worker function for utilRebuildIndexes(): rebuild all selected
+ * indexes of a single table.
+ *
+ * If an index was deactivated but cannot be reactivated, activation is
+ * retried once; if that also fails, the index is reported as left
+ * INACTIVE.
+ */
+static bool
+_rebuildIndexesJob(FBconn *conn, int worker, int job, void *arg)
+{
+	rebuildIndexesRun *run = (rebuildIndexesRun *)arg;
+	rebuildIndexesTable *table = &run->tables[job];
+	bool		success = true;
+	int			i;
+
+	for (i = table->first_index; i < table->first_index + table->nindexes; i++)
+	{
+		rebuildIndexesIndex *index = &run->indexes[i];
+		FBresult   *res = NULL;
+		query_time	before, after;
+		bool		ok = true;
+		bool		deactivated = false;
+
+		gettimeofday(&before, NULL);
+
+		if (index->inactive == false)
+		{
+			ok = _execDDL(conn, "ALTER INDEX ", index->index_name, " INACTIVE", &res);
+			deactivated = ok;
+		}
+
+		if (ok == true)
+		{
+			ok = _execDDL(conn, "ALTER INDEX ", index->index_name, " ACTIVE", &res);
+
+			/* don't give up on an index we deactivated after a single attempt */
+			if (ok == false && deactivated == true)
+			{
+				FQclear(res);
+				ok = _execDDL(conn, "ALTER INDEX ", index->index_name, " ACTIVE", &res);
+			}
+
+			if (ok == false && deactivated == true)
+				index->left_inactive = true;
+		}
+
+		gettimeofday(&after, NULL);
+		INSTR_TIME_SUBTRACT(after, before);
+
+		parallelOutputLock();
+		run->completed++;
+
+		if (ok == true)
+		{
+			run->rebuilt++;
+			printf("[%i/%i] %s on %s: %s (%.3f ms)\n",
+				   run->completed, run->nindexes,
+				   index->index_name, table->relation_name,
+				   index->inactive ? "activated" : "rebuilt",
+				   INSTR_TIME_GET_MILLISEC(after));
+		}
+		else if (index->left_inactive == true)
+		{
+			run->failed++;
+			run->left_inactive++;
+			printf("[%i/%i] %s on %s: error reactivating index; the index is now INACTIVE\n%s\n",
+				   run->completed, run->nindexes,
+				   index->index_name, table->relation_name,
+				   FQresultErrorMessage(res));
+			success = false;
+		}
+		else
+		{
+			run->failed++;
+			printf("[%i/%i] %s on %s: error rebuilding index\n%s\n",
+				   run->completed, run->nindexes,
+				   index->index_name, table->relation_name,
+				   FQresultErrorMessage(res));
+			success = false;
+		}
+
+		parallelOutputUnlock();
+
+		if (res != NULL)
+			FQclear(res);
+	}
+
+	return success;
+}
+
+
+/**
+ * _execDDL()
+ *
+ * Execute a DDL statement of the form "prefix <quoted identifier> suffix".
+ * On failure, the result is returned in "res" for error reporting and
+ * must be freed by the caller; on success, "res" is set to NULL.
+ */
+static bool
+_execDDL(FBconn *conn, const char *prefix, const char *ident, const char *suffix, FBresult **res)
+{
+	FQExpBufferData buf;
+
+	initFQExpBuffer(&buf);
+	appendFQExpBufferStr(&buf, prefix);
+	appendSQLIdentifier(&buf, ident);
+	appendFQExpBufferStr(&buf, suffix);
+
+	*res = FQexec(conn, buf.data);
+	termFQExpBuffer(&buf);
+
+	if (FQresultStatus(*res) == FBRES_COMMAND_OK)
+	{
+		FQclear(*res);
+		*res = NULL;
+		return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * utilSweep()
+ *
+ * \util sweep [workers N]
+ *
+ * Sweep the database via the Services API, and report the oldest
+ * interesting transaction (OIT) before and after.
+ *
+ * "workers" sets the number of parallel workers used by the sweep
+ * (Firebird 5.0 and later); by default the value provided with
+ * --parallel-workers, if any, is used.
+ *
+ * Returns FBSQL_CMD_ERROR if the options are invalid, and
+ * FBSQL_CMD_FAILED if the sweep could not be run or monitoring was
+ * cancelled.
+ */
+backslashResult
+utilSweep(FbsqlScanState scan_state)
+{
+	char	   *opt;
+	int			nworkers = fset.parallel_workers;
+	long		oit_before = 0, oit_after = 0;
+	bool		have_before, success;
+	query_time	before, after;
+
+	while ((opt = fbsql_scan_slash_option(scan_state,
+										  OT_NORMAL, NULL, false)))
+	{
+		if (strcmp(opt, "workers") == 0)
+		{
+			char *value = fbsql_scan_slash_option(scan_state,
+												  OT_NORMAL, NULL, false);
+
+			nworkers = parseWorkerCount(value);
+			free(value);
+
+			if (nworkers < 0)
+			{
+				fbsql_error("\\util sweep: \"workers\" must be followed by a number between 1 and %i\n",
+							PARALLEL_MAX_WORKERS);
+				free(opt);
+				return FBSQL_CMD_ERROR;
+			}
+		}
+		else
+		{
+			fbsql_error("\\util sweep: unexpected option \"%s\"\n", opt);
+			free(opt);
+			return FBSQL_CMD_ERROR;
+		}
+
+		free(opt);
+	}
+
+	if (nworkers > 0 && FQserverVersion(fset.conn) < 50000)
+	{
+		puts("Note: parallel workers are only supported by Firebird 5.0 and later");
+		nworkers = 0;
+	}
+
+	if (FQisActiveTransaction(fset.conn))
+		puts("Warning: this session has an active transaction, which may prevent the sweep from advancing the OIT");
+
+	have_before = _printTransactionCounters("Before sweep", &oit_before);
+
+	if (nworkers > 0)
+		printf("Sweeping database using %i parallel worker(s)...\n", nworkers);
+	else
+		puts("Sweeping database...");
+
+	fflush(stdout);
+
+	gettimeofday(&before, NULL);
+	success = serviceSweep(nworkers);
+	gettimeofday(&after, NULL);
+	INSTR_TIME_SUBTRACT(after, before);
+
+	if (success == false)
+		return FBSQL_CMD_FAILED;
+
+	printf("Sweep completed (%.3f ms)\n", INSTR_TIME_GET_MILLISEC(after));
+
+	if (_printTransactionCounters("After sweep", &oit_after) && have_before)
+		printf("OIT advanced by %li\n", oit_after - oit_before);
+
+	return FBSQL_CMD_SKIP_LINE;
+}
+
+
+/**
+ * _printTransactionCounters()
+ *
+ * Display the database's transaction counters, read from MON$DATABASE
+ * in a separate transaction so the values are current.
+ */
+static bool
+_printTransactionCounters(const char *label, long *oit)
+{
+	FBresult   *res;
+	long		oat, next;
+
+	res = FQexecTransaction(fset.conn,
+"SELECT mon$oldest_transaction, mon$oldest_active, mon$next_transaction \n"
+"  FROM mon$database");
+
+	if (FQresultStatus(res) != FBRES_TUPLES_OK || FQntuples(res) == 0)
+	{
+		FQclear(res);
+		return false;
+	}
+
+	*oit = atol(FQgetvalue(res, 0, 0));
+	oat = atol(FQgetvalue(res, 0, 1));
+	next = atol(FQgetvalue(res, 0, 2));
+
+	FQclear(res);
+
+	printf("%s: OIT %li, OAT %li, next transaction %li (gap: %li)\n",
+		   label, *oit, oat, next, next - *oit);
+
+	return true;
+}
+
+
+/**
+ * utilGstat()
+ *
+ * \util gstat [TABLE] [system]
+ *
+ * Retrieve database statistics via the Services API (equivalent to
+ * "gstat -d -r -i") and display them as tables: data page and record
+ * version statistics per table, including the page fill distribution,
+ * followed by depth, key length, compression and duplicate statistics
+ * per index.
+ *
+ * If TABLE is provided, only that table is analysed; "system" includes
+ * system tables.
+ *
+ * Returns FBSQL_CMD_ERROR if the options are invalid, and
+ * FBSQL_CMD_FAILED if the table was not found or the statistics could
+ * not be retrieved.
+ */
+backslashResult
+utilGstat(FbsqlScanState scan_state)
+{
+	char	   *opt;
+	char	   *table_name = NULL;
+	char	   *relation_name = NULL;
+	bool		show_system = false;
+	gstatData  *stats;
+	fbsqlTable	tables, indexes;
+	printQueryOpt pqopt = fset.popt;
+	query_time	before, after;
+	int			i, j, k;
+
+	static const char *const table_headers[] =
+		{"Table", "Records", "Avg record length", "Versions", "Max versions",
+		 "Data pages", "Avg fill", "0-19%", "20-39%", "40-59%", "60-79%", "80-99%",
+		 "Compression ratio"};
+
+	static const char *const index_headers[] =
+		{"Table", "Index", "Depth", "Leaf buckets", "Nodes", "Avg key length",
+		 "Compression ratio", "Total dup", "Max dup", "Dup %"};
+
+	while ((opt = fbsql_scan_slash_option(scan_state,
+										  OT_NORMAL, NULL, false)))
+	{
+		if (strcmp(opt, "system") == 0)
+			show_system = true;
+		else if (table_name == NULL)
+		{
+			table_name = opt;
+			continue;
+		}
+		else
+		{
+			fbsql_error("\\util gstat: unexpected option \"%s\"\n", opt);
+			free(opt);
+			free(table_name);
+			return FBSQL_CMD_ERROR;
+		}
+
+		free(opt);
+	}
+
+	/* the service expects the table name as stored in the system tables */
+	if (table_name != NULL)
+	{
+		FQExpBufferData buf;
+		FBresult   *res;
+
+		initFQExpBuffer(&buf);
+
+		appendFQExpBufferStr(&buf,
+"SELECT TRIM(rdb$relation_name) \n"
+"  FROM rdb$relations \n"
+" WHERE rdb$view_blr IS NULL \n"
+"   AND TRIM(LOWER(rdb$relation_name)) = LOWER(");
+		appendSQLLiteral(&buf, table_name);
+		appendFQExpBufferStr(&buf, ")");
+
+		res = commandExec(buf.data);
+		termFQExpBuffer(&buf);
+
+		if (FQresultStatus(res) != FBRES_TUPLES_OK || FQntuples(res) == 0)
+		{
+			fbsql_error("\\util gstat: table \"%s\" not found\n", table_name);
+			FQclear(res);
+			free(table_name);
+			return FBSQL_CMD_FAILED;
+		}
+
+		relation_name = strdup(FQgetvalue(res, 0, 0));
+		FQclear(res);
+
+		/* a named system table is analysed on request */
+		if (strncmp(relation_name, "RDB$", 4) == 0 || strncmp(relation_name, "MON$", 4) == 0)
+			show_system = true;
+	}
+
+	puts("Retrieving database statistics...");
+	fflush(stdout);
+
+	gettimeofday(&before, NULL);
+	stats = serviceDatabaseStats(relation_name, true, show_system, true);
+	gettimeofday(&after, NULL);
+	INSTR_TIME_SUBTRACT(after, before);
+
+	free(table_name);
+	free(relation_name);
+
+	if (stats == NULL)
+		return FBSQL_CMD_FAILED;
+
+	initTable(&tables, lengthof(table_headers), table_headers);
+	initTable(&indexes, lengthof(index_headers), index_headers);
+
+	for (i = 1; i < lengthof(table_headers); i++)
+		tables.right_align[i] = true;
+
+	for (i = 2; i < lengthof(index_headers); i++)
+		indexes.right_align[i] = true;
+
+	for (i = 0; i < stats->ntables; i++)
+	{
+		gstatTable *table = &stats->tables[i];
+		const char *values[13];
+		char		cells[13][32];
+
+		values[0] = table->name;
+		_formatStat(cells[1], sizeof(cells[1]), "%.0f", table->records, &values[1]);
+		_formatStat(cells[2], sizeof(cells[2]), "%.2f", table->avg_record_length, &values[2]);
+		_formatStat(cells[3], sizeof(cells[3]), "%.0f", table->versions, &values[3]);
+		_formatStat(cells[4], sizeof(cells[4]), "%.0f", table->max_versions, &values[4]);
+		_formatStat(cells[5], sizeof(cells[5]), "%.0f", table->data_pages, &values[5]);
+		_formatStat(cells[6], sizeof(cells[6]), "%.0f%%", table->avg_fill, &values[6]);
+
+		for (k = 0; k < GSTAT_FILL_BUCKETS; k++)
+			_formatStat(cells[7 + k], sizeof(cells[7 + k]), "%.0f", table->fill[k], &values[7 + k]);
+
+		_formatStat(cells[12], sizeof(cells[12]), "%.2f", table->compression_ratio, &values[12]);
+
+		addTableRow(&tables, values);
+
+		for (j = 0; j < table->nindexes; j++)
+		{
+			gstatIndex *index = &table->indexes[j];
+
+			values[0] = table->name;
+			values[1] = index->name;
+			_formatStat(cells[2], sizeof(cells[2]), "%.0f", index->depth, &values[2]);
+			_formatStat(cells[3], sizeof(cells[3]), "%.0f", index->leaf_buckets, &values[3]);
+			_formatStat(cells[4], sizeof(cells[4]), "%.0f", index->nodes, &values[4]);
+			_formatStat(cells[5], sizeof(cells[5]), "%.2f", index->avg_key_length, &values[5]);
+			_formatStat(cells[6], sizeof(cells[6]), "%.2f", index->compression_ratio, &values[6]);
+			_formatStat(cells[7], sizeof(cells[7]), "%.0f", index->total_dup, &values[7]);
+			_formatStat(cells[8], sizeof(cells[8]), "%.0f", index->max_dup, &values[8]);
+
+			if (index->nodes > 0 && index->total_dup >= 0)
+				_formatStat(cells[9], sizeof(cells[9]), "%.1f",
+							100.0 * index->total_dup / index->nodes, &values[9]);
+			else
+				values[9] = NULL;
+
+			addTableRow(&indexes, values);
+		}
+	}
+
+	if (tables.ntuples == 0)
+	{
+		puts("No statistics returned");
+	}
+	else
+	{
+		pqopt.header = "Data pages";
+		printTable(&tables, &pqopt);
+		puts("");
+
+		if (indexes.ntuples > 0)
+		{
+			pqopt.header = "Indexes";
+			printTable(&indexes, &pqopt);
+			puts("");
+		}
+	}
+
+	printf("Statistics for %i table(s) and %i index(es) retrieved (%.3f ms)\n",
+		   tables.ntuples, indexes.ntuples, INSTR_TIME_GET_MILLISEC(after));
+
+	termTable(&tables);
+	termTable(&indexes);
+	freeDatabaseStats(stats);
+
+	return FBSQL_CMD_SKIP_LINE;
+}
+
+
+/**
+ * _formatStat()
+ *
+ * Format a statistics value for display; negative values (not reported by
+ * the server) are displayed as NULL.
+ */
+static void
+_formatStat(char *buf, size_t buf_len, const char *format, double value, const char **cell)
+{
+	if (value < 0)
+	{
+		*cell = NULL;
+		return;
+	}
+
+	snprintf(buf, buf_len, format, value);
+	*cell = buf;
+}
@@ -0,0 +1,26 @@
+#ifndef UTIL_H
+#define UTIL_H
+
+#include "settings.h"
+#include "fbsqlscan.h"
+#include "command.h"
+
+/* Number of rows sampled when checking whether index statistics are stale */
+#define INDEX_STATISTICS_SAMPLE_ROWS	 10000
+
+/* Relative difference in distinct keys above which statistics are stale */
+#define INDEX_STATISTICS_STALE_THRESHOLD 0.1
+
+extern backslashResult
+utilSetIndexStatistics(FbsqlScanState scan_state);
+
+extern backslashResult
+utilRebuildIndexes(FbsqlScanState scan_state);
+
+extern backslashResult
+utilSweep(FbsqlScanState scan_state);
+
+extern backslashResult
+utilGstat(FbsqlScanState scan_state);
+
+#endif   /* UTIL_H */
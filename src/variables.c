@@ -0,0 +1,169 @@
+/* ---------------------------------------------------------------------
+ *
+ * variables.c
+ *
+ * Client-side variables (\set, \unset)
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "common.h"
+#include "variables.h"
+
+
+/**
+ * CreateVariableSpace()
+ *
+ * Create an empty variable list.
+ */
+VariableSpace
+CreateVariableSpace(void)
+{
+	return (VariableSpace)fb_malloc0(sizeof(struct _variable));
+}
+
+
+/**
+ * GetVariable()
+ *
+ * Return the value of the named variable, or NULL if it is not set.
+ */
+const char *
+GetVariable(VariableSpace space, const char *name)
+{
+	struct _variable *current;
+
+	if (space == NULL)
+		return NULL;
+
+	for (current = space->next; current != NULL; current = current->next)
+	{
+		int cmp = strcmp(current->name, name);
+
+		if (cmp == 0)
+			return current->value;
+
+		/* list is sorted, so no need to look further */
+		if (cmp > 0)
+			break;
+	}
+
+	return NULL;
+}
+
+
+/**
+ * SetVariable()
+ *
+ * Set the named variable, creating it if necessary. Returns false if
+ * the name is not valid.
+ */
+bool
+SetVariable(VariableSpace space, const char *name, const char *value)
+{
+	struct _variable *current, *previous;
+	struct _variable *variable;
+
+	if (space == NULL || ValidVariableName(name) == false)
+		return false;
+
+	for (previous = space, current = space->next;
+		 current != NULL;
+		 previous = current, current = current->next)
+	{
+		int cmp = strcmp(current->name, name);
+
+		if (cmp == 0)
+		{
+			free(current->value);
+			current->value = strdup(value);
+			return true;
+		}
+
+		if (cmp > 0)
+			break;
+	}
+
+	variable = (struct _variable *)fb_malloc0(sizeof(struct _variable));
+	variable->name = strdup(name);
+	variable->value = strdup(value);
+	variable->next = current;
+	previous->next = variable;
+
+	return true;
+}
+
+
+/**
+ * DeleteVariable()
+ *
+ * Remove the named variable; returns false if it was not set.
+ */
+bool
+DeleteVariable(VariableSpace space, const char *name)
+{
+	struct _variable *current, *previous;
+
+	if (space == NULL)
+		return false;
+
+	for (previous = space, current = space->next;
+		 current != NULL;
+		 previous = current, current = current->next)
+	{
+		if (strcmp(current->name, name) == 0)
+		{
+			previous->next = current->next;
+			free(current->name);
+			free(current->value);
+			free(current);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void
+PrintVariables(VariableSpace space)
+{
+	struct _variable *current;
+
+	if (space == NULL)
+		return;
+
+	for (current = space->next; current != NULL; current = current->next)
+		printf("%s = '%s'\n", current->name, current->value);
+}
+
+
+/**
+ * ValidVariableName()
+ *
+ * Variable names may contain only the characters which the lexer
+ * recognises in variable references.
+ */
+bool
+ValidVariableName(const char *name)
+{
+	const unsigned char *ptr = (const unsigned char *)name;
+
+	if (*ptr == '\0')
+		return false;
+
+	while (*ptr)
+	{
+		if ((*ptr & 0x80) || isalnum(*ptr) || *ptr == '_')
+			ptr++;
+		else
+			return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,40 @@
+#ifndef VARIABLES_H
+#define VARIABLES_H
+
+#include <stdbool.h>
+
+/*
+ * Client-side variables, set with \set and referenced in queries and
+ * backslash command arguments as :name, :'name' (quoted as a literal)
+ * or :"name" (quoted as an identifier).
+ *
+ * The variable list is kept in name order, with a dummy header element.
+ */
+struct _variable
+{
+	char	   *name;
+	char	   *value;
+	struct _variable *next;
+};
+
+typedef struct _variable *VariableSpace;
+
+extern VariableSpace
+CreateVariableSpace(void);
+
+extern const char *
+GetVariable(VariableSpace space, const char *name);
+
+extern bool
+SetVariable(VariableSpace space, const char *name, const char *value);
+
+extern bool
+DeleteVariable(VariableSpace space, const char *name);
+
+extern void
+PrintVariables(VariableSpace space);
+
+extern bool
+ValidVariableName(const char *name);
+
+#endif   /* VARIABLES_H */
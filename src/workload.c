@@ -0,0 +1,877 @@
+/* ---------------------------------------------------------------------
+ *
+ * workload.c
+ *
+ * Analyse the statements in a SQL script ("workload") without
+ * executing them
+ *
+ * ---------------------------------------------------------------------
+ */
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "libfq.h"
+#include "fbsql.h"
+#include "command.h"
+#include "common.h"
+#include "fbsqlscan.h"
+#include "query.h"
+#include "settings.h"
+#include "workload.h"
+
+#define WORKLOAD_PREDICATE_LEN 60
+#define WORKLOAD_STATEMENT_LEN 50
+
+typedef struct workloadTableSize
+{
+	char	   *table_name;
+	long		est_rows;		/* -1 if not available */
+	int			pointer_pages;
+} workloadTableSize;
+
+typedef struct workloadTableSizeCache
+{
+	int			ntables;
+	int			alloc_tables;
+	workloadTableSize *tables;
+} workloadTableSizeCache;
+
+
+static bool _readLine(FILE *source, FQExpBuffer line_buf);
+static void _storeStatement(workloadStatement *statement, const char *query, int lineno, FbsqlScanState scan_state);
+static const char *_skipQuotedText(const char *p);
+
+static int _extractNaturalScans(const char *plan, bool explained, char ***tables);
+static workloadTableSize *_getTableSize(workloadTableSizeCache *cache, const char *table_name);
+static char *_extractPredicates(const char *query);
+
+
+/**
+ * analyzeWorkload()
+ *
+ * \analyze_workload FILE [MIN_ROWS]
+ *
+ * Split the provided script into statements, prepare each one without
+ * executing it and examine the resulting plan for natural scans on
+ * tables estimated to contain at least "min_rows" rows.
+ *
+ * As Firebird does not maintain row counts, table sizes are estimated
+ * from the selectivity of the table's unique indexes (1 / number of keys).
+ * Where no unique index statistics are available, a table is considered
+ * large if it occupies more than one pointer page.
+ *
+ * Returns false if the script could not be read or any statement could
+ * not be prepared.
+ */
+bool
+analyzeWorkload(const char *filename, long min_rows)
+{
+	workloadStatement *statements;
+	workloadTableSizeCache cache;
+	fbsqlTable table;
+	FQExpBufferData errors;
+	printQueryOpt pqopt = fset.popt;
+	int nstatements = 0;
+	int i;
+	int analysed = 0, skipped = 0, failed = 0, flagged = 0;
+	bool explained = FQserverVersion(fset.conn) >= 30000;
+
+	static const char *const headers[] =
+		{"Line", "Table", "Est. rows", "Predicates", "Statement"};
+
+	statements = readWorkloadScript(filename, &nstatements);
+
+	if (statements == NULL)
+		return false;
+
+	cache.ntables = 0;
+	cache.alloc_tables = 16;
+	cache.tables = (workloadTableSize *)malloc(cache.alloc_tables * sizeof(workloadTableSize));
+
+	initTable(&table, lengthof(headers), headers);
+	table.right_align[0] = true;
+	table.right_align[2] = true;
+
+	initFQExpBuffer(&errors);
+
+	for (i = 0; i < nstatements; i++)
+	{
+		char *plan;
+		char *text;
+		char **scanned_tables = NULL;
+		int nscanned, j;
+
+		if (!isAnalysableStatement(statements[i].query))
+		{
+			skipped++;
+			continue;
+		}
+
+		/* the plan is requested without parameters, so bound values are inlined */
+		text = workloadStatementText(&statements[i]);
+
+		if (explained)
+			plan = FQexplainStatement(fset.conn, text);
+		else
+			plan = FQplanStatement(fset.conn, text);
+
+		free(text);
+
+		if (plan == NULL)
+		{
+			char *condensed = condenseText(statements[i].query,
+											strlen(statements[i].query),
+											WORKLOAD_STATEMENT_LEN);
+
+			appendFQExpBuffer(&errors, "  line %i: %s\n",
+							  statements[i].lineno,
+							  condensed);
+			free(condensed);
+			failed++;
+			continue;
+		}
+
+		analysed++;
+
+		nscanned = _extractNaturalScans(plan, explained, &scanned_tables);
+
+		for (j = 0; j < nscanned; j++)
+		{
+			workloadTableSize *size = _getTableSize(&cache, scanned_tables[j]);
+			bool is_large;
+
+			if (size->est_rows >= 0)
+				is_large = size->est_rows >= min_rows;
+			else
+				is_large = size->pointer_pages > 1;
+
+			if (is_large == true)
+			{
+				const char *values[5];
+				char lineno[16];
+				char est_rows[32];
+				char *predicates = _extractPredicates(statements[i].query);
+				char *condensed = condenseText(statements[i].query,
+												strlen(statements[i].query),
+												WORKLOAD_STATEMENT_LEN);
+
+				snprintf(lineno, sizeof(lineno), "%i", statements[i].lineno);
+
+				if (size->est_rows >= 0)
+					snprintf(est_rows, sizeof(est_rows), "%li", size->est_rows);
+				else
+					snprintf(est_rows, sizeof(est_rows), "? (%i pointer pages)", size->pointer_pages);
+
+				values[0] = lineno;
+				values[1] = scanned_tables[j];
+				values[2] = est_rows;
+				values[3] = predicates;
+				values[4] = condensed;
+
+				addTableRow(&table, values);
+				flagged++;
+
+				free(predicates);
+				free(condensed);
+			}
+
+			free(scanned_tables[j]);
+		}
+
+		if (scanned_tables != NULL)
+			free(scanned_tables);
+
+		free(plan);
+	}
+
+	if (table.ntuples > 0)
+	{
+		pqopt.header = "Natural scans on large tables";
+		printTable(&table, &pqopt);
+		puts("");
+	}
+
+	if (failed > 0)
+	{
+		puts("Statements which could not be prepared:");
+		printf("%s\n", errors.data);
+	}
+
+	printf("%i statement(s) analysed, %i skipped, %i could not be prepared; %i natural scan(s) on large tables\n",
+		   analysed, skipped, failed, flagged);
+
+	termFQExpBuffer(&errors);
+	termTable(&table);
+
+	for (i = 0; i < cache.ntables; i++)
+		free(cache.tables[i].table_name);
+	free(cache.tables);
+
+	freeWorkloadStatements(statements, nstatements);
+
+	return failed == 0;
+}
+
+
+/**
+ * readWorkloadScript()
+ *
+ * Split a script into individual statements using the same lexer as
+ * the main input loop. Backslash commands are skipped. If "filename" is
+ * "-", the script is read from standard input.
+ *
+ * With bind_variables set, each statement's variable references are
+ * "?" placeholders, and the values to bind are stored with it.
+ *
+ * Returns an array of statements (NULL on error), the number of which is
+ * written to "nstatements".
+ */
+workloadStatement *
+readWorkloadScript(const char *filename, int *nstatements)
+{
+	FILE *source;
+	FbsqlScanState scan_state;
+	FQExpBuffer query_buf;
+	FQExpBuffer line_buf;
+	workloadStatement *statements;
+	int alloc_statements = 64;
+	int lineno = 0;
+	int start_lineno = 0;
+
+	source = strcmp(filename, "-") == 0 ? stdin : fopen(filename, "r");
+
+	if (source == NULL)
+	{
+		fbsql_error("%s: %s\n", filename, strerror(errno));
+		return NULL;
+	}
+
+	statements = (workloadStatement *)malloc(alloc_statements * sizeof(workloadStatement));
+	*nstatements = 0;
+
+	query_buf = createFQExpBuffer();
+	line_buf = createFQExpBuffer();
+	scan_state = fbsql_scan_create(";");
+
+	while (_readLine(source, line_buf) == true)
+	{
+		lineno++;
+
+		/* insert newlines into query buffer between source lines */
+		if (query_buf->len > 0)
+			appendFQExpBufferChar(query_buf, '\n');
+
+		fbsql_scan_setup(scan_state, line_buf->data, line_buf->len);
+
+		for (;;)
+		{
+			FbsqlScanResult scan_result;
+			char prompt_tmp[100];
+
+			scan_result = fbsql_scan(scan_state, query_buf, prompt_tmp);
+
+			if (start_lineno == 0 && query_buf->len > 0)
+				start_lineno = lineno;
+
+			if (scan_result == FSCAN_SEMICOLON)
+			{
+				if (*nstatements == alloc_statements)
+				{
+					alloc_statements *= 2;
+					statements = (workloadStatement *)realloc(statements,
+															  alloc_statements * sizeof(workloadStatement));
+				}
+
+				_storeStatement(&statements[*nstatements], query_buf->data, start_lineno, scan_state);
+				(*nstatements)++;
+
+				resetFQExpBuffer(query_buf);
+				fbsql_scan_clear_bind_values(scan_state);
+				start_lineno = 0;
+			}
+			else if (scan_result == FSCAN_BACKSLASH)
+			{
+				char *cmd = fbsql_scan_slash_command(scan_state);
+				char *arg;
+
+				while ((arg = fbsql_scan_slash_option(scan_state,
+													  OT_WHOLE_LINE, NULL, false)))
+					free(arg);
+
+				fbsql_scan_slash_command_end(scan_state);
+				free(cmd);
+			}
+			else
+			{
+				/* FSCAN_INCOMPLETE or FSCAN_EOL */
+				break;
+			}
+		}
+
+		fbsql_scan_finish(scan_state);
+	}
+
+	/* Final statement without a terminating semicolon */
+	if (query_buf->len > 0)
+	{
+		if (*nstatements == alloc_statements)
+		{
+			alloc_statements++;
+			statements = (workloadStatement *)realloc(statements,
+													  alloc_statements * sizeof(workloadStatement));
+		}
+
+		_storeStatement(&statements[*nstatements], query_buf->data, start_lineno, scan_state);
+		(*nstatements)++;
+	}
+
+	fbsql_scan_destroy(scan_state);
+	destroyFQExpBuffer(line_buf);
+	destroyFQExpBuffer(query_buf);
+
+	if (source != stdin)
+		fclose(source);
+
+	return statements;
+}
+
+
+/**
+ * _storeStatement()
+ *
+ * Initialise a workload statement with a copy of the query and of the
+ * values bound to its placeholders.
+ */
+static void
+_storeStatement(workloadStatement *statement, const char *query, int lineno, FbsqlScanState scan_state)
+{
+	const char *const *values;
+	int			i;
+
+	statement->query = strdup(query);
+	statement->lineno = lineno;
+	statement->nparams = fbsql_scan_bind_values(scan_state, &values);
+	statement->params = NULL;
+
+	if (statement->nparams > 0)
+	{
+		statement->params = (char **)malloc(statement->nparams * sizeof(char *));
+
+		for (i = 0; i < statement->nparams; i++)
+			statement->params[i] = strdup(values[i]);
+	}
+}
+
+
+/**
+ * _readLine()
+ *
+ * Read a complete line of arbitrary length into "line_buf", stripping
+ * the trailing newline. Returns false at end of input.
+ */
+static bool
+_readLine(FILE *source, FQExpBuffer line_buf)
+{
+	char chunk[1024];
+	bool read_data = false;
+
+	resetFQExpBuffer(line_buf);
+
+	while (fgets(chunk, sizeof(chunk), source) != NULL)
+	{
+		read_data = true;
+		appendFQExpBufferStr(line_buf, chunk);
+
+		if (line_buf->len > 0 && line_buf->data[line_buf->len - 1] == '\n')
+		{
+			line_buf->data[--line_buf->len] = '\0';
+			break;
+		}
+	}
+
+	return read_data;
+}
+
+
+void
+freeWorkloadStatements(workloadStatement *statements, int nstatements)
+{
+	int i;
+
+	for (i = 0; i < nstatements; i++)
+	{
+		int j;
+
+		free(statements[i].query);
+
+		for (j = 0; j < statements[i].nparams; j++)
+			free(statements[i].params[j]);
+
+		free(statements[i].params);
+	}
+
+	free(statements);
+}
+
+
+/**
+ * workloadStatementText()
+ *
+ * Return a copy of the statement with its "?" placeholders (outside
+ * quoted strings, quoted identifiers and comments) replaced by its bound
+ * values as string literals, for use where the values cannot be passed
+ * as parameters. If the number of
+ * placeholders does not match the number of values, the statement is
+ * returned unchanged.
+ */
+char *
+workloadStatementText(const workloadStatement *statement)
+{
+	FQExpBufferData buf;
+	const char *p;
+	int			nplaceholders = 0;
+	int			param = 0;
+
+	if (statement->nparams == 0)
+		return strdup(statement->query);
+
+	for (p = statement->query; *p; )
+	{
+		const char *end = _skipQuotedText(p);
+
+		if (end != NULL)
+			p = end;
+		else if (*p++ == '?')
+			nplaceholders++;
+	}
+
+	if (nplaceholders != statement->nparams)
+		return strdup(statement->query);
+
+	initFQExpBuffer(&buf);
+
+	for (p = statement->query; *p; )
+	{
+		const char *end = _skipQuotedText(p);
+
+		if (end != NULL)
+		{
+			appendBinaryFQExpBuffer(&buf, p, end - p);
+			p = end;
+		}
+		else if (*p == '?')
+		{
+			appendSQLLiteral(&buf, statement->params[param++]);
+			p++;
+		}
+		else
+		{
+			appendFQExpBufferChar(&buf, *p++);
+		}
+	}
+
+	return buf.data;
+}
+
+
+/**
+ * _skipQuotedText()
+ *
+ * If "p" is at the start of a quoted string or identifier or a comment,
+ * return a pointer to the character following it, otherwise NULL.
+ */
+static const char *
+_skipQuotedText(const char *p)
+{
+	if (*p == '\'' || *p == '"')
+	{
+		char		quote = *p;
+
+		for (p++; *p; p++)
+		{
+			if (*p != quote)
+				continue;
+
+			/* a doubled quote is part of the text */
+			if (p[1] != quote)
+				return p + 1;
+
+			p++;
+		}
+
+		return p;
+	}
+
+	if (p[0] == '-' && p[1] == '-')
+		return p + strcspn(p, "\n");
+
+	if (p[0] == '/' && p[1] == '*')
+	{
+		const char *end = strstr(p + 2, "*/");
+
+		return end != NULL ? end + 2 : p + strlen(p);
+	}
+
+	return NULL;
+}
+
+
+/**
+ * isAnalysableStatement()
+ *
+ * Determine whether the statement is one for which Firebird generates
+ * a plan (i.e. DML or EXECUTE BLOCK/PROCEDURE).
+ */
+bool
+isAnalysableStatement(const char *query)
+{
+	static const char *const keywords[] =
+		{"SELECT", "WITH", "INSERT", "UPDATE", "DELETE", "MERGE", "EXECUTE", NULL};
+	const char *p = query;
+	int i;
+
+	while (*p && isspace((unsigned char) *p))
+		p++;
+
+	/* skip any leading bracket, e.g. "(SELECT ...) UNION (...)" */
+	while (*p == '(' || isspace((unsigned char) *p))
+		p++;
+
+	for (i = 0; keywords[i] != NULL; i++)
+	{
+		size_t len = strlen(keywords[i]);
+
+		if (pg_strncasecmp(p, keywords[i], len) == 0
+			&& !isalnum((unsigned char) p[len]) && p[len] != '_')
+			return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * _extractNaturalScans()
+ *
+ * Extract the names of all tables accessed via a natural (full) scan
+ * from the provided plan. "explained" indicates whether the plan is an
+ * explained plan (Firebird 3.0 and later), which contains lines like:
+ *
+ *     -> Table "EMPLOYEE" as "E" Full Scan
+ *
+ * otherwise the legacy plan format is expected, e.g.:
+ *
+ *     PLAN JOIN (E NATURAL, D INDEX (RDB$PRIMARY5))
+ *
+ * Note that the legacy format contains the table alias, where one was
+ * provided, rather than the table name.
+ *
+ * Returns the number of tables found; the names are returned in a
+ * malloc'd array in "tables".
+ */
+static int
+_extractNaturalScans(const char *plan, bool explained, char ***tables)
+{
+	int ntables = 0;
+	int alloc_tables = 8;
+	const char *p = plan;
+
+	*tables = (char **)malloc(alloc_tables * sizeof(char *));
+
+	for (;;)
+	{
+		const char *name_start = NULL;
+		int name_len = 0;
+
+		if (explained)
+		{
+			const char *line_end;
+			const char *full_scan;
+			const char *table;
+
+			full_scan = strstr(p, "Full Scan");
+
+			if (full_scan == NULL)
+				break;
+
+			/* find the start of the line containing "Full Scan" */
+			table = full_scan;
+			while (table > plan && table[-1] != '\n')
+				table--;
+
+			line_end = full_scan;
+			table = strstr(table, "Table \"");
+
+			if (table != NULL && table < line_end)
+			{
+				name_start = table + strlen("Table \"");
+				while (name_start + name_len < line_end && name_start[name_len] != '"')
+					name_len++;
+			}
+
+			p = full_scan + strlen("Full Scan");
+		}
+		else
+		{
+			const char *natural = strstr(p, " NATURAL");
+			const char *name_end;
+
+			if (natural == NULL)
+				break;
+
+			name_end = natural;
+
+			while (name_end > plan && isspace((unsigned char) name_end[-1]))
+				name_end--;
+
+			name_start = name_end;
+
+			while (name_start > plan &&
+				   (isalnum((unsigned char) name_start[-1]) ||
+					name_start[-1] == '_' ||
+					name_start[-1] == '$' ||
+					name_start[-1] == '"'))
+				name_start--;
+
+			name_len = name_end - name_start;
+
+			p = natural + strlen(" NATURAL");
+		}
+
+		if (name_start == NULL || name_len == 0)
+			continue;
+
+		if (ntables == alloc_tables)
+		{
+			alloc_tables *= 2;
+			*tables = (char **)realloc(*tables, alloc_tables * sizeof(char *));
+		}
+
+		(*tables)[ntables] = (char *)malloc(name_len + 1);
+		memcpy((*tables)[ntables], name_start, name_len);
+		(*tables)[ntables][name_len] = '\0';
+		ntables++;
+	}
+
+	return ntables;
+}
+
+
+/**
+ * _getTableSize()
+ *
+ * Retrieve the estimated size of the named table, caching the result
+ * to avoid repeated catalog queries for frequently used tables.
+ */
+static workloadTableSize *
+_getTableSize(workloadTableSizeCache *cache, const char *table_name)
+{
+	workloadTableSize *size;
+	FBresult   *query_result;
+	FQExpBufferData buf;
+	int i;
+
+	for (i = 0; i < cache->ntables; i++)
+	{
+		if (strcmp(cache->tables[i].table_name, table_name) == 0)
+			return &cache->tables[i];
+	}
+
+	if (cache->ntables == cache->alloc_tables)
+	{
+		cache->alloc_tables *= 2;
+		cache->tables = (workloadTableSize *)realloc(cache->tables,
+													  cache->alloc_tables * sizeof(workloadTableSize));
+	}
+
+	size = &cache->tables[cache->ntables++];
+	size->table_name = strdup(table_name);
+	size->est_rows = -1;
+	size->pointer_pages = 0;
+
+	initFQExpBuffer(&buf);
+
+	appendFQExpBufferStr(&buf,
+"    SELECT (SELECT CAST(1 / MIN(i.rdb$statistics) AS BIGINT) \n"
+"              FROM rdb$indices i \n"
+"             WHERE i.rdb$relation_name = r.rdb$relation_name \n"
+"               AND i.rdb$unique_flag = 1 \n"
+"               AND i.rdb$statistics > 0) AS est_rows, \n"
+"           (SELECT COUNT(*) \n"
+"              FROM rdb$pages p \n"
+"             WHERE p.rdb$relation_id = r.rdb$relation_id \n"
+"               AND p.rdb$page_type = 4) AS pointer_pages \n"
+"      FROM rdb$relations r \n"
+"     WHERE TRIM(r.rdb$relation_name) = ");
+
+	/* table names are taken from the plan, but quote defensively anyway */
+	appendSQLLiteral(&buf, table_name);
+	appendFQExpBufferChar(&buf, '\n');
+
+	query_result = commandExec(buf.data);
+	termFQExpBuffer(&buf);
+
+	if (FQresultStatus(query_result) == FBRES_TUPLES_OK && FQntuples(query_result) > 0)
+	{
+		if (!FQgetisnull(query_result, 0, 0))
+			size->est_rows = atol(FQgetvalue(query_result, 0, 0));
+
+		size->pointer_pages = atoi(FQgetvalue(query_result, 0, 1));
+	}
+
+	FQclear(query_result);
+
+	return size;
+}
+
+
+/**
+ * _extractPredicates()
+ *
+ * Return a condensed copy of the statement's WHERE clause (up to any
+ * following GROUP BY, ORDER BY etc.), or an empty string if none found.
+ */
+static char *
+_extractPredicates(const char *query)
+{
+	static const char *const terminators[] =
+		{"GROUP", "HAVING", "ORDER", "ROWS", "FETCH", "OFFSET", "PLAN", "UNION", "RETURNING", NULL};
+	const char *where_start = NULL;
+	const char *where_end;
+	const char *p;
+	char in_quote = 0;
+
+	/* find the first WHERE outside of quotes */
+	for (p = query; *p; p++)
+	{
+		if (in_quote)
+		{
+			if (*p == in_quote)
+				in_quote = 0;
+			continue;
+		}
+
+		if (*p == '\'' || *p == '"')
+		{
+			in_quote = *p;
+			continue;
+		}
+
+		if ((p == query || !(isalnum((unsigned char) p[-1]) || p[-1] == '_' || p[-1] == '$'))
+			&& pg_strncasecmp(p, "WHERE", 5) == 0
+			&& !(isalnum((unsigned char) p[5]) || p[5] == '_' || p[5] == '$'))
+		{
+			where_start = p + 5;
+			break;
+		}
+	}
+
+	if (where_start == NULL)
+		return strdup("");
+
+	/* find the end of the WHERE clause */
+	in_quote = 0;
+
+	for (where_end = where_start; *where_end && *where_end != ';'; where_end++)
+	{
+		int i;
+		bool found = false;
+
+		if (in_quote)
+		{
+			if (*where_end == in_quote)
+				in_quote = 0;
+			continue;
+		}
+
+		if (*where_end == '\'' || *where_end == '"')
+		{
+			in_quote = *where_end;
+			continue;
+		}
+
+		if (!isspace((unsigned char) where_end[-1]))
+			continue;
+
+		for (i = 0; terminators[i] != NULL; i++)
+		{
+			size_t len = strlen(terminators[i]);
+
+			if (pg_strncasecmp(where_end, terminators[i], len) == 0
+				&& !(isalnum((unsigned char) where_end[len]) || where_end[len] == '_'))
+			{
+				found = true;
+				break;
+			}
+		}
+
+		if (found)
+			break;
+	}
+
+	return condenseText(where_start, where_end - where_start, WORKLOAD_PREDICATE_LEN);
+}
+
+
+/**
+ * condenseText()
+ *
+ * Return a copy of the provided text with whitespace runs collapsed
+ * into single spaces, truncated to "max_len" characters.
+ */
+char *
+condenseText(const char *text, int text_len, int max_len)
+{
+	char *result = (char *)malloc(max_len + 4);
+	int i = 0, result_len = 0;
+	bool in_space = true;
+
+	while (i < text_len)
+	{
+		int char_len;
+
+		if (isspace((unsigned char) text[i]))
+		{
+			if (!in_space && result_len < max_len)
+				result[result_len++] = ' ';
+			in_space = true;
+			i++;
+			continue;
+		}
+
+		/* don't split multibyte characters */
+		char_len = FQmblen(text + i, fset.client_encoding_id);
+
+		if (result_len + char_len > max_len)
+			break;
+
+		in_space = false;
+		memcpy(result + result_len, text + i, char_len);
+		result_len += char_len;
+		i += char_len;
+	}
+
+	/* strip trailing whitespace and semicolon */
+	while (result_len > 0 &&
+		   (result[result_len - 1] == ' ' || result[result_len - 1] == ';'))
+		result_len--;
+
+	/* indicate truncation, unless only whitespace or a semicolon was omitted */
+	for (; i < text_len; i++)
+	{
+		if (!isspace((unsigned char) text[i]) && text[i] != ';')
+		{
+			memcpy(result + result_len, "...", 3);
+			result_len += 3;
+			break;
+		}
+	}
+
+	result[result_len] = '\0';
+
+	return result;
+}
@@ -0,0 +1,35 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include "settings.h"
+
+/* Default table size (estimated rows) above which a natural scan is reported */
+#define WORKLOAD_LARGE_TABLE_ROWS 10000
+
+typedef struct workloadStatement
+{
+	char	   *query;
+	int			lineno;			/* script line where the statement starts */
+	int			nparams;
+	char	  **params;			/* values bound to "?" (bind_variables) */
+} workloadStatement;
+
+extern workloadStatement *
+readWorkloadScript(const char *filename, int *nstatements);
+
+extern void
+freeWorkloadStatements(workloadStatement *statements, int nstatements);
+
+extern char *
+workloadStatementText(const workloadStatement *statement);
+
+extern bool
+isAnalysableStatement(const char *query);
+
+extern char *
+condenseText(const char *text, int text_len, int max_len);
+
+extern bool
+analyzeWorkload(const char *filename, long min_rows);
+
+#endif   /* WORKLOAD_H */